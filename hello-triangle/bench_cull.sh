@@ -0,0 +1,17 @@
+#!/bin/sh
+# CPU frame cost without culling and with sphere and box culling, headless, with the camera close enough that most objects are off screen.
+# Extra arguments are passed to main, e.g. `./bench_cull.sh --threads 4`.
+cd "$(dirname "$0")"
+
+frames=${FRAMES:-500}
+objects=${OBJECTS:-65536}
+
+printf "%8s %9s  %-24s %s\n" cull distance "frame rate" culling
+for distance in 2.5 1 0.3; do
+	for cull in off sphere aabb; do
+		out=$(./main --headless --frames "$frames" --objects "$objects" --cull "$cull" --camera-distance "$distance" --no-gpu-timings "$@")
+		fps=$(echo "$out" | grep "^frames:" | sed 's/.*fps: \([0-9.]*\), frame time: \([0-9.]*\) ms.*/\1 fps, \2 ms/')
+		line=$(echo "$out" | grep "^culling: ")
+		printf "%8s %9s  %-24s %s\n" "$cull" "$distance" "$fps" "${line#culling: }"
+	done
+done
@@ -0,0 +1,21 @@
+#!/bin/sh
+# CPU cost of drawing every object with its own recorded draw (--model uniform, culled on the CPU or not)
+# against culling on the GPU (--model instance --cull gpu), which records one dispatch and one indirect draw whatever the object count.
+# Headless, use `--software` for lavapipe. Extra arguments are passed to main, e.g. `./bench_gpu_cull.sh --software`.
+cd "$(dirname "$0")"
+
+frames=${FRAMES:-300}
+distance=${DISTANCE:-1}
+
+printf "%8s  %-22s %-26s %-36s %s\n" objects draws "frame rate" "command recording" culling
+for objects in 1000 10000 65536; do
+	for mode in "uniform off" "uniform sphere" "instance gpu"; do
+		model=${mode% *}
+		cull=${mode#* }
+		out=$(./main --headless --frames "$frames" --objects "$objects" --model "$model" --cull "$cull" --camera-distance "$distance" "$@")
+		fps=$(echo "$out" | grep "^frames:" | sed 's/.*fps: \([0-9.]*\), frame time: \([0-9.]*\) ms.*/\1 fps, \2 ms/')
+		record=$(echo "$out" | grep "^command recording:" | sed 's/.*), \([0-9.]*\) ms\/frame.*/\1 ms\/frame/')
+		line=$(echo "$out" | grep "^culling: " | tail -n 1)
+		printf "%8s  %-22s %-26s %-36s %s\n" "$objects" "$model, cull $cull" "$fps" "$record" "${line#culling: }"
+	done
+done
@@ -0,0 +1,24 @@
+#!/bin/sh
+# GPU time of the draws and triangles drawn per frame with a mesh at full detail and with --lod at a few pixel thresholds,
+# from a few camera distances. e.g. `./bench_lod.sh model.glb`. The objects are instances culled on the GPU, which also picks
+# their levels. OBJECTS of them, extra arguments for main go in ARGS.
+cd "$(dirname "$0")"
+
+frames=${FRAMES:-300}
+objects=${OBJECTS:-1000}
+
+printf "%-32s %8s %8s %14s  %s\n" mesh distance lod "draws avg ms" "triangles per frame"
+for mesh in "$@"; do
+	for distance in 0.5 2.5 10; do
+		for pixels in 0 1 4; do
+			lod=""
+			[ "$pixels" != 0 ] && lod="--lod $pixels"
+			out=$(./main --headless --frames "$frames" --objects "$objects" --model instance --cull gpu --mesh "$mesh" --optimize-mesh \
+				--camera-distance "$distance" $lod $ARGS) || { echo "$mesh: failed"; continue; }
+			draws=$(echo "$out" | grep "^  draws " | awk '{ print $3 }')
+			triangles=$(echo "$out" | grep "^levels of detail: under" | sed 's/.*error, \(.*\)/\1/')
+			[ -z "$triangles" ] && triangles="full detail"
+			printf "%-32s %8s %8s %14s  %s\n" "$mesh" "$distance" "${lod:-off}" "$draws" "$triangles"
+		done
+	done
+done
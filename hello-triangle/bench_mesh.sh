@@ -0,0 +1,18 @@
+#!/bin/sh
+# Load time, peak RSS and frame rate of the meshes given, e.g. `./bench_mesh.sh model.glb model.gltf model.obj`.
+# Each is drawn OBJECTS times instanced, extra arguments for main go in ARGS.
+cd "$(dirname "$0")"
+
+frames=${FRAMES:-300}
+objects=${OBJECTS:-100}
+
+printf "%-32s %10s %12s %12s  %s\n" mesh triangles "load" "peak RSS" "frame rate"
+for mesh in "$@"; do
+	out=$(./main --headless --frames "$frames" --objects "$objects" --model instance --mesh "$mesh" --no-gpu-timings $ARGS) || { echo "$mesh: failed"; continue; }
+	line=$(echo "$out" | grep "^mesh: ")
+	triangles=$(echo "$line" | sed 's/.*, \([0-9]*\) triangles.*/\1/')
+	load=$(echo "$line" | sed 's/.* \([0-9.]*\) ms to load.*/\1 ms/')
+	rss=$(echo "$line" | sed 's/.*peak RSS: \([0-9.]*\) MB.*/\1 MB/')
+	fps=$(echo "$out" | grep "^frames:" | sed 's/.*fps: \([0-9.]*\), frame time: \([0-9.]*\) ms.*/\1 fps, \2 ms/')
+	printf "%-32s %10s %12s %12s  %s\n" "$mesh" "$triangles" "$load" "$rss" "$fps"
+done
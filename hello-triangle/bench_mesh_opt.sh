@@ -0,0 +1,19 @@
+#!/bin/sh
+# GPU time of the draws with each mesh as loaded and after --optimize-mesh, with the cache statistics of the optimization.
+# e.g. `./bench_mesh_opt.sh model.glb model.obj`. Each is drawn OBJECTS times instanced, extra arguments for main go in ARGS.
+cd "$(dirname "$0")"
+
+frames=${FRAMES:-300}
+objects=${OBJECTS:-100}
+
+printf "%-32s %-10s %14s  %s\n" mesh order "draws avg ms" "cache"
+for mesh in "$@"; do
+	for optimize in "" --optimize-mesh; do
+		out=$(./main --headless --frames "$frames" --objects "$objects" --model instance --mesh "$mesh" $optimize $ARGS) || { echo "$mesh: failed"; continue; }
+		draws=$(echo "$out" | grep "^  draws " | awk '{ print $3 }')
+		order=file
+		[ -n "$optimize" ] && order=optimized
+		cache=$(echo "$out" | grep "^mesh optimized" | sed 's/.*: \(ACMR.*\), [0-9]* clusters.*/\1/')
+		printf "%-32s %-10s %14s  %s\n" "$mesh" "$order" "$draws" "$cache"
+	done
+done
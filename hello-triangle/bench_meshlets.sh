@@ -0,0 +1,20 @@
+#!/bin/sh
+# GPU time of a frame with each mesh culled per object (--cull gpu) and per meshlet, with the compute pass and with mesh shaders.
+# e.g. `./bench_meshlets.sh model.glb model.obj`. Each is drawn OBJECTS times, optimized, extra arguments for main go in ARGS.
+# Without VK_EXT_mesh_shader (lavapipe) the last row takes the compute path as well.
+cd "$(dirname "$0")"
+
+frames=${FRAMES:-300}
+objects=${OBJECTS:-1000}
+distance=${DISTANCE:-1}
+
+printf "%-32s %-28s %14s  %s\n" mesh culling "frame avg ms" "tested and visible"
+for mesh in "$@"; do
+	for mode in "gpu" "meshlets --no-mesh-shader" "meshlets"; do
+		out=$(./main --headless --frames "$frames" --objects "$objects" --model instance --mesh "$mesh" --optimize-mesh \
+			--camera-distance "$distance" --cull $mode $ARGS) || { echo "$mesh: failed"; continue; }
+		frame=$(echo "$out" | grep "^  frame " | awk '{ print $3 }')
+		line=$(echo "$out" | grep "^culling: " | tail -n 1 | sed 's/.*, \([0-9]* [a-z]* tested and [0-9]* visible per frame ([0-9.]*%)\).*/\1/')
+		printf "%-32s %-28s %14s  %s\n" "$mesh" "$mode" "$frame" "$line"
+	done
+done
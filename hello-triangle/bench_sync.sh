@@ -0,0 +1,16 @@
+#!/bin/sh
+# CPU cost of frame synchronisation with fences and with the timeline semaphore, headless, for every frames in flight count.
+# Extra arguments are passed to main, e.g. `./bench_sync.sh --software`.
+cd "$(dirname "$0")"
+
+frames=${FRAMES:-2000}
+
+printf "%8s %9s  %-24s %s\n" sync in-flight "frame rate" cost
+for sync in fences timeline; do
+	for fif in 1 2 3 4; do
+		out=$(./main --headless --frames "$frames" --frames-in-flight "$fif" --sync "$sync" --no-gpu-timings "$@")
+		fps=$(echo "$out" | grep "^frames:" | sed 's/.*fps: \([0-9.]*\), frame time: \([0-9.]*\) ms.*/\1 fps, \2 ms/')
+		line=$(echo "$out" | grep "^frame sync: .*calls")
+		printf "%8s %9s  %-24s %s\n" "$sync" "$fif" "$fps" "${line#frame sync: }"
+	done
+done
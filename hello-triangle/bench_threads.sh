@@ -0,0 +1,15 @@
+#!/bin/sh
+# Per-frame command recording cost for different draw and thread counts, headless.
+# Extra arguments are passed to main, e.g. `./bench_threads.sh --software`.
+# Threads 0 records inline into the primary command buffer, N > 0 records secondary command buffers on N threads.
+cd "$(dirname "$0")"
+
+frames=${FRAMES:-300}
+
+printf "%8s %8s  %s\n" draws threads recording
+for draws in 100 1000 10000 65536; do
+	for threads in 0 1 2 4 8; do
+		line=$(./main --headless --frames "$frames" --objects "$draws" --threads "$threads" "$@" | grep "^command recording")
+		printf "%8s %8s  %s\n" "$draws" "$threads" "${line#command recording: }"
+	done
+done
@@ -5,7 +5,14 @@ set shader_compiler=glslc
 
 echo build shaders...
 %shader_compiler% shader.vert -o shader.vert.spv
+%shader_compiler% -DMODEL_FROM_SCENE shader.vert -o shader_scene.vert.spv
+%shader_compiler% shader_instanced.vert -o shader_instanced.vert.spv
 %shader_compiler% shader.frag -o shader.frag.spv
+%shader_compiler% cull.comp -o cull.comp.spv
+%shader_compiler% meshlet_cull.comp -o meshlet_cull.comp.spv
+rem mesh shaders are SPIR-V 1.4, which needs Vulkan 1.2
+%shader_compiler% --target-env=vulkan1.2 meshlet.task -o meshlet.task.spv
+%shader_compiler% --target-env=vulkan1.2 meshlet.mesh -o meshlet.mesh.spv
 
 echo build c...
 cl /Iglfw_include /I%vk_path%/Include main.c /link /LIBPATH:glfw_lib_vc2019 /LIBPATH:%vk_path%/Lib
\ No newline at end of file
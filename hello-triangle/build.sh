@@ -0,0 +1,21 @@
+#!/bin/sh
+# Linux build. Needs the Vulkan headers and loader, GLFW 3 and glslc (Vulkan SDK or distro packages).
+# Extra compiler flags go in CFLAGS, e.g. `CFLAGS="-mavx2 -mfma" ./build.sh` for the AVX2 math kernels.
+set -e
+cd "$(dirname "$0")"
+
+shader_compiler=${SHADER_COMPILER:-glslc}
+
+echo build shaders...
+$shader_compiler shader.vert -o shader.vert.spv
+$shader_compiler -DMODEL_FROM_SCENE shader.vert -o shader_scene.vert.spv
+$shader_compiler shader_instanced.vert -o shader_instanced.vert.spv
+$shader_compiler shader.frag -o shader.frag.spv
+$shader_compiler cull.comp -o cull.comp.spv
+$shader_compiler meshlet_cull.comp -o meshlet_cull.comp.spv
+# mesh shaders are SPIR-V 1.4, which needs Vulkan 1.2
+$shader_compiler --target-env=vulkan1.2 meshlet.task -o meshlet.task.spv
+$shader_compiler --target-env=vulkan1.2 meshlet.mesh -o meshlet.mesh.spv
+
+echo build c...
+${CC:-cc} -O2 $CFLAGS -Iglfw_include main.c -o main -pthread -lglfw -lvulkan -lm
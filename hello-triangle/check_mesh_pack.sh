@@ -0,0 +1,42 @@
+#!/bin/sh
+# Fails when --pack-mesh reconstructs positions or normals worse than the bounds in mesh_pack.h: main exits non-zero then.
+# Checks a UV sphere with normals, colors and texcoords written here, and any meshes given, e.g. `./check_mesh_pack.sh model.glb`.
+cd "$(dirname "$0")"
+
+sphere=$(mktemp /tmp/check_mesh_pack_XXXXXX)
+mv "$sphere" "$sphere.obj"
+sphere="$sphere.obj"
+trap 'rm -f "$sphere"' EXIT
+
+# 64 x 32 quads, off the origin so the bounding box isn't centered
+awk 'BEGIN {
+	pi = 3.14159265358979; slices = 64; stacks = 32
+	for(j = 0; j <= stacks; j++) {
+		for(i = 0; i <= slices; i++) {
+			t = pi * j / stacks; p = 2 * pi * i / slices
+			x = sin(t) * cos(p); y = cos(t); z = sin(t) * sin(p)
+			printf "v %.6f %.6f %.6f %.4f %.4f %.4f\n", 3 + 2 * x, 1 + 2 * y, -5 + 2 * z, (x + 1) / 2, (y + 1) / 2, (z + 1) / 2
+			printf "vn %.6f %.6f %.6f\n", x, y, z
+			printf "vt %.6f %.6f\n", i / slices, j / stacks
+		}
+	}
+	for(j = 0; j < stacks; j++) {
+		for(i = 0; i < slices; i++) {
+			a = j * (slices + 1) + i + 1; b = a + slices + 1
+			printf "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, a + 1, a + 1, a + 1
+			printf "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a + 1, a + 1, a + 1, b, b, b, b + 1, b + 1, b + 1
+		}
+	}
+}' > "$sphere"
+
+failed=0
+for mesh in "$sphere" "$@"; do
+	if out=$(./main --headless --frames 1 --mesh "$mesh" --pack-mesh $ARGS); then
+		echo "$mesh: ok, $(echo "$out" | grep "^mesh packed" | sed 's/.*largest errors: //')"
+	else
+		echo "$mesh: FAILED"
+		echo "$out" | grep "^mesh packed\|^(!)"
+		failed=1
+	fi
+done
+exit $failed
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Fails when swapchain recreation leaks GPU memory: resizes the window every RESIZE_EVERY frames for FRAMES frames on the
+# software device, under xvfb-run so it needs no display, and compares the allocations and bytes before and after, both
+# without the render targets, which follow the window size.
+# Extra arguments are passed to main, e.g. `./check_resize_leak.sh --frames-in-flight 3`.
+cd "$(dirname "$0")"
+
+frames=${FRAMES:-3000}
+resize_every=${RESIZE_EVERY:-10}
+
+out=$(xvfb-run -a -s "-screen 0 1920x1080x24" ./main --software --frames "$frames" --resize-every "$resize_every" --present throughput "$@")
+status=$?
+line=$(echo "$out" | grep "^swapchain recreations:")
+echo "$line"
+if [ $status -ne 0 ]; then
+	echo "$out" | grep "^(!)"
+	echo "FAILED: main exited with $status"
+	exit 1
+fi
+if [ -z "$line" ]; then
+	echo "FAILED: the swapchain was never recreated"
+	exit 1
+fi
+
+# "gpu memory without the render targets before: A allocations, B KB, after: C allocations, D KB"
+before=$(echo "$line" | sed 's/.*before: \([0-9]*\) allocations, \([0-9.]*\) KB.*/\1 \2/')
+after=$(echo "$line" | sed 's/.*after: \([0-9]*\) allocations, \([0-9.]*\) KB.*/\1 \2/')
+if [ "$before" != "$after" ]; then
+	echo "FAILED: gpu memory before (allocations KB) $before, after $after"
+	exit 1
+fi
+echo "ok"
@@ -0,0 +1,197 @@
+#pragma once
+
+// CPU zones, dumped as a Chrome trace (JSON trace event format, opens in chrome://tracing and ui.perfetto.dev).
+//
+// A zone is a named begin/end pair of time_now_ns() readings. Every thread writes its zones into its own ring buffer,
+// created the first time it records one, so recording never takes a lock. The buffers keep the last
+// CPU_PROFILER_EVENTS zones of each thread. cpu_profiler_dump_trace() writes them out together with the
+// GPU zones from the GPU profiler, moved onto the same clock.
+// Dumping reads the other threads' buffers, so it must only happen while they aren't recording (e.g. between frames).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "gpu_profiler.h"
+
+
+
+#define CPU_PROFILER_MAX_THREADS	32
+#define CPU_PROFILER_EVENTS		(1 << 15) // per thread
+
+typedef struct cpu_event_t {
+	const char*		name;
+	unsigned long long	begin_ns;
+	unsigned long long	end_ns;
+} cpu_event_t;
+
+typedef struct cpu_thread_events_t {
+	char			name[32];
+	cpu_event_t		events[CPU_PROFILER_EVENTS]; // ring buffer
+	unsigned long long	events_count; // total written
+} cpu_thread_events_t;
+
+typedef struct cpu_zone_t {
+	const char*		name; // NULL when the profiler is off
+	unsigned long long	begin_ns;
+} cpu_zone_t;
+
+typedef struct cpu_profiler_t {
+	int			enabled;
+	mutex_t			mutex; // only for adding threads
+	cpu_thread_events_t*	threads[CPU_PROFILER_MAX_THREADS];
+	int			threads_count;
+} cpu_profiler_t;
+
+static cpu_profiler_t cpu_profiler = {0};
+static THREAD_LOCAL cpu_thread_events_t* cpu_profiler__thread = NULL;
+
+
+
+// With enabled = 0 zones cost a branch and nothing is recorded.
+static inline void
+cpu_profiler_init(int enabled) {
+	cpu_profiler.enabled = enabled;
+	mutex_init(&cpu_profiler.mutex);
+} // cpu_profiler_init
+
+static inline void
+cpu_profiler_deinit() {
+	for(int i = 0; i < cpu_profiler.threads_count; i++) {
+		free(cpu_profiler.threads[i]);
+	}
+	mutex_destroy(&cpu_profiler.mutex);
+	memset(&cpu_profiler, 0, sizeof(cpu_profiler));
+} // cpu_profiler_deinit
+
+// The calling thread's buffer, created on first use. NULL when there are too many threads.
+static inline cpu_thread_events_t*
+cpu_profiler__thread_events() {
+	if(cpu_profiler__thread) return cpu_profiler__thread;
+
+	cpu_thread_events_t* thread = calloc(1, sizeof(cpu_thread_events_t));
+	mutex_lock(&cpu_profiler.mutex);
+	if(cpu_profiler.threads_count < CPU_PROFILER_MAX_THREADS) {
+		snprintf(thread->name, sizeof(thread->name), "thread %d", cpu_profiler.threads_count);
+		cpu_profiler.threads[cpu_profiler.threads_count++] = thread;
+	} else {
+		free(thread);
+		thread = NULL;
+	}
+	mutex_unlock(&cpu_profiler.mutex);
+
+	cpu_profiler__thread = thread;
+	return thread;
+} // cpu_profiler__thread_events
+
+// Names the calling thread in traces.
+static inline void
+cpu_profiler_thread_name(const char* name) {
+	if(!cpu_profiler.enabled) return;
+	cpu_thread_events_t* thread = cpu_profiler__thread_events();
+	if(thread) snprintf(thread->name, sizeof(thread->name), "%s", name);
+} // cpu_profiler_thread_name
+
+// `name` must outlive the profiler, string literals are best.
+static inline cpu_zone_t
+cpu_zone_begin(const char* name) {
+	cpu_zone_t zone = {0};
+	if(!cpu_profiler.enabled) return zone;
+	zone.name = name;
+	zone.begin_ns = time_now_ns();
+	return zone;
+} // cpu_zone_begin
+
+static inline void
+cpu_zone_end(const cpu_zone_t* zone) {
+	if(!zone->name) return;
+	const unsigned long long end_ns = time_now_ns();
+	cpu_thread_events_t* thread = cpu_profiler__thread_events();
+	if(!thread) return;
+
+	cpu_event_t* event = &thread->events[thread->events_count++ % CPU_PROFILER_EVENTS];
+	event->name = zone->name;
+	event->begin_ns = zone->begin_ns;
+	event->end_ns = end_ns;
+} // cpu_zone_end
+
+static inline void
+cpu_profiler__write_event(FILE* f, int* first, const char* name, int index, int pid, int tid,
+	unsigned long long begin_ns, unsigned long long end_ns, unsigned long long origin_ns) {
+	// microseconds from the start of the trace
+	const double ts = (double)(long long)(begin_ns - origin_ns) * 1e-3;
+	const double dur = (double)(end_ns - begin_ns) * 1e-3;
+	fprintf(f, "%s\n{\"name\":\"%s", *first ? "" : ",", name);
+	if(index >= 0) fprintf(f, "[%d]", index);
+	fprintf(f, "\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", pid, tid, ts, dur);
+	*first = 0;
+} // cpu_profiler__write_event
+
+static inline void
+cpu_profiler__write_name(FILE* f, int* first, const char* what, int pid, int tid, const char* name, int index) {
+	fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s", *first ? "" : ",", what, pid, tid, name);
+	if(index >= 0) fprintf(f, "[%d]", index);
+	fprintf(f, "\"}}");
+	*first = 0;
+} // cpu_profiler__write_name
+
+// Writes every recorded CPU zone, and the GPU zones of `gpu` (may be NULL) when it has been calibrated,
+// to `path` as a Chrome trace. The CPU threads are one process, every GPU zone gets its own track in a second one.
+// Returns the number of zones written, -1 if the file can't be written.
+static inline int
+cpu_profiler_dump_trace(const char* path, const gpu_profiler_t* gpu) {
+	FILE* f = fopen(path, "wb");
+	if(!f) return -1;
+
+	// Start the timeline at the oldest zone still around.
+	unsigned long long origin_ns = ~0ull;
+	for(int t = 0; t < cpu_profiler.threads_count; t++) {
+		const cpu_thread_events_t* thread = cpu_profiler.threads[t];
+		const unsigned long long n = thread->events_count < CPU_PROFILER_EVENTS ? thread->events_count : CPU_PROFILER_EVENTS;
+		for(unsigned long long i = thread->events_count - n; i < thread->events_count; i++) {
+			const unsigned long long begin_ns = thread->events[i % CPU_PROFILER_EVENTS].begin_ns;
+			if(begin_ns < origin_ns) origin_ns = begin_ns;
+		}
+	}
+	if(origin_ns == ~0ull) origin_ns = time_now_ns();
+
+	int written = 0;
+	int first = 1;
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	cpu_profiler__write_name(f, &first, "process_name", 1, 0, "CPU", -1);
+	for(int t = 0; t < cpu_profiler.threads_count; t++) {
+		const cpu_thread_events_t* thread = cpu_profiler.threads[t];
+		cpu_profiler__write_name(f, &first, "thread_name", 1, t, thread->name, -1);
+
+		const unsigned long long n = thread->events_count < CPU_PROFILER_EVENTS ? thread->events_count : CPU_PROFILER_EVENTS;
+		for(unsigned long long i = thread->events_count - n; i < thread->events_count; i++) {
+			const cpu_event_t* event = &thread->events[i % CPU_PROFILER_EVENTS];
+			cpu_profiler__write_event(f, &first, event->name, -1, 1, t, event->begin_ns, event->end_ns, origin_ns);
+			written++;
+		}
+	}
+
+	if(gpu && gpu->calibrated) {
+		cpu_profiler__write_name(f, &first, "process_name", 2, 0, "GPU", -1);
+		for(int z = 0; z < gpu->stats_count; z++) {
+			cpu_profiler__write_name(f, &first, "thread_name", 2, z, gpu->stats[z].zone.name, gpu->stats[z].zone.index);
+		}
+
+		const unsigned long long n = gpu->events_count < GPU_PROFILER_EVENTS ? gpu->events_count : GPU_PROFILER_EVENTS;
+		for(unsigned long long i = gpu->events_count - n; i < gpu->events_count; i++) {
+			const gpu_event_t* event = &gpu->events[i % GPU_PROFILER_EVENTS];
+			const unsigned long long begin_ns = gpu_profiler_ticks_to_cpu_ns(gpu, event->begin);
+			const unsigned long long end_ns = gpu_profiler_ticks_to_cpu_ns(gpu, event->end);
+			if(begin_ns < origin_ns) continue; // older than anything the CPU still has
+			const gpu_zone_t* zone = &gpu->stats[event->stats_index].zone;
+			cpu_profiler__write_event(f, &first, zone->name, zone->index, 2, event->stats_index, begin_ns, end_ns, origin_ns);
+			written++;
+		}
+	}
+
+	fprintf(f, "\n]}\n");
+	const int ok = fclose(f) == 0;
+	return ok ? written : -1;
+} // cpu_profiler_dump_trace
@@ -0,0 +1,242 @@
+#pragma once
+
+// Frustum culling on the CPU.
+//
+// Every draw has a world space bounding sphere and axis aligned box, kept as structure of arrays so a group of objects
+// loads into one vector per value. The test takes 4 objects per instruction (SSE2, NEON) or 8 (AVX2): for every frustum plane,
+// the signed distance of each center plus its radius (or the box's extent along the plane normal) is kept as a running minimum,
+// and the object is outside when it ends up below zero. The visible indices are written out in order, a compacted draw list.
+// Ranges are independent, so the work splits over threads with each writing its own part of the list.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "vmath.h"
+
+
+
+typedef enum cull_shape_t {
+	CULL_SHAPE_SPHERE,	// cheapest, a bit loose for long thin objects
+	CULL_SHAPE_AABB,	// tighter, a few more operations per plane
+} cull_shape_t;
+
+typedef struct cull_bounds_t {
+	int	count;
+	float*	center_x;
+	float*	center_y;
+	float*	center_z;
+	float*	radius;
+	float*	extent_x;	// half sizes of the box
+	float*	extent_y;
+	float*	extent_z;
+} cull_bounds_t;
+
+// Planes as (normal, distance), normals pointing inside and unit length: left, right, bottom, top, near, far.
+typedef struct cull_frustum_t {
+	float	planes[6][4];
+} cull_frustum_t;
+
+
+
+// Room for `count` objects. Returns 0 on success.
+static inline int
+cull_bounds_init(cull_bounds_t* b, int count) {
+	memset(b, 0, sizeof(*b));
+	float* floats = calloc((size_t)count * 7, sizeof(float));
+	if(!floats) return -1;
+	b->count = count;
+	b->center_x = floats;
+	b->center_y = floats + (size_t)count * 1;
+	b->center_z = floats + (size_t)count * 2;
+	b->radius   = floats + (size_t)count * 3;
+	b->extent_x = floats + (size_t)count * 4;
+	b->extent_y = floats + (size_t)count * 5;
+	b->extent_z = floats + (size_t)count * 6;
+	return 0;
+} // cull_bounds_init
+
+static inline void
+cull_bounds_deinit(cull_bounds_t* b) {
+	free(b->center_x);
+	memset(b, 0, sizeof(*b));
+} // cull_bounds_deinit
+
+// Bounds of object i: the local box (center, half sizes) moved by `world`. The box gets the extents of its transformed
+// corners, the sphere goes around the local box, scaled by the largest scale of `world`.
+static inline void
+cull_bounds_set(cull_bounds_t* b, int i, const mat4_t* world, vec3_t local_center, vec3_t local_extent) {
+	const float* m = world->m;
+	b->center_x[i] = m[0] * local_center.x + m[4] * local_center.y + m[8]  * local_center.z + m[12];
+	b->center_y[i] = m[1] * local_center.x + m[5] * local_center.y + m[9]  * local_center.z + m[13];
+	b->center_z[i] = m[2] * local_center.x + m[6] * local_center.y + m[10] * local_center.z + m[14];
+	b->extent_x[i] = fabsf(m[0]) * local_extent.x + fabsf(m[4]) * local_extent.y + fabsf(m[8])  * local_extent.z;
+	b->extent_y[i] = fabsf(m[1]) * local_extent.x + fabsf(m[5]) * local_extent.y + fabsf(m[9])  * local_extent.z;
+	b->extent_z[i] = fabsf(m[2]) * local_extent.x + fabsf(m[6]) * local_extent.y + fabsf(m[10]) * local_extent.z;
+
+	float scale2 = m[0] * m[0] + m[1] * m[1] + m[2] * m[2];
+	const float sy2 = m[4] * m[4] + m[5] * m[5] + m[6] * m[6];
+	const float sz2 = m[8] * m[8] + m[9] * m[9] + m[10] * m[10];
+	if(sy2 > scale2) scale2 = sy2;
+	if(sz2 > scale2) scale2 = sz2;
+	b->radius[i] = vec3_length(local_extent) * sqrtf(scale2);
+} // cull_bounds_set
+
+// The frustum of a projection * view matrix from vmath.h (reversed Z, so near is depth 1 and far is depth 0).
+// With an infinite far plane that plane is degenerate, it becomes one that everything is inside of.
+static inline cull_frustum_t
+cull_frustum(const mat4_t* view_projection) {
+	const float* m = view_projection->m;
+	// rows of the matrix
+	const float r[4][4] = {
+		{m[0], m[4], m[8],  m[12]},
+		{m[1], m[5], m[9],  m[13]},
+		{m[2], m[6], m[10], m[14]},
+		{m[3], m[7], m[11], m[15]},
+	};
+	// inside: -w <= x <= w, -w <= y <= w, 0 <= z <= w
+	const float sign[6] = {1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 0.0f};
+	const int row[6] = {0, 0, 1, 1, 2, 2};
+
+	cull_frustum_t f;
+	for(int p = 0; p < 6; p++) {
+		for(int j = 0; j < 4; j++) {
+			f.planes[p][j] = p == 5 ? r[2][j] : r[3][j] + sign[p] * r[row[p]][j];
+		}
+		const float len = sqrtf(f.planes[p][0] * f.planes[p][0] + f.planes[p][1] * f.planes[p][1] + f.planes[p][2] * f.planes[p][2]);
+		if(len > 1e-20f) {
+			for(int j = 0; j < 4; j++) {
+				f.planes[p][j] /= len;
+			}
+		} else {
+			f.planes[p][0] = f.planes[p][1] = f.planes[p][2] = 0.0f;
+			f.planes[p][3] = 1.0f;
+		}
+	}
+	return f;
+} // cull_frustum
+
+// How far object i is inside the frustum, negative when it's outside.
+static inline float
+cull__distance(const cull_bounds_t* b, const cull_frustum_t* f, cull_shape_t shape, int i) {
+	float distance = INFINITY;
+	for(int p = 0; p < 6; p++) {
+		const float* plane = f->planes[p];
+		float d = plane[0] * b->center_x[i] + plane[1] * b->center_y[i] + plane[2] * b->center_z[i] + plane[3];
+		if(shape == CULL_SHAPE_SPHERE) d += b->radius[i];
+		else d += fabsf(plane[0]) * b->extent_x[i] + fabsf(plane[1]) * b->extent_y[i] + fabsf(plane[2]) * b->extent_z[i];
+		if(d < distance) distance = d;
+	}
+	return distance;
+} // cull__distance
+
+// Writes the indices of the visible objects in [first, first + count) to `visible`, in order. Returns how many.
+static inline int
+cull_range_scalar(const cull_bounds_t* b, const cull_frustum_t* f, cull_shape_t shape, int first, int count, int* visible) {
+	int n = 0;
+	for(int i = first; i < first + count; i++) {
+		visible[n] = i;
+		n += cull__distance(b, f, shape, i) >= 0.0f;
+	}
+	return n;
+} // cull_range_scalar
+
+// See cull_range_scalar().
+static inline int
+cull_range(const cull_bounds_t* b, const cull_frustum_t* f, cull_shape_t shape, int first, int count, int* visible) {
+	const int last = first + count;
+	int i = first;
+	int n = 0;
+
+#if defined(VMATH_SIMD)
+	// the absolute normals, for boxes
+	float abs_normal[6][3];
+	for(int p = 0; p < 6; p++) {
+		for(int j = 0; j < 3; j++) {
+			abs_normal[p][j] = fabsf(f->planes[p][j]);
+		}
+	}
+#endif
+
+#if defined(VMATH_AVX2)
+	for(; i + 8 <= last; i += 8) {
+		const __m256 cx = _mm256_loadu_ps(b->center_x + i);
+		const __m256 cy = _mm256_loadu_ps(b->center_y + i);
+		const __m256 cz = _mm256_loadu_ps(b->center_z + i);
+		__m256 size;
+		__m256 ex = _mm256_setzero_ps(), ey = ex, ez = ex;
+		if(shape == CULL_SHAPE_SPHERE) {
+			size = _mm256_loadu_ps(b->radius + i);
+		} else {
+			size = _mm256_setzero_ps();
+			ex = _mm256_loadu_ps(b->extent_x + i);
+			ey = _mm256_loadu_ps(b->extent_y + i);
+			ez = _mm256_loadu_ps(b->extent_z + i);
+		}
+
+		__m256 distance = _mm256_set1_ps(INFINITY);
+		for(int p = 0; p < 6; p++) {
+			const float* plane = f->planes[p];
+			// plus the radius, or the box's extent along the normal
+			__m256 d = _mm256_add_ps(size, _mm256_set1_ps(plane[3]));
+			d = _mm256_fmadd_ps(_mm256_set1_ps(plane[0]), cx, d);
+			d = _mm256_fmadd_ps(_mm256_set1_ps(plane[1]), cy, d);
+			d = _mm256_fmadd_ps(_mm256_set1_ps(plane[2]), cz, d);
+			if(shape == CULL_SHAPE_AABB) {
+				d = _mm256_fmadd_ps(_mm256_set1_ps(abs_normal[p][0]), ex, d);
+				d = _mm256_fmadd_ps(_mm256_set1_ps(abs_normal[p][1]), ey, d);
+				d = _mm256_fmadd_ps(_mm256_set1_ps(abs_normal[p][2]), ez, d);
+			}
+			distance = _mm256_min_ps(distance, d);
+		}
+
+		// one bit per object, appended without branches: every index is written, the count only moves past the visible ones
+		const int mask = _mm256_movemask_ps(_mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+		for(int j = 0; j < 8; j++) {
+			visible[n] = i + j;
+			n += (mask >> j) & 1;
+		}
+	}
+#elif defined(VMATH_SIMD)
+	for(; i + 4 <= last; i += 4) {
+		const vmath_f4 cx = vmath_load(b->center_x + i);
+		const vmath_f4 cy = vmath_load(b->center_y + i);
+		const vmath_f4 cz = vmath_load(b->center_z + i);
+		const vmath_f4 zero = vmath_set1(0.0f);
+		vmath_f4 size = zero, ex = zero, ey = zero, ez = zero;
+		if(shape == CULL_SHAPE_SPHERE) {
+			size = vmath_load(b->radius + i);
+		} else {
+			ex = vmath_load(b->extent_x + i);
+			ey = vmath_load(b->extent_y + i);
+			ez = vmath_load(b->extent_z + i);
+		}
+
+		vmath_f4 distance = vmath_set1(INFINITY);
+		for(int p = 0; p < 6; p++) {
+			const float* plane = f->planes[p];
+			vmath_f4 d = vmath_add(size, vmath_set1(plane[3]));
+			d = vmath_madd(vmath_set1(plane[0]), cx, d);
+			d = vmath_madd(vmath_set1(plane[1]), cy, d);
+			d = vmath_madd(vmath_set1(plane[2]), cz, d);
+			if(shape == CULL_SHAPE_AABB) {
+				d = vmath_madd(vmath_set1(abs_normal[p][0]), ex, d);
+				d = vmath_madd(vmath_set1(abs_normal[p][1]), ey, d);
+				d = vmath_madd(vmath_set1(abs_normal[p][2]), ez, d);
+			}
+			distance = vmath_min(distance, d);
+		}
+
+		// appended without branches, like above
+		float d[4];
+		vmath_store(d, distance);
+		for(int j = 0; j < 4; j++) {
+			visible[n] = i + j;
+			n += d[j] >= 0.0f;
+		}
+	}
+#endif
+
+	// what doesn't fill a vector
+	return n + cull_range_scalar(b, f, shape, i, last - i, visible + n);
+} // cull_range
@@ -0,0 +1,166 @@
+#pragma once
+
+// Deferred destruction of GPU objects.
+//
+// Objects the GPU may still be using are pushed with the value of the last piece of work that uses them:
+// a frame number, or a timeline semaphore value. deletion_queue_collect() is called with the value that work
+// is known to have finished up to (e.g. after a fence wait), and destroys everything at or below it.
+// Nothing ever waits for the GPU, memory comes back as soon as it's safe, and the queue keeps track of how long that took.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "gpu_alloc.h"
+
+
+
+#define DELETION_MAX_DATA	160	// bytes of object data per entry, copied in
+
+// Destroys the object described by `data`.
+typedef void (*deletion_fn_t)(void* context, void* data);
+
+typedef struct deletion_t {
+	deletion_fn_t		fn;
+	void*			context;
+	unsigned long long	value;		// destroy once the work has finished up to this value
+	unsigned long long	pushed_ns;
+	VkDeviceSize		bytes;		// GPU memory it holds, for the stats
+	unsigned char		data[DELETION_MAX_DATA];
+} deletion_t;
+
+typedef struct deletion_stats_t {
+	unsigned long long	pushed;
+	unsigned long long	destroyed;
+	int			pending;
+	VkDeviceSize		pending_bytes;
+	VkDeviceSize		peak_pending_bytes;
+	VkDeviceSize		reclaimed_bytes;
+	unsigned long long	latency_total_ns; // from push to destruction, over all destroyed entries
+	unsigned long long	latency_max_ns;
+} deletion_stats_t;
+
+typedef struct deletion_queue_t {
+	deletion_t*		entries;	// in push order
+	int			count;
+	int			capacity;
+	deletion_stats_t	stats;
+} deletion_queue_t;
+
+// Buffers and images with memory from the allocator.
+typedef struct deletion_resource_t {
+	gpu_allocator_t*	allocator;
+	VkBuffer		buffer;
+	VkImage			image;
+	gpu_allocation_t	memory;
+} deletion_resource_t;
+
+
+
+static inline void
+deletion_queue_init(deletion_queue_t* q) {
+	memset(q, 0, sizeof(*q));
+} // deletion_queue_init
+
+// `data` (up to DELETION_MAX_DATA bytes) is copied, fn gets a pointer to the copy. Returns 0 on success.
+static inline int
+deletion_queue_push(deletion_queue_t* q, unsigned long long value, deletion_fn_t fn, void* context,
+	const void* data, size_t size, VkDeviceSize bytes) {
+	if(size > DELETION_MAX_DATA) return -1;
+	if(q->count == q->capacity) {
+		const int capacity = q->capacity ? q->capacity * 2 : 16;
+		deletion_t* entries = realloc(q->entries, capacity * sizeof(deletion_t));
+		if(!entries) return -1;
+		q->entries = entries;
+		q->capacity = capacity;
+	}
+
+	deletion_t* d = &q->entries[q->count++];
+	d->fn = fn;
+	d->context = context;
+	d->value = value;
+	d->pushed_ns = time_now_ns();
+	d->bytes = bytes;
+	memcpy(d->data, data, size);
+
+	q->stats.pushed++;
+	q->stats.pending = q->count;
+	q->stats.pending_bytes += bytes;
+	if(q->stats.pending_bytes > q->stats.peak_pending_bytes) q->stats.peak_pending_bytes = q->stats.pending_bytes;
+	return 0;
+} // deletion_queue_push
+
+static void
+deletion__destroy_resource(void* context, void* data) {
+	deletion_resource_t* r = data;
+	if(r->buffer != VK_NULL_HANDLE) gpu_destroy_buffer(r->allocator, r->buffer, &r->memory);
+	if(r->image != VK_NULL_HANDLE) gpu_destroy_image(r->allocator, r->image, &r->memory);
+} // deletion__destroy_resource
+
+static inline int
+deletion_queue_buffer(deletion_queue_t* q, unsigned long long value, gpu_allocator_t* allocator, VkBuffer buffer, const gpu_allocation_t* memory) {
+	deletion_resource_t r = {0};
+	r.allocator = allocator;
+	r.buffer = buffer;
+	r.memory = *memory;
+	return deletion_queue_push(q, value, deletion__destroy_resource, NULL, &r, sizeof(r), memory->size);
+} // deletion_queue_buffer
+
+static inline int
+deletion_queue_image(deletion_queue_t* q, unsigned long long value, gpu_allocator_t* allocator, VkImage image, const gpu_allocation_t* memory) {
+	deletion_resource_t r = {0};
+	r.allocator = allocator;
+	r.image = image;
+	r.memory = *memory;
+	return deletion_queue_push(q, value, deletion__destroy_resource, NULL, &r, sizeof(r), memory->size);
+} // deletion_queue_image
+
+// Destroys everything pushed with a value <= completed, in push order. Returns how many.
+static inline int
+deletion_queue_collect(deletion_queue_t* q, unsigned long long completed) {
+	if(q->count == 0) return 0;
+
+	const unsigned long long now_ns = time_now_ns();
+	int kept = 0;
+	int destroyed = 0;
+	for(int i = 0; i < q->count; i++) {
+		deletion_t* d = &q->entries[i];
+		if(d->value > completed) {
+			if(kept != i) q->entries[kept] = *d;
+			kept++;
+			continue;
+		}
+
+		d->fn(d->context, d->data);
+		destroyed++;
+
+		const unsigned long long latency_ns = now_ns - d->pushed_ns;
+		q->stats.destroyed++;
+		q->stats.pending_bytes -= d->bytes;
+		q->stats.reclaimed_bytes += d->bytes;
+		q->stats.latency_total_ns += latency_ns;
+		if(latency_ns > q->stats.latency_max_ns) q->stats.latency_max_ns = latency_ns;
+	}
+	q->count = kept;
+	q->stats.pending = kept;
+	return destroyed;
+} // deletion_queue_collect
+
+// Everything still queued is destroyed, only call when the device is idle.
+static inline void
+deletion_queue_deinit(deletion_queue_t* q) {
+	deletion_queue_collect(q, ~0ull);
+	free(q->entries);
+	q->entries = NULL;
+	q->count = q->capacity = 0;
+} // deletion_queue_deinit
+
+static inline void
+deletion_queue_print_stats(const deletion_queue_t* q) {
+	const deletion_stats_t* s = &q->stats;
+	printf("deferred deletion: %llu pushed, %llu destroyed, %d pending (%.1f KB), peak pending %.1f KB, reclaimed %.1f KB, reclaim latency %.3f ms avg, %.3f ms max\n",
+		s->pushed, s->destroyed, s->pending, (double)s->pending_bytes / 1024.0, (double)s->peak_pending_bytes / 1024.0,
+		(double)s->reclaimed_bytes / 1024.0,
+		s->destroyed ? (double)s->latency_total_ns * 1e-6 / (double)s->destroyed : 0.0, (double)s->latency_max_ns * 1e-6);
+} // deletion_queue_print_stats
@@ -0,0 +1,269 @@
+#pragma once
+
+// Device extension and feature selection.
+//
+// The application lists the extensions and features it uses, each with how badly it needs it and why.
+// device_caps_select() checks them against a physical device, and decides what to enable.
+// device_caps_print() reports that decision. Only listed extensions are ever enabled,
+// so the driver's behaviour doesn't depend on whatever else a machine happens to expose.
+// Features of extensions and newer core versions live in their own structs, which are queried and
+// chained behind VkPhysicalDeviceFeatures2 (Vulkan 1.1+) when the device has them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+
+
+#define DEVICE_CAPS_MAX		32	// table entries
+#define DEVICE_CAPS_MAX_STRUCTS	8	// feature structs in the chain
+#define DEVICE_CAPS_STRUCT_SIZE	512	// bytes, big enough for any feature struct
+
+typedef enum ext_need_t {
+	EXT_REQUIRED,		// no device without it
+	EXT_REQUIRED_WINDOWED,	// required when presenting, not used in headless mode
+	EXT_OPTIONAL,		// used when available
+	EXT_IF_PRESENT,		// the spec says it must be enabled whenever the device exposes it
+} ext_need_t;
+
+typedef struct device_extension_t {
+	const char*	name;
+	ext_need_t	need;
+	const char*	why;
+	unsigned int	core_version;	// promoted to core in this API version, and not enabled there. 0 = not promoted
+	unsigned int	min_version;	// only enabled from this API version on, where its dependencies are core. 0 = any
+} device_extension_t;
+
+// A feature struct other than VkPhysicalDeviceFeatures.
+typedef struct device_feature_struct_t {
+	VkStructureType	type;
+	size_t		size;
+	unsigned int	core_version;	// available on devices with this API version, 0 = extension only
+	const char*	extension;	// or with this extension enabled, NULL = core only
+} device_feature_struct_t;
+
+// A VkPhysicalDeviceFeatures member, or a member of another feature struct, by offset.
+typedef struct device_feature_t {
+	const char*	name;
+	size_t		offset;
+	int		required;
+	const char*	why;
+	const device_feature_struct_t* in; // NULL = VkPhysicalDeviceFeatures
+} device_feature_t;
+
+#define DEVICE_FEATURE(member)			#member, offsetof(VkPhysicalDeviceFeatures, member)
+#define DEVICE_FEATURE_IN(type, member)		#member, offsetof(type, member)
+
+typedef enum cap_status_t {
+	CAP_ENABLED,
+	CAP_UNAVAILABLE,	// optional and not supported
+	CAP_MISSING,		// required and not supported
+	CAP_NOT_NEEDED,		// not needed in this configuration
+} cap_status_t;
+
+typedef struct device_caps_t {
+	unsigned int		api_version;	// min(instance, device)
+	const device_extension_t* ext_table;	// both tables end with a NULL name
+	const device_feature_t*	feature_table;
+	cap_status_t		ext_status[DEVICE_CAPS_MAX];
+	cap_status_t		feature_status[DEVICE_CAPS_MAX];
+
+	// what goes into VkDeviceCreateInfo
+	const char*		extensions[DEVICE_CAPS_MAX];
+	int			extensions_count;
+	VkPhysicalDeviceFeatures2 features;	// head of the feature struct chain, see device_caps_chain()
+	const device_feature_struct_t* structs_info[DEVICE_CAPS_MAX_STRUCTS];
+	unsigned long long	structs[DEVICE_CAPS_MAX_STRUCTS][DEVICE_CAPS_STRUCT_SIZE / 8]; // the rest of the chain
+	int			structs_count;
+} device_caps_t;
+
+// Start of every feature struct.
+typedef struct device_caps__header_t {
+	VkStructureType	sType;
+	void*		pNext;
+} device_caps__header_t;
+
+
+
+static inline const char*
+ext_need_name(ext_need_t need) {
+	switch(need) {
+		case EXT_REQUIRED:		return "required";
+		case EXT_REQUIRED_WINDOWED:	return "required with a window";
+		case EXT_OPTIONAL:		return "optional";
+		case EXT_IF_PRESENT:		return "if present";
+		default:			return "?";
+	}
+} // ext_need_name
+
+static inline int
+device_caps_has_extension(const device_caps_t* caps, const char* name) {
+	for(int i = 0; i < caps->extensions_count; i++) {
+		if(strcmp(caps->extensions[i], name) == 0) return 1;
+	}
+	return 0;
+} // device_caps_has_extension
+
+// The slot of feature struct `in`, added if it's available on the device. -1 when it isn't.
+static inline int
+device_caps__struct(device_caps_t* caps, const device_feature_struct_t* in) {
+	for(int i = 0; i < caps->structs_count; i++) {
+		if(caps->structs_info[i] == in) return i;
+	}
+
+	const int core = in->core_version && caps->api_version >= in->core_version;
+	const int ext = in->extension && device_caps_has_extension(caps, in->extension);
+	if(!core && !ext) return -1;
+	if(caps->structs_count == DEVICE_CAPS_MAX_STRUCTS || in->size > DEVICE_CAPS_STRUCT_SIZE) return -1;
+
+	const int i = caps->structs_count++;
+	caps->structs_info[i] = in;
+	((device_caps__header_t*)caps->structs[i])->sType = in->type;
+	return i;
+} // device_caps__struct
+
+// Decides what to enable on `physical_device`. Returns 0 when something required is missing.
+// get_features2 is vkGetPhysicalDeviceFeatures2 when the instance and device are Vulkan 1.1+, else NULL.
+static inline int
+device_caps_select(device_caps_t* caps, VkPhysicalDevice physical_device, unsigned int api_version, int windowed,
+	PFN_vkGetPhysicalDeviceFeatures2 get_features2, const device_extension_t* ext_table, const device_feature_t* feature_table) {
+	memset(caps, 0, sizeof(*caps));
+	caps->api_version = api_version;
+	caps->ext_table = ext_table;
+	caps->feature_table = feature_table;
+	caps->features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+
+	int ok = 1;
+
+	unsigned int n_avail = 0;
+	vkEnumerateDeviceExtensionProperties(physical_device, NULL, &n_avail, NULL);
+	VkExtensionProperties* avail = calloc(n_avail ? n_avail : 1, sizeof(VkExtensionProperties));
+	vkEnumerateDeviceExtensionProperties(physical_device, NULL, &n_avail, avail);
+
+	for(int i = 0; ext_table[i].name; i++) {
+		const device_extension_t* ext = &ext_table[i];
+		if((ext->need == EXT_REQUIRED_WINDOWED && !windowed) || (ext->core_version && api_version >= ext->core_version)) {
+			caps->ext_status[i] = CAP_NOT_NEEDED;
+			continue;
+		}
+
+		// on older devices its dependencies would have to be enabled as well
+		const int new_enough = !ext->min_version || api_version >= ext->min_version;
+		int found = 0;
+		for(unsigned int j = 0; j < n_avail && new_enough && !found; j++) {
+			found = strcmp(avail[j].extensionName, ext->name) == 0;
+		}
+
+		if(found) {
+			caps->ext_status[i] = CAP_ENABLED;
+			caps->extensions[caps->extensions_count++] = ext->name;
+		} else if(ext->need == EXT_REQUIRED || ext->need == EXT_REQUIRED_WINDOWED) {
+			caps->ext_status[i] = CAP_MISSING;
+			ok = 0;
+		} else {
+			caps->ext_status[i] = CAP_UNAVAILABLE;
+		}
+	}
+	free(avail);
+
+	// Feature structs only exist with vkGetPhysicalDeviceFeatures2.
+	if(get_features2) {
+		for(int i = 0; feature_table[i].name; i++) {
+			if(feature_table[i].in) device_caps__struct(caps, feature_table[i].in);
+		}
+	}
+
+	// What the device supports, in a chain of empty copies of the structs.
+	VkPhysicalDeviceFeatures supported;
+	unsigned long long (*supported_structs)[DEVICE_CAPS_STRUCT_SIZE / 8] = calloc(DEVICE_CAPS_MAX_STRUCTS, sizeof(*supported_structs));
+	if(get_features2) {
+		VkPhysicalDeviceFeatures2 supported2 = {0};
+		supported2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		for(int i = caps->structs_count - 1; i >= 0; i--) {
+			device_caps__header_t* header = (device_caps__header_t*)supported_structs[i];
+			header->sType = caps->structs_info[i]->type;
+			header->pNext = supported2.pNext;
+			supported2.pNext = header;
+		}
+		get_features2(physical_device, &supported2);
+		supported = supported2.features;
+	} else {
+		vkGetPhysicalDeviceFeatures(physical_device, &supported);
+	}
+
+	for(int i = 0; feature_table[i].name; i++) {
+		const device_feature_t* feat = &feature_table[i];
+		char* enabled = (char*)&caps->features.features;
+		const char* has_in = (const char*)&supported;
+		if(feat->in) {
+			const int s = get_features2 ? device_caps__struct(caps, feat->in) : -1;
+			enabled = s >= 0 ? (char*)caps->structs[s] : NULL;
+			has_in = s >= 0 ? (const char*)supported_structs[s] : NULL;
+		}
+
+		const VkBool32 has = has_in ? *(const VkBool32*)(has_in + feat->offset) : VK_FALSE;
+		if(has) {
+			caps->feature_status[i] = CAP_ENABLED;
+			*(VkBool32*)(enabled + feat->offset) = VK_TRUE;
+		} else if(feat->required) {
+			caps->feature_status[i] = CAP_MISSING;
+			ok = 0;
+		} else {
+			caps->feature_status[i] = CAP_UNAVAILABLE;
+		}
+	}
+	free(supported_structs);
+
+	return ok;
+} // device_caps_select
+
+// Links the feature structs together, and returns what goes into VkDeviceCreateInfo::pNext.
+// Done right before creating the device rather than in device_caps_select(), so that caps can be copied around until then.
+// Without Vulkan 1.1 there is no chain, the core features go into pEnabledFeatures instead.
+static inline const void*
+device_caps_chain(device_caps_t* caps) {
+	if(caps->api_version < VK_API_VERSION_1_1) return NULL;
+	caps->features.pNext = NULL;
+	for(int i = caps->structs_count - 1; i >= 0; i--) {
+		device_caps__header_t* header = (device_caps__header_t*)caps->structs[i];
+		header->pNext = caps->features.pNext;
+		caps->features.pNext = header;
+	}
+	return &caps->features;
+} // device_caps_chain
+
+static inline const VkPhysicalDeviceFeatures*
+device_caps_enabled_features(const device_caps_t* caps) {
+	return caps->api_version < VK_API_VERSION_1_1 ? &caps->features.features : NULL;
+} // device_caps_enabled_features
+
+static inline int
+device_caps_has_feature(const device_caps_t* caps, const char* name) {
+	for(int i = 0; caps->feature_table[i].name; i++) {
+		if(strcmp(caps->feature_table[i].name, name) == 0) return caps->feature_status[i] == CAP_ENABLED;
+	}
+	return 0;
+} // device_caps_has_feature
+
+static inline void
+device_caps_print(const device_caps_t* caps) {
+	static const char* status_names[] = {
+		[CAP_ENABLED]		= "enabled",
+		[CAP_UNAVAILABLE]	= "not available",
+		[CAP_MISSING]		= "MISSING",
+		[CAP_NOT_NEEDED]	= "not needed",
+	};
+
+	printf("device extensions:\n");
+	for(int i = 0; caps->ext_table[i].name; i++) {
+		const device_extension_t* ext = &caps->ext_table[i];
+		printf("  %-36s %-13s (%s) %s\n", ext->name, status_names[caps->ext_status[i]], ext_need_name(ext->need), ext->why);
+	}
+
+	printf("device features:%s\n", caps->feature_table[0].name ? "" : " none requested");
+	for(int i = 0; caps->feature_table[i].name; i++) {
+		const device_feature_t* feat = &caps->feature_table[i];
+		printf("  %-36s %-13s (%s) %s\n", feat->name, status_names[caps->feature_status[i]], feat->required ? "required" : "optional", feat->why);
+	}
+} // device_caps_print
@@ -0,0 +1,479 @@
+#pragma once
+
+// GPU memory sub-allocator.
+//
+// Instead of one vkAllocateMemory() per resource, memory is allocated in large blocks per memory type
+// and handed out with a buddy allocator. Drivers limit the number of live allocations
+// (maxMemoryAllocationCount, often 4096), and each one is slow to create.
+//
+// - Every memory type has two pools, one for linear resources (buffers) and one for optimal tiling images.
+//   Linear and optimal resources never share a block, so bufferImageGranularity can't be violated.
+// - Buddy nodes are aligned to their own size, so any power of two alignment up to the node size is free.
+// - Host visible blocks are mapped once when created, allocations get a pointer into that mapping.
+// - Resources bigger than half a block get their own dedicated VkDeviceMemory.
+//
+// Free nodes are tracked with one bit per node (all levels of the buddy tree back to back)
+// and a free count per level, so merging with a buddy is a single bit test.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+
+#define GPU_ALLOC_BLOCK_SIZE	(64ull << 20)	// preferred size of one VkDeviceMemory block
+#define GPU_ALLOC_MIN_SIZE	(256ull)	// smallest buddy node
+
+typedef enum gpu_resource_kind_t {
+	GPU_RESOURCE_LINEAR,	// buffers (and linear tiling images)
+	GPU_RESOURCE_OPTIMAL,	// optimal tiling images
+	GPU_RESOURCE_KIND_COUNT
+} gpu_resource_kind_t;
+
+typedef struct gpu_allocation_t {
+	VkDeviceMemory	memory;
+	VkDeviceSize	offset;
+	VkDeviceSize	size;		// requested size
+	void*		mapped;		// host pointer to `offset`, NULL if the memory isn't host visible
+	int		pool;		// memory type * GPU_RESOURCE_KIND_COUNT + kind
+	int		block;		// index into the pool's blocks, -1 for a dedicated allocation
+	int		level;		// buddy tree level of the node
+} gpu_allocation_t;
+
+typedef struct gpu_block_t {
+	VkDeviceMemory		memory;
+	void*			mapped;
+	unsigned long long*	free_bits;	// one bit per buddy node, level 0 (whole block) first
+	unsigned int*		free_count;	// number of free nodes per level
+	VkDeviceSize		used;		// requested bytes
+	VkDeviceSize		allocated;	// bytes in handed out nodes
+	int			allocations;
+} gpu_block_t;
+
+typedef struct gpu_pool_t {
+	gpu_block_t*	blocks;
+	int		blocks_count;
+	int		levels;		// node size at the last level is GPU_ALLOC_MIN_SIZE
+	VkDeviceSize	block_size;
+	// dedicated allocations don't live in blocks, they're just counted
+	VkDeviceSize	dedicated_bytes;
+	int		dedicated_count;
+} gpu_pool_t;
+
+typedef struct gpu_allocator_t {
+	VkDevice				device;
+	VkPhysicalDeviceMemoryProperties	mem_props;
+	VkDeviceSize				buffer_image_granularity;
+	unsigned int				max_memory_objects;
+	int					memory_objects;	// live VkDeviceMemory objects
+	gpu_pool_t				pools[VK_MAX_MEMORY_TYPES * GPU_RESOURCE_KIND_COUNT];
+} gpu_allocator_t;
+
+typedef struct gpu_alloc_stats_t {
+	VkDeviceSize	committed;	// bytes in VkDeviceMemory objects
+	VkDeviceSize	used;		// bytes requested by resources
+	VkDeviceSize	allocated;	// bytes handed out, including buddy rounding
+	VkDeviceSize	free;		// free bytes in blocks
+	VkDeviceSize	largest_free;	// biggest single allocation that fits in an existing block
+	VkDeviceSize	contiguous_free; // sum over blocks of the biggest free node in each
+	int		memory_objects;
+	int		allocations;
+} gpu_alloc_stats_t;
+
+
+
+static inline int
+gpu_alloc__ctz64(unsigned long long x) {
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward64(&i, x);
+	return (int)i;
+#else
+	return __builtin_ctzll(x);
+#endif
+} // gpu_alloc__ctz64
+
+// first node index of `level` in the bit array
+static inline unsigned long long
+gpu_alloc__level_first(int level) {
+	return (1ull << level) - 1;
+} // gpu_alloc__level_first
+
+static inline int
+gpu_alloc__test(const gpu_block_t* block, unsigned long long bit) {
+	return (block->free_bits[bit >> 6] >> (bit & 63)) & 1;
+} // gpu_alloc__test
+
+static inline void
+gpu_alloc__set_free(gpu_block_t* block, int level, unsigned long long node) {
+	const unsigned long long bit = gpu_alloc__level_first(level) + node;
+	block->free_bits[bit >> 6] |= 1ull << (bit & 63);
+	block->free_count[level]++;
+} // gpu_alloc__set_free
+
+static inline void
+gpu_alloc__set_used(gpu_block_t* block, int level, unsigned long long node) {
+	const unsigned long long bit = gpu_alloc__level_first(level) + node;
+	block->free_bits[bit >> 6] &= ~(1ull << (bit & 63));
+	block->free_count[level]--;
+} // gpu_alloc__set_used
+
+// returns the first free node at `level`. the level must have at least one.
+static inline unsigned long long
+gpu_alloc__find_free(const gpu_block_t* block, int level) {
+	const unsigned long long first = gpu_alloc__level_first(level);
+	const unsigned long long end = first + (1ull << level);
+	for(unsigned long long b = first; b < end; ) {
+		unsigned long long word = block->free_bits[b >> 6] >> (b & 63);
+		if(end - b < 64) word &= (1ull << (end - b)) - 1;
+		if(word) return b + gpu_alloc__ctz64(word) - first;
+		b += 64 - (b & 63);
+	}
+	return ~0ull;
+} // gpu_alloc__find_free
+
+// smallest level (biggest node) that is still >= size
+static inline int
+gpu_alloc__level_for_size(const gpu_pool_t* pool, VkDeviceSize size) {
+	int level = pool->levels - 1;
+	while(level > 0 && (pool->block_size >> level) < size) level--;
+	return level;
+} // gpu_alloc__level_for_size
+
+
+
+static inline void
+gpu_alloc_init(gpu_allocator_t* a, VkPhysicalDevice physical_device, VkDevice device) {
+	memset(a, 0, sizeof(*a));
+	a->device = device;
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &a->mem_props);
+
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(physical_device, &props);
+	a->buffer_image_granularity = props.limits.bufferImageGranularity;
+	a->max_memory_objects = props.limits.maxMemoryAllocationCount;
+
+	// Small heaps (e.g. a 256MB BAR heap) get smaller blocks, so a single block doesn't eat most of the heap.
+	for(int t = 0; t < a->mem_props.memoryTypeCount; t++) {
+		const VkDeviceSize heap_size = a->mem_props.memoryHeaps[a->mem_props.memoryTypes[t].heapIndex].size;
+		VkDeviceSize block_size = GPU_ALLOC_BLOCK_SIZE;
+		while(block_size > heap_size / 8 && block_size > GPU_ALLOC_MIN_SIZE * 1024) block_size >>= 1;
+
+		int levels = 1;
+		while((block_size >> (levels - 1)) > GPU_ALLOC_MIN_SIZE) levels++;
+
+		for(int k = 0; k < GPU_RESOURCE_KIND_COUNT; k++) {
+			gpu_pool_t* pool = &a->pools[t * GPU_RESOURCE_KIND_COUNT + k];
+			pool->block_size = block_size;
+			pool->levels = levels;
+		}
+	}
+} // gpu_alloc_init
+
+// Returns the first memory type allowed by `type_bits` that has all `required` flags,
+// preferring one that also has the `preferred` flags. -1 if there is none.
+static inline int
+gpu_alloc_find_memory_type(const gpu_allocator_t* a, unsigned int type_bits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) {
+	const VkMemoryPropertyFlags wanted[2] = {required | preferred, required};
+	for(int w = 0; w < 2; w++) {
+		for(int i = 0; i < a->mem_props.memoryTypeCount; i++) {
+			if((type_bits & (1u << i)) && (a->mem_props.memoryTypes[i].propertyFlags & wanted[w]) == wanted[w]) {
+				return i;
+			}
+		}
+	}
+	return -1;
+} // gpu_alloc_find_memory_type
+
+static inline VkResult
+gpu_alloc__new_memory(gpu_allocator_t* a, int type, VkDeviceSize size, VkDeviceMemory* memory, void** mapped) {
+	if(a->max_memory_objects && a->memory_objects >= a->max_memory_objects) {
+		return VK_ERROR_TOO_MANY_OBJECTS;
+	}
+
+	VkMemoryAllocateInfo alloc_info = {0};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = size;
+	alloc_info.memoryTypeIndex = type;
+
+	VkResult res = vkAllocateMemory(a->device, &alloc_info, NULL, memory);
+	if(res != VK_SUCCESS) return res;
+
+	*mapped = NULL;
+	if(a->mem_props.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		res = vkMapMemory(a->device, *memory, 0, VK_WHOLE_SIZE, 0, mapped);
+		if(res != VK_SUCCESS) {
+			vkFreeMemory(a->device, *memory, NULL);
+			return res;
+		}
+	}
+
+	a->memory_objects++;
+	return VK_SUCCESS;
+} // gpu_alloc__new_memory
+
+// Allocates memory for a resource with the given requirements from memory type `type`.
+static inline VkResult
+gpu_alloc(gpu_allocator_t* a, const VkMemoryRequirements* reqs, int type, gpu_resource_kind_t kind, gpu_allocation_t* out) {
+	memset(out, 0, sizeof(*out));
+	if(type < 0 || type >= a->mem_props.memoryTypeCount || !(reqs->memoryTypeBits & (1u << type))) {
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	out->pool = type * GPU_RESOURCE_KIND_COUNT + kind;
+	out->size = reqs->size;
+	gpu_pool_t* pool = &a->pools[out->pool];
+
+	// Nodes are aligned to their size, so asking for at least `alignment` bytes takes care of alignment.
+	VkDeviceSize node_size = reqs->size > reqs->alignment ? reqs->size : reqs->alignment;
+
+	if(node_size > pool->block_size / 2) {
+		out->block = -1;
+		out->offset = 0;
+		VkResult res = gpu_alloc__new_memory(a, type, reqs->size, &out->memory, &out->mapped);
+		if(res != VK_SUCCESS) return res;
+		pool->dedicated_bytes += reqs->size;
+		pool->dedicated_count++;
+		return VK_SUCCESS;
+	}
+
+	const int level = gpu_alloc__level_for_size(pool, node_size);
+
+	// Find a block with a free node at this level or above (bigger), closest level first.
+	int block_idx = -1;
+	int found_level = -1;
+	for(int b = 0; b < pool->blocks_count && block_idx < 0; b++) {
+		for(int l = level; l >= 0; l--) {
+			if(pool->blocks[b].free_count[l]) {
+				block_idx = b;
+				found_level = l;
+				break;
+			}
+		}
+	}
+
+	if(block_idx < 0) {
+		gpu_block_t block = {0};
+		VkResult res = gpu_alloc__new_memory(a, type, pool->block_size, &block.memory, &block.mapped);
+		if(res != VK_SUCCESS) return res;
+
+		const unsigned long long nodes = (1ull << pool->levels) - 1;
+		block.free_bits = calloc((nodes + 63) / 64, sizeof(unsigned long long));
+		block.free_count = calloc(pool->levels, sizeof(unsigned int));
+		gpu_alloc__set_free(&block, 0, 0);
+
+		pool->blocks = realloc(pool->blocks, (pool->blocks_count + 1) * sizeof(gpu_block_t));
+		pool->blocks[pool->blocks_count] = block;
+		block_idx = pool->blocks_count++;
+		found_level = 0;
+	}
+
+	gpu_block_t* block = &pool->blocks[block_idx];
+	unsigned long long node = gpu_alloc__find_free(block, found_level);
+	gpu_alloc__set_used(block, found_level, node);
+
+	// Split down to the wanted level, the right halves become free.
+	for(int l = found_level; l < level; l++) {
+		node *= 2;
+		gpu_alloc__set_free(block, l + 1, node + 1);
+	}
+
+	out->memory = block->memory;
+	out->offset = node * (pool->block_size >> level);
+	out->mapped = block->mapped ? (char*)block->mapped + out->offset : NULL;
+	out->block = block_idx;
+	out->level = level;
+
+	block->used += reqs->size;
+	block->allocated += pool->block_size >> level;
+	block->allocations++;
+	return VK_SUCCESS;
+} // gpu_alloc
+
+static inline void
+gpu_free(gpu_allocator_t* a, gpu_allocation_t* alloc) {
+	if(alloc->memory == VK_NULL_HANDLE) return;
+	gpu_pool_t* pool = &a->pools[alloc->pool];
+
+	if(alloc->block < 0) {
+		vkFreeMemory(a->device, alloc->memory, NULL); // also unmaps
+		a->memory_objects--;
+		pool->dedicated_bytes -= alloc->size;
+		pool->dedicated_count--;
+		memset(alloc, 0, sizeof(*alloc));
+		return;
+	}
+
+	gpu_block_t* block = &pool->blocks[alloc->block];
+	int level = alloc->level;
+	unsigned long long node = alloc->offset / (pool->block_size >> level);
+
+	block->used -= alloc->size;
+	block->allocated -= pool->block_size >> level;
+	block->allocations--;
+
+	// Merge with the buddy for as long as it is free too.
+	while(level > 0) {
+		const unsigned long long buddy = node ^ 1;
+		if(!gpu_alloc__test(block, gpu_alloc__level_first(level) + buddy)) break;
+		gpu_alloc__set_used(block, level, buddy);
+		node >>= 1;
+		level--;
+	}
+	gpu_alloc__set_free(block, level, node);
+
+	// Blocks are kept around once created (they're few and big), so that
+	// alloc/free patterns don't keep hitting vkAllocateMemory().
+	memset(alloc, 0, sizeof(*alloc));
+} // gpu_free
+
+
+
+// Creates a buffer and binds memory to it.
+static inline VkResult
+gpu_alloc_create_buffer(gpu_allocator_t* a, const VkBufferCreateInfo* info, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, VkBuffer* buffer, gpu_allocation_t* alloc) {
+	VkResult res = vkCreateBuffer(a->device, info, NULL, buffer);
+	if(res != VK_SUCCESS) return res;
+
+	VkMemoryRequirements reqs;
+	vkGetBufferMemoryRequirements(a->device, *buffer, &reqs);
+
+	const int type = gpu_alloc_find_memory_type(a, reqs.memoryTypeBits, required, preferred);
+	res = gpu_alloc(a, &reqs, type, GPU_RESOURCE_LINEAR, alloc);
+	if(res == VK_SUCCESS) res = vkBindBufferMemory(a->device, *buffer, alloc->memory, alloc->offset);
+
+	if(res != VK_SUCCESS) {
+		gpu_free(a, alloc);
+		vkDestroyBuffer(a->device, *buffer, NULL);
+		*buffer = VK_NULL_HANDLE;
+	}
+	return res;
+} // gpu_alloc_create_buffer
+
+// Creates an image and binds memory to it.
+static inline VkResult
+gpu_alloc_create_image(gpu_allocator_t* a, const VkImageCreateInfo* info, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, VkImage* image, gpu_allocation_t* alloc) {
+	VkResult res = vkCreateImage(a->device, info, NULL, image);
+	if(res != VK_SUCCESS) return res;
+
+	VkMemoryRequirements reqs;
+	vkGetImageMemoryRequirements(a->device, *image, &reqs);
+
+	const int type = gpu_alloc_find_memory_type(a, reqs.memoryTypeBits, required, preferred);
+	const gpu_resource_kind_t kind = info->tiling == VK_IMAGE_TILING_OPTIMAL ? GPU_RESOURCE_OPTIMAL : GPU_RESOURCE_LINEAR;
+	res = gpu_alloc(a, &reqs, type, kind, alloc);
+	if(res == VK_SUCCESS) res = vkBindImageMemory(a->device, *image, alloc->memory, alloc->offset);
+
+	if(res != VK_SUCCESS) {
+		gpu_free(a, alloc);
+		vkDestroyImage(a->device, *image, NULL);
+		*image = VK_NULL_HANDLE;
+	}
+	return res;
+} // gpu_alloc_create_image
+
+static inline void
+gpu_destroy_buffer(gpu_allocator_t* a, VkBuffer buffer, gpu_allocation_t* alloc) {
+	vkDestroyBuffer(a->device, buffer, NULL);
+	gpu_free(a, alloc);
+} // gpu_destroy_buffer
+
+static inline void
+gpu_destroy_image(gpu_allocator_t* a, VkImage image, gpu_allocation_t* alloc) {
+	vkDestroyImage(a->device, image, NULL);
+	gpu_free(a, alloc);
+} // gpu_destroy_image
+
+
+
+static inline gpu_alloc_stats_t
+gpu_alloc_pool_stats(const gpu_pool_t* pool) {
+	gpu_alloc_stats_t stats = {0};
+	stats.committed = pool->dedicated_bytes;
+	stats.used = pool->dedicated_bytes;
+	stats.allocated = pool->dedicated_bytes;
+	stats.memory_objects = pool->dedicated_count;
+	stats.allocations = pool->dedicated_count;
+
+	for(int b = 0; b < pool->blocks_count; b++) {
+		const gpu_block_t* block = &pool->blocks[b];
+		stats.committed += pool->block_size;
+		stats.used += block->used;
+		stats.allocated += block->allocated;
+		stats.free += pool->block_size - block->allocated;
+		stats.memory_objects++;
+		stats.allocations += block->allocations;
+
+		for(int l = 0; l < pool->levels; l++) {
+			if(block->free_count[l]) {
+				if((pool->block_size >> l) > stats.largest_free) stats.largest_free = pool->block_size >> l;
+				stats.contiguous_free += pool->block_size >> l;
+				break;
+			}
+		}
+	}
+	return stats;
+} // gpu_alloc_pool_stats
+
+static inline gpu_alloc_stats_t
+gpu_alloc_total_stats(const gpu_allocator_t* a) {
+	gpu_alloc_stats_t total = {0};
+	for(int p = 0; p < a->mem_props.memoryTypeCount * GPU_RESOURCE_KIND_COUNT; p++) {
+		const gpu_alloc_stats_t s = gpu_alloc_pool_stats(&a->pools[p]);
+		total.committed += s.committed;
+		total.used += s.used;
+		total.allocated += s.allocated;
+		total.free += s.free;
+		total.contiguous_free += s.contiguous_free;
+		total.memory_objects += s.memory_objects;
+		total.allocations += s.allocations;
+		if(s.largest_free > total.largest_free) total.largest_free = s.largest_free;
+	}
+	return total;
+} // gpu_alloc_total_stats
+
+// Prints used/committed bytes and fragmentation per pool and in total.
+// internal fragmentation: bytes lost to rounding allocations up to buddy nodes.
+// external fragmentation: how much of the free space in each block is NOT in that block's biggest free node.
+static inline void
+gpu_alloc_print_stats(const gpu_allocator_t* a) {
+	printf("gpu memory: %d memory objects (limit %u), buffer/image granularity %llu\n",
+		a->memory_objects, a->max_memory_objects, (unsigned long long)a->buffer_image_granularity);
+
+	for(int p = 0; p < a->mem_props.memoryTypeCount * GPU_RESOURCE_KIND_COUNT; p++) {
+		const gpu_pool_t* pool = &a->pools[p];
+		if(!pool->blocks_count && !pool->dedicated_count) continue;
+
+		const gpu_alloc_stats_t s = gpu_alloc_pool_stats(pool);
+		const double internal = s.allocated ? 1.0 - (double)s.used / (double)s.allocated : 0.0;
+		const double external = s.free ? 1.0 - (double)s.contiguous_free / (double)s.free : 0.0;
+		printf("  type %2d %-7s: %d allocations, %d blocks of %llu KB + %d dedicated, used %llu / committed %llu bytes, fragmentation internal %.1f%% external %.1f%%\n",
+			p / GPU_RESOURCE_KIND_COUNT, (p % GPU_RESOURCE_KIND_COUNT) == GPU_RESOURCE_LINEAR ? "linear" : "optimal",
+			s.allocations, pool->blocks_count, (unsigned long long)(pool->block_size >> 10), pool->dedicated_count,
+			(unsigned long long)s.used, (unsigned long long)s.committed, internal * 100.0, external * 100.0);
+	}
+
+	const gpu_alloc_stats_t t = gpu_alloc_total_stats(a);
+	printf("  total: %d allocations, used %llu / committed %llu bytes\n",
+		t.allocations, (unsigned long long)t.used, (unsigned long long)t.committed);
+} // gpu_alloc_print_stats
+
+static inline void
+gpu_alloc_deinit(gpu_allocator_t* a) {
+	for(int p = 0; p < VK_MAX_MEMORY_TYPES * GPU_RESOURCE_KIND_COUNT; p++) {
+		gpu_pool_t* pool = &a->pools[p];
+		for(int b = 0; b < pool->blocks_count; b++) {
+			vkFreeMemory(a->device, pool->blocks[b].memory, NULL);
+			free(pool->blocks[b].free_bits);
+			free(pool->blocks[b].free_count);
+		}
+		free(pool->blocks);
+		pool->blocks = NULL;
+		pool->blocks_count = 0;
+	}
+	a->memory_objects = 0;
+} // gpu_alloc_deinit
@@ -0,0 +1,391 @@
+#pragma once
+
+// Frustum culling on the GPU.
+//
+// A compute pass (cull.comp) tests every instance's bounding sphere against the planes of the frame's projection * view,
+// and writes a VkDrawIndexedIndirectCommand for each visible one. The scene pass then draws all of them with a single
+// indirect call, so what the CPU records doesn't depend on the number of objects, or on which of them are visible.
+// - With vkCmdDrawIndexedIndirectCount (VK_KHR_draw_indirect_count) the visible commands are packed to the front and
+//   counted, and the draw reads the count. Otherwise every object keeps its own command, with instanceCount 0 when culled.
+// - Commands and counts have one region per frame in flight (or swapchain image), like the uniform ring, so nothing
+//   the compute pass writes is still being read by an older frame. The counts are host visible: the number of visible
+//   objects is read back the next time the region comes around, after its fence has been waited on, like the GPU timings.
+// With meshlets (--cull meshlets, meshlet.h) every object's meshlets are tested instead, each against the frustum and its normal cone:
+// - GPU_CULL_MESHLETS: meshlet_cull.comp writes a command per visible meshlet of every object, drawing its range of the index buffer
+//   with the same graphics pipeline. Commands are per object and meshlet, so there are objects * meshlets of them.
+// - GPU_CULL_MESH_TASKS (VK_EXT_mesh_shader): no compute pass and no commands. meshlet.task tests the meshlets of one object,
+//   32 per workgroup, and launches meshlet.mesh for the visible ones, which reads the meshlet's vertices and triangles itself.
+//   The application creates the graphics pipeline with this pass's layout, the descriptors are bound by gpu_cull_draw().
+// With a level of detail chain (--lod, mesh_lod.h) cull.comp also picks each visible object's level, from its distance and the
+// frame's projection, and its command draws that level's range of the index buffer. The triangles drawn are counted next to the
+// visible objects. The levels go into the push constants, so there are at most GPU_CULL_MAX_LODS.
+// All functions accept a NULL cull and do nothing, so the recording code doesn't need to check.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu_alloc.h"
+
+
+
+#define GPU_CULL_MAX_REGIONS	8	// >= MAX_FRAMES_IN_FLIGHT and the number of swapchain images
+#define GPU_CULL_GROUP_SIZE	64	// local_size_x of cull.comp and meshlet_cull.comp
+#define GPU_CULL_TASK_GROUP_SIZE 32	// local_size_x of meshlet.task
+#define GPU_CULL_MAX_COMMANDS	(1 << 22) // per region, 80 MB of commands
+#define GPU_CULL_BINDINGS	8
+#define GPU_CULL_MAX_LODS	6	// MESH_LOD_MAX
+
+typedef enum gpu_cull_mode_t {
+	GPU_CULL_OBJECTS,	// cull.comp, a command per object
+	GPU_CULL_MESHLETS,	// meshlet_cull.comp, a command per meshlet of every object
+	GPU_CULL_MESH_TASKS,	// meshlet.task in the scene pass, no commands
+} gpu_cull_mode_t;
+
+// Push constants of cull.comp, meshlet_cull.comp and meshlet.task.
+typedef struct gpu_cull_push_t {
+	unsigned int	objects_count;
+	unsigned int	index_count;
+	unsigned int	compact;	// pack the visible commands and count them
+	unsigned int	meshlets_count;
+	float		sphere[4];	// bounds of the mesh: center, radius
+	unsigned int	lods_count;	// 0 = no LOD selection, index_count from index 0
+	unsigned int	lod_first_index[GPU_CULL_MAX_LODS];
+	unsigned int	lod_index_count[GPU_CULL_MAX_LODS];
+	float		lod_error[GPU_CULL_MAX_LODS]; // of the fitted mesh, see mesh_lod_select()
+} gpu_cull_push_t;
+
+typedef struct gpu_cull_info_t {
+	VkDevice		device;
+	gpu_allocator_t*	allocator;
+	VkPipelineCache		pipeline_cache;
+	gpu_cull_mode_t		mode;
+	const void*		spirv;		// cull.comp or meshlet_cull.comp, unused with GPU_CULL_MESH_TASKS
+	size_t			spirv_size;
+	VkDeviceSize		storage_alignment; // minStorageBufferOffsetAlignment
+	int			regions_count;
+	int			objects_count;
+	unsigned int		index_count;	// of the mesh every object draws
+	float			sphere[4];	// bounds of the mesh: center, radius
+	// frame constants (projection and view) and per-instance data, one region of each per frame
+	VkBuffer		frame_buffer;
+	VkDeviceSize		frame_size;
+	VkBuffer		instance_buffer;
+	VkDeviceSize		instance_region_size; // a multiple of storage_alignment
+	PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count; // NULL = one command per object
+	// GPU_CULL_OBJECTS: the level of detail chain, 0 = none. The frame constants carry the selection factor
+	int			lods_count;
+	unsigned int		lod_first_index[GPU_CULL_MAX_LODS];
+	unsigned int		lod_index_count[GPU_CULL_MAX_LODS];
+	float			lod_error[GPU_CULL_MAX_LODS];
+	// meshlet modes: meshlet_t with the bounds of the fitted mesh
+	int			meshlets_count;
+	VkBuffer		meshlets;
+	// GPU_CULL_MESH_TASKS: meshlets_t.vertices and triangles, and a meshlet_vertex_t per mesh vertex
+	VkBuffer		meshlet_vertices;
+	VkBuffer		meshlet_triangles;
+	VkBuffer		vertices;
+	PFN_vkCmdDrawMeshTasksEXT draw_mesh_tasks;
+} gpu_cull_info_t;
+
+typedef struct gpu_cull_stats_t {
+	unsigned long long	frames;		// read back
+	unsigned long long	tested;
+	unsigned long long	visible;
+	unsigned long long	triangles;	// drawn, with a level of detail chain
+} gpu_cull_stats_t;
+
+typedef struct gpu_cull_t {
+	VkDevice		device;
+	gpu_allocator_t*	allocator;
+	gpu_cull_mode_t		mode;
+	VkShaderStageFlags	stages;		// compute, or task and mesh
+	VkDescriptorSetLayout	ds_layout;
+	VkPipelineLayout	layout;		// the graphics pipeline's with GPU_CULL_MESH_TASKS
+	VkPipeline		pipeline;	// VK_NULL_HANDLE with GPU_CULL_MESH_TASKS
+	VkDescriptorPool	ds_pool;
+	VkDescriptorSet		desc_set;
+
+	VkBuffer		commands;	// device local, VkDrawIndexedIndirectCommand per object (and meshlet)
+	gpu_allocation_t	commands_memory;
+	VkDeviceSize		commands_region_size;
+	unsigned int		commands_count;	// per region. Also what's tested with GPU_CULL_MESH_TASKS, which has no commands
+	VkBuffer		counts;		// host visible, the visible count and the triangles drawn per region
+	gpu_allocation_t	counts_memory;
+	VkDeviceSize		counts_region_size;
+	VkDeviceSize		instance_region_size;
+	int			regions_count;
+	int			submitted[GPU_CULL_MAX_REGIONS]; // the region's count is written and not read back yet
+
+	gpu_cull_push_t		push;
+	PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count;
+	PFN_vkCmdDrawMeshTasksEXT draw_mesh_tasks;
+	gpu_cull_stats_t	stats;
+} gpu_cull_t;
+
+
+
+static inline void gpu_cull_deinit(gpu_cull_t* cull);
+
+static inline VkResult
+gpu_cull_init(gpu_cull_t* cull, const gpu_cull_info_t* info) {
+	memset(cull, 0, sizeof(*cull));
+	if(info->regions_count > GPU_CULL_MAX_REGIONS) return VK_ERROR_INITIALIZATION_FAILED;
+	cull->device = info->device;
+	cull->allocator = info->allocator;
+	cull->mode = info->mode;
+	cull->stages = info->mode == GPU_CULL_MESH_TASKS ? VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT : VK_SHADER_STAGE_COMPUTE_BIT;
+	cull->regions_count = info->regions_count;
+	cull->instance_region_size = info->instance_region_size;
+	cull->draw_indexed_indirect_count = info->mode == GPU_CULL_MESH_TASKS ? NULL : info->draw_indexed_indirect_count;
+	cull->draw_mesh_tasks = info->draw_mesh_tasks;
+	cull->commands_count = (unsigned int)info->objects_count * (info->mode == GPU_CULL_OBJECTS ? 1u : (unsigned int)info->meshlets_count);
+	cull->push.objects_count = (unsigned int)info->objects_count;
+	cull->push.index_count = info->index_count;
+	cull->push.compact = cull->draw_indexed_indirect_count != NULL;
+	cull->push.meshlets_count = info->mode == GPU_CULL_OBJECTS ? 0 : (unsigned int)info->meshlets_count;
+	memcpy(cull->push.sphere, info->sphere, sizeof(cull->push.sphere));
+	if(info->mode == GPU_CULL_OBJECTS && info->lods_count > 0) {
+		if(info->lods_count > GPU_CULL_MAX_LODS) return VK_ERROR_INITIALIZATION_FAILED;
+		cull->push.lods_count = (unsigned int)info->lods_count;
+		memcpy(cull->push.lod_first_index, info->lod_first_index, sizeof(cull->push.lod_first_index));
+		memcpy(cull->push.lod_index_count, info->lod_index_count, sizeof(cull->push.lod_index_count));
+		memcpy(cull->push.lod_error, info->lod_error, sizeof(cull->push.lod_error));
+	}
+
+	const VkDeviceSize align = info->storage_alignment;
+	cull->commands_region_size = (sizeof(VkDrawIndexedIndirectCommand) * cull->commands_count + align - 1) / align * align;
+	cull->counts_region_size = (2 * sizeof(unsigned int) + align - 1) / align * align;
+
+	VkBufferCreateInfo buf_info = {0};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	VkResult res;
+	if(info->mode != GPU_CULL_MESH_TASKS) {
+		buf_info.size = cull->commands_region_size * info->regions_count;
+		buf_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+		res = gpu_alloc_create_buffer(info->allocator, &buf_info, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &cull->commands, &cull->commands_memory);
+		if(res != VK_SUCCESS) goto fail;
+	}
+
+	// cleared with vkCmdFillBuffer() before every pass
+	buf_info.size = cull->counts_region_size * info->regions_count;
+	buf_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	res = gpu_alloc_create_buffer(info->allocator, &buf_info, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0,
+		&cull->counts, &cull->counts_memory);
+	if(res != VK_SUCCESS) goto fail;
+
+	// Frame constants, instances, commands, count: dynamic, the region is picked when binding.
+	// Then the meshlets, and the meshlet vertices, triangles and vertices for the mesh shaders. Each mode uses some of them.
+	const VkDescriptorBufferInfo buffers[GPU_CULL_BINDINGS] = {
+		{info->frame_buffer, 0, info->frame_size},
+		{info->instance_buffer, 0, info->instance_region_size},
+		{cull->commands, 0, cull->commands_region_size},
+		{cull->counts, 0, 2 * sizeof(unsigned int)},
+		{info->meshlets, 0, VK_WHOLE_SIZE},
+		{info->meshlet_vertices, 0, VK_WHOLE_SIZE},
+		{info->meshlet_triangles, 0, VK_WHOLE_SIZE},
+		{info->vertices, 0, VK_WHOLE_SIZE},
+	};
+	const int last_binding = info->mode == GPU_CULL_OBJECTS ? 3 : info->mode == GPU_CULL_MESHLETS ? 4 : 7;
+	VkDescriptorSetLayoutBinding ds_bind[GPU_CULL_BINDINGS] = {0};
+	VkDescriptorBufferInfo buffer_info[GPU_CULL_BINDINGS];
+	int bindings = 0, dynamic_storage = 0, storage = 0;
+	for(int i = 0; i <= last_binding; i++) {
+		if(i == 2 && info->mode == GPU_CULL_MESH_TASKS) continue;
+		ds_bind[bindings].binding = i;
+		ds_bind[bindings].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC :
+			i < 4 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		ds_bind[bindings].descriptorCount = 1;
+		ds_bind[bindings].stageFlags = cull->stages;
+		buffer_info[bindings] = buffers[i];
+		if(i > 0) *(i < 4 ? &dynamic_storage : &storage) += 1;
+		bindings++;
+	}
+	VkDescriptorSetLayoutCreateInfo ds_info = {0};
+	ds_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	ds_info.bindingCount = bindings;
+	ds_info.pBindings = ds_bind;
+	res = vkCreateDescriptorSetLayout(info->device, &ds_info, NULL, &cull->ds_layout);
+	if(res != VK_SUCCESS) goto fail;
+
+	VkPushConstantRange push_range = {0};
+	push_range.stageFlags = cull->stages;
+	push_range.size = sizeof(gpu_cull_push_t);
+	VkPipelineLayoutCreateInfo pl_info = {0};
+	pl_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pl_info.setLayoutCount = 1;
+	pl_info.pSetLayouts = &cull->ds_layout;
+	pl_info.pushConstantRangeCount = 1;
+	pl_info.pPushConstantRanges = &push_range;
+	res = vkCreatePipelineLayout(info->device, &pl_info, NULL, &cull->layout);
+	if(res != VK_SUCCESS) goto fail;
+
+	if(info->mode != GPU_CULL_MESH_TASKS) {
+		VkShaderModuleCreateInfo mod_info = {0};
+		mod_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		mod_info.codeSize = info->spirv_size;
+		mod_info.pCode = info->spirv;
+		VkShaderModule module;
+		res = vkCreateShaderModule(info->device, &mod_info, NULL, &module);
+		if(res != VK_SUCCESS) goto fail;
+
+		VkComputePipelineCreateInfo pipe_info = {0};
+		pipe_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipe_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipe_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipe_info.stage.module = module;
+		pipe_info.stage.pName = "main";
+		pipe_info.layout = cull->layout;
+		res = vkCreateComputePipelines(info->device, info->pipeline_cache, 1, &pipe_info, NULL, &cull->pipeline);
+		vkDestroyShaderModule(info->device, module, NULL);
+		if(res != VK_SUCCESS) goto fail;
+	}
+
+	VkDescriptorPoolSize ps_info[3] = {0};
+	ps_info[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	ps_info[0].descriptorCount = 1;
+	ps_info[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	ps_info[1].descriptorCount = dynamic_storage;
+	ps_info[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	ps_info[2].descriptorCount = storage;
+	VkDescriptorPoolCreateInfo pool_info = {0};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.maxSets = 1;
+	pool_info.poolSizeCount = storage ? 3 : 2;
+	pool_info.pPoolSizes = ps_info;
+	res = vkCreateDescriptorPool(info->device, &pool_info, NULL, &cull->ds_pool);
+	if(res != VK_SUCCESS) goto fail;
+
+	VkDescriptorSetAllocateInfo alloc_info = {0};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = cull->ds_pool;
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &cull->ds_layout;
+	res = vkAllocateDescriptorSets(info->device, &alloc_info, &cull->desc_set);
+	if(res != VK_SUCCESS) goto fail;
+
+	VkWriteDescriptorSet write_info[GPU_CULL_BINDINGS] = {0};
+	for(int i = 0; i < bindings; i++) {
+		write_info[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write_info[i].dstSet = cull->desc_set;
+		write_info[i].dstBinding = ds_bind[i].binding;
+		write_info[i].descriptorCount = 1;
+		write_info[i].descriptorType = ds_bind[i].descriptorType;
+		write_info[i].pBufferInfo = &buffer_info[i];
+	}
+	vkUpdateDescriptorSets(info->device, bindings, write_info, 0, NULL);
+	return VK_SUCCESS;
+
+fail:
+	gpu_cull_deinit(cull);
+	return res;
+} // gpu_cull_init
+
+static inline void
+gpu_cull_deinit(gpu_cull_t* cull) {
+	if(!cull || !cull->device) return;
+	if(cull->ds_pool) vkDestroyDescriptorPool(cull->device, cull->ds_pool, NULL);
+	if(cull->pipeline) vkDestroyPipeline(cull->device, cull->pipeline, NULL);
+	if(cull->layout) vkDestroyPipelineLayout(cull->device, cull->layout, NULL);
+	if(cull->ds_layout) vkDestroyDescriptorSetLayout(cull->device, cull->ds_layout, NULL);
+	if(cull->commands) gpu_destroy_buffer(cull->allocator, cull->commands, &cull->commands_memory);
+	if(cull->counts) gpu_destroy_buffer(cull->allocator, cull->counts, &cull->counts_memory);
+	memset(cull, 0, sizeof(*cull));
+} // gpu_cull_deinit
+
+// Records the cull pass for `region`, reading the frame constants at frame_offset in the frame buffer.
+// Goes outside of a render pass, before the draws that use its commands. With GPU_CULL_MESH_TASKS it only clears the count.
+static inline void
+gpu_cull_dispatch(gpu_cull_t* cull, VkCommandBuffer cmd, int region, unsigned int frame_offset) {
+	if(!cull) return;
+	const VkDeviceSize count_offset = region * cull->counts_region_size;
+	vkCmdFillBuffer(cmd, cull->counts, count_offset, 2 * sizeof(unsigned int), 0);
+
+	// the cleared count before the shader's atomics
+	const VkPipelineStageFlags stage = cull->mode == GPU_CULL_MESH_TASKS ? VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	VkMemoryBarrier barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, stage, 0, 1, &barrier, 0, NULL, 0, NULL);
+	if(cull->mode == GPU_CULL_MESH_TASKS) return;
+
+	const unsigned int dyn_offsets[4] = {
+		frame_offset,
+		(unsigned int)(region * cull->instance_region_size),
+		(unsigned int)(region * cull->commands_region_size),
+		(unsigned int)count_offset,
+	};
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull->pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull->layout, 0, 1, &cull->desc_set, 4, dyn_offsets);
+	vkCmdPushConstants(cmd, cull->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(gpu_cull_push_t), &cull->push);
+	if(cull->mode == GPU_CULL_MESHLETS) {
+		// a row of workgroups over the meshlets per object
+		vkCmdDispatch(cmd, (cull->push.meshlets_count + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, cull->push.objects_count, 1);
+	} else {
+		vkCmdDispatch(cmd, (cull->push.objects_count + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+	}
+
+	// the commands and count before the indirect draw, and the count before it's read back
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &barrier, 0, NULL, 0, NULL);
+} // gpu_cull_dispatch
+
+// Draws the visible objects of `region` inside the scene pass, with the pipeline, buffers and descriptors already bound.
+// The commands' firstInstance is the object, so the instance data is read from where it is for every object.
+// With GPU_CULL_MESH_TASKS only the pipeline is bound: this binds the pass's descriptors, with the frame constants at frame_offset,
+// and launches a row of task workgroups over the meshlets per object.
+static inline void
+gpu_cull_draw(const gpu_cull_t* cull, VkCommandBuffer cmd, int region, unsigned int frame_offset) {
+	if(!cull) return;
+	if(cull->mode == GPU_CULL_MESH_TASKS) {
+		const unsigned int dyn_offsets[3] = {
+			frame_offset,
+			(unsigned int)(region * cull->instance_region_size),
+			(unsigned int)(region * cull->counts_region_size),
+		};
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, cull->layout, 0, 1, &cull->desc_set, 3, dyn_offsets);
+		vkCmdPushConstants(cmd, cull->layout, cull->stages, 0, sizeof(gpu_cull_push_t), &cull->push);
+		cull->draw_mesh_tasks(cmd, (cull->push.meshlets_count + GPU_CULL_TASK_GROUP_SIZE - 1) / GPU_CULL_TASK_GROUP_SIZE, cull->push.objects_count, 1);
+		return;
+	}
+	const VkDeviceSize offset = region * cull->commands_region_size;
+	const unsigned int stride = sizeof(VkDrawIndexedIndirectCommand);
+	if(cull->draw_indexed_indirect_count) {
+		cull->draw_indexed_indirect_count(cmd, cull->commands, offset, cull->counts, region * cull->counts_region_size,
+			cull->commands_count, stride);
+	} else {
+		vkCmdDrawIndexedIndirect(cmd, cull->commands, offset, cull->commands_count, stride);
+	}
+} // gpu_cull_draw
+
+// Goes after the scene pass: with GPU_CULL_MESH_TASKS, the task shaders' count before it's read back.
+static inline void
+gpu_cull_end(const gpu_cull_t* cull, VkCommandBuffer cmd) {
+	if(!cull || cull->mode != GPU_CULL_MESH_TASKS) return;
+	VkMemoryBarrier barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+} // gpu_cull_end
+
+// Marks the region's pass as submitted, its count is read back by the next gpu_cull_collect().
+static inline void
+gpu_cull_submitted(gpu_cull_t* cull, int region) {
+	if(!cull) return;
+	cull->submitted[region] = 1;
+} // gpu_cull_submitted
+
+// Adds the region's visible count and triangles from its last submission to the stats. Only call once the region's fence has signalled.
+static inline void
+gpu_cull_collect(gpu_cull_t* cull, int region) {
+	if(!cull || !cull->submitted[region]) return;
+	cull->submitted[region] = 0;
+	const unsigned int* count = (const unsigned int*)((const char*)cull->counts_memory.mapped + region * cull->counts_region_size);
+	cull->stats.frames++;
+	cull->stats.tested += cull->commands_count;
+	cull->stats.visible += count[0];
+	cull->stats.triangles += count[1];
+} // gpu_cull_collect
@@ -0,0 +1,318 @@
+#pragma once
+
+// GPU timings from timestamp queries.
+//
+// Every slot (a frame in flight, or a swapchain image when command buffers are prerecorded) has its own query pool.
+// Zones are pairs of timestamps written around a pass or a group of draws. The pool is reset at the start of
+// the slot's command buffer, and read back the next time the slot comes around, after its fence has been waited on,
+// so reading the results never stalls. Each zone keeps a rolling window of samples for min/avg/p99.
+// All functions accept a NULL profiler and do nothing, so the recording code doesn't need to check.
+// The last resolved zones are also kept as events, which gpu_profiler_calibrate() lets us put on the CPU clock for traces.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+
+
+
+#define GPU_PROFILER_MAX_SLOTS	8	// >= MAX_FRAMES_IN_FLIGHT and the number of swapchain images
+#define GPU_PROFILER_MAX_ZONES	32	// per slot, two queries each
+#define GPU_PROFILER_HISTORY	256	// samples kept per zone for the rolling stats
+#define GPU_PROFILER_EVENTS	8192	// resolved zones kept for traces
+
+typedef struct gpu_zone_t {
+	const char*	name;
+	int		index;	// e.g. the recording thread, -1 = none
+} gpu_zone_t;
+
+typedef struct gpu_profiler_slot_t {
+	VkQueryPool	pool;
+	gpu_zone_t	zones[GPU_PROFILER_MAX_ZONES];
+	int		zones_count;
+	int		submitted; // the queries have been submitted and not read back yet
+} gpu_profiler_slot_t;
+
+typedef struct gpu_zone_stats_t {
+	gpu_zone_t	zone;
+	float		samples[GPU_PROFILER_HISTORY]; // ms, ring buffer
+	int		samples_count;
+	int		next;
+	unsigned long long total_samples;
+} gpu_zone_stats_t;
+
+// A resolved zone, in GPU ticks.
+typedef struct gpu_event_t {
+	int			stats_index;	// which zone, in gpu_profiler_t::stats
+	unsigned long long	begin;
+	unsigned long long	end;
+} gpu_event_t;
+
+typedef struct gpu_profiler_t {
+	VkDevice		device;
+	double			ns_per_tick;	// VkPhysicalDeviceLimits::timestampPeriod
+	unsigned long long	tick_mask;	// timestampValidBits of the queue family
+	gpu_profiler_slot_t	slots[GPU_PROFILER_MAX_SLOTS];
+	int			slots_count;
+	int			current;	// slot being recorded
+
+	gpu_zone_stats_t	stats[GPU_PROFILER_MAX_ZONES];
+	int			stats_count;
+	unsigned long long	lost;		// zones whose results weren't available when read back
+
+	gpu_event_t		events[GPU_PROFILER_EVENTS]; // ring buffer
+	unsigned long long	events_count;	// total written
+
+	int			calibrated;
+	long long		cpu_offset_ns;	// time_now_ns() = ticks * ns_per_tick + cpu_offset_ns
+} gpu_profiler_t;
+
+
+
+// Returns VK_ERROR_FEATURE_NOT_PRESENT when the queue family doesn't support timestamps (valid_bits == 0).
+static inline VkResult
+gpu_profiler_init(gpu_profiler_t* prof, VkDevice device, float timestamp_period, unsigned int valid_bits, int slots_count) {
+	memset(prof, 0, sizeof(*prof));
+	if(valid_bits == 0) return VK_ERROR_FEATURE_NOT_PRESENT;
+	if(slots_count > GPU_PROFILER_MAX_SLOTS) return VK_ERROR_INITIALIZATION_FAILED;
+
+	prof->device = device;
+	prof->ns_per_tick = timestamp_period;
+	prof->tick_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+	prof->slots_count = slots_count;
+
+	VkQueryPoolCreateInfo pool_info = {0};
+	pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	pool_info.queryCount = GPU_PROFILER_MAX_ZONES * 2;
+
+	for(int i = 0; i < slots_count; i++) {
+		VkResult res = vkCreateQueryPool(device, &pool_info, NULL, &prof->slots[i].pool);
+		if(res != VK_SUCCESS) return res;
+	}
+	return VK_SUCCESS;
+} // gpu_profiler_init
+
+static inline void
+gpu_profiler_deinit(gpu_profiler_t* prof) {
+	if(!prof) return;
+	for(int i = 0; i < prof->slots_count; i++) {
+		if(prof->slots[i].pool != VK_NULL_HANDLE) vkDestroyQueryPool(prof->device, prof->slots[i].pool, NULL);
+	}
+	memset(prof, 0, sizeof(*prof));
+} // gpu_profiler_deinit
+
+static inline gpu_zone_stats_t*
+gpu_profiler__stats(gpu_profiler_t* prof, const gpu_zone_t* zone) {
+	for(int i = 0; i < prof->stats_count; i++) {
+		if(prof->stats[i].zone.index == zone->index && strcmp(prof->stats[i].zone.name, zone->name) == 0) return &prof->stats[i];
+	}
+	if(prof->stats_count == GPU_PROFILER_MAX_ZONES) return NULL;
+	gpu_zone_stats_t* stats = &prof->stats[prof->stats_count++];
+	stats->zone = *zone;
+	return stats;
+} // gpu_profiler__stats
+
+// Reads back the slot's timestamps from its last submission. Only call once the slot's fence has signalled.
+static inline void
+gpu_profiler_collect(gpu_profiler_t* prof, int slot) {
+	if(!prof) return;
+	gpu_profiler_slot_t* s = &prof->slots[slot];
+	if(!s->submitted || s->zones_count == 0) return;
+	s->submitted = 0;
+
+	// value, availability pairs
+	unsigned long long results[GPU_PROFILER_MAX_ZONES * 2][2];
+	VkResult res = vkGetQueryPoolResults(prof->device, s->pool, 0, s->zones_count * 2, sizeof(results), results,
+		sizeof(results[0]), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+	if(res != VK_SUCCESS && res != VK_NOT_READY) return;
+
+	for(int z = 0; z < s->zones_count; z++) {
+		const unsigned long long* begin = results[z * 2];
+		const unsigned long long* end = results[z * 2 + 1];
+		if(!begin[1] || !end[1]) {
+			prof->lost++;
+			continue;
+		}
+
+		gpu_zone_stats_t* stats = gpu_profiler__stats(prof, &s->zones[z]);
+		if(!stats) continue;
+		const unsigned long long ticks = (end[0] - begin[0]) & prof->tick_mask;
+		stats->samples[stats->next] = (float)(ticks * prof->ns_per_tick * 1e-6);
+		stats->next = (stats->next + 1) % GPU_PROFILER_HISTORY;
+		if(stats->samples_count < GPU_PROFILER_HISTORY) stats->samples_count++;
+		stats->total_samples++;
+
+		gpu_event_t* event = &prof->events[prof->events_count++ % GPU_PROFILER_EVENTS];
+		event->stats_index = (int)(stats - prof->stats);
+		event->begin = begin[0] & prof->tick_mask;
+		event->end = event->begin + ticks;
+	}
+} // gpu_profiler_collect
+
+// Finds the offset between the GPU timestamps and time_now_ns(), by writing a timestamp and waiting for it.
+// The timestamp is taken somewhere between the submit and the wait returning, the middle is the best guess.
+// Good to about the submit latency, plenty for lining zones up in a trace. Uses the first slot's queries,
+// so call it before the slot is used.
+static inline VkResult
+gpu_profiler_calibrate(gpu_profiler_t* prof, VkQueue queue, VkCommandPool cmd_pool) {
+	if(!prof) return VK_SUCCESS;
+	VkQueryPool pool = prof->slots[0].pool;
+
+	VkCommandBufferAllocateInfo alloc_info = {0};
+	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	alloc_info.commandPool = cmd_pool;
+	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	alloc_info.commandBufferCount = 1;
+
+	VkCommandBuffer cmd;
+	VkResult res = vkAllocateCommandBuffers(prof->device, &alloc_info, &cmd);
+	if(res != VK_SUCCESS) return res;
+
+	VkCommandBufferBeginInfo begin_info = {0};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(cmd, &begin_info);
+	vkCmdResetQueryPool(cmd, pool, 0, 1);
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pool, 0);
+	res = vkEndCommandBuffer(cmd);
+
+	VkSubmitInfo submit_info = {0};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &cmd;
+
+	const unsigned long long before_ns = time_now_ns();
+	if(res == VK_SUCCESS) res = vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
+	if(res == VK_SUCCESS) res = vkQueueWaitIdle(queue);
+	const unsigned long long after_ns = time_now_ns();
+
+	unsigned long long ticks = 0;
+	if(res == VK_SUCCESS) {
+		res = vkGetQueryPoolResults(prof->device, pool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+	}
+	vkFreeCommandBuffers(prof->device, cmd_pool, 1, &cmd);
+	if(res != VK_SUCCESS) return res;
+
+	const unsigned long long mid_ns = before_ns + (after_ns - before_ns) / 2;
+	prof->cpu_offset_ns = (long long)mid_ns - (long long)((ticks & prof->tick_mask) * prof->ns_per_tick);
+	prof->calibrated = 1;
+	return VK_SUCCESS;
+} // gpu_profiler_calibrate
+
+// GPU ticks to time_now_ns() time. Only meaningful after gpu_profiler_calibrate().
+static inline unsigned long long
+gpu_profiler_ticks_to_cpu_ns(const gpu_profiler_t* prof, unsigned long long ticks) {
+	return (unsigned long long)((long long)(ticks * prof->ns_per_tick) + prof->cpu_offset_ns);
+} // gpu_profiler_ticks_to_cpu_ns
+
+// Makes `slot` the one zones are allocated in, and forgets the zones recorded into it last time,
+// so gpu_profiler_collect() for the slot has to come first.
+static inline void
+gpu_profiler_select(gpu_profiler_t* prof, int slot) {
+	if(!prof) return;
+	prof->current = slot;
+	prof->slots[slot].zones_count = 0;
+	prof->slots[slot].submitted = 0;
+} // gpu_profiler_select
+
+// Resets the current slot's queries. Recorded outside of a render pass, before any of the slot's zones run on the GPU.
+static inline void
+gpu_profiler_reset(gpu_profiler_t* prof, VkCommandBuffer cmd) {
+	if(!prof) return;
+	vkCmdResetQueryPool(cmd, prof->slots[prof->current].pool, 0, GPU_PROFILER_MAX_ZONES * 2);
+} // gpu_profiler_reset
+
+// Starts recording the slot's zones into cmd.
+static inline void
+gpu_profiler_begin(gpu_profiler_t* prof, VkCommandBuffer cmd, int slot) {
+	gpu_profiler_select(prof, slot);
+	gpu_profiler_reset(prof, cmd);
+} // gpu_profiler_begin
+
+// Marks the slot's command buffer as submitted, its results are read back by the next gpu_profiler_collect().
+static inline void
+gpu_profiler_submitted(gpu_profiler_t* prof, int slot) {
+	if(!prof) return;
+	prof->slots[slot].submitted = 1;
+} // gpu_profiler_submitted
+
+// Reserves a zone in the slot being recorded, without writing anything.
+// Zones written from several threads are reserved up front on one thread, the threads only call gpu_zone_mark().
+// Returns -1 when the slot is full.
+static inline int
+gpu_zone_alloc(gpu_profiler_t* prof, const char* name, int index) {
+	if(!prof) return -1;
+	gpu_profiler_slot_t* s = &prof->slots[prof->current];
+	if(s->zones_count == GPU_PROFILER_MAX_ZONES) return -1;
+	s->zones[s->zones_count].name = name;
+	s->zones[s->zones_count].index = index;
+	return s->zones_count++;
+} // gpu_zone_alloc
+
+// Writes the zone's begin (end = 0) or end (end = 1) timestamp.
+// The begin waits for nothing (top of pipe), the end for everything before it to finish (bottom of pipe).
+static inline void
+gpu_zone_mark(gpu_profiler_t* prof, VkCommandBuffer cmd, int zone, int end) {
+	if(!prof || zone < 0) return;
+	vkCmdWriteTimestamp(cmd, end ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		prof->slots[prof->current].pool, zone * 2 + end);
+} // gpu_zone_mark
+
+static inline int
+gpu_zone_begin(gpu_profiler_t* prof, VkCommandBuffer cmd, const char* name, int index) {
+	const int zone = gpu_zone_alloc(prof, name, index);
+	gpu_zone_mark(prof, cmd, zone, 0);
+	return zone;
+} // gpu_zone_begin
+
+static inline void
+gpu_zone_end(gpu_profiler_t* prof, VkCommandBuffer cmd, int zone) {
+	gpu_zone_mark(prof, cmd, zone, 1);
+} // gpu_zone_end
+
+static int
+gpu_profiler__compare_floats(const void* a, const void* b) {
+	const float x = *(const float*)a;
+	const float y = *(const float*)b;
+	return (x > y) - (x < y);
+} // gpu_profiler__compare_floats
+
+// min/avg/p99 over the rolling window, in ms. Returns the number of samples it covers.
+static inline int
+gpu_zone_stats(const gpu_zone_stats_t* stats, float* min, float* avg, float* p99) {
+	const int n = stats->samples_count;
+	*min = *avg = *p99 = 0.0f;
+	if(n == 0) return 0;
+
+	float sorted[GPU_PROFILER_HISTORY];
+	memcpy(sorted, stats->samples, n * sizeof(float));
+	qsort(sorted, n, sizeof(float), gpu_profiler__compare_floats);
+
+	double sum = 0.0;
+	for(int i = 0; i < n; i++) sum += sorted[i];
+
+	*min = sorted[0];
+	*avg = (float)(sum / n);
+	*p99 = sorted[(n * 99 + 99) / 100 - 1];
+	return n;
+} // gpu_zone_stats
+
+static inline void
+gpu_profiler_print(const gpu_profiler_t* prof) {
+	if(!prof) return;
+	printf("gpu timings (ms, last %d frames):        min       avg       p99\n", GPU_PROFILER_HISTORY);
+	for(int i = 0; i < prof->stats_count; i++) {
+		const gpu_zone_stats_t* stats = &prof->stats[i];
+		float min, avg, p99;
+		gpu_zone_stats(stats, &min, &avg, &p99);
+
+		char name[64];
+		if(stats->zone.index >= 0) snprintf(name, sizeof(name), "%s[%d]", stats->zone.name, stats->zone.index);
+		else snprintf(name, sizeof(name), "%s", stats->zone.name);
+		printf("  %-36s %9.4f %9.4f %9.4f\n", name, min, avg, p99);
+	}
+	if(prof->lost > 0) printf("  (%llu zones had no results when read back)\n", prof->lost);
+} // gpu_profiler_print
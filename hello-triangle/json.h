@@ -0,0 +1,255 @@
+#pragma once
+
+// Minimal JSON reader, enough for glTF.
+//
+// json_parse() turns the whole text into a flat array of tokens in document order, without copying any of it:
+// a token is a type and a byte range in the text. Containers count their children and know where they end,
+// so skipping a value is one jump and lookups walk only the container's own members.
+// Strings are left escaped, json_string() unescapes them when needed. Numbers are parsed when read.
+
+#include <stdlib.h>
+#include <string.h>
+
+
+
+#define JSON_MAX_DEPTH	64
+
+typedef enum json_type_t {
+	JSON_NULL,
+	JSON_FALSE,
+	JSON_TRUE,
+	JSON_NUMBER,
+	JSON_STRING,
+	JSON_ARRAY,
+	JSON_OBJECT,
+} json_type_t;
+
+typedef struct json_token_t {
+	json_type_t	type;
+	int		start;	// byte range in the text, strings without their quotes
+	int		end;
+	int		size;	// elements of an array, members of an object (each a key token followed by its value)
+	int		next;	// index of the token after this value and everything in it
+} json_token_t;
+
+typedef struct json_t {
+	const char*	text;
+	int		length;
+	json_token_t*	tokens;	// tokens[0] is the document's value
+	int		count;
+	int		capacity;
+	int		pos;	// parser position
+} json_t;
+
+
+
+static inline int
+json__is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+} // json__is_space
+
+static inline void
+json__skip_space(json_t* json) {
+	while(json->pos < json->length && json__is_space(json->text[json->pos])) json->pos++;
+} // json__skip_space
+
+static inline int
+json__add(json_t* json, json_type_t type, int start) {
+	if(json->count == json->capacity) {
+		const int capacity = json->capacity ? json->capacity * 2 : 256;
+		json_token_t* tokens = realloc(json->tokens, capacity * sizeof(json_token_t));
+		if(!tokens) return -1;
+		json->tokens = tokens;
+		json->capacity = capacity;
+	}
+	json_token_t* t = &json->tokens[json->count];
+	t->type = type;
+	t->start = start;
+	t->end = start;
+	t->size = 0;
+	t->next = 0;
+	return json->count++;
+} // json__add
+
+// Parses one value at the current position. Returns its token, or -1.
+static inline int
+json__value(json_t* json, int depth) {
+	json__skip_space(json);
+	if(json->pos >= json->length || depth > JSON_MAX_DEPTH) return -1;
+	const char* s = json->text;
+	const int start = json->pos;
+	int token;
+
+	if(s[start] == '{' || s[start] == '[') {
+		const int object = s[start] == '{';
+		token = json__add(json, object ? JSON_OBJECT : JSON_ARRAY, start);
+		if(token < 0) return -1;
+		json->pos++;
+		json__skip_space(json);
+		if(json->pos < json->length && s[json->pos] == (object ? '}' : ']')) {
+			json->pos++;
+		} else {
+			for(;;) {
+				if(object) {
+					json__skip_space(json);
+					if(json->pos >= json->length || s[json->pos] != '"') return -1;
+					const int key = json__value(json, depth + 1);
+					if(key < 0) return -1;
+					json__skip_space(json);
+					if(json->pos >= json->length || s[json->pos] != ':') return -1;
+					json->pos++;
+				}
+				if(json__value(json, depth + 1) < 0) return -1;
+				json->tokens[token].size++;
+
+				json__skip_space(json);
+				if(json->pos >= json->length) return -1;
+				const char c = s[json->pos++];
+				if(c == ',') continue;
+				if(c == (object ? '}' : ']')) break;
+				return -1;
+			}
+		}
+		json->tokens[token].end = json->pos;
+	} else if(s[start] == '"') {
+		int i = start + 1;
+		while(i < json->length && s[i] != '"') i += s[i] == '\\' ? 2 : 1;
+		if(i >= json->length) return -1;
+		token = json__add(json, JSON_STRING, start + 1);
+		if(token < 0) return -1;
+		json->tokens[token].end = i;
+		json->pos = i + 1;
+	} else {
+		// a number or a literal, up to the next delimiter
+		int i = start;
+		while(i < json->length && !json__is_space(s[i]) && s[i] != ',' && s[i] != ']' && s[i] != '}' && s[i] != ':') i++;
+		const int n = i - start;
+		json_type_t type = JSON_NUMBER;
+		if(n == 4 && memcmp(s + start, "null", 4) == 0) type = JSON_NULL;
+		else if(n == 4 && memcmp(s + start, "true", 4) == 0) type = JSON_TRUE;
+		else if(n == 5 && memcmp(s + start, "false", 5) == 0) type = JSON_FALSE;
+		else if(n == 0 || !(s[start] == '-' || (s[start] >= '0' && s[start] <= '9'))) return -1;
+		token = json__add(json, type, start);
+		if(token < 0) return -1;
+		json->tokens[token].end = i;
+		json->pos = i;
+	}
+
+	json->tokens[token].next = json->count;
+	return token;
+} // json__value
+
+// Returns 0 on success, -1 on a syntax error or when out of memory.
+static inline int
+json_parse(json_t* json, const char* text, size_t length) {
+	memset(json, 0, sizeof(*json));
+	if(length > 0x7fffffff) return -1;
+	json->text = text;
+	json->length = (int)length;
+	if(json__value(json, 0) != 0) return -1;
+	json__skip_space(json);
+	return json->pos == json->length ? 0 : -1;
+} // json_parse
+
+static inline void
+json_free(json_t* json) {
+	free(json->tokens);
+	memset(json, 0, sizeof(*json));
+} // json_free
+
+// Whether string token `token` is exactly `str` (compared escaped, fine for the plain ASCII names glTF uses).
+static inline int
+json_string_equals(const json_t* json, int token, const char* str) {
+	if(token < 0 || json->tokens[token].type != JSON_STRING) return 0;
+	const json_token_t* t = &json->tokens[token];
+	const size_t n = strlen(str);
+	return (size_t)(t->end - t->start) == n && memcmp(json->text + t->start, str, n) == 0;
+} // json_string_equals
+
+// The value of member `key` of object token `object`, -1 when there is none.
+static inline int
+json_member(const json_t* json, int object, const char* key) {
+	if(object < 0 || json->tokens[object].type != JSON_OBJECT) return -1;
+	int t = object + 1;
+	for(int i = 0; i < json->tokens[object].size; i++) {
+		if(json_string_equals(json, t, key)) return t + 1;
+		t = json->tokens[t + 1].next;
+	}
+	return -1;
+} // json_member
+
+// Element `index` of array token `array`, -1 when out of range.
+static inline int
+json_element(const json_t* json, int array, int index) {
+	if(array < 0 || json->tokens[array].type != JSON_ARRAY || index < 0 || index >= json->tokens[array].size) return -1;
+	int t = array + 1;
+	for(int i = 0; i < index; i++) t = json->tokens[t].next;
+	return t;
+} // json_element
+
+static inline int
+json_size(const json_t* json, int token) {
+	return token < 0 ? 0 : json->tokens[token].size;
+} // json_size
+
+static inline double
+json_number(const json_t* json, int token, double fallback) {
+	if(token < 0 || json->tokens[token].type != JSON_NUMBER) return fallback;
+	char buf[64];
+	const json_token_t* t = &json->tokens[token];
+	const int n = t->end - t->start < (int)sizeof(buf) - 1 ? t->end - t->start : (int)sizeof(buf) - 1;
+	memcpy(buf, json->text + t->start, n);
+	buf[n] = 0;
+	return strtod(buf, NULL);
+} // json_number
+
+static inline long long
+json_int(const json_t* json, int token, long long fallback) {
+	if(token < 0 || json->tokens[token].type != JSON_NUMBER) return fallback;
+	// clamped, converting a double outside long long's range is undefined
+	const double d = json_number(json, token, 0.0);
+	return d >= 9.2e18 ? 9200000000000000000ll : d <= -9.2e18 ? -9200000000000000000ll : (long long)d;
+} // json_int
+
+// Unescaped string token into out (always terminated). \u escapes are written as UTF-8.
+// Returns the length, or -1 when it didn't fit or isn't a string.
+static inline int
+json_string(const json_t* json, int token, char* out, int out_size) {
+	if(token < 0 || json->tokens[token].type != JSON_STRING || out_size < 1) return -1;
+	const json_token_t* t = &json->tokens[token];
+	const char* s = json->text;
+	int n = 0;
+	for(int i = t->start; i < t->end; i++) {
+		unsigned int c = (unsigned char)s[i];
+		int code_point = 0; // \u escape, raw bytes are already UTF-8
+		if(c == '\\' && i + 1 < t->end) {
+			c = (unsigned char)s[++i];
+			switch(c) {
+				case 'n': c = '\n'; break;
+				case 't': c = '\t'; break;
+				case 'r': c = '\r'; break;
+				case 'b': c = '\b'; break;
+				case 'f': c = '\f'; break;
+				case 'u': {
+					if(i + 4 >= t->end) return -1;
+					const char hex[5] = {s[i + 1], s[i + 2], s[i + 3], s[i + 4], 0};
+					c = (unsigned int)strtoul(hex, NULL, 16);
+					code_point = 1;
+					i += 4;
+				} break;
+				default: break; // \" \\ \/
+			}
+		}
+		// surrogate pairs are not combined
+		char utf8[3];
+		int bytes = 1;
+		if(!code_point || c < 0x80) utf8[0] = (char)c;
+		else if(c < 0x800) { utf8[0] = (char)(0xc0 | (c >> 6)); utf8[1] = (char)(0x80 | (c & 0x3f)); bytes = 2; }
+		else { utf8[0] = (char)(0xe0 | (c >> 12)); utf8[1] = (char)(0x80 | ((c >> 6) & 0x3f)); utf8[2] = (char)(0x80 | (c & 0x3f)); bytes = 3; }
+		if(n + bytes >= out_size) return -1;
+		memcpy(out + n, utf8, bytes);
+		n += bytes;
+	}
+	out[n] = 0;
+	return n;
+} // json_string
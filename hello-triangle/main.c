@@ -4,6 +4,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "platform.h"
+#include "gpu_alloc.h"
+#include "upload.h"
+#include "worker_pool.h"
+#include "pipeline_cache.h"
+#include "device_caps.h"
+#include "gpu_profiler.h"
+#include "cpu_profiler.h"
+#include "deletion_queue.h"
+#include "timeline.h"
+#include "vmath.h"
+#include "vmath_bench.h"
+#include "scene.h"
+#include "cull.h"
+#include "gpu_cull.h"
+#include "mesh.h"
+#include "mesh_opt.h"
+#include "mesh_pack.h"
+#include "meshlet.h"
+#include "mesh_lod.h"
 
 
 
@@ -15,6 +38,22 @@
 #define WINDOW_SIZE_X  720
 #define WINDOW_SIZE_Y 480
 
+// headless mode renders into offscreen images instead of a swapchain
+#define HEADLESS_IMAGES_COUNT	3
+#define HEADLESS_DEFAULT_FRAMES	1000
+
+// how many frames the CPU may run ahead of the GPU
+#define MAX_FRAMES_IN_FLIGHT		4
+#define DEFAULT_FRAMES_IN_FLIGHT	2
+
+// where compiled pipelines are kept between runs, relative to the working directory
+#define DEFAULT_PIPELINE_CACHE_PATH	"pipeline_cache.bin"
+
+// upper limit for --objects
+#define MAX_OBJECTS	65536
+#define MAX_INSTANCES	(1 << 20)	// with --model instance or scene
+#define SCENE_GROUP_NODES 9		// --model scene: a root, 4 children orbiting it, and one grandchild under each of them
+
 // heap memory allocator
 #define heap_alloc(num_elements, elem_size)		malloc(num_elements * elem_size)
 #define heap_alloc_zeroed(num_elements, elem_size)	calloc(num_elements, elem_size)
@@ -26,26 +65,334 @@
 
 #define CLEAR_COLOR {0.0f, 0.5f, 0.5f, 1.0f}
 
+// What to optimise the swapchain present mode for.
+// Each policy has a list of modes in order of preference, FIFO is always the last resort (it's the only guaranteed one).
+typedef enum present_policy_t {
+	PRESENT_POLICY_POWER,		// FIFO: vsync, no tearing, lowest power. default
+	PRESENT_POLICY_RELAXED,		// FIFO_RELAXED: vsync, but late frames are shown right away (may tear)
+	PRESENT_POLICY_LATENCY,		// MAILBOX: no tearing, the newest finished frame replaces the queued one
+	PRESENT_POLICY_THROUGHPUT,	// IMMEDIATE: uncapped, may tear. use for benchmarks
+	PRESENT_POLICY_COUNT
+} present_policy_t;
+
+static const char* present_policy_names[PRESENT_POLICY_COUNT] = {"power", "relaxed", "latency", "throughput"};
+
+static const VkPresentModeKHR present_policy_modes[PRESENT_POLICY_COUNT][3] = {
+	[PRESENT_POLICY_POWER]		= {VK_PRESENT_MODE_FIFO_KHR,		VK_PRESENT_MODE_FIFO_KHR,	VK_PRESENT_MODE_FIFO_KHR},
+	[PRESENT_POLICY_RELAXED]	= {VK_PRESENT_MODE_FIFO_RELAXED_KHR,	VK_PRESENT_MODE_FIFO_KHR,	VK_PRESENT_MODE_FIFO_KHR},
+	[PRESENT_POLICY_LATENCY]	= {VK_PRESENT_MODE_MAILBOX_KHR,		VK_PRESENT_MODE_IMMEDIATE_KHR,	VK_PRESENT_MODE_FIFO_KHR},
+	[PRESENT_POLICY_THROUGHPUT]	= {VK_PRESENT_MODE_IMMEDIATE_KHR,	VK_PRESENT_MODE_MAILBOX_KHR,	VK_PRESENT_MODE_FIFO_KHR},
+};
+
+// Device extensions we use, nothing else gets enabled.
+static const device_extension_t device_extension_table[] = {
+	{VK_KHR_SWAPCHAIN_EXTENSION_NAME,	EXT_REQUIRED_WINDOWED,	"presenting to the window"},
+	{"VK_KHR_portability_subset",		EXT_IF_PRESENT,		"non-conformant implementations (e.g. MoltenVK) only work with it enabled"},
+	{VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, EXT_OPTIONAL,	"frame sync with one counter instead of fences (--sync)", VK_API_VERSION_1_2},
+	// Also enabled on 1.2, where the core version would need VkPhysicalDeviceVulkan12Features, which can't be chained
+	// together with the timeline semaphore struct.
+	{VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME, EXT_OPTIONAL,	"GPU culling packs the visible draws and draws only those (--cull gpu)"},
+	// Needs SPIR-V 1.4, core in 1.2 (older devices would need VK_KHR_spirv_1_4 and VK_KHR_shader_float_controls as well).
+	{VK_EXT_MESH_SHADER_EXTENSION_NAME,	EXT_OPTIONAL,		"meshlets culled in task shaders and drawn by mesh shaders (--cull meshlets)", 0, VK_API_VERSION_1_2},
+	{NULL},
+};
+
+// Feature structs beyond VkPhysicalDeviceFeatures.
+static const device_feature_struct_t timeline_semaphore_features = {
+	VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES, sizeof(VkPhysicalDeviceTimelineSemaphoreFeatures),
+	VK_API_VERSION_1_2, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME
+};
+static const device_feature_struct_t mesh_shader_features = {
+	VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT, sizeof(VkPhysicalDeviceMeshShaderFeaturesEXT),
+	0, VK_EXT_MESH_SHADER_EXTENSION_NAME
+};
+
+// Device features we use.
+static const device_feature_t device_feature_table[] = {
+	{DEVICE_FEATURE_IN(VkPhysicalDeviceTimelineSemaphoreFeatures, timelineSemaphore), 0, "frame sync with one counter instead of fences (--sync)", &timeline_semaphore_features},
+	{DEVICE_FEATURE(multiDrawIndirect),		0, "all objects in one indirect draw (--cull gpu)"},
+	{DEVICE_FEATURE(drawIndirectFirstInstance),	0, "indirect draws pick their object's instance data (--cull gpu)"},
+	{DEVICE_FEATURE_IN(VkPhysicalDeviceMeshShaderFeaturesEXT, taskShader), 0, "meshlets culled in task shaders (--cull meshlets)", &mesh_shader_features},
+	{DEVICE_FEATURE_IN(VkPhysicalDeviceMeshShaderFeaturesEXT, meshShader), 0, "meshlets drawn by mesh shaders (--cull meshlets)", &mesh_shader_features},
+	{NULL},
+};
+
+// Per-frame synchronisation objects and command memory.
+// Each frame in flight has its own set, so that recording/submitting frame N+1 never touches
+// objects the GPU may still be using for frame N.
+typedef struct frame_data_t {
+	VkSemaphore	sema_acquire;	// signalled when the swapchain image is ready to be rendered into
+	VkSemaphore	sema_render;	// signalled when rendering is done, presentation waits on it
+	VkFence		fence;		// signalled when the GPU has finished the frame (SYNC_FENCES)
+	VkCommandPool	cmd_pool;	// transient, reset as a whole once the frame is done
+	VkCommandBuffer	cmd;		// recorded every frame (RECORD_PER_FRAME)
+	// one transient pool and secondary command buffer per recording thread (--threads)
+	VkCommandPool	thread_pools[WORKER_POOL_MAX_THREADS];
+	VkCommandBuffer	thread_cmds[WORKER_POOL_MAX_THREADS];
+} frame_data_t;
+
+// Everything that depends on the window size. Recreated on resize.
+typedef struct render_targets_t {
+	VkSwapchainKHR	swapchain;	// VK_NULL_HANDLE in headless mode
+	VkExtent2D	extent;
+	int		images_count;
+	VkImage*	images;
+	gpu_allocation_t* images_memory; // only used in headless mode, swapchain images are owned by the swapchain
+	VkImageView*	views;
+	VkImage		depth_img;
+	gpu_allocation_t depth_mem;
+	VkImageView	depth_view;
+	VkFramebuffer*	framebuffers;
+} render_targets_t;
+
+// What the render targets are created with, doesn't change on resize.
+typedef struct render_targets_info_t {
+	VkPhysicalDevice	physical_device;
+	VkSurfaceFormatKHR	color_fmt;
+	VkCompositeAlphaFlagBitsKHR alpha_fmt;
+	VkFormat		depth_fmt;
+	VkRenderPass		renderpass;
+} render_targets_info_t;
+
 typedef struct vulkan_data_t {
 	VkInstance	instance;
 	VkDevice	device;
-	int		images_count;
-	VkImage*	images;
-	VkFence*	fences;
-	VkSwapchainKHR	swapchain;
+	render_targets_t targets;
+	deletion_queue_t deletions; // objects waiting for the frames that use them to finish, keyed on frame number
+	unsigned long long* image_frames; // per image: number of the frame that last rendered into it, 0 = none
+	int		frames_in_flight;
+	int		use_timeline;	// frames are tracked with frame_timeline instead of their fences
+	timeline_t	frame_timeline;	// signalled with the frame number when the GPU has finished a frame
+	frame_data_t	frames[MAX_FRAMES_IN_FLIGHT];
 	VkSurfaceKHR	surface;
+	VkPresentModeKHR present_mode;
 	VkCommandPool	cmd_pool;
+	unsigned int	api_version; // instance API version
+	device_caps_t	caps; // enabled device extensions and features
+	gpu_allocator_t	allocator; // all buffer and image memory comes from here
+	upload_engine_t	uploader; // copies data into device local buffers
 } vulkan_data_t;
 static vulkan_data_t vulkan_data = {0};
 
+// Uniform block layouts, must match shader.vert.
+typedef struct frame_constants_t {
+	float	projection[16];
+	float	view[16];
+	float	mesh[16];	// fits the mesh into the triangle's -1 to 1 box, before the model matrix, and dequantizes packed positions
+	float	lod[4];		// cull.comp's level of detail selection: mesh_lod_factor() of the frame (0 = off), the near plane's distance
+} frame_constants_t;
+
+typedef struct object_constants_t {
+	float	model[16];
+} object_constants_t;
+
+// Per-instance vertex attributes, must match shader_instanced.vert.
+typedef struct instance_data_t {
+	float		model[12];	// rows of a 3x4 model matrix (the last row is always 0 0 0 1)
+	unsigned int	color;		// RGBA8, multiplies the vertex color
+} instance_data_t;
+
+// Persistently mapped uniform memory with one region per frame in flight
+// (or per swapchain image, when the command buffers are prerecorded per image).
+// A region is only written once the GPU is done with the last frame that used it,
+// so the CPU never races the GPU and nothing is ever mapped/unmapped or rewritten in a descriptor.
+// A region holds the frame constants followed by the constants of every object. Shaders see it
+// through UNIFORM_BUFFER_DYNAMIC descriptors, blocks are selected with dynamic offsets at bind time.
+typedef struct uniform_ring_t {
+	VkBuffer	buffer;
+	gpu_allocation_t memory;
+	VkDeviceSize	frame_stride;	// sizes rounded up to minUniformBufferOffsetAlignment
+	VkDeviceSize	object_stride;
+	VkDeviceSize	region_size;
+	int		regions_count;
+} uniform_ring_t;
+
+// How the CPU finds out that the GPU is done with a frame.
+typedef enum sync_mode_t {
+	SYNC_AUTO,	// timeline when the device has it, fences otherwise. default
+	SYNC_FENCES,	// a fence per frame in flight, reset and waited on every frame
+	SYNC_TIMELINE,	// one timeline semaphore, signalled with the frame number
+} sync_mode_t;
+
+// Frustum culling of the objects before their draws are recorded.
+typedef enum cull_mode_t {
+	CULL_AUTO,	// spheres when the draws are recorded per object every frame, off otherwise. default
+	CULL_OFF,
+	CULL_SPHERE,
+	CULL_AABB,
+	CULL_GPU,	// spheres, tested by a compute pass that writes the draws (--model instance)
+	CULL_MESHLETS,	// spheres and normal cones of every object's meshlets, in task shaders or a compute pass that writes the draws (--model instance)
+} cull_mode_t;
+
+// Persistently mapped per-instance data (MODEL_SOURCE_INSTANCE), regions follow the uniform ring's.
+// Read as a vertex buffer straight from host memory, so the CPU writes go over the bus every frame.
+typedef struct instance_ring_t {
+	VkBuffer	buffer;
+	gpu_allocation_t memory;
+	VkDeviceSize	region_size;
+	int		regions_count;
+} instance_ring_t;
+
+// Persistently mapped world matrices of the scene nodes (MODEL_SOURCE_SCENE), regions follow the uniform ring's.
+// Read as a storage buffer indexed by instance, by shader.vert built with MODEL_FROM_SCENE (shader_scene.vert.spv). Every region only gets the matrices that changed since it was last written.
+typedef struct node_ring_t {
+	VkBuffer	buffer;
+	gpu_allocation_t memory;
+	VkDeviceSize	region_size;
+	int		regions_count;
+	unsigned long long* versions; // per region: the scene version it has, see scene_write()
+} node_ring_t;
+
+// How command buffers are recorded.
+typedef enum record_mode_t {
+	RECORD_PER_FRAME,	// every frame, into the frame's own transient command pool
+	RECORD_STATIC,		// once per swapchain image before the main loop, replayed forever
+} record_mode_t;
+
+// Where the model matrices come from.
+typedef enum model_source_t {
+	MODEL_SOURCE_UNIFORM,	// per-object blocks in the uniform ring, one descriptor bind per draw
+	MODEL_SOURCE_PUSH,	// push constants, needs the command buffer re-recorded to change them
+	MODEL_SOURCE_INSTANCE,	// per-instance vertex attributes, all objects in one instanced draw
+	MODEL_SOURCE_SCENE,	// world matrices of a node hierarchy in a storage buffer, all nodes in one instanced draw
+} model_source_t;
+
+// Everything needed to record the scene into a command buffer.
+typedef struct draw_context_t {
+	VkRenderPass	renderpass;
+	VkExtent2D	extent;
+	VkPipeline	pipeline;
+	VkPipelineLayout layout;
+	VkDescriptorSet	desc_set;
+	VkBuffer	vertex_buffers[MESH_MAX_BINDINGS]; // one per binding of the mesh, the instance data comes after them
+	int		vertex_buffers_count;
+	VkBuffer	index_buffer;
+	VkIndexType	index_type;
+	unsigned int	n_indices;
+	int		objects_count;
+	const uniform_ring_t* uniforms;
+	const object_constants_t* push_models; // MODEL_SOURCE_PUSH only, objects_count of them
+	const int*	draw_list;	// with culling: the objects to draw, objects_count of them. NULL = all
+	const instance_ring_t* instances; // MODEL_SOURCE_INSTANCE only
+	const mesh_lod_t* lods;		// with --lod and one draw per object: the chain, and the level of every object
+	const unsigned char* object_lods;
+	gpu_cull_t*	cull;		// with CULL_GPU and CULL_MESHLETS: the instances are drawn by its indirect commands, or its task shaders
+	const node_ring_t* nodes;	// MODEL_SOURCE_SCENE only
+	gpu_profiler_t*	profiler; // NULL = no GPU timings
+} draw_context_t;
+
+// Shared by the recording threads, each one records its share of the objects into its own secondary command buffer.
+typedef struct record_job_t {
+	VkDevice		device;
+	const draw_context_t*	ctx;
+	frame_data_t*		frame;
+	VkFramebuffer		framebuffer;
+	int			region;
+	int			threads;
+	int			zones[WORKER_POOL_MAX_THREADS]; // GPU timing zone around each thread's draws
+	VkResult		results[WORKER_POOL_MAX_THREADS];
+} record_job_t;
+
+// Shared by the threads writing the instance data, each one writes its share of the instances.
+typedef struct instance_job_t {
+	instance_data_t*	instances;
+	int			count;
+	float			time;
+	int			threads;
+} instance_job_t;
+
+// Orbits the origin, always looking at it. Arrow keys turn it, W and S move it closer and further.
+typedef struct camera_t {
+	float	yaw;		// radians around Y, 0 = on +Z
+	float	pitch;		// radians above the XZ plane
+	float	distance;
+	float	fov_y;		// radians
+	float	near;		// the far plane is at infinity
+} camera_t;
+
+// Shared by the culling threads, each one culls its share of the objects into its own part of the draw list.
+typedef struct cull_job_t {
+	const cull_bounds_t*	bounds;
+	cull_frustum_t		frustum;
+	cull_shape_t		shape;
+	int			threads;
+	int*			visible;	// a thread's part starts at its first object
+	int			visible_counts[WORKER_POOL_MAX_THREADS];
+} cull_job_t;
+
+// settings from the command line
+typedef struct ren_config_t {
+	int		headless;	// no window, surface or swapchain. Render into offscreen images.
+	int		software;	// prefer a CPU implementation (e.g. Mesa lavapipe) even if a GPU exists
+	int		max_frames;	// stop after this many frames, 0 = until the window is closed
+	int		frames_in_flight; // 1 to MAX_FRAMES_IN_FLIGHT
+	present_policy_t present_policy;
+	const char*	screenshot_path; // headless only: write the last rendered frame to a .ppm file
+	int		objects;	// number of triangles drawn, each with its own animated model matrix
+	model_source_t	model_source;
+	record_mode_t	record_mode;
+	int		threads;	// record secondary command buffers on this many threads, 0 = record inline into the primary
+	const char*	pipeline_cache_path; // NULL = don't load or save the pipeline cache
+	int		all_device_extensions; // enable everything the device has (the old behaviour, to compare device creation time)
+	int		no_gpu_timings;	// don't write timestamp queries
+	const char*	trace_path;	// record CPU zones and write them with the GPU zones to this Chrome trace file, NULL = off
+	int		resize_every;	// windowed only: resize the window every this many frames, to exercise swapchain recreation. 0 = never
+	sync_mode_t	sync_mode;
+	int		bench_math;	// run the math kernel micro-benchmarks and exit
+	int		static_nodes;	// --model scene: percentage of node groups that never move
+	cull_mode_t	cull_mode;
+	float		camera_distance; // starting distance of the camera from the origin, 0 = default
+	const char*	mesh_path;	// draw this .gltf, .glb or .obj file instead of the triangle, NULL = the triangle
+	int		optimize_mesh;	// reorder the mesh's triangles and vertices for the vertex cache, overdraw and vertex fetch after loading
+	int		pack_mesh;	// store the vertices in 16 and 8 bit formats before uploading them
+	int		no_mesh_shader;	// --cull meshlets: always the compute pass, even where the device has mesh shaders
+	float		lod_pixels;	// draw every object at the coarsest level of detail whose error projects to at most this many pixels, 0 = full detail
+} ren_config_t;
+static ren_config_t ren_config = {0};
+
 static GLFWwindow* ren_glfw_window;
+static int ren_window_resized; // set by GLFW, the swapchain is recreated before the next frame
+static int ren_present_presses; // P presses since the last frame, set by GLFW
+
+// window system functions, loaded in main()
+static PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR	GetPhysicalDeviceSurfaceCapabilitiesKHR;
+static PFN_vkGetPhysicalDeviceSurfaceFormatsKHR		GetPhysicalDeviceSurfaceFormatsKHR;
+static PFN_vkGetPhysicalDeviceSurfacePresentModesKHR	GetPhysicalDeviceSurfacePresentModesKHR;
+static PFN_vkCreateSwapchainKHR				CreateSwapchainKHR;
+static PFN_vkDestroySwapchainKHR			DestroySwapchainKHR;
+static PFN_vkGetSwapchainImagesKHR			GetSwapchainImagesKHR;
+static PFN_vkAcquireNextImageKHR			AcquireNextImageKHR;
+static PFN_vkQueuePresentKHR				QueuePresentKHR;
 
 
 
 void _ren_vulkan_init(); // TODO
 void _ren_vulkan_deinit(); // TODO
 
-char* read_entire_file_from_filename(char* fullpath, size_t* const bytes_read);
+static inline char* read_entire_file_from_filename(const char* fullpath, size_t* const bytes_read);
+static inline const char* present_mode_name(VkPresentModeKHR mode);
+static inline VkPresentModeKHR present_policy_mode(VkPhysicalDevice physical_device, VkSurfaceKHR surface, present_policy_t policy);
+static inline unsigned int uniform_frame_offset(const uniform_ring_t* ring, int region);
+static inline unsigned int uniform_object_offset(const uniform_ring_t* ring, int region, int object);
+static inline void camera_update(camera_t* camera, GLFWwindow* window, float dt);
+static inline mat4_t object_transform(int object, int objects_count, float time);
+static inline int object_lod(const mesh_lods_t* lods, const mat4_t* transform, vec3_t center, float radius, vec3_t eye, float near, float factor);
+static inline void build_scene(scene_t* scene, int nodes_count);
+static inline void animate_scene(scene_t* scene, float time, int static_percent);
+static inline void object_instances(instance_data_t* instances, int first, int count, int objects_count, float time);
+static void instance_job(void* user, int worker);
+static void cull_job(void* user, int worker);
+static inline void cmd_begin_scene_pass(VkCommandBuffer cmd, const draw_context_t* ctx, VkFramebuffer framebuffer, VkSubpassContents contents);
+static inline void cmd_draw_objects(VkCommandBuffer cmd, const draw_context_t* ctx, int region, int first, int count);
+static inline VkResult record_draw_commands(VkCommandBuffer cmd, VkCommandBufferUsageFlags usage, const draw_context_t* ctx, VkFramebuffer framebuffer, int region);
+static void record_secondary_job(void* user, int worker);
+static VkResult render_targets_create(render_targets_t* rt, const render_targets_info_t* info, VkSwapchainKHR old_swapchain);
+static void render_targets_destroy(render_targets_t* rt);
+static void render_targets_deleter(void* context, void* data);
+static VkDeviceSize render_targets_bytes(const render_targets_t* rt);
+static void window_resized(GLFWwindow* window, int width, int height);
+static void key_pressed(GLFWwindow* window, int key, int scancode, int action, int mods);
+static int vertex_format_supported(VkFormat format, void* physical_device);
 
 
 
@@ -56,25 +403,7 @@ float vertices[] = {
 	-1.0f,	1.0f, 0.0f, 0.0f,	1.0f,	0.0f,
 	 0.0f, -1.0f, 0.0f, 0.0f,	0.0f,	1.0f
 };
-int indices[] = {0, 1, 2};
-// Projection Matrix (60deg FOV, 3:2 aspect ratio, [1.0, 256.0] clipping plane range)
-// hardcoded for simplicity
-float mvp[] = {
-	1.155,	0.000,	0.000,	0.000,
-	0.000,	1.732,	0.000,	0.000,
-	0.000,	0.000, -1.008, -1.000,
-	0.000,	0.000, -2.008,	0.000,
-	// Model Matrix (identity)
-	1.0f, 0.0f, 0.0f, 0.0f,
-	0.0f, 1.0f, 0.0f, 0.0f,
-	0.0f, 0.0f, 1.0f, 0.0f,
-	0.0f, 0.0f, 0.0f, 1.0f,
-	// View Matrix (distance of 2.5)
-	1.0f,  0.0f,  0.0f,	 0.0f,
-	0.0f,  1.0f,  0.0f,	 0.0f,
-	0.0f,  0.0f,  1.0f,	 0.0f,
-	0.0f,  0.0f, -2.5f,	 1.0f
-};
+unsigned int indices[] = {0, 1, 2};
 
 
 
@@ -82,26 +411,176 @@ int
 main(int argc, char **argv) {
 	VkResult res = {0}; // shared result variable
 
+	// parse the command line
+	int pipeline_cache_set = 0;
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--headless") == 0) {
+			ren_config.headless = 1;
+		} else if(strcmp(argv[i], "--software") == 0) {
+			ren_config.software = 1;
+		} else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			ren_config.max_frames = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+			ren_config.frames_in_flight = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--present") == 0 && i + 1 < argc) {
+			i++;
+			int found = 0;
+			for(int p = 0; p < PRESENT_POLICY_COUNT; p++) {
+				if(strcmp(argv[i], present_policy_names[p]) == 0) {
+					ren_config.present_policy = (present_policy_t)p;
+					found = 1;
+				}
+			}
+			ERROR_IF(!found, "unknown present policy `%s` (power, relaxed, latency or throughput)\n", argv[i]);
+		} else if(strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc) {
+			ren_config.screenshot_path = argv[++i];
+		} else if(strcmp(argv[i], "--objects") == 0 && i + 1 < argc) {
+			ren_config.objects = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+			i++;
+			if(strcmp(argv[i], "uniform") == 0) ren_config.model_source = MODEL_SOURCE_UNIFORM;
+			else if(strcmp(argv[i], "push") == 0) ren_config.model_source = MODEL_SOURCE_PUSH;
+			else if(strcmp(argv[i], "instance") == 0) ren_config.model_source = MODEL_SOURCE_INSTANCE;
+			else if(strcmp(argv[i], "scene") == 0) ren_config.model_source = MODEL_SOURCE_SCENE;
+			else ERROR_IF(1, "unknown model source `%s` (uniform, push, instance or scene)\n", argv[i]);
+		} else if(strcmp(argv[i], "--static-nodes") == 0 && i + 1 < argc) {
+			ren_config.static_nodes = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			i++;
+			if(strcmp(argv[i], "per-frame") == 0) ren_config.record_mode = RECORD_PER_FRAME;
+			else if(strcmp(argv[i], "static") == 0) ren_config.record_mode = RECORD_STATIC;
+			else ERROR_IF(1, "unknown record mode `%s` (per-frame or static)\n", argv[i]);
+		} else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			ren_config.threads = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--resize-every") == 0 && i + 1 < argc) {
+			ren_config.resize_every = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--sync") == 0 && i + 1 < argc) {
+			i++;
+			if(strcmp(argv[i], "fences") == 0) ren_config.sync_mode = SYNC_FENCES;
+			else if(strcmp(argv[i], "timeline") == 0) ren_config.sync_mode = SYNC_TIMELINE;
+			else ERROR_IF(1, "unknown sync mode `%s` (fences or timeline)\n", argv[i]);
+		} else if(strcmp(argv[i], "--cull") == 0 && i + 1 < argc) {
+			i++;
+			if(strcmp(argv[i], "off") == 0) ren_config.cull_mode = CULL_OFF;
+			else if(strcmp(argv[i], "sphere") == 0) ren_config.cull_mode = CULL_SPHERE;
+			else if(strcmp(argv[i], "aabb") == 0) ren_config.cull_mode = CULL_AABB;
+			else if(strcmp(argv[i], "gpu") == 0) ren_config.cull_mode = CULL_GPU;
+			else if(strcmp(argv[i], "meshlets") == 0) ren_config.cull_mode = CULL_MESHLETS;
+			else ERROR_IF(1, "unknown cull mode `%s` (off, sphere, aabb, gpu or meshlets)\n", argv[i]);
+		} else if(strcmp(argv[i], "--no-mesh-shader") == 0) {
+			ren_config.no_mesh_shader = 1;
+		} else if(strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+			ren_config.mesh_path = argv[++i];
+		} else if(strcmp(argv[i], "--lod") == 0 && i + 1 < argc) {
+			ren_config.lod_pixels = (float)atof(argv[++i]);
+		} else if(strcmp(argv[i], "--optimize-mesh") == 0) {
+			ren_config.optimize_mesh = 1;
+		} else if(strcmp(argv[i], "--pack-mesh") == 0) {
+			ren_config.pack_mesh = 1;
+		} else if(strcmp(argv[i], "--camera-distance") == 0 && i + 1 < argc) {
+			ren_config.camera_distance = (float)atof(argv[++i]);
+		} else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			ren_config.trace_path = argv[++i];
+		} else if(strcmp(argv[i], "--no-gpu-timings") == 0) {
+			ren_config.no_gpu_timings = 1;
+		} else if(strcmp(argv[i], "--all-device-extensions") == 0) {
+			ren_config.all_device_extensions = 1;
+		} else if(strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc) {
+			i++;
+			ren_config.pipeline_cache_path = strcmp(argv[i], "none") == 0 ? NULL : argv[i];
+			pipeline_cache_set = 1;
+		} else if(strcmp(argv[i], "--bench-math") == 0) {
+			ren_config.bench_math = 1;
+		} else {
+			printf("usage: %s [--headless] [--software] [--frames N] [--frames-in-flight 1-%d] [--present power|relaxed|latency|throughput] [--screenshot out.ppm] [--objects 1-%d, 1-%d instanced] [--model uniform|push|instance|scene] [--static-nodes 0-100] [--record per-frame|static] [--threads 0-%d] [--pipeline-cache path|none] [--all-device-extensions] [--no-gpu-timings] [--trace out.json] [--resize-every N] [--sync fences|timeline] [--cull off|sphere|aabb|gpu|meshlets] [--no-mesh-shader] [--camera-distance D] [--mesh file.gltf|.glb|.obj] [--optimize-mesh] [--pack-mesh] [--lod pixels] [--bench-math]\n", argv[0], MAX_FRAMES_IN_FLIGHT, MAX_OBJECTS, MAX_INSTANCES, WORKER_POOL_MAX_THREADS);
+			return 1;
+		}
+	}
+
+	if(ren_config.bench_math) {
+		// No window or device needed.
+		return vmath_bench_run() == 0 ? 0 : 1;
+	}
+
+	if(ren_config.headless && ren_config.max_frames <= 0) {
+		ren_config.max_frames = HEADLESS_DEFAULT_FRAMES;
+	}
+	if(ren_config.frames_in_flight <= 0) ren_config.frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
+	if(ren_config.frames_in_flight > MAX_FRAMES_IN_FLIGHT) ren_config.frames_in_flight = MAX_FRAMES_IN_FLIGHT;
+	vulkan_data.frames_in_flight = ren_config.frames_in_flight;
+	if(ren_config.objects <= 0) ren_config.objects = 1;
+	const int instanced = ren_config.model_source == MODEL_SOURCE_INSTANCE || ren_config.model_source == MODEL_SOURCE_SCENE;
+	const int max_objects = instanced ? MAX_INSTANCES : MAX_OBJECTS;
+	if(ren_config.objects > max_objects) ren_config.objects = max_objects;
+	if(ren_config.static_nodes < 0) ren_config.static_nodes = 0;
+	if(ren_config.static_nodes > 100) ren_config.static_nodes = 100;
+	ERROR_IF(ren_config.model_source == MODEL_SOURCE_PUSH && ren_config.record_mode == RECORD_STATIC,
+		"push constants are recorded into the command buffer, they need --record per-frame\n");
+	if(!pipeline_cache_set) ren_config.pipeline_cache_path = DEFAULT_PIPELINE_CACHE_PATH;
+	if(ren_config.threads < 0) ren_config.threads = 0;
+	if(ren_config.threads > WORKER_POOL_MAX_THREADS) ren_config.threads = WORKER_POOL_MAX_THREADS;
+	ERROR_IF(ren_config.threads > 0 && ren_config.record_mode == RECORD_STATIC, "--threads needs --record per-frame\n");
+	// Culling picks the draws to record, so it needs them recorded every frame, one per object.
+	const int can_cull = !instanced && ren_config.record_mode == RECORD_PER_FRAME;
+	ERROR_IF(!can_cull && (ren_config.cull_mode == CULL_SPHERE || ren_config.cull_mode == CULL_AABB),
+		"--cull sphere and aabb need --record per-frame and --model uniform or push\n");
+	if(ren_config.cull_mode == CULL_AUTO) ren_config.cull_mode = can_cull ? CULL_SPHERE : CULL_OFF;
+	// The compute pass reads the instance data and writes the draws, there is one draw call to record.
+	const int gpu_culling = ren_config.cull_mode == CULL_GPU || ren_config.cull_mode == CULL_MESHLETS;
+	ERROR_IF(gpu_culling && ren_config.model_source != MODEL_SOURCE_INSTANCE, "--cull gpu and meshlets need --model instance\n");
+	ERROR_IF(gpu_culling && ren_config.threads > 0, "--cull gpu and meshlets record one draw, there is nothing to split over --threads\n");
+	// The level is picked per object every frame: by the CPU for the draws it records, or by the compute pass for instances.
+	if(ren_config.lod_pixels < 0.0f) ren_config.lod_pixels = 0.0f;
+	ERROR_IF(ren_config.lod_pixels > 0.0f && !can_cull && ren_config.cull_mode != CULL_GPU,
+		"--lod needs --record per-frame and --model uniform or push, or --model instance with --cull gpu\n");
+
+	// CPU zones are only recorded for a trace.
+	cpu_profiler_init(ren_config.trace_path != NULL);
+	cpu_profiler_thread_name("main");
+
+	// The main thread is worker 0, so this starts threads - 1 extra threads.
+	worker_pool_t workers = {0};
+	if(ren_config.threads > 0) {
+		ERROR_IF(worker_pool_init(&workers, ren_config.threads) != 0, "creating %d recording threads failed\n", ren_config.threads);
+	}
+
 	// open window
 	// initialize GLFW.
 	// GLFW handles OS-specific interfaces such as creating and accessing a window and gathering input.
-	{
+	// Not needed at all in headless mode, so that we can run on machines without a display.
+	if(!ren_config.headless) {
 		const int glfw_init_res = glfwInit();
 		ERROR_IF(glfw_init_res != GLFW_TRUE, "GLFW failed to initialize");
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 		ren_glfw_window = glfwCreateWindow(WINDOW_SIZE_X, WINDOW_SIZE_Y, "vulkan-hello-triangle", NULL, NULL);
 		ERROR_IF(!ren_glfw_window, "Error creating a GLFW window\n");
+		glfwSetFramebufferSizeCallback(ren_glfw_window, window_resized);
+		glfwSetKeyCallback(ren_glfw_window, key_pressed);
 	}
 	
 	// create vulkan instance
 	{
 		// Retrieves the names of the Vulkan *instance* extensions that are necessary.
 		// If NULL is returned, then Vulkan is not usable (likely not installed).
+		// Headless mode doesn't present anything, so it doesn't need any surface extensions.
 		unsigned int n_inst_exts = 0;
-		const char **req_inst_exts = glfwGetRequiredInstanceExtensions(&n_inst_exts);
-		ERROR_IF(!req_inst_exts, "Could not find any Vulkan extensions\n");
+		const char **req_inst_exts = NULL;
+		if(!ren_config.headless) {
+			req_inst_exts = glfwGetRequiredInstanceExtensions(&n_inst_exts);
+			ERROR_IF(!req_inst_exts, "Could not find any Vulkan extensions\n");
+		}
+
+		// Use the newest of Vulkan 1.1 (the feature struct chain, vkGetPhysicalDeviceFeatures2) and 1.2 (timeline semaphores
+		// without the extension) the loader has. vkEnumerateInstanceVersion doesn't exist in 1.0 loaders, so it has to be looked up.
+		vulkan_data.api_version = VK_API_VERSION_1_0;
+		PFN_vkEnumerateInstanceVersion enumerate_instance_version =
+			(PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(NULL, "vkEnumerateInstanceVersion");
+		unsigned int loader_version = VK_API_VERSION_1_0;
+		if(enumerate_instance_version && enumerate_instance_version(&loader_version) == VK_SUCCESS && loader_version >= VK_API_VERSION_1_1) {
+			vulkan_data.api_version = loader_version >= VK_API_VERSION_1_2 ? VK_API_VERSION_1_2 : VK_API_VERSION_1_1;
+		}
 
 		// Create a Vulkan Instance.
 		// We provide Vulkan information about our program and the extensions available on this system,
@@ -112,7 +591,7 @@ main(int argc, char **argv) {
 		app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		app_info.pEngineName = "No Engine";
 		app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		app_info.apiVersion = VK_API_VERSION_1_0;
+		app_info.apiVersion = vulkan_data.api_version;
 
 		VkInstanceCreateInfo create_info = {0};
 		create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -127,93 +606,196 @@ main(int argc, char **argv) {
 
 	// create vulkan device
 	VkPhysicalDevice physical_device = {0};
+	VkPhysicalDeviceProperties gpu_props = {0};
 	int queue_index = -1;
-	const char** dev_exts;
-	VkExtensionProperties* dev_ext_props;
+	int transfer_index = -1; // queue family used for uploads, may be the same as queue_index
+	unsigned int timestamp_bits = 0; // of the graphics queue family, 0 = no timestamp queries
+	VkQueue queue;
+	const char** dev_exts = NULL; // only with --all-device-extensions
+	VkExtensionProperties* dev_ext_props = NULL;
 	{
 		// Determine the list of graphics hardware devices in this computer.
-		// In this example we just select the first vulkan_data.device on the list.
-		int physical_device_count = 0;
+		unsigned int physical_device_count = 0;
 		res = vkEnumeratePhysicalDevices(vulkan_data.instance, &physical_device_count, NULL);
 		ERROR_IF(physical_device_count <= 0, "No graphics hardware was found (physical vulkan_data.device count = %d) (%d)\n", physical_device_count, res);
 
-		physical_device_count = 1;
-		res = vkEnumeratePhysicalDevices(vulkan_data.instance, &physical_device_count, &physical_device);
+		VkPhysicalDevice* physical_devices = heap_alloc(physical_device_count, sizeof(VkPhysicalDevice));
+		res = vkEnumeratePhysicalDevices(vulkan_data.instance, &physical_device_count, physical_devices);
 		ERROR_IF(res != VK_SUCCESS, "vkEnumeratePhysicalDevices() failed (%d)\n", res);
 
-		// Determine which queue family to use.
-		// In this case, we just look for the first one that can do graphics.
-		int n_queues = 0;
-		vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &n_queues, NULL);
-		ERROR_IF(n_queues <= 0, "No queue families were found\n");
+		PFN_vkGetPhysicalDeviceFeatures2 get_features2 = vulkan_data.api_version >= VK_API_VERSION_1_1 ?
+			(PFN_vkGetPhysicalDeviceFeatures2)vkGetInstanceProcAddr(vulkan_data.instance, "vkGetPhysicalDeviceFeatures2") : NULL;
+
+		// Pick the best device that has a queue family which can do graphics (and present, when we have a window),
+		// and all the extensions and features we can't do without.
+		// Real hardware wins over CPU implementations such as Mesa lavapipe, which are only used
+		// when there is nothing else (GPU-less CI machines), or when asked for with --software.
+		int best_score = -1;
+		for(int i = 0; i < physical_device_count; i++) {
+			VkPhysicalDeviceProperties props;
+			vkGetPhysicalDeviceProperties(physical_devices[i], &props);
+
+			int score = 0;
+			switch(props.deviceType) {
+				case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:	score = 4; break;
+				case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:	score = 3; break;
+				case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:	score = 2; break;
+				case VK_PHYSICAL_DEVICE_TYPE_CPU:		score = ren_config.software ? 5 : 1; break;
+				default:					score = 0; break;
+			}
+			if(score <= best_score) continue;
+
+			// Determine which queue family to use.
+			// In this case, we just look for the first one that can do graphics.
+			unsigned int n_queues = 0;
+			vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i], &n_queues, NULL);
+
+			VkQueueFamilyProperties* qfp = heap_alloc(n_queues, sizeof(VkQueueFamilyProperties));
+			vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i], &n_queues, qfp);
+
+			int family = -1;
+			for(int j = 0; j < n_queues; j++) {
+				if(!(qfp[j].queueFlags & VK_QUEUE_GRAPHICS_BIT)) continue;
+				// Check that the chosen queue family supports presentation.
+				if(!ren_config.headless && !glfwGetPhysicalDevicePresentationSupport(vulkan_data.instance, physical_devices[i], j)) continue;
+				family = j;
+				break;
+			}
+			heap_free(qfp);
 
-		VkQueueFamilyProperties* qfp = heap_alloc(n_queues, sizeof(VkQueueFamilyProperties));
-		vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &n_queues, qfp);
+			if(family < 0) continue;
 
-		for(int i = 0; i < n_queues; i++) {
-			if(qfp[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-				queue_index = i;
+			const unsigned int api_version = props.apiVersion < vulkan_data.api_version ? props.apiVersion : vulkan_data.api_version;
+			device_caps_t caps;
+			if(!device_caps_select(&caps, physical_devices[i], api_version, !ren_config.headless,
+				api_version >= VK_API_VERSION_1_1 ? get_features2 : NULL, device_extension_table, device_feature_table)) {
+				printf("skipping device %s: missing required extensions or features\n", props.deviceName);
+				continue;
+			}
+
+			best_score = score;
+			vulkan_data.caps = caps;
+			physical_device = physical_devices[i];
+			gpu_props = props;
+			queue_index = family;
+		}
+		heap_free(physical_devices);
+
+		ERROR_IF(queue_index < 0, "Could not find a device with a graphics%s queue and the required extensions\n", ren_config.headless ? "" : " and present");
+
+		const char* type_name =
+			gpu_props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU	? "discrete" :
+			gpu_props.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU	? "integrated" :
+			gpu_props.deviceType == VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU	? "virtual" :
+			gpu_props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU		? "cpu" : "other";
+		printf("using device: %s (%s)\n", gpu_props.deviceName, type_name);
+
+		// Look for a queue family dedicated to transfers (usually DMA engines on discrete GPUs).
+		// Uploads on it run alongside rendering. Without one, uploads go to the graphics queue.
+		{
+			unsigned int n_queues = 0;
+			vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &n_queues, NULL);
+
+			VkQueueFamilyProperties* qfp = heap_alloc(n_queues, sizeof(VkQueueFamilyProperties));
+			vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &n_queues, qfp);
+
+			timestamp_bits = qfp[queue_index].timestampValidBits;
+			transfer_index = queue_index;
+			for(int j = 0; j < n_queues; j++) {
+				const VkQueueFlags flags = qfp[j].queueFlags;
+				if(!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) continue;
+				transfer_index = j;
 				break;
 			}
+			heap_free(qfp);
+
+			printf("upload queue family: %d (%s)\n", transfer_index, transfer_index != queue_index ? "dedicated transfer" : "graphics");
 		}
-		heap_free(qfp);
 
-		ERROR_IF(queue_index < 0, "Could not find a queue family with graphics support\n");
-		// Check that the chosen queue family supports presentation.
-		ERROR_IF(!glfwGetPhysicalDevicePresentationSupport(vulkan_data.instance, physical_device, queue_index), "The selected queue family does not support present mode\n");
+		device_caps_print(&vulkan_data.caps);
 
-		// Get all Vulkan *device* extensions (as opposed to vulkan_data.instance extensions)
-		unsigned int n_dev_exts = 0;
-		res = vkEnumerateDeviceExtensionProperties(physical_device, NULL, &n_dev_exts, NULL);
-		ERROR_IF(n_dev_exts <= 0 || res != VK_SUCCESS, "Could not find any Vulkan device extensions (found %d, error %d)\n", n_dev_exts, res);
+		// Only what's in the extension table, unless asked to enable everything the device has.
+		unsigned int n_dev_exts = vulkan_data.caps.extensions_count;
+		dev_exts = vulkan_data.caps.extensions;
+		if(ren_config.all_device_extensions) {
+			res = vkEnumerateDeviceExtensionProperties(physical_device, NULL, &n_dev_exts, NULL);
+			ERROR_IF(res != VK_SUCCESS, "vkEnumerateDeviceExtensionProperties() failed (%d)\n", res);
 
-		dev_ext_props = heap_alloc_zeroed(n_dev_exts, sizeof(VkExtensionProperties));
-		res = vkEnumerateDeviceExtensionProperties(physical_device, NULL, &n_dev_exts, dev_ext_props);
-		ERROR_IF(res != VK_SUCCESS, "vkEnumerateDeviceExtensionProperties() failed (%d)\n", res);
+			dev_ext_props = heap_alloc_zeroed(n_dev_exts, sizeof(VkExtensionProperties));
+			res = vkEnumerateDeviceExtensionProperties(physical_device, NULL, &n_dev_exts, dev_ext_props);
+			ERROR_IF(res != VK_SUCCESS, "vkEnumerateDeviceExtensionProperties() failed (%d)\n", res);
 
-		dev_exts = heap_alloc_zeroed(n_dev_exts, sizeof(void*));
-		for(int i = 0; i < n_dev_exts; i++) {
-			dev_exts[i] = &dev_ext_props[i].extensionName[0];
+			dev_exts = heap_alloc_zeroed(n_dev_exts, sizeof(void*));
+			for(int i = 0; i < n_dev_exts; i++) {
+				dev_exts[i] = &dev_ext_props[i].extensionName[0];
+			}
 		}
 
 		// Create a virtual device for Vulkan.
 		// We pass in information regarding the hardware features we want to use as well as the set of queues,
 		// which are essentially the interface between our program and the GPU.
 		float priority = 0.0f;
-		VkDeviceQueueCreateInfo queue_info = {0};
-		queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		queue_info.queueFamilyIndex = queue_index;
-		queue_info.queueCount = 1;
-		queue_info.pQueuePriorities = &priority;
+		VkDeviceQueueCreateInfo queue_info[2] = {0};
+		queue_info[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queue_info[0].queueFamilyIndex = queue_index;
+		queue_info[0].queueCount = 1;
+		queue_info[0].pQueuePriorities = &priority;
+		queue_info[1] = queue_info[0];
+		queue_info[1].queueFamilyIndex = transfer_index;
 
 		VkDeviceCreateInfo device_info = {0};
 		device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-		device_info.queueCreateInfoCount = 1;
-		device_info.pQueueCreateInfos = &queue_info;
+		device_info.queueCreateInfoCount = transfer_index != queue_index ? 2 : 1;
+		device_info.pQueueCreateInfos = queue_info;
 		device_info.enabledExtensionCount = n_dev_exts;
 		device_info.ppEnabledExtensionNames = dev_exts;
+		device_info.pNext = device_caps_chain(&vulkan_data.caps);
+		device_info.pEnabledFeatures = device_caps_enabled_features(&vulkan_data.caps);
 
+		const unsigned long long device_start_ns = time_now_ns();
 		res = vkCreateDevice(physical_device, &device_info, NULL, &vulkan_data.device);
 		ERROR_IF(res != VK_SUCCESS, "vkCreateDevice() failed (%d)\n", res);
+		printf("device creation: %.3f ms (%u extensions%s, Vulkan %u.%u)\n", (time_now_ns() - device_start_ns) / 1e6,
+			n_dev_exts, ren_config.all_device_extensions ? ", all the device has" : "",
+			VK_VERSION_MAJOR(vulkan_data.caps.api_version), VK_VERSION_MINOR(vulkan_data.caps.api_version));
+
+		gpu_alloc_init(&vulkan_data.allocator, physical_device, vulkan_data.device);
+
+		// Frames and uploads are tracked with timeline semaphores when the device has them, unless asked for fences.
+		const int has_timeline = device_caps_has_feature(&vulkan_data.caps, "timelineSemaphore");
+		ERROR_IF(ren_config.sync_mode == SYNC_TIMELINE && !has_timeline, "--sync timeline: the device has no timeline semaphores\n");
+		vulkan_data.use_timeline = has_timeline && ren_config.sync_mode != SYNC_FENCES;
+		if(vulkan_data.use_timeline) {
+			res = timeline_init(&vulkan_data.frame_timeline, vulkan_data.device, 0);
+			ERROR_IF(res != VK_SUCCESS, "creating the frame timeline semaphore failed (%d)\n", res);
+		}
+		printf("frame sync: %s\n", vulkan_data.use_timeline ? "timeline semaphore" : "fences");
+
+		vkGetDeviceQueue(vulkan_data.device, queue_index, 0, &queue);
+		VkQueue transfer_queue;
+		vkGetDeviceQueue(vulkan_data.device, transfer_index, 0, &transfer_queue);
+
+		res = upload_init(&vulkan_data.uploader, vulkan_data.device, &vulkan_data.allocator,
+			transfer_queue, transfer_index, queue, queue_index, vulkan_data.use_timeline);
+		ERROR_IF(res != VK_SUCCESS, "upload_init() failed (%d)\n", res);
+
+		deletion_queue_init(&vulkan_data.deletions);
 	}
 
 	// Get implementation-specific function pointers.
 	// This lets us use parts of the Vulkan API that aren't generalised.
-	PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR	GetPhysicalDeviceSurfaceCapabilitiesKHR;
-	PFN_vkGetPhysicalDeviceSurfaceFormatsKHR	GetPhysicalDeviceSurfaceFormatsKHR;
-	PFN_vkCreateSwapchainKHR			CreateSwapchainKHR;
-	PFN_vkDestroySwapchainKHR			DestroySwapchainKHR;
-	PFN_vkGetSwapchainImagesKHR			GetSwapchainImagesKHR;
-	PFN_vkAcquireNextImageKHR			AcquireNextImageKHR;
-	PFN_vkQueuePresentKHR				QueuePresentKHR;
-	{
-		const int total_fptrs = 7;
+	// Headless mode never touches a surface or swapchain, and the surface functions don't exist
+	// without the instance extensions we skipped.
+	if(!ren_config.headless) {
+		const int total_fptrs = 8;
 		int tally = 0;
 
 		GetPhysicalDeviceSurfaceCapabilitiesKHR
 			= (PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR)vkGetInstanceProcAddr(vulkan_data.instance, "vkGetPhysicalDeviceSurfaceCapabilitiesKHR");
 		GetPhysicalDeviceSurfaceFormatsKHR
 			= (PFN_vkGetPhysicalDeviceSurfaceFormatsKHR)vkGetInstanceProcAddr(vulkan_data.instance, "vkGetPhysicalDeviceSurfaceFormatsKHR");
+		GetPhysicalDeviceSurfacePresentModesKHR
+			= (PFN_vkGetPhysicalDeviceSurfacePresentModesKHR)vkGetInstanceProcAddr(vulkan_data.instance, "vkGetPhysicalDeviceSurfacePresentModesKHR");
 
 		CreateSwapchainKHR	= (PFN_vkCreateSwapchainKHR)	vkGetDeviceProcAddr(vulkan_data.device, "vkCreateSwapchainKHR");
 		DestroySwapchainKHR	= (PFN_vkDestroySwapchainKHR)	vkGetDeviceProcAddr(vulkan_data.device, "vkDestroySwapchainKHR");
@@ -223,6 +805,7 @@ main(int argc, char **argv) {
 
 		tally += GetPhysicalDeviceSurfaceCapabilitiesKHR != NULL;
 		tally += GetPhysicalDeviceSurfaceFormatsKHR != NULL;
+		tally += GetPhysicalDeviceSurfacePresentModesKHR != NULL;
 		tally += CreateSwapchainKHR != NULL;
 		tally += DestroySwapchainKHR != NULL;
 		tally += GetSwapchainImagesKHR != NULL;
@@ -236,8 +819,10 @@ main(int argc, char **argv) {
 	// In this example I use GLFW's equivalent API, which is platform-agnostic.
 	VkSurfaceFormatKHR color_fmt = {0};
 	VkCompositeAlphaFlagBitsKHR alpha_fmt = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-	VkSurfaceCapabilitiesKHR surf_caps;
-	{
+	if(ren_config.headless) {
+		// No surface to ask, so pick what a window would most likely have given us.
+		color_fmt.format = VK_FORMAT_B8G8R8A8_UNORM;
+	} else {
 		res = glfwCreateWindowSurface(vulkan_data.instance, ren_glfw_window, NULL, &vulkan_data.surface);
 		ERROR_IF(res != VK_SUCCESS, "glfwCreateWindowSurface() failed (%d)\n", res);
 
@@ -260,17 +845,14 @@ main(int argc, char **argv) {
 
 		ERROR_IF(color_fmt.format == VK_FORMAT_UNDEFINED, "The ren_glfw_window surface does not define a B8G8R8A8 color format\n");
 
-		// Get information about the OS-specific surface.
+		// Get information about the OS-specific surface. The size is asked for again whenever the swapchain is created.
+		VkSurfaceCapabilitiesKHR surf_caps = {0};
 		res = GetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, vulkan_data.surface, &surf_caps);
 		ERROR_IF(res != VK_SUCCESS, "vkGetPhysicalDeviceSurfaceCapabilitiesKHR() failed (%d)\n", res);
 
-		if(surf_caps.currentExtent.width == 0xffffffff) {
-			surf_caps.currentExtent.width  = WINDOW_SIZE_X;
-			surf_caps.currentExtent.height = WINDOW_SIZE_Y;
-		}
-
-		// This would be where you might want to call vkGetPhysicalDeviceSurfacePresentModeKHR()
-		// to use a non-Vsync presentation mode
+		// Select the present mode.
+		vulkan_data.present_mode = present_policy_mode(physical_device, vulkan_data.surface, ren_config.present_policy);
+		printf("present mode: %s (policy: %s)\n", present_mode_name(vulkan_data.present_mode), present_policy_names[ren_config.present_policy]);
 
 		// Select the composite alpha format.
 		VkCompositeAlphaFlagBitsKHR alpha_list[] = {
@@ -288,108 +870,9 @@ main(int argc, char **argv) {
 		}
 	}
 
-	// Create a swapchain
-	// This lets us maintain a rotating cast of framebuffers.
-	// In this example, we set it up for double-buffering.
-	VkImageView* img_views;
-	{
-		int n_swap_images = surf_caps.minImageCount + 1;
-		if(surf_caps.maxImageCount > 0 && n_swap_images > surf_caps.maxImageCount)
-			n_swap_images = surf_caps.maxImageCount;
-
-		VkImageUsageFlags img_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
-			(surf_caps.supportedUsageFlags & (VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT));
-
-		VkSwapchainCreateInfoKHR swap_info = {0};
-		swap_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-		swap_info.pNext = NULL;
-		swap_info.surface = vulkan_data.surface;
-		swap_info.minImageCount = n_swap_images;
-		swap_info.imageFormat = color_fmt.format;
-		swap_info.imageColorSpace = color_fmt.colorSpace;
-		swap_info.imageExtent = surf_caps.currentExtent;
-		swap_info.imageUsage = img_usage;
-		swap_info.preTransform = (VkSurfaceTransformFlagBitsKHR)surf_caps.currentTransform;
-		swap_info.imageArrayLayers = 1;
-		swap_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		swap_info.queueFamilyIndexCount = 0;
-		swap_info.pQueueFamilyIndices = NULL;
-		swap_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
-		swap_info.oldSwapchain = NULL;
-		swap_info.clipped = VK_TRUE;
-		swap_info.compositeAlpha = alpha_fmt;
-
-		vulkan_data.swapchain;
-		res = CreateSwapchainKHR(vulkan_data.device, &swap_info, NULL, &vulkan_data.swapchain);
-		ERROR_IF(res != VK_SUCCESS, "vkCreateSwapchainKHR() failed (%d)\n", res);
-
-		// Get swapchain images
-		// These are the endpoints for our framebuffers
-		res = GetSwapchainImagesKHR(vulkan_data.device, vulkan_data.swapchain, &vulkan_data.images_count, NULL);
-		ERROR_IF(vulkan_data.images_count <= 0 || res != VK_SUCCESS, "Could not find any swapchain images\n");
-
-		vulkan_data.images = heap_alloc_zeroed(vulkan_data.images_count, sizeof(VkImage));
-		res = GetSwapchainImagesKHR(vulkan_data.device, vulkan_data.swapchain, &vulkan_data.images_count, vulkan_data.images);
-		ERROR_IF(res != VK_SUCCESS, "vkGetSwapchainImagesKHR() failed (%d)\n", res);
-
-		// Create image views for the swapchain.
-		VkImageViewCreateInfo iv_info = {0};
-		iv_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		iv_info.pNext = NULL;
-		iv_info.format = color_fmt.format;
-		iv_info.components = (VkComponentMapping){
-			.r = VK_COMPONENT_SWIZZLE_R,
-			.g = VK_COMPONENT_SWIZZLE_G,
-			.b = VK_COMPONENT_SWIZZLE_B,
-			.a = VK_COMPONENT_SWIZZLE_A
-		};
-		iv_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		iv_info.subresourceRange.baseMipLevel = 0;
-		iv_info.subresourceRange.levelCount = 1;
-		iv_info.subresourceRange.baseArrayLayer = 0;
-		iv_info.subresourceRange.layerCount = 1;
-		iv_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		iv_info.flags = 0;
-
-		img_views = heap_alloc_zeroed(vulkan_data.images_count, sizeof(VkImageView));
-		for(int i = 0; i < vulkan_data.images_count; i++) {
-			iv_info.image = vulkan_data.images[i];
-			res = vkCreateImageView(vulkan_data.device, &iv_info, NULL, &img_views[i]);
-			ERROR_IF(res != VK_SUCCESS, "vkCreateImageView() %d failed (%d)\n", i, res);
-		}
-	}
-
-
-	// Create a command pool.
-	// A command pool is essentially a thread-specific block of memory that is used for allocating commands.
-	{
-		VkCommandPoolCreateInfo cpool_info = {0};
-		cpool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		cpool_info.queueFamilyIndex = queue_index;
-		cpool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-
-		res = vkCreateCommandPool(vulkan_data.device, &cpool_info, NULL, &vulkan_data.cmd_pool);
-		ERROR_IF(res != VK_SUCCESS, "vkCreateCommandPool() failed (%d)\n", res);
-	}
-
-	// Allocate command buffers - one for each image
-	VkCommandBuffer* cmd_buffers;
-	{
-		VkCommandBufferAllocateInfo cbuf_alloc_info = {0};
-		cbuf_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		cbuf_alloc_info.commandPool = vulkan_data.cmd_pool;
-		cbuf_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		cbuf_alloc_info.commandBufferCount = vulkan_data.images_count;
-	
-		cmd_buffers = heap_alloc_zeroed(vulkan_data.images_count, sizeof(VkCommandBuffer));
-		res = vkAllocateCommandBuffers(vulkan_data.device, &cbuf_alloc_info, cmd_buffers);
-		ERROR_IF(res != VK_SUCCESS, "vkAllocateCommandBuffers() failed (%d)\n", res);
-	}
-
 	// Select the depth format.
 	// Used in the creation of the depth stencil.
 	VkFormat depth_fmt = VK_FORMAT_UNDEFINED;
-	VkPhysicalDeviceMemoryProperties gpu_mem;
 	VkFormat formats[] = {
 		VK_FORMAT_D32_SFLOAT_S8_UINT,
 		VK_FORMAT_D32_SFLOAT,
@@ -409,89 +892,8 @@ main(int argc, char **argv) {
 	
 	ERROR_IF(depth_fmt == VK_FORMAT_UNDEFINED, "Could not find a suitable depth format\n");
 
-	// Create depth stencil image.
-	VkImageCreateInfo dimg_info = {0};
-	dimg_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	dimg_info.imageType = VK_IMAGE_TYPE_2D;
-	dimg_info.format = depth_fmt;
-	dimg_info.extent = (VkExtent3D){
-		.width	= surf_caps.currentExtent.width,
-		.height = surf_caps.currentExtent.height,
-		.depth	= 1
-	};
-	dimg_info.mipLevels = 1;
-	dimg_info.arrayLayers = 1;
-	dimg_info.samples = VK_SAMPLE_COUNT_1_BIT;
-	dimg_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-	dimg_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-
-	VkImage depth_img;
-	res = vkCreateImage(vulkan_data.device, &dimg_info, NULL, &depth_img);
-	ERROR_IF(res != VK_SUCCESS, "vkCreateImage() for depth stencil failed (%d)\n", res);
-
-	// Allocate memory for the depth stencil.
-	vkGetPhysicalDeviceMemoryProperties(physical_device, &gpu_mem);
-
-	VkMemoryRequirements mem_reqs;
-	vkGetImageMemoryRequirements(vulkan_data.device, depth_img, &mem_reqs);
-
-
-
-	int mem_type_idx = -1;
-	for(int i = 0; i < gpu_mem.memoryTypeCount; i++) {
-		if((mem_reqs.memoryTypeBits & (1 << i))
-			&& (gpu_mem.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
-			mem_type_idx = i;
-			break;
-		}
-	}
-
-	ERROR_IF(mem_type_idx < 0, "Could not find a suitable type of graphics memory\n");
-
-	VkMemoryAllocateInfo alloc_info = {0};
-	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	alloc_info.allocationSize = mem_reqs.size;
-	alloc_info.memoryTypeIndex = mem_type_idx;
-
-	VkDeviceMemory depth_mem;
-	res = vkAllocateMemory(vulkan_data.device, &alloc_info, NULL, &depth_mem);
-	ERROR_IF(res != VK_SUCCESS, "vkAllocateMemory() for depth stencil failed (%d)\n", res);
-
-	// Bind the newly allocated memory to the depth stencil image.
-	res = vkBindImageMemory(vulkan_data.device, depth_img, depth_mem, 0);
-	ERROR_IF(res != VK_SUCCESS, "vkBindImageMemory() for depth stencil failed (%d)\n", res);
-
-
-
-	// Create depth stencil view.
-	// This is passed to each framebuffer.
-	VkImageAspectFlagBits aspect =
-		depth_fmt >= VK_FORMAT_D16_UNORM_S8_UINT ?
-		VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT :
-		VK_IMAGE_ASPECT_DEPTH_BIT;
-
-	VkImageViewCreateInfo dview_info = {0};
-	dview_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	dview_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	dview_info.image = depth_img;
-	dview_info.format = depth_fmt;
-	dview_info.subresourceRange.baseMipLevel = 0;
-	dview_info.subresourceRange.levelCount = 1;
-	dview_info.subresourceRange.baseArrayLayer = 0;
-	dview_info.subresourceRange.layerCount = 1;
-	dview_info.subresourceRange.aspectMask = aspect;
-
-	VkImageView depth_view;
-	res = vkCreateImageView(vulkan_data.device, &dview_info, NULL, &depth_view);
-	if(res != VK_SUCCESS) {
-		fprintf(stderr, "vkCreateImageView() for depth stencil failed (%d)\n", res);
-		return 23;
-	}
-
-
 	// Set up the render pass.
 	VkRenderPass renderpass;
-	VkFramebuffer* fbuffers;
 	{
 		VkAttachmentDescription attachments[] = {
 			{ // Color attachment
@@ -503,7 +905,8 @@ main(int argc, char **argv) {
 				.stencilLoadOp		= VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 				.stencilStoreOp 	= VK_ATTACHMENT_STORE_OP_DONT_CARE,
 				.initialLayout		= VK_IMAGE_LAYOUT_UNDEFINED,
-				.finalLayout		= VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+				// headless images are never presented, only (optionally) copied out
+				.finalLayout		= ren_config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
 			},
 			{ // Depth attachment
 				.flags			= 0,
@@ -569,133 +972,386 @@ main(int argc, char **argv) {
 			fprintf(stderr, "vkCreateRenderPass() failed (%d)\n", res);
 			return 24;
 		}
-	
-		// Create the frame buffers.
-		VkImageView fb_views[2];
-		fb_views[1] = depth_view;
-	
-		VkFramebufferCreateInfo fb_info = {0};
-		fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		fb_info.renderPass = renderpass;
-		fb_info.attachmentCount = 2;
-		fb_info.pAttachments = fb_views;
-		fb_info.width = surf_caps.currentExtent.width;
-		fb_info.height = surf_caps.currentExtent.height;
-		fb_info.layers = 1;
-	
-		fbuffers = heap_alloc_zeroed(vulkan_data.images_count, sizeof(VkFramebuffer));
-		for(int i = 0; i < vulkan_data.images_count; i++) {
-			fb_views[0] = img_views[i];
-			res = vkCreateFramebuffer(vulkan_data.device, &fb_info, NULL, &fbuffers[i]);
-			ERROR_IF(res != VK_SUCCESS, "vkCreateFramebuffer() %d failed (%d)\n", i, res);
-		}
+	}
+
+	// Create the swapchain, or in headless mode the same number of plain images, and everything that depends on its size:
+	// image views, the depth buffer and framebuffers. All of it is recreated when the window is resized.
+	render_targets_info_t targets_info = {0};
+	{
+		targets_info.physical_device = physical_device;
+		targets_info.color_fmt = color_fmt;
+		targets_info.alpha_fmt = alpha_fmt;
+		targets_info.depth_fmt = depth_fmt;
+		targets_info.renderpass = renderpass;
+
+		res = render_targets_create(&vulkan_data.targets, &targets_info, VK_NULL_HANDLE);
+		ERROR_IF(res != VK_SUCCESS, "creating the render targets failed (%d)\n", res);
 	}
 
 
-	// Create semaphores for synchronising draw commands and image presentation.
-	VkSemaphore sema_present;
-	VkSemaphore sema_render;
+	// Create a command pool.
+	// A command pool is essentially a thread-specific block of memory that is used for allocating commands.
+	// This one is for long-lived command buffers, the ones recorded every frame come from the per-frame pools.
 	{
-		VkSemaphoreCreateInfo bake_sema = {0};
-		bake_sema.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		VkCommandPoolCreateInfo cpool_info = {0};
+		cpool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		cpool_info.queueFamilyIndex = queue_index;
+		cpool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+		res = vkCreateCommandPool(vulkan_data.device, &cpool_info, NULL, &vulkan_data.cmd_pool);
+		ERROR_IF(res != VK_SUCCESS, "vkCreateCommandPool() failed (%d)\n", res);
+	}
+
+	// Allocate command buffers - one for each image (only recorded with RECORD_STATIC)
+	VkCommandBuffer* cmd_buffers;
+	{
+		VkCommandBufferAllocateInfo cbuf_alloc_info = {0};
+		cbuf_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cbuf_alloc_info.commandPool = vulkan_data.cmd_pool;
+		cbuf_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cbuf_alloc_info.commandBufferCount = vulkan_data.targets.images_count;
 	
-		if(vkCreateSemaphore(vulkan_data.device, &bake_sema, NULL, &sema_present) != VK_SUCCESS ||
-			vkCreateSemaphore(vulkan_data.device, &bake_sema, NULL, &sema_render) != VK_SUCCESS) {
-			fprintf(stderr, "Failed to create Vulkan semaphores\n");
-			return 26;
-		}
+		cmd_buffers = heap_alloc_zeroed(vulkan_data.targets.images_count, sizeof(VkCommandBuffer));
+		res = vkAllocateCommandBuffers(vulkan_data.device, &cbuf_alloc_info, cmd_buffers);
+		ERROR_IF(res != VK_SUCCESS, "vkAllocateCommandBuffers() failed (%d)\n", res);
 	}
 
-	// Create wait fences - one for each image.
+
+	// Create semaphores for synchronising draw commands and image presentation,
+	// and the fences the CPU waits on before reusing a frame - one set for each frame in flight.
+	// With the frame timeline there are no fences, the frame number tells which frames are done.
 	{
+		VkSemaphoreCreateInfo bake_sema = {0};
+		bake_sema.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
 		VkFenceCreateInfo fence_info = {0};
 		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 		fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-	
-		vulkan_data.fences = heap_alloc_zeroed(vulkan_data.images_count, sizeof(VkFence));
-		for(int i = 0; i < vulkan_data.images_count; i++) {
-			res = vkCreateFence(vulkan_data.device, &fence_info, NULL, &vulkan_data.fences[i]);
-			ERROR_IF(res != VK_SUCCESS, "vkCreateFence() failed (%d)\n", res);
+
+		for(int i = 0; i < vulkan_data.frames_in_flight; i++) {
+			frame_data_t* frame = &vulkan_data.frames[i];
+			if(vkCreateSemaphore(vulkan_data.device, &bake_sema, NULL, &frame->sema_acquire) != VK_SUCCESS ||
+				vkCreateSemaphore(vulkan_data.device, &bake_sema, NULL, &frame->sema_render) != VK_SUCCESS) {
+				fprintf(stderr, "Failed to create Vulkan semaphores\n");
+				return 26;
+			}
+
+			if(!vulkan_data.use_timeline) {
+				res = vkCreateFence(vulkan_data.device, &fence_info, NULL, &frame->fence);
+				ERROR_IF(res != VK_SUCCESS, "vkCreateFence() failed (%d)\n", res);
+			}
+
+			// Everything allocated from this pool lives for one frame,
+			// so it's reset in one go instead of buffer by buffer.
+			VkCommandPoolCreateInfo cpool_info = {0};
+			cpool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			cpool_info.queueFamilyIndex = queue_index;
+			cpool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+			res = vkCreateCommandPool(vulkan_data.device, &cpool_info, NULL, &frame->cmd_pool);
+			ERROR_IF(res != VK_SUCCESS, "vkCreateCommandPool() for frame %d failed (%d)\n", i, res);
+
+			VkCommandBufferAllocateInfo cbuf_alloc_info = {0};
+			cbuf_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			cbuf_alloc_info.commandPool = frame->cmd_pool;
+			cbuf_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			cbuf_alloc_info.commandBufferCount = 1;
+
+			res = vkAllocateCommandBuffers(vulkan_data.device, &cbuf_alloc_info, &frame->cmd);
+			ERROR_IF(res != VK_SUCCESS, "vkAllocateCommandBuffers() for frame %d failed (%d)\n", i, res);
+
+			// Command pools must not be used from two threads at once, so every recording thread gets its own.
+			for(int t = 0; t < ren_config.threads; t++) {
+				res = vkCreateCommandPool(vulkan_data.device, &cpool_info, NULL, &frame->thread_pools[t]);
+				ERROR_IF(res != VK_SUCCESS, "vkCreateCommandPool() for frame %d thread %d failed (%d)\n", i, t, res);
+
+				cbuf_alloc_info.commandPool = frame->thread_pools[t];
+				cbuf_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+				res = vkAllocateCommandBuffers(vulkan_data.device, &cbuf_alloc_info, &frame->thread_cmds[t]);
+				ERROR_IF(res != VK_SUCCESS, "vkAllocateCommandBuffers() for frame %d thread %d failed (%d)\n", i, t, res);
+			}
+		}
+
+		// No image has been rendered into yet.
+		vulkan_data.image_frames = heap_alloc_zeroed(vulkan_data.targets.images_count, sizeof(unsigned long long));
+	}
+
+	// GPU timings. The queries of a slot live as long as its command buffer:
+	// one slot per frame in flight, or per swapchain image when the command buffers are prerecorded.
+	gpu_profiler_t gpu_prof;
+	gpu_profiler_t* profiler = NULL;
+	if(!ren_config.no_gpu_timings) {
+		const int slots = ren_config.record_mode == RECORD_STATIC ? vulkan_data.targets.images_count : vulkan_data.frames_in_flight;
+		res = gpu_profiler_init(&gpu_prof, vulkan_data.device, gpu_props.limits.timestampPeriod, timestamp_bits, slots);
+		if(res == VK_SUCCESS) {
+			profiler = &gpu_prof;
+		} else {
+			printf("gpu timings: not available (%s)\n", res == VK_ERROR_FEATURE_NOT_PRESENT ? "no timestamps on the graphics queue" : "couldn't create the query pools");
+			gpu_profiler_deinit(&gpu_prof);
 		}
 	}
 
+	// Traces show the GPU zones on the CPU timeline.
+	if(profiler && ren_config.trace_path) {
+		res = gpu_profiler_calibrate(profiler, queue, vulkan_data.cmd_pool);
+		if(res != VK_SUCCESS) printf("trace: couldn't line up the GPU and CPU clocks (%d), only CPU zones will be written\n", res);
+	}
+
+
+
+	// The mesh: the triangle, or a file (--mesh). Files are mapped, their vertex layout is kept as it is.
+	mesh_t mesh = {0};
+	meshlets_t meshlets = {0};
+	mesh_lods_t lods = {0};
+	unsigned long long mesh_load_ns = 0;
+	{
+		if(ren_config.mesh_path) {
+			const unsigned long long load_start_ns = time_now_ns();
+			ERROR_IF(mesh_load(&mesh, ren_config.mesh_path) != 0, "loading `%s` failed: %s\n", ren_config.mesh_path, mesh.error);
+			ERROR_IF(mesh_convert_unsupported(&mesh, vertex_format_supported, &physical_device) != 0,
+				"converting the vertex formats of `%s` failed: %s\n", ren_config.mesh_path, mesh.error);
+			ERROR_IF(mesh.vertex_count == 0 || mesh.index_count == 0, "`%s` has no triangles\n", ren_config.mesh_path);
+			mesh_load_ns = time_now_ns() - load_start_ns;
+			printf("mesh `%s`: %d vertices, %u triangles, %d vertex bindings, %.3f ms to load (%.1f MB mapped, %.1f MB copied)\n",
+				ren_config.mesh_path, mesh.vertex_count, mesh.index_count / 3, mesh.bindings_count, mesh_load_ns / 1e6,
+				mesh.stats.mapped_bytes / 1e6, mesh.stats.copied_bytes / 1e6);
+			if(mesh.primitives_skipped) printf("mesh: only the first triangle list is drawn, %d other primitives skipped\n", mesh.primitives_skipped);
+		} else {
+			const int offsets[MESH_ATTRIBUTE_KINDS] = {0, -1, 3, -1}; // position and color
+			mesh_init_interleaved(&mesh, vertices, 3, 6, offsets, indices, 3);
+		}
+
+		if(ren_config.optimize_mesh) {
+			mesh_opt_report_t report;
+			ERROR_IF(mesh_optimize(&mesh, &report) != 0, "optimizing the mesh failed: %s\n", mesh.error);
+			printf("mesh optimized in %.3f ms: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%d entry FIFO), vertex overfetch %.2f -> %.2f, %d clusters, %d unused vertices dropped\n",
+				report.ns / 1e6, report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr, MESH_OPT_CACHE_SIZE,
+				report.before.overfetch, report.after.overfetch, report.clusters, report.vertices_dropped);
+		}
 
+		// 16 bit indices whenever the vertex count allows, the triangle's included
+		const size_t index_bytes = mesh.indices_size;
+		ERROR_IF(mesh_pack_indices(&mesh) != 0, "packing the indices failed: %s\n", mesh.error);
+		if(ren_config.pack_mesh) {
+			mesh_pack_report_t report;
+			ERROR_IF(mesh_pack(&mesh, vertex_format_supported, &physical_device, &report) != 0, "packing the mesh failed: %s\n", mesh.error);
+			printf("mesh packed: %u -> %u bytes per vertex (%.2f -> %.2f MB), indices %.2f -> %.2f MB. largest errors: position %g (%.2g of the box diagonal), normal %.3g degrees, color %.3g, texcoord %.3g\n",
+				report.vertex_bytes_before, report.vertex_bytes_after, (double)report.vertex_bytes_before * mesh.vertex_count / 1e6,
+				(double)report.vertex_bytes_after * mesh.vertex_count / 1e6, index_bytes / 1e6, mesh.indices_size / 1e6,
+				report.position_error, report.position_error_relative, report.normal_error, report.color_error, report.texcoord_error);
+			ERROR_IF(mesh_pack_check(&mesh, &report) != 0, "the packed mesh is off: %s\n", mesh.error);
+		}
+
+		// after packing, in the final index type, and after the reordering, which the levels keep
+		if(ren_config.lod_pixels > 0.0f) {
+			ERROR_IF(mesh_lod_build(&mesh, &lods) != 0, "building the levels of detail failed: %s\n", mesh.error);
+			printf("levels of detail: %d in %.3f ms, %d vertex positions locked (borders and seams), indices %.2f MB\n",
+				lods.count, lods.ns / 1e6, lods.locked, mesh.indices_size / 1e6);
+			for(int i = 0; i < lods.count; i++) {
+				printf("  level %d: %u triangles (%.1f%%), error %g\n", i, lods.levels[i].index_count / 3,
+					100.0 * lods.levels[i].index_count / lods.levels[0].index_count, lods.levels[i].error);
+			}
+		}
+
+		// in the final index order, so the meshlets are ranges of the index buffer that gets uploaded
+		if(ren_config.cull_mode == CULL_MESHLETS) {
+			const unsigned long long build_start_ns = time_now_ns();
+			ERROR_IF(meshlets_build(&meshlets, &mesh) != 0, "building the meshlets failed: %s\n", mesh.error);
+			// A loaded mesh is drawn with back faces culled (the pipeline below), so a meshlet facing away is culled whole.
+			// The triangle is seen from both sides, culling it when it faces away would change the image.
+			if(!ren_config.mesh_path) meshlets_disable_cones(&meshlets);
+			printf("meshlets: %d in %.3f ms, %.1f vertices and %.1f triangles each on average, %d with a normal cone that can cull\n",
+				meshlets.count, (time_now_ns() - build_start_ns) / 1e6, (double)meshlets.vertices_count / meshlets.count,
+				(double)(mesh.index_count / 3) / meshlets.count, meshlets.cones);
+		}
+	}
 
+	// Scaled uniformly and centered so the largest side goes from -1 to 1, the triangle stays as it is.
+	// Culling tests the fitted box, and the fitted meshlets. The level of detail errors are of the fitted mesh as well.
+	vec3_t mesh_center = {0}, mesh_extent = {0}; // bounding box of the mesh, fitted
+	mat4_t mesh_fit = mat4_identity();
+	{
+		const vec3_t lo = vec3_make(mesh.lo[0], mesh.lo[1], mesh.lo[2]), hi = vec3_make(mesh.hi[0], mesh.hi[1], mesh.hi[2]);
+		const vec3_t center = vec3_scale(vec3_add(lo, hi), 0.5f);
+		const vec3_t extent = vec3_scale(vec3_sub(hi, lo), 0.5f);
+		const float largest = fmaxf(extent.x, fmaxf(extent.y, extent.z));
+		const float scale = largest > 0.0f ? 1.0f / largest : 1.0f;
+		mesh_fit = mat4_trs(vec3_scale(center, -scale), quat_identity(), vec3_make(scale, scale, scale));
+		mesh_center = vec3_make(0.0f, 0.0f, 0.0f);
+		mesh_extent = vec3_scale(extent, scale);
+		const float offset[3] = {-center.x * scale, -center.y * scale, -center.z * scale};
+		meshlets_transform(&meshlets, scale, offset);
+		mesh_lod_scale(&lods, scale);
+		if(mesh.positions_quantized) {
+			// the shaders get 0 to 1 over the box, the same matrix scales it back first
+			const mat4_t dequantize = mat4_trs(vec3_make(mesh.position_offset[0], mesh.position_offset[1], mesh.position_offset[2]), quat_identity(),
+				vec3_make(mesh.position_scale[0], mesh.position_scale[1], mesh.position_scale[2]));
+			mesh_fit = mat4_mul(&mesh_fit, &dequantize);
+		}
+	}
+
+	// --cull meshlets: task and mesh shaders where the device has them, within the workgroup counts every device allows
+	// (65535 objects in y, 2^22 task workgroups), the compute pass writing indirect draws otherwise (lavapipe, older GPUs).
+	const unsigned int task_groups = (meshlets.count + GPU_CULL_TASK_GROUP_SIZE - 1) / GPU_CULL_TASK_GROUP_SIZE;
+	const int mesh_tasks = ren_config.cull_mode == CULL_MESHLETS && !ren_config.no_mesh_shader &&
+		device_caps_has_feature(&vulkan_data.caps, "taskShader") && device_caps_has_feature(&vulkan_data.caps, "meshShader") &&
+		ren_config.objects <= 65535 && (unsigned long long)task_groups * ren_config.objects <= (1u << 22);
+
+	// a buffer per vertex binding, then the index buffer, then the meshlets: meshlet_t, and for the mesh shaders
+	// their vertices and triangles, and the vertices they read
 	struct {
-		void *bytes;
-		int size;
+		const void *bytes;
+		VkDeviceSize size;
 		VkBufferUsageFlagBits usage;
-		VkDeviceMemory memory;
+		gpu_allocation_t memory;
 		VkBuffer buffer;
-	} data[] = {
-		{(void*)vertices, 18 * sizeof(float),	VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,	VK_NULL_HANDLE, VK_NULL_HANDLE},
-		{(void*)indices,   3 * sizeof(int),	VK_BUFFER_USAGE_INDEX_BUFFER_BIT,	VK_NULL_HANDLE, VK_NULL_HANDLE},
-		{(void*)mvp,	  48 * sizeof(float), 	VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,	VK_NULL_HANDLE, VK_NULL_HANDLE},
-	};
+	} data[MESH_MAX_BINDINGS + 5] = {0};
+	const int meshlet_data = mesh.bindings_count + 1;
+	int data_count = meshlet_data;
+	for(int i = 0; i < mesh.bindings_count; i++) {
+		data[i].bytes = mesh.bindings[i].data;
+		data[i].size = mesh.bindings[i].size;
+		data[i].usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	}
+	data[mesh.bindings_count].bytes = mesh.indices;
+	data[mesh.bindings_count].size = mesh.indices_size;
+	data[mesh.bindings_count].usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	meshlet_vertex_t* meshlet_vertices = NULL;
+	if(meshlets.count > 0) {
+		data[data_count].bytes = meshlets.meshlets;
+		data[data_count++].size = meshlets.count * sizeof(meshlet_t);
+		if(mesh_tasks) {
+			// location 1 as the pipeline's vertex input would pick it
+			const mesh_attribute_kind_t color = mesh.attributes[MESH_COLOR].binding >= 0 ? MESH_COLOR :
+				mesh.attributes[MESH_NORMAL].binding >= 0 ? MESH_NORMAL : MESH_POSITION;
+			meshlet_vertices = heap_alloc(mesh.vertex_count, sizeof(meshlet_vertex_t));
+			meshlets_vertex_data(&mesh, color, meshlet_vertices);
+			data[data_count].bytes = meshlets.vertices;
+			data[data_count++].size = meshlets.vertices_count * sizeof(unsigned int);
+			data[data_count].bytes = meshlets.triangles;
+			data[data_count++].size = meshlets.triangles_size;
+			data[data_count].bytes = meshlet_vertices;
+			data[data_count++].size = mesh.vertex_count * sizeof(meshlet_vertex_t);
+		}
+		for(int i = meshlet_data; i < data_count; i++) data[i].usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	}
+	const int meshlets_count = meshlets.count;
 
-	for(int i = 0; i < 3; i++) {
-		VkBufferCreateInfo buf_info = {0};
-		buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		buf_info.size = data[i].size;
-		buf_info.usage = data[i].usage;
+	{
+		const unsigned long long upload_start_ns = time_now_ns();
 
-		res = vkCreateBuffer(vulkan_data.device, &buf_info, NULL, &data[i].buffer);
-		if(res != VK_SUCCESS) {
-			fprintf(stderr, "vkCreateBuffer() %d failed (%d)\n", i, res);
-			return 28;
+		// Vertex and index data never changes, so it lives in device local memory and goes through the upload engine.
+		// All meshes are queued first and then copied in one submit. A file's data is staged straight from its mapping.
+		for(int i = 0; i < data_count; i++) {
+			res = upload_create_buffer(&vulkan_data.uploader, data[i].bytes, data[i].size, data[i].usage, &data[i].buffer, &data[i].memory);
+			ERROR_IF(res != VK_SUCCESS, "creating buffer %d failed (%d)\n", i, res);
 		}
+		res = upload_wait_idle(&vulkan_data.uploader);
+		ERROR_IF(res != VK_SUCCESS, "uploading buffers failed (%d)\n", res);
+		mesh_free(&mesh); // the layout and bounds stay, the data is on the GPU
+		meshlets_free(&meshlets);
+		free(meshlet_vertices);
+
+		const upload_stats_t* us = &vulkan_data.uploader.stats;
+		printf("uploaded %llu bytes: %llu copies, %llu copy commands, %llu submits, %llu ring waits, %.3f ms\n",
+			us->bytes, us->copies, us->copy_commands, us->submits, us->ring_waits, (time_now_ns() - upload_start_ns) / 1e6);
+		if(ren_config.mesh_path) printf("peak RSS after the mesh upload: %.1f MB\n", peak_rss_bytes() / 1e6);
+	}
 
-		VkMemoryRequirements mem_reqs;
-		vkGetBufferMemoryRequirements(vulkan_data.device, data[i].buffer, &mem_reqs);
+	// Uniform ring, written by the CPU every frame, so it's host visible and stays mapped.
+	uniform_ring_t uniforms = {0};
+	{
+		const VkDeviceSize align = gpu_props.limits.minUniformBufferOffsetAlignment;
+		uniforms.frame_stride  = (sizeof(frame_constants_t)  + align - 1) / align * align;
+		uniforms.object_stride = (sizeof(object_constants_t) + align - 1) / align * align;
+		// instances and scene nodes don't use the object blocks, but the descriptor still needs one to point at
+		const int object_blocks = instanced ? 1 : ren_config.objects;
+		uniforms.region_size   = uniforms.frame_stride + uniforms.object_stride * object_blocks;
+		// regions follow the frames in flight, or the images when command buffers are prerecorded per image
+		uniforms.regions_count = ren_config.record_mode == RECORD_STATIC ? vulkan_data.targets.images_count : vulkan_data.frames_in_flight;
 
-		unsigned int flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-		int type_idx = -1;
-		for(int j = 0; j < gpu_mem.memoryTypeCount; j++) {
-			if((mem_reqs.memoryTypeBits & (1 << j)) &&
-				(gpu_mem.memoryTypes[j].propertyFlags & flags) == flags) {
-				mem_type_idx = j;
-				break;
-			}
-		}
+		VkBufferCreateInfo buf_info = {0};
+		buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buf_info.size = uniforms.region_size * uniforms.regions_count;
+		buf_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+
+		const unsigned int flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		res = gpu_alloc_create_buffer(&vulkan_data.allocator, &buf_info, flags, 0, &uniforms.buffer, &uniforms.memory);
+		ERROR_IF(res != VK_SUCCESS, "creating the uniform ring failed (%d)\n", res);
+	}
 
-		ERROR_IF(mem_type_idx < 0, "Could not find an appropriate memory type (%d)\n", i);
+	// Instance ring, also written by the CPU every frame, with the same regions as the uniform ring.
+	instance_ring_t instance_ring = {0};
+	if(ren_config.model_source == MODEL_SOURCE_INSTANCE) {
+		// GPU culling also reads the regions as storage buffers, at dynamic offsets
+		const VkDeviceSize align = gpu_props.limits.minStorageBufferOffsetAlignment;
+		instance_ring.region_size = (sizeof(instance_data_t) * ren_config.objects + align - 1) / align * align;
+		instance_ring.regions_count = uniforms.regions_count;
 
-		alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		alloc_info.allocationSize = mem_reqs.size;
-		alloc_info.memoryTypeIndex = mem_type_idx;
+		VkBufferCreateInfo buf_info = {0};
+		buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buf_info.size = instance_ring.region_size * instance_ring.regions_count;
+		buf_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+		if(gpu_culling) buf_info.usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
 
-		res = vkAllocateMemory(vulkan_data.device, &alloc_info, NULL, &data[i].memory);
-		ERROR_IF(res != VK_SUCCESS, "vkAllocateMemory() %d failed (%d)\n", i, res);
+		const unsigned int flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		res = gpu_alloc_create_buffer(&vulkan_data.allocator, &buf_info, flags, 0, &instance_ring.buffer, &instance_ring.memory);
+		ERROR_IF(res != VK_SUCCESS, "creating the instance ring (%.1f MB) failed (%d)\n", (double)buf_info.size / (1 << 20), res);
+	}
 
-		void *buf;
-		res = vkMapMemory(vulkan_data.device, data[i].memory, 0, alloc_info.allocationSize, 0, &buf);
-		ERROR_IF(res != VK_SUCCESS, "vkMapMemory() %d failed (%d)\n", i, res);
+	// Scene nodes, and their world matrices in a ring like the instance ring.
+	scene_t scene = {0};
+	node_ring_t node_ring = {0};
+	if(ren_config.model_source == MODEL_SOURCE_SCENE) {
+		ERROR_IF(scene_init(&scene, ren_config.objects) != 0, "allocating %d scene nodes failed\n", ren_config.objects);
+		build_scene(&scene, ren_config.objects);
 
-		memcpy(buf, data[i].bytes, data[i].size);
-		vkUnmapMemory(vulkan_data.device, data[i].memory);
+		const VkDeviceSize align = gpu_props.limits.minStorageBufferOffsetAlignment;
+		node_ring.region_size = (sizeof(mat4_t) * ren_config.objects + align - 1) / align * align;
+		node_ring.regions_count = uniforms.regions_count;
+		node_ring.versions = heap_alloc_zeroed(node_ring.regions_count, sizeof(unsigned long long));
 
-		res = vkBindBufferMemory(vulkan_data.device, data[i].buffer, data[i].memory, 0);
-		ERROR_IF(res != VK_SUCCESS, "vkBindBufferMemory() %d failed (%d)\n", i, res);
+		VkBufferCreateInfo buf_info = {0};
+		buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buf_info.size = node_ring.region_size * node_ring.regions_count;
+		buf_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+		const unsigned int flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		res = gpu_alloc_create_buffer(&vulkan_data.allocator, &buf_info, flags, 0, &node_ring.buffer, &node_ring.memory);
+		ERROR_IF(res != VK_SUCCESS, "creating the node ring (%.1f MB) failed (%d)\n", (double)buf_info.size / (1 << 20), res);
 	}
 
-	// Describe the MVP to a uniform descriptor.
+	gpu_alloc_print_stats(&vulkan_data.allocator);
+
+	// Describe the frame and object constants to dynamic uniform descriptors,
+	// and the scene's world matrices to a dynamic storage descriptor.
 	VkDescriptorSetLayout ds_layout;
-	VkDescriptorBufferInfo uniform_info = {0}; // TODO
+	VkDescriptorBufferInfo uniform_info[3] = {0};
+	const int ds_bindings = ren_config.model_source == MODEL_SOURCE_SCENE ? 3 : 2;
 	{
-		uniform_info.buffer = data[2].buffer;
-		uniform_info.offset = 0;
-		uniform_info.range = data[2].size;
+		uniform_info[0].buffer = uniforms.buffer;
+		uniform_info[0].offset = 0;
+		uniform_info[0].range = sizeof(frame_constants_t);
+		uniform_info[1].buffer = uniforms.buffer;
+		uniform_info[1].offset = 0;
+		uniform_info[1].range = sizeof(object_constants_t);
+		uniform_info[2].buffer = node_ring.buffer;
+		uniform_info[2].offset = 0;
+		uniform_info[2].range = node_ring.region_size;
 	
 		// Create descriptor set layout.
-		VkDescriptorSetLayoutBinding ds_bind = {0};
-		ds_bind.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		ds_bind.descriptorCount = 1;
-		ds_bind.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		VkDescriptorSetLayoutBinding ds_bind[3] = {0};
+		for(int i = 0; i < ds_bindings; i++) {
+			ds_bind[i].binding = i;
+			ds_bind[i].descriptorType = i < 2 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+			ds_bind[i].descriptorCount = 1;
+			ds_bind[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		}
 	
 		VkDescriptorSetLayoutCreateInfo ds_info = {0};
 		ds_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		ds_info.bindingCount = 1;
-		ds_info.pBindings = &ds_bind;
+		ds_info.bindingCount = ds_bindings;
+		ds_info.pBindings = ds_bind;
 	
 		res = vkCreateDescriptorSetLayout(vulkan_data.device, &ds_info, NULL, &ds_layout);
 		ERROR_IF(res != VK_SUCCESS, "vkCreateDescriptorSetLayout() failed (%d)\n", res);
@@ -708,6 +1364,14 @@ main(int argc, char **argv) {
 		pl_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		pl_info.setLayoutCount = 1;
 		pl_info.pSetLayouts = &ds_layout;
+
+		// model matrix, used with MODEL_SOURCE_PUSH
+		VkPushConstantRange push_range = {0};
+		push_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		push_range.offset = 0;
+		push_range.size = sizeof(object_constants_t);
+		pl_info.pushConstantRangeCount = 1;
+		pl_info.pPushConstantRanges = &push_range;
 	
 		res = vkCreatePipelineLayout(vulkan_data.device, &pl_info, NULL, &pl_layout);
 		ERROR_IF(res != VK_SUCCESS, "vkCreatePipelineLayout() failed (%d)\n", res);
@@ -717,10 +1381,13 @@ main(int argc, char **argv) {
 	// prepare shaders
 	VkShaderModule frag_shader;
 	VkShaderModule vert_shader;
+	VkShaderModule task_shader = VK_NULL_HANDLE, mesh_shader = VK_NULL_HANDLE; // --cull meshlets with mesh shaders, instead of the vertex shader
 	{
 		// load shader file data
 		size_t vert_shader_spv_size = 0;
-		char* vert_shader_spv = read_entire_file_from_filename("./shader.vert.spv", &vert_shader_spv_size);
+		const char* vert_path = ren_config.model_source == MODEL_SOURCE_INSTANCE ? "./shader_instanced.vert.spv" :
+			ren_config.model_source == MODEL_SOURCE_SCENE ? "./shader_scene.vert.spv" : "./shader.vert.spv";
+		char* vert_shader_spv = read_entire_file_from_filename(vert_path, &vert_shader_spv_size);
 		size_t frag_shader_spv_size = 0;
 		char* frag_shader_spv = read_entire_file_from_filename("./shader.frag.spv", &frag_shader_spv_size);
 
@@ -736,10 +1403,105 @@ main(int argc, char **argv) {
 	
 		res = vkCreateShaderModule(vulkan_data.device, &mod_info, NULL, &vert_shader);
 		ERROR_IF(res != VK_SUCCESS, "vkCreateShaderModule() for vertex shader failed (%d)\n", res);
+
+		if(mesh_tasks) {
+			size_t task_shader_spv_size = 0, mesh_shader_spv_size = 0;
+			char* task_shader_spv = read_entire_file_from_filename("./meshlet.task.spv", &task_shader_spv_size);
+			char* mesh_shader_spv = read_entire_file_from_filename("./meshlet.mesh.spv", &mesh_shader_spv_size);
+			mod_info.codeSize = task_shader_spv_size;
+			mod_info.pCode = (unsigned int*)task_shader_spv;
+			res = vkCreateShaderModule(vulkan_data.device, &mod_info, NULL, &task_shader);
+			ERROR_IF(res != VK_SUCCESS, "vkCreateShaderModule() for task shader failed (%d)\n", res);
+			mod_info.codeSize = mesh_shader_spv_size;
+			mod_info.pCode = (unsigned int*)mesh_shader_spv;
+			res = vkCreateShaderModule(vulkan_data.device, &mod_info, NULL, &mesh_shader);
+			ERROR_IF(res != VK_SUCCESS, "vkCreateShaderModule() for mesh shader failed (%d)\n", res);
+			free(task_shader_spv);
+			free(mesh_shader_spv);
+		}
 	}
 
 
 
+	// Load the pipeline cache from the last run, so the driver can skip compiling the shaders again.
+	VkPipelineCache pipeline_cache;
+	pipeline_cache_status_t pipeline_cache_status;
+	{
+		size_t loaded = 0;
+		res = pipeline_cache_load(vulkan_data.device, &gpu_props, ren_config.pipeline_cache_path, &pipeline_cache, &pipeline_cache_status, &loaded);
+		ERROR_IF(res != VK_SUCCESS, "vkCreatePipelineCache() failed (%d)\n", res);
+
+		if(ren_config.pipeline_cache_path) {
+			printf("pipeline cache `%s`: %s (%zu bytes)\n", ren_config.pipeline_cache_path, pipeline_cache_status_name(pipeline_cache_status), loaded);
+		}
+	}
+
+	// The GPU culling pass, before the graphics pipeline: with mesh shaders that pipeline uses its descriptors.
+	gpu_cull_t gpu_cull = {0};
+	if(gpu_culling) {
+		const gpu_cull_mode_t mode = ren_config.cull_mode == CULL_GPU ? GPU_CULL_OBJECTS : mesh_tasks ? GPU_CULL_MESH_TASKS : GPU_CULL_MESHLETS;
+		if(mode != GPU_CULL_MESH_TASKS) {
+			const unsigned long long commands = (unsigned long long)ren_config.objects * (mode == GPU_CULL_MESHLETS ? meshlets_count : 1);
+			ERROR_IF(!device_caps_has_feature(&vulkan_data.caps, "multiDrawIndirect") || !device_caps_has_feature(&vulkan_data.caps, "drawIndirectFirstInstance"),
+				"--cull gpu and meshlets need the multiDrawIndirect and drawIndirectFirstInstance features, or mesh shaders\n");
+			ERROR_IF(commands > gpu_props.limits.maxDrawIndirectCount || commands > GPU_CULL_MAX_COMMANDS,
+				"--cull draws at most maxDrawIndirectCount (%u) and %d commands, objects * meshlets is %llu\n",
+				gpu_props.limits.maxDrawIndirectCount, GPU_CULL_MAX_COMMANDS, commands);
+			ERROR_IF(mode == GPU_CULL_MESHLETS && (unsigned int)ren_config.objects > gpu_props.limits.maxComputeWorkGroupCount[1],
+				"--cull meshlets dispatches a workgroup row per object, at most maxComputeWorkGroupCount[1] (%u)\n", gpu_props.limits.maxComputeWorkGroupCount[1]);
+		}
+
+		size_t spirv_size = 0;
+		char* spirv = mode == GPU_CULL_MESH_TASKS ? NULL :
+			read_entire_file_from_filename(mode == GPU_CULL_OBJECTS ? "./cull.comp.spv" : "./meshlet_cull.comp.spv", &spirv_size);
+		gpu_cull_info_t info = {0};
+		info.device = vulkan_data.device;
+		info.allocator = &vulkan_data.allocator;
+		info.pipeline_cache = pipeline_cache;
+		info.mode = mode;
+		info.spirv = spirv;
+		info.spirv_size = spirv_size;
+		info.storage_alignment = gpu_props.limits.minStorageBufferOffsetAlignment;
+		info.regions_count = uniforms.regions_count;
+		info.objects_count = ren_config.objects;
+		info.index_count = mesh.index_count;
+		info.sphere[0] = mesh_center.x;
+		info.sphere[1] = mesh_center.y;
+		info.sphere[2] = mesh_center.z;
+		info.sphere[3] = vec3_length(mesh_extent);
+		info.frame_buffer = uniforms.buffer;
+		info.frame_size = sizeof(frame_constants_t);
+		info.instance_buffer = instance_ring.buffer;
+		info.instance_region_size = instance_ring.region_size;
+		if(mode == GPU_CULL_OBJECTS && lods.count > 1) {
+			info.lods_count = lods.count;
+			for(int i = 0; i < lods.count; i++) {
+				info.lod_first_index[i] = lods.levels[i].first_index;
+				info.lod_index_count[i] = lods.levels[i].index_count;
+				info.lod_error[i] = lods.levels[i].error;
+			}
+		}
+		if(mode != GPU_CULL_MESH_TASKS && device_caps_has_extension(&vulkan_data.caps, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+			info.draw_indexed_indirect_count = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(vulkan_data.device, "vkCmdDrawIndexedIndirectCountKHR");
+		}
+		if(mode != GPU_CULL_OBJECTS) {
+			info.meshlets_count = meshlets_count;
+			info.meshlets = data[meshlet_data].buffer;
+		}
+		if(mode == GPU_CULL_MESH_TASKS) {
+			info.meshlet_vertices = data[meshlet_data + 1].buffer;
+			info.meshlet_triangles = data[meshlet_data + 2].buffer;
+			info.vertices = data[meshlet_data + 3].buffer;
+			info.draw_mesh_tasks = (PFN_vkCmdDrawMeshTasksEXT)vkGetDeviceProcAddr(vulkan_data.device, "vkCmdDrawMeshTasksEXT");
+		}
+		res = gpu_cull_init(&gpu_cull, &info);
+		ERROR_IF(res != VK_SUCCESS, "creating the GPU culling pass failed (%d)\n", res);
+		free(spirv);
+		printf("culling: on the GPU, %s, %s\n", mode == GPU_CULL_OBJECTS ? "objects" : "meshlets",
+			mode == GPU_CULL_MESH_TASKS ? "in task shaders" : info.draw_indexed_indirect_count ? "visible draws packed and counted" :
+			mode == GPU_CULL_MESHLETS ? "one indirect command per meshlet of every object" : "one indirect command per object");
+	}
+
 	// Create graphics pipeline.
 	VkPipeline pipeline;
 	{
@@ -752,6 +1514,8 @@ main(int argc, char **argv) {
 		raster_info.polygonMode = VK_POLYGON_MODE_FILL;
 		raster_info.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 		raster_info.lineWidth = 1.0f;
+		// the meshlet normal cones cull what faces away, the rasterizer has to as well or the image would depend on them
+		if(ren_config.cull_mode == CULL_MESHLETS && ren_config.mesh_path) raster_info.cullMode = VK_CULL_MODE_BACK_BIT;
 	
 		VkPipelineColorBlendAttachmentState cblend_att = {0};
 		cblend_att.colorWriteMask = 0xf;
@@ -780,7 +1544,7 @@ main(int argc, char **argv) {
 		depth_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 		depth_info.depthTestEnable = VK_TRUE;
 		depth_info.depthWriteEnable = VK_TRUE;
-		depth_info.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		depth_info.depthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL; // reversed Z, see mat4_perspective()
 		depth_info.back.failOp = VK_STENCIL_OP_KEEP;
 		depth_info.back.passOp = VK_STENCIL_OP_KEEP;
 		depth_info.back.compareOp = VK_COMPARE_OP_ALWAYS;
@@ -790,39 +1554,82 @@ main(int argc, char **argv) {
 		ms_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 		ms_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 	
-		VkVertexInputBindingDescription vb_info = {0};
-		vb_info.binding = 0;
-		vb_info.stride = 6 * sizeof(float); // position and color
-		vb_info.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-	
-		VkVertexInputAttributeDescription vert_att[] = {
-			{ // Position
-				.binding  = 0,
-				.location = 0,
-				.format	  = VK_FORMAT_R32G32B32_SFLOAT,
-				.offset	  = 0
+		// The mesh's bindings and formats as they are in its buffers, then the instance binding.
+		// Location 1 is the color, or the normal shown as one when the mesh has no colors, or else the position.
+		VkVertexInputBindingDescription vb_info[MESH_MAX_BINDINGS + 1] = {0};
+		VkVertexInputAttributeDescription vert_att[MESH_ATTRIBUTE_KINDS + 4] = {0};
+		const mesh_input_t mesh_inputs[] = {
+			{0, MESH_POSITION},
+			{1, mesh.attributes[MESH_COLOR].binding >= 0 ? MESH_COLOR : mesh.attributes[MESH_NORMAL].binding >= 0 ? MESH_NORMAL : MESH_POSITION},
+		};
+		const int mesh_attributes = mesh_vertex_input(&mesh, mesh_inputs, 2, vb_info, vert_att);
+		const int instance_binding = mesh.bindings_count;
+		vb_info[instance_binding].binding = instance_binding;
+		vb_info[instance_binding].stride = sizeof(instance_data_t);
+		vb_info[instance_binding].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+	
+		const VkVertexInputAttributeDescription instance_att[] = {
+			// per instance (shader_instanced.vert only)
+			{ // Model matrix rows
+				.binding  = instance_binding,
+				.location = 2,
+				.format	  = VK_FORMAT_R32G32B32A32_SFLOAT,
+				.offset	  = offsetof(instance_data_t, model[0])
+			},
+			{
+				.binding  = instance_binding,
+				.location = 3,
+				.format	  = VK_FORMAT_R32G32B32A32_SFLOAT,
+				.offset	  = offsetof(instance_data_t, model[4])
 			},
-			{ // Color
-				.binding  = 0,
-				.location = 1,
-				.format	  = VK_FORMAT_R32G32B32_SFLOAT,
-				.offset	  = 3 * sizeof(float)
+			{
+				.binding  = instance_binding,
+				.location = 4,
+				.format	  = VK_FORMAT_R32G32B32A32_SFLOAT,
+				.offset	  = offsetof(instance_data_t, model[8])
+			},
+			{ // Instance color
+				.binding  = instance_binding,
+				.location = 5,
+				.format	  = VK_FORMAT_R8G8B8A8_UNORM,
+				.offset	  = offsetof(instance_data_t, color)
 			}
 		};
 	
+		const int instance_attributes = ren_config.model_source == MODEL_SOURCE_INSTANCE;
+		if(instance_attributes) memcpy(vert_att + mesh_attributes, instance_att, sizeof(instance_att));
 		VkPipelineVertexInputStateCreateInfo vert_info = {0};
 		vert_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vert_info.vertexBindingDescriptionCount = 1;
-		vert_info.pVertexBindingDescriptions = &vb_info;
-		vert_info.vertexAttributeDescriptionCount = 2;
+		vert_info.vertexBindingDescriptionCount = mesh.bindings_count + (instance_attributes ? 1 : 0);
+		vert_info.pVertexBindingDescriptions = vb_info;
+		vert_info.vertexAttributeDescriptionCount = mesh_attributes + (instance_attributes ? 4 : 0);
 		vert_info.pVertexAttributeDescriptions = vert_att;
 	
+		// MODEL_FROM_PUSH_CONSTANT in shader.vert, COLOR_FROM_OCTAHEDRAL_NORMAL in both vertex shaders
+		const VkBool32 spec_data[2] = {
+			ren_config.model_source == MODEL_SOURCE_PUSH,
+			mesh_inputs[1].kind == MESH_NORMAL && mesh.attributes[MESH_NORMAL].octahedral,
+		};
+		VkSpecializationMapEntry spec_entries[2] = {0};
+		for(int i = 0; i < 2; i++) {
+			spec_entries[i].constantID = i;
+			spec_entries[i].offset = i * sizeof(VkBool32);
+			spec_entries[i].size = sizeof(VkBool32);
+		}
+
+		VkSpecializationInfo spec_info = {0};
+		spec_info.mapEntryCount = 2;
+		spec_info.pMapEntries = spec_entries;
+		spec_info.dataSize = sizeof(spec_data);
+		spec_info.pData = spec_data;
+
 		VkPipelineShaderStageCreateInfo shader_stages[] = {
 			{
 				.sType	= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
 				.stage	= VK_SHADER_STAGE_VERTEX_BIT,
 				.module = vert_shader,
-				.pName	= "main"
+				.pName	= "main",
+				.pSpecializationInfo = &spec_info
 			},
 			{
 				.sType	= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -831,6 +1638,21 @@ main(int argc, char **argv) {
 				.pName	= "main"
 			}
 		};
+		const VkPipelineShaderStageCreateInfo mesh_task_stages[] = {
+			{
+				.sType	= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				.stage	= VK_SHADER_STAGE_TASK_BIT_EXT,
+				.module = task_shader,
+				.pName	= "main"
+			},
+			{
+				.sType	= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				.stage	= VK_SHADER_STAGE_MESH_BIT_EXT,
+				.module = mesh_shader,
+				.pName	= "main"
+			},
+			shader_stages[1]
+		};
 	
 		VkGraphicsPipelineCreateInfo pipe_info = {0};
 		pipe_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -846,26 +1668,41 @@ main(int argc, char **argv) {
 		pipe_info.pDepthStencilState = &depth_info;
 		pipe_info.renderPass = renderpass;
 		pipe_info.pDynamicState = &dyn_info;
+		if(mesh_tasks) {
+			// no vertex input, the mesh shader reads the vertices, and gets its descriptors from the culling pass
+			pipe_info.layout = gpu_cull.layout;
+			pipe_info.stageCount = 3;
+			pipe_info.pStages = mesh_task_stages;
+			pipe_info.pVertexInputState = NULL;
+			pipe_info.pInputAssemblyState = NULL;
+		}
 	
-		res = vkCreateGraphicsPipelines(vulkan_data.device, VK_NULL_HANDLE, 1, &pipe_info, NULL, &pipeline);
+		const unsigned long long pipeline_start_ns = time_now_ns();
+		res = vkCreateGraphicsPipelines(vulkan_data.device, pipeline_cache, 1, &pipe_info, NULL, &pipeline);
 		ERROR_IF(res != VK_SUCCESS, "vkCreateGraphicsPipelines() failed (%d)\n", res);
+		printf("pipeline creation: %.3f ms (%s cache)\n", (time_now_ns() - pipeline_start_ns) / 1e6,
+			ren_config.pipeline_cache_path ? pipeline_cache_status_name(pipeline_cache_status) : "no");
 	}
 
 	// Destroy shader modules (now that they have already been incorporated into the pipeline).
 	vkDestroyShaderModule(vulkan_data.device, vert_shader, NULL);
 	vkDestroyShaderModule(vulkan_data.device, frag_shader, NULL);
+	if(task_shader) vkDestroyShaderModule(vulkan_data.device, task_shader, NULL);
+	if(mesh_shader) vkDestroyShaderModule(vulkan_data.device, mesh_shader, NULL);
 
 	// Create a descriptor pool for our descriptor set.
 	VkDescriptorPool dpool;
 	{
-		VkDescriptorPoolSize ps_info = {0};
-		ps_info.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		ps_info.descriptorCount = 1;
+		VkDescriptorPoolSize ps_info[2] = {0};
+		ps_info[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		ps_info[0].descriptorCount = 2;
+		ps_info[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		ps_info[1].descriptorCount = 1;
 	
 		VkDescriptorPoolCreateInfo dpool_info = {0};
 		dpool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		dpool_info.poolSizeCount = 1;
-		dpool_info.pPoolSizes = &ps_info;
+		dpool_info.poolSizeCount = ds_bindings > 2 ? 2 : 1;
+		dpool_info.pPoolSizes = ps_info;
 		dpool_info.maxSets = 1;
 	
 		res = vkCreateDescriptorPool(vulkan_data.device, &dpool_info, NULL, &dpool);
@@ -886,68 +1723,66 @@ main(int argc, char **argv) {
 		ERROR_IF(res != VK_SUCCESS, "vkAllocateDescriptorSets() failed (%d)\n", res);
 	
 		// Set up the descriptor set.
-		VkWriteDescriptorSet write_info = {0};
-		write_info.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		write_info.dstSet = desc_set;
-		write_info.descriptorCount = 1;
-		write_info.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		write_info.pBufferInfo = &uniform_info;
-		write_info.dstBinding = 0;
+		// Written once, the dynamic offsets pick the blocks.
+		VkWriteDescriptorSet write_info[3] = {0};
+		for(int i = 0; i < ds_bindings; i++) {
+			write_info[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write_info[i].dstSet = desc_set;
+			write_info[i].descriptorCount = 1;
+			write_info[i].descriptorType = i < 2 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+			write_info[i].pBufferInfo = &uniform_info[i];
+			write_info[i].dstBinding = i;
+		}
 	
-		vkUpdateDescriptorSets(vulkan_data.device, 1, &write_info, 0, NULL);
+		vkUpdateDescriptorSets(vulkan_data.device, ds_bindings, write_info, 0, NULL);
 	}
 
 	// Construct the command buffers.
 	// This is where we place the draw commands, which are executed by the GPU later.
+	// By default they are recorded every frame in the main loop. With RECORD_STATIC they are recorded here once,
+	// then only the uniform ring contents change.
+	object_constants_t* push_models = NULL;
+	draw_context_t draw_ctx = {0};
+	cull_bounds_t cull_bounds = {0};
+	int* draw_list = NULL;
+	unsigned char* object_lods = NULL; // --lod with one draw per object, the level picked for each this frame
 	{
-		VkCommandBufferBeginInfo cbuf_info = {0};
-		cbuf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	
-		VkClearValue clear_values[] = {
-			{.color = {CLEAR_COLOR}},
-			{.depthStencil = {1.0f, 0}},
-		};
-	
-		VkRenderPassBeginInfo renderpass_info = {0};
-		renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderpass_info.renderPass = renderpass;
-		renderpass_info.renderArea.offset.x = 0;
-		renderpass_info.renderArea.offset.y = 0;
-		renderpass_info.renderArea.extent = surf_caps.currentExtent;
-		renderpass_info.clearValueCount = 2;
-		renderpass_info.pClearValues = clear_values;
-	
-		VkRect2D* scissor = &renderpass_info.renderArea;
-	
-		VkViewport viewport = {0};
-		viewport.height = (float)surf_caps.currentExtent.height;
-		viewport.width = (float)surf_caps.currentExtent.width;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-	
-		for(int i = 0; i < vulkan_data.images_count; i++) {
-			res = vkBeginCommandBuffer(cmd_buffers[i], &cbuf_info);
-			ERROR_IF(res != VK_SUCCESS, "vkBeginCommandBuffer() %d failed (%d)\n", i, res);
-	
-			renderpass_info.framebuffer = fbuffers[i];
-			vkCmdBeginRenderPass(cmd_buffers[i], &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
-	
-			vkCmdSetViewport(cmd_buffers[i], 0, 1, &viewport);
-			vkCmdSetScissor(cmd_buffers[i], 0, 1, scissor);
-	
-			vkCmdBindDescriptorSets(cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pl_layout, 0, 1, &desc_set, 0, NULL);
-			vkCmdBindPipeline(cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-	
-			VkDeviceSize offset = 0;
-			vkCmdBindVertexBuffers(cmd_buffers[i], 0, 1, &data[0].buffer, &offset);
-			vkCmdBindIndexBuffer(cmd_buffers[i], data[1].buffer, 0, VK_INDEX_TYPE_UINT32);
-	
-			const int n_indices = 3;
-			vkCmdDrawIndexed(cmd_buffers[i], n_indices, 1, 0, 0, 1);
-	
-			vkCmdEndRenderPass(cmd_buffers[i]);
-			res = vkEndCommandBuffer(cmd_buffers[i]);
-			ERROR_IF(res != VK_SUCCESS, "vkEndCommandBuffer() %d failed (%d)\n", i, res);
+		draw_ctx.renderpass = renderpass;
+		draw_ctx.extent = vulkan_data.targets.extent;
+		draw_ctx.pipeline = pipeline;
+		draw_ctx.layout = pl_layout;
+		draw_ctx.desc_set = desc_set;
+		for(int i = 0; i < mesh.bindings_count; i++) {
+			draw_ctx.vertex_buffers[i] = data[i].buffer;
+		}
+		draw_ctx.vertex_buffers_count = mesh.bindings_count;
+		draw_ctx.index_buffer = data[mesh.bindings_count].buffer;
+		draw_ctx.index_type = mesh.index_type;
+		draw_ctx.n_indices = mesh.index_count;
+		draw_ctx.objects_count = ren_config.objects;
+		draw_ctx.uniforms = &uniforms;
+		draw_ctx.profiler = profiler;
+
+		if(ren_config.model_source == MODEL_SOURCE_PUSH) {
+			push_models = heap_alloc_zeroed(ren_config.objects, sizeof(object_constants_t));
+			draw_ctx.push_models = push_models;
+		}
+		if(ren_config.model_source == MODEL_SOURCE_INSTANCE) draw_ctx.instances = &instance_ring;
+		if(ren_config.cull_mode == CULL_SPHERE || ren_config.cull_mode == CULL_AABB) {
+			ERROR_IF(cull_bounds_init(&cull_bounds, ren_config.objects) != 0, "allocating the bounds of %d objects failed\n", ren_config.objects);
+			draw_list = heap_alloc(ren_config.objects, sizeof(int));
+		}
+		if(lods.count > 1 && !instanced) {
+			object_lods = heap_alloc_zeroed(ren_config.objects, sizeof(unsigned char));
+			draw_ctx.lods = lods.levels;
+			draw_ctx.object_lods = object_lods;
+		}
+		if(gpu_culling) draw_ctx.cull = &gpu_cull;
+		if(ren_config.model_source == MODEL_SOURCE_SCENE) draw_ctx.nodes = &node_ring;
+
+		for(int i = 0; ren_config.record_mode == RECORD_STATIC && i < vulkan_data.targets.images_count; i++) {
+			res = record_draw_commands(cmd_buffers[i], 0, &draw_ctx, vulkan_data.targets.framebuffers[i], i);
+			ERROR_IF(res != VK_SUCCESS, "recording command buffer %d failed (%d)\n", i, res);
 		}
 	}
 
@@ -956,84 +1791,615 @@ main(int argc, char **argv) {
 	// Prepare main loop.
 	VkSubmitInfo submit_info = {0};
 	VkPresentInfoKHR present_info = {0};
-	VkQueue queue;
+	VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	VkSemaphore signal_semas[2] = {0}; // the frame's render semaphore (windowed), then the frame timeline
+	uint64_t signal_values[2] = {0}; // only the timeline's is used
+	uint64_t wait_value = 0; // unused, the acquire semaphore is binary
+	VkTimelineSemaphoreSubmitInfo timeline_submit = {0};
 	{
-		VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	
 		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submit_info.pWaitDstStageMask = &wait_stage;
-		submit_info.pWaitSemaphores = &sema_present;
-		submit_info.waitSemaphoreCount = 1;
-		submit_info.pSignalSemaphores = &sema_render;
-		submit_info.signalSemaphoreCount = 1;
 		submit_info.commandBufferCount = 1;
+		submit_info.pSignalSemaphores = signal_semas;
+
+		// Offscreen images are never acquired or presented, so there is nothing to wait for or signal.
+		// The semaphores themselves change every frame.
+		if(!ren_config.headless) {
+			submit_info.pWaitDstStageMask = &wait_stage;
+			submit_info.waitSemaphoreCount = 1;
+			submit_info.signalSemaphoreCount = 1;
+		}
+
+		// The frame timeline is signalled after the rest, with the frame number.
+		if(vulkan_data.use_timeline) {
+			signal_semas[submit_info.signalSemaphoreCount++] = vulkan_data.frame_timeline.semaphore;
+
+			timeline_submit.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+			timeline_submit.waitSemaphoreValueCount = submit_info.waitSemaphoreCount;
+			timeline_submit.pWaitSemaphoreValues = &wait_value;
+			timeline_submit.signalSemaphoreValueCount = submit_info.signalSemaphoreCount;
+			timeline_submit.pSignalSemaphoreValues = signal_values;
+			submit_info.pNext = &timeline_submit;
+		}
 	
 		present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 		present_info.swapchainCount = 1;
-		present_info.pSwapchains = &vulkan_data.swapchain;
-		present_info.pWaitSemaphores = &sema_render;
+		present_info.pSwapchains = &vulkan_data.targets.swapchain;
 		present_info.waitSemaphoreCount = 1;
-	
-		vkGetDeviceQueue(vulkan_data.device, queue_index, 0, &queue);
 	}
 
 
 
 	unsigned long long frame_num = 0;
+	int idx = 0;
 
 	// main loop
 	unsigned long long max64 = -1;
-	while(!glfwWindowShouldClose(ren_glfw_window)) {
+	unsigned long long constants_ns = 0; // CPU time spent writing frame and object constants
+	unsigned long long record_ns = 0; // CPU time spent resetting pools and recording command buffers
+	int trace_key_down = 0;
+	camera_t camera = {0.0f, 0.0f, 2.5f, VMATH_PI / 3.0f, 0.1f}; // where the old fixed view was
+	if(ren_config.camera_distance > 0.0f) camera.distance = ren_config.camera_distance;
+	unsigned long long cull_tested = 0;
+	unsigned long long cull_visible = 0;
+	unsigned long long cull_ns = 0;
+	unsigned long long lod_triangles = 0; // drawn, with --lod and one draw per object
+	int swapchain_dirty = 0; // recreate the swapchain before the next frame
+	unsigned long long recreate_count = 0;
+	unsigned long long recreate_ns = 0;
+	unsigned long long recreate_max_ns = 0;
+	unsigned long long sync_wait_ns = 0; // CPU time spent waiting for frames and images to be done
+	unsigned long long sync_calls = 0; // fence waits and resets (SYNC_FENCES only, the timeline counts its own)
+	// Without the render targets: their depth buffer follows the window size, and the window may end at another size than it started.
+	gpu_alloc_stats_t start_memory = gpu_alloc_total_stats(&vulkan_data.allocator);
+	start_memory.used -= render_targets_bytes(&vulkan_data.targets);
+	const unsigned long long loop_start_ns = time_now_ns();
+	unsigned long long input_ns = loop_start_ns;
+	while(ren_config.headless || !glfwWindowShouldClose(ren_glfw_window)) {
+		if(ren_config.max_frames > 0 && frame_num >= ren_config.max_frames) break;
+
+		if(!ren_config.headless) {
+			glfwPollEvents(); // read input from GLFW, resizes included
+
+			// T writes the trace so far.
+			const int trace_key = glfwGetKey(ren_glfw_window, GLFW_KEY_T) == GLFW_PRESS;
+			if(trace_key && !trace_key_down && ren_config.trace_path) {
+				const int zones = cpu_profiler_dump_trace(ren_config.trace_path, profiler);
+				printf("trace: wrote %d zones to `%s`\n", zones, ren_config.trace_path);
+			}
+			trace_key_down = trace_key;
+
+			// P switches to the next policy that gives a different present mode, through a new swapchain.
+			for(; ren_present_presses > 0; ren_present_presses--) {
+				const VkPresentModeKHR current = vulkan_data.present_mode;
+				for(int i = 0; i < PRESENT_POLICY_COUNT - 1 && vulkan_data.present_mode == current; i++) {
+					ren_config.present_policy = (present_policy_t)((ren_config.present_policy + 1) % PRESENT_POLICY_COUNT);
+					vulkan_data.present_mode = present_policy_mode(physical_device, vulkan_data.surface, ren_config.present_policy);
+				}
+				if(vulkan_data.present_mode != current) swapchain_dirty = 1;
+				printf("present mode: %s (policy: %s)\n", present_mode_name(vulkan_data.present_mode), present_policy_names[ren_config.present_policy]);
+			}
+
+			const unsigned long long now_ns = time_now_ns();
+			camera_update(&camera, ren_glfw_window, (float)((now_ns - input_ns) * 1e-9));
+			input_ns = now_ns;
+		}
+
+		// Recreate the swapchain when the window size changed or it stopped matching the surface.
+		// The old render targets may still be used by frames in flight, so they go to the deletion queue
+		// with the number of the last frame that may use them, and nothing waits for the GPU here.
+		if(!ren_config.headless && (swapchain_dirty || ren_window_resized)) {
+			cpu_zone_t zone = cpu_zone_begin("recreate swapchain");
+			const unsigned long long recreate_start_ns = time_now_ns();
+
+			render_targets_t targets = {0};
+			res = render_targets_create(&targets, &targets_info, vulkan_data.targets.swapchain);
+			if(res == VK_NOT_READY) {
+				// Minimized, there is nothing to render into until the window comes back.
+				cpu_zone_end(&zone);
+				glfwWaitEvents();
+				continue;
+			}
+			ERROR_IF(res != VK_SUCCESS, "recreating the render targets failed (%d)\n", res);
+			const int pushed = deletion_queue_push(&vulkan_data.deletions, frame_num, render_targets_deleter, NULL,
+				&vulkan_data.targets, sizeof(vulkan_data.targets), render_targets_bytes(&vulkan_data.targets));
+			ERROR_IF(pushed != 0, "queueing the old render targets for deletion failed\n");
+			vulkan_data.targets = targets;
+			swapchain_dirty = 0;
+			ren_window_resized = 0;
+
+			// No frame has rendered into the new images yet.
+			free(vulkan_data.image_frames);
+			vulkan_data.image_frames = heap_alloc_zeroed(vulkan_data.targets.images_count, sizeof(unsigned long long));
+			draw_ctx.extent = vulkan_data.targets.extent;
+
+			// Prerecorded command buffers point at the old framebuffers. Re-recording them means waiting until none
+			// of them is in use, and they (and their uniform regions) are per image, so the image count has to stay the same.
+			if(ren_config.record_mode == RECORD_STATIC) {
+				ERROR_IF(vulkan_data.targets.images_count != uniforms.regions_count,
+					"the swapchain image count changed (%d to %d), --record static can't follow\n", uniforms.regions_count, vulkan_data.targets.images_count);
+				vkDeviceWaitIdle(vulkan_data.device);
+				for(int i = 0; i < vulkan_data.targets.images_count; i++) {
+					res = record_draw_commands(cmd_buffers[i], 0, &draw_ctx, vulkan_data.targets.framebuffers[i], i);
+					ERROR_IF(res != VK_SUCCESS, "recording command buffer %d failed (%d)\n", i, res);
+				}
+			}
+
+			const unsigned long long elapsed_ns = time_now_ns() - recreate_start_ns;
+			recreate_count++;
+			recreate_ns += elapsed_ns;
+			if(elapsed_ns > recreate_max_ns) recreate_max_ns = elapsed_ns;
+			cpu_zone_end(&zone);
+		}
+
+		const int slot = frame_num % vulkan_data.frames_in_flight;
+		frame_data_t* frame = &vulkan_data.frames[slot];
+
+		cpu_zone_t frame_zone = cpu_zone_begin("frame");
+
+		// Wait until the GPU is done with the last frame that used this slot.
+		// With N frames in flight this lets the CPU run up to N-1 frames ahead.
+		// Frames are numbered from 1, this one is frame_num + 1 and the last one in this slot was N frames before it.
+		const unsigned long long slot_frame = frame_num + 1 > vulkan_data.frames_in_flight ? frame_num + 1 - vulkan_data.frames_in_flight : 0;
+		cpu_zone_t zone = cpu_zone_begin("wait for frame");
+		unsigned long long wait_start_ns = time_now_ns();
+		if(vulkan_data.use_timeline) {
+			res = timeline_wait(&vulkan_data.frame_timeline, slot_frame, max64);
+			ERROR_IF(res != VK_SUCCESS, "vkWaitSemaphores() failed (%d)\n", res);
+		} else {
+			res = vkWaitForFences(vulkan_data.device, 1, &frame->fence, VK_TRUE, max64);
+			ERROR_IF(res != VK_SUCCESS, "vkWaitForFences() failed (%d)\n", res);
+			sync_calls++;
+		}
+		sync_wait_ns += time_now_ns() - wait_start_ns;
+		cpu_zone_end(&zone);
+
+		// Every frame up to the one that used this slot last is done, and whatever only they used can go.
+		// Fences are waited on in order, so that's all they tell. The timeline knows exactly how far the GPU got.
+		const unsigned long long completed = vulkan_data.use_timeline ? timeline_completed(&vulkan_data.frame_timeline) : slot_frame;
+		deletion_queue_collect(&vulkan_data.deletions, completed);
+
+		zone = cpu_zone_begin("acquire");
+		if(ren_config.headless) {
+			// Nobody hands out images, so just cycle through them.
+			idx = frame_num % vulkan_data.targets.images_count;
+		} else {
+			res = AcquireNextImageKHR(vulkan_data.device, vulkan_data.targets.swapchain, max64, frame->sema_acquire, NULL, &idx);
+			if(res == VK_ERROR_OUT_OF_DATE_KHR) {
+				// Nothing was acquired and the semaphore stays unsignalled. Start the frame over with a new swapchain.
+				swapchain_dirty = 1;
+				cpu_zone_end(&zone);
+				cpu_zone_end(&frame_zone);
+				continue;
+			}
+			ERROR_IF(res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR, "vkAcquireNextImageKHR() failed (%d)\n", res);
+			// still presentable, recreate after this frame
+			if(res == VK_SUBOPTIMAL_KHR) swapchain_dirty = 1;
+		}
+		cpu_zone_end(&zone);
 		frame_num++;
-		glfwPollEvents(); // read input from GLFW
 
-		// printf("frame %i\n", frame_num);
+		// The image (and its command buffer) may still be in use by an older frame from a different slot.
+		// A frame that isn't known to be done is newer than slot_frame, so its slot's fence is still its own.
+		const unsigned long long image_frame = vulkan_data.image_frames[idx];
+		if(image_frame > completed) {
+			zone = cpu_zone_begin("wait for image");
+			wait_start_ns = time_now_ns();
+			if(vulkan_data.use_timeline) {
+				res = timeline_wait(&vulkan_data.frame_timeline, image_frame, max64);
+				ERROR_IF(res != VK_SUCCESS, "vkWaitSemaphores() for image %d failed (%d)\n", idx, res);
+			} else {
+				res = vkWaitForFences(vulkan_data.device, 1, &vulkan_data.frames[(image_frame - 1) % vulkan_data.frames_in_flight].fence, VK_TRUE, max64);
+				ERROR_IF(res != VK_SUCCESS, "vkWaitForFences() for image %d failed (%d)\n", idx, res);
+				sync_calls++;
+			}
+			sync_wait_ns += time_now_ns() - wait_start_ns;
+			cpu_zone_end(&zone);
+		}
+		vulkan_data.image_frames[idx] = frame_num;
+
+		// Now that nothing in flight uses this frame slot or image idx, their uniform region is free to write.
+		// The same goes for the GPU timings written by the last frame that used it.
+		const int region = ren_config.record_mode == RECORD_STATIC ? idx : slot;
+		gpu_profiler_collect(profiler, region);
+		gpu_cull_collect(draw_ctx.cull, region);
+		mat4_t view_projection;
+		{
+			zone = cpu_zone_begin("constants");
+			const unsigned long long constants_start_ns = time_now_ns();
+			const float time = (float)((constants_start_ns - loop_start_ns) * 1e-9);
+			frame_constants_t* fc = (frame_constants_t*)((char*)uniforms.memory.mapped + uniform_frame_offset(&uniforms, region));
+			// the aspect ratio follows the render targets, resizes included
+			const mat4_t projection = mat4_perspective(camera.fov_y, (float)draw_ctx.extent.width / (float)draw_ctx.extent.height, camera.near, INFINITY);
+			const vec3_t eye = vec3_make(camera.distance * cosf(camera.pitch) * sinf(camera.yaw), camera.distance * sinf(camera.pitch),
+				camera.distance * cosf(camera.pitch) * cosf(camera.yaw));
+			const mat4_t view = mat4_look_at(eye, vec3_make(0.0f, 0.0f, 0.0f), vec3_make(0.0f, 1.0f, 0.0f));
+			memcpy(fc->projection, projection.m, sizeof(fc->projection));
+			memcpy(fc->view, view.m, sizeof(fc->view));
+			memcpy(fc->mesh, mesh_fit.m, sizeof(fc->mesh));
+			view_projection = mat4_mul(&projection, &view);
+			// pixels per unit of error from this frame's projection and target height, for the CPU here or cull.comp
+			const float lod_factor = lods.count > 1 ? mesh_lod_factor(projection.m, (float)draw_ctx.extent.height, ren_config.lod_pixels) : 0.0f;
+			fc->lod[0] = lod_factor;
+			fc->lod[1] = camera.near;
+			fc->lod[2] = fc->lod[3] = 0.0f;
+
+			if(ren_config.model_source == MODEL_SOURCE_INSTANCE) {
+				// Straight into the mapped region, split over the recording threads when there are any.
+				instance_job_t job = {0};
+				job.instances = (instance_data_t*)((char*)instance_ring.memory.mapped + region * instance_ring.region_size);
+				job.count = ren_config.objects;
+				job.time = time;
+				job.threads = workers.workers_count;
+				if(job.threads > 1) worker_pool_run(&workers, instance_job, &job);
+				else object_instances(job.instances, 0, job.count, job.count, time);
+			} else if(ren_config.model_source == MODEL_SOURCE_SCENE) {
+				// Only what moved is recomputed, and only what this region hasn't seen is written.
+				animate_scene(&scene, time, ren_config.static_nodes);
+				scene_update(&scene);
+				scene_write(&scene, (mat4_t*)((char*)node_ring.memory.mapped + region * node_ring.region_size), &node_ring.versions[region]);
+			} else {
+				for(int i = 0; i < ren_config.objects; i++) {
+					object_constants_t* oc = ren_config.model_source == MODEL_SOURCE_PUSH ? &push_models[i] :
+						(object_constants_t*)((char*)uniforms.memory.mapped + uniform_object_offset(&uniforms, region, i));
+					const mat4_t transform = object_transform(i, ren_config.objects, time);
+					memcpy(oc->model, transform.m, sizeof(oc->model));
+					if(draw_list) cull_bounds_set(&cull_bounds, i, &transform, mesh_center, mesh_extent);
+					if(object_lods) object_lods[i] = (unsigned char)object_lod(&lods, &transform, mesh_center, vec3_length(mesh_extent), eye, camera.near, lod_factor);
+				}
+			}
+			constants_ns += time_now_ns() - constants_start_ns;
+			cpu_zone_end(&zone);
+		}
 
-		int idx;
-		res = AcquireNextImageKHR(vulkan_data.device, vulkan_data.swapchain, max64, sema_present, NULL, &idx);
-		ERROR_IF(res != VK_SUCCESS, "vkAcquireNextImageKHR() failed (%d)\n", res);
+		// Cull against the frame's frustum, only the visible objects get recorded.
+		if(draw_list) {
+			zone = cpu_zone_begin("cull");
+			const unsigned long long cull_start_ns = time_now_ns();
+			cull_job_t job = {0};
+			job.bounds = &cull_bounds;
+			job.frustum = cull_frustum(&view_projection);
+			job.shape = ren_config.cull_mode == CULL_AABB ? CULL_SHAPE_AABB : CULL_SHAPE_SPHERE;
+			job.threads = workers.workers_count > 1 ? workers.workers_count : 1;
+			job.visible = draw_list;
+			if(job.threads > 1) worker_pool_run(&workers, cull_job, &job);
+			else cull_job(&job, 0);
+
+			// close the gaps between the threads' parts, the list stays in object order
+			int visible = job.visible_counts[0];
+			for(int t = 1; t < job.threads; t++) {
+				const int first = (int)((long long)cull_bounds.count * t / job.threads);
+				memmove(draw_list + visible, draw_list + first, job.visible_counts[t] * sizeof(int));
+				visible += job.visible_counts[t];
+			}
+			draw_ctx.draw_list = draw_list;
+			draw_ctx.objects_count = visible;
 
-		res = vkWaitForFences(vulkan_data.device, 1, &vulkan_data.fences[idx], VK_TRUE, max64);
-		ERROR_IF(res != VK_SUCCESS, "vkWaitForFences() failed (%d)\n", res);
+			cull_tested += cull_bounds.count;
+			cull_visible += visible;
+			cull_ns += time_now_ns() - cull_start_ns;
+			cpu_zone_end(&zone);
+		}
+
+		if(object_lods) {
+			for(int i = 0; i < draw_ctx.objects_count; i++) lod_triangles += lods.levels[object_lods[draw_list ? draw_list[i] : i]].index_count / 3;
+		}
 
-		res = vkResetFences(vulkan_data.device, 1, &vulkan_data.fences[idx]);
-		ERROR_IF(res != VK_SUCCESS, "vkResetFences() failed (%d)\n", res);
+		// Record this frame's commands. The wait above means the GPU is done with everything
+		// allocated from the frame's pool, so all of it is recycled at once.
+		VkCommandBuffer cmd = cmd_buffers[idx];
+		if(ren_config.record_mode == RECORD_PER_FRAME) {
+			zone = cpu_zone_begin("record");
+			const unsigned long long record_start_ns = time_now_ns();
+
+			res = vkResetCommandPool(vulkan_data.device, frame->cmd_pool, 0);
+			ERROR_IF(res != VK_SUCCESS, "vkResetCommandPool() failed (%d)\n", res);
+
+			if(ren_config.threads == 0) {
+				res = record_draw_commands(frame->cmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, &draw_ctx, vulkan_data.targets.framebuffers[idx], region);
+				ERROR_IF(res != VK_SUCCESS, "recording the command buffer failed (%d)\n", res);
+			} else {
+				// The draws are split over the threads, the primary only runs the render pass and executes their secondaries.
+				record_job_t job = {0};
+				job.device = vulkan_data.device;
+				job.ctx = &draw_ctx;
+				job.frame = frame;
+				job.framebuffer = vulkan_data.targets.framebuffers[idx];
+				job.region = region;
+				job.threads = workers.workers_count;
+
+				// The zones are allocated here for all threads. Query pools can't be reset inside a render pass,
+				// so the reset goes at the start of the primary, which runs before the secondaries.
+				gpu_profiler_t* prof = draw_ctx.profiler;
+				gpu_profiler_select(prof, region);
+				const int frame_zone = gpu_zone_alloc(prof, "frame", -1);
+				const int pass_zone = gpu_zone_alloc(prof, "scene pass", -1);
+				for(int t = 0; t < job.threads; t++) {
+					job.zones[t] = gpu_zone_alloc(prof, "draws", t);
+				}
+
+				worker_pool_run(&workers, record_secondary_job, &job);
+				for(int t = 0; t < job.threads; t++) {
+					ERROR_IF(job.results[t] != VK_SUCCESS, "recording on thread %d failed (%d)\n", t, job.results[t]);
+				}
+
+				VkCommandBufferBeginInfo cbuf_info = {0};
+				cbuf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+				cbuf_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+				res = vkBeginCommandBuffer(frame->cmd, &cbuf_info);
+				ERROR_IF(res != VK_SUCCESS, "vkBeginCommandBuffer() failed (%d)\n", res);
+
+				gpu_profiler_reset(prof, frame->cmd);
+				gpu_zone_mark(prof, frame->cmd, frame_zone, 0);
+				gpu_zone_mark(prof, frame->cmd, pass_zone, 0);
+				cmd_begin_scene_pass(frame->cmd, &draw_ctx, vulkan_data.targets.framebuffers[idx], VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+				vkCmdExecuteCommands(frame->cmd, job.threads, frame->thread_cmds);
+				vkCmdEndRenderPass(frame->cmd);
+				gpu_zone_mark(prof, frame->cmd, pass_zone, 1);
+				gpu_zone_mark(prof, frame->cmd, frame_zone, 1);
+
+				res = vkEndCommandBuffer(frame->cmd);
+				ERROR_IF(res != VK_SUCCESS, "vkEndCommandBuffer() failed (%d)\n", res);
+			}
+			cmd = frame->cmd;
 
-		submit_info.pCommandBuffers = &cmd_buffers[idx];
-		res = vkQueueSubmit(queue, 1, &submit_info, vulkan_data.fences[idx]);
+			record_ns += time_now_ns() - record_start_ns;
+			cpu_zone_end(&zone);
+		}
+
+		zone = cpu_zone_begin("submit");
+		if(!vulkan_data.use_timeline) {
+			res = vkResetFences(vulkan_data.device, 1, &frame->fence);
+			ERROR_IF(res != VK_SUCCESS, "vkResetFences() failed (%d)\n", res);
+			sync_calls++;
+		}
+
+		submit_info.pWaitSemaphores = &frame->sema_acquire;
+		if(!ren_config.headless) signal_semas[0] = frame->sema_render;
+		if(vulkan_data.use_timeline) signal_values[submit_info.signalSemaphoreCount - 1] = frame_num;
+		submit_info.pCommandBuffers = &cmd;
+		res = vkQueueSubmit(queue, 1, &submit_info, frame->fence);
 		ERROR_IF(res != VK_SUCCESS, "vkQueueSubmit() failed (%d)\n", res);
+		gpu_profiler_submitted(profiler, region);
+		gpu_cull_submitted(draw_ctx.cull, region);
+		cpu_zone_end(&zone);
+
+		if(!ren_config.headless) {
+			zone = cpu_zone_begin("present");
+			present_info.pWaitSemaphores = &frame->sema_render;
+			present_info.pImageIndices = &idx;
+			res = QueuePresentKHR(queue, &present_info);
+			if(res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR) swapchain_dirty = 1;
+			else ERROR_IF(res != VK_SUCCESS, "vkQueuePresentKHR() failed (%d)\n", res);
+			cpu_zone_end(&zone);
+
+			// Cycle through a few window sizes, to exercise swapchain recreation.
+			if(ren_config.resize_every > 0 && frame_num % ren_config.resize_every == 0) {
+				static const int sizes[][2] = {{WINDOW_SIZE_X, WINDOW_SIZE_Y}, {960, 540}, {400, 700}, {1280, 720}, {333, 222}};
+				const int size = (frame_num / ren_config.resize_every) % (sizeof(sizes) / sizeof(sizes[0]));
+				glfwSetWindowSize(ren_glfw_window, sizes[size][0], sizes[size][1]);
+			}
+		}
 
-		present_info.pImageIndices = &idx;
-		res = QueuePresentKHR(queue, &present_info);
-		ERROR_IF(res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR, "vkQueuePresentKHR() failed (%d)\n", res);
+		cpu_zone_end(&frame_zone);
 	}
 
+	// Let the GPU finish, so that the timing covers all submitted work (and clean-up is safe).
+	vkDeviceWaitIdle(vulkan_data.device);
 
-	// clean-up vulkan
+	// Nothing uses anything in the deletion queue anymore.
+	deletion_queue_collect(&vulkan_data.deletions, ~0ull);
+
+	// The last frames' GPU timings are ready now too.
+	for(int i = 0; profiler && i < profiler->slots_count; i++) {
+		gpu_profiler_collect(profiler, i);
+	}
+
+	if(ren_config.trace_path) {
+		const int zones = cpu_profiler_dump_trace(ren_config.trace_path, profiler);
+		ERROR_IF(zones < 0, "couldn't write the trace to `%s`\n", ren_config.trace_path);
+		printf("trace: wrote %d zones to `%s`\n", zones, ren_config.trace_path);
+	}
+
+	// frame statistics
 	{
-		for(int i = 0; i < 3; i++) {
-			vkDestroyBuffer(vulkan_data.device, data[i].buffer, NULL);
-			vkFreeMemory(vulkan_data.device, data[i].memory, NULL);
+		const double seconds = (double)(time_now_ns() - loop_start_ns) * 1e-9;
+		// FIFO modes are capped at the display refresh rate, so say so next to the numbers.
+		printf("frames: %llu, time: %.3f s, fps: %.1f, frame time: %.3f ms, frames in flight: %d, present mode: %s%s (%s, %s)\n",
+			frame_num, seconds,
+			seconds > 0.0 ? (double)frame_num / seconds : 0.0,
+			frame_num > 0 ? seconds * 1000.0 / (double)frame_num : 0.0,
+			vulkan_data.frames_in_flight,
+			ren_config.headless ? "none" : present_mode_name(vulkan_data.present_mode),
+			!ren_config.headless && (vulkan_data.present_mode == VK_PRESENT_MODE_FIFO_KHR || vulkan_data.present_mode == VK_PRESENT_MODE_FIFO_RELAXED_KHR) ? " (vsync capped)" : "",
+			ren_config.headless ? "headless" : "windowed", gpu_props.deviceName);
+		static const char* model_source_names[] = {
+			[MODEL_SOURCE_UNIFORM]	= "uniform ring",
+			[MODEL_SOURCE_PUSH]	= "push constants",
+			[MODEL_SOURCE_INSTANCE]	= "instance attributes, one draw",
+			[MODEL_SOURCE_SCENE]	= "scene nodes, one draw",
+		};
+		printf("objects: %d, model matrices from %s, constants update: %.3f ms/frame\n",
+			ren_config.objects, model_source_names[ren_config.model_source],
+			frame_num > 0 ? (double)constants_ns * 1e-6 / (double)frame_num : 0.0);
+		printf("mesh: %s, %u triangles, %.3f ms to load, peak RSS: %.1f MB\n", ren_config.mesh_path ? ren_config.mesh_path : "the triangle",
+			mesh.index_count / 3, mesh_load_ns / 1e6, peak_rss_bytes() / 1e6);
+		if(ren_config.model_source == MODEL_SOURCE_INSTANCE) {
+			// everything the CPU wrote into the mapped instance ring
+			const double bytes = (double)instance_ring.region_size * (double)frame_num;
+			printf("instance data: %.2f MB/frame, written at %.2f GB/s\n", (double)instance_ring.region_size / (1 << 20),
+				constants_ns > 0 ? bytes / (double)constants_ns : 0.0);
 		}
-	
-		vkDestroyImageView(vulkan_data.device, depth_view, NULL);
-		vkDestroyImage(vulkan_data.device, depth_img, NULL);
-		vkFreeMemory(vulkan_data.device, depth_mem, NULL);
-	
-		vkDestroySemaphore(vulkan_data.device, sema_present, NULL);
-		vkDestroySemaphore(vulkan_data.device, sema_render, NULL);
-	
-		for(int i = 0; i < vulkan_data.images_count; i++) {
-			vkDestroyFence(vulkan_data.device, vulkan_data.fences[i], NULL);
+		if(ren_config.model_source == MODEL_SOURCE_SCENE) {
+			const scene_stats_t* ss = &scene.stats;
+			const double frames = frame_num > 0 ? (double)frame_num : 1.0;
+			printf("scene: %d nodes, %d%% static. per frame: %.0f local and %.0f world matrices computed in %.3f ms, %.0f written (%.2f MB) in %.3f ms\n",
+				scene.count, ren_config.static_nodes, (double)ss->locals / frames, (double)ss->worlds / frames, (double)ss->update_ns * 1e-6 / frames,
+				(double)ss->written / frames, (double)ss->written * sizeof(mat4_t) / (1 << 20) / frames, (double)ss->write_ns * 1e-6 / frames);
 		}
-		free(vulkan_data.fences);
-	
-		for(int i = 0; i < vulkan_data.images_count; i++) {
-			vkDestroyFramebuffer(vulkan_data.device, fbuffers[i], NULL);
+		if(ren_config.record_mode == RECORD_PER_FRAME) {
+			char how[64];
+			if(ren_config.threads == 0) snprintf(how, sizeof(how), "inline");
+			else snprintf(how, sizeof(how), "%d thread%s, secondary command buffers", workers.workers_count, workers.workers_count > 1 ? "s" : "");
+			const double draws = draw_list ? (double)cull_visible : (double)frame_num * (double)ren_config.objects;
+			printf("command recording: per frame (%s), %.3f ms/frame (%.1f ns/draw)\n", how,
+				frame_num > 0 ? (double)record_ns * 1e-6 / (double)frame_num : 0.0,
+				draws > 0.0 ? (double)record_ns / draws : 0.0);
+		} else {
+			printf("command recording: static, prerecorded per image\n");
+		}
+		if(draw_list) {
+			printf("culling: %s, %s, %.0f objects tested and %.0f visible per frame (%.1f%%), %.3f ms/frame\n",
+				ren_config.cull_mode == CULL_AABB ? "boxes" : "spheres", vmath_backend(),
+				frame_num > 0 ? (double)cull_tested / (double)frame_num : 0.0, frame_num > 0 ? (double)cull_visible / (double)frame_num : 0.0,
+				cull_tested > 0 ? 100.0 * (double)cull_visible / (double)cull_tested : 0.0,
+				frame_num > 0 ? (double)cull_ns * 1e-6 / (double)frame_num : 0.0);
+		} else if(draw_ctx.cull) {
+			const gpu_cull_stats_t* cs = &gpu_cull.stats;
+			printf("culling: on the GPU, %s, %.0f %s tested and %.0f visible per frame (%.1f%%), one %s\n",
+				gpu_cull.mode == GPU_CULL_MESH_TASKS ? "task shaders" : gpu_cull.draw_indexed_indirect_count ? "packed and counted" :
+				gpu_cull.mode == GPU_CULL_MESHLETS ? "one command per meshlet" : "one command per object",
+				cs->frames > 0 ? (double)cs->tested / (double)cs->frames : 0.0, gpu_cull.mode == GPU_CULL_OBJECTS ? "objects" : "meshlets",
+				cs->frames > 0 ? (double)cs->visible / (double)cs->frames : 0.0,
+				cs->tested > 0 ? 100.0 * (double)cs->visible / (double)cs->tested : 0.0,
+				gpu_cull.mode == GPU_CULL_MESH_TASKS ? "mesh task draw" : "indirect draw");
+		} else {
+			printf("culling: off\n");
+		}
+		// triangles drawn per frame, and what the same draws would have been at full detail
+		const double lod_drawn = object_lods ? (double)lod_triangles : draw_ctx.cull && lods.count > 1 ? (double)gpu_cull.stats.triangles : 0.0;
+		const double lod_draws = object_lods ? (draw_list ? (double)cull_visible : (double)frame_num * (double)ren_config.objects) :
+			(double)gpu_cull.stats.visible;
+		const double lod_frames = object_lods ? (double)frame_num : (double)gpu_cull.stats.frames;
+		if(lods.count > 1 && lod_frames > 0.0) {
+			printf("levels of detail: under %g pixels of error, %.0f triangles drawn per frame, %.1f%% of the full mesh's %.0f\n", ren_config.lod_pixels,
+				lod_drawn / lod_frames, lod_draws > 0.0 ? 100.0 * lod_drawn / (lod_draws * (lods.levels[0].index_count / 3)) : 0.0,
+				lod_draws / lod_frames * (lods.levels[0].index_count / 3));
+		}
+		gpu_profiler_print(profiler);
+
+		// What it cost the CPU to keep track of the frames.
+		const timeline_stats_t* ts = &vulkan_data.frame_timeline.stats;
+		if(vulkan_data.use_timeline) sync_calls = ts->waits + ts->queries;
+		printf("frame sync: %s, %.2f sync calls/frame, blocked %.3f ms/frame\n",
+			vulkan_data.use_timeline ? "timeline semaphore" : "fences",
+			frame_num > 0 ? (double)sync_calls / (double)frame_num : 0.0,
+			frame_num > 0 ? (double)sync_wait_ns * 1e-6 / (double)frame_num : 0.0);
+
+		if(vulkan_data.deletions.stats.pushed > 0) deletion_queue_print_stats(&vulkan_data.deletions);
+
+		// With every retired render target gone, the memory besides the current render targets should be back to where it was
+		// before the first resize. The allocation count doesn't depend on the size, so it's compared as it is.
+		if(recreate_count > 0) {
+			gpu_alloc_stats_t end_memory = gpu_alloc_total_stats(&vulkan_data.allocator);
+			end_memory.used -= render_targets_bytes(&vulkan_data.targets);
+			printf("swapchain recreations: %llu, %.3f ms avg, %.3f ms max. gpu memory without the render targets before: %d allocations, %.1f KB, after: %d allocations, %.1f KB\n",
+				recreate_count, (double)recreate_ns * 1e-6 / (double)recreate_count, (double)recreate_max_ns * 1e-6,
+				start_memory.allocations, (double)start_memory.used / 1024.0, end_memory.allocations, (double)end_memory.used / 1024.0);
+			ERROR_IF(end_memory.allocations != start_memory.allocations || end_memory.used != start_memory.used,
+				"gpu memory leaked over the swapchain recreations: %d allocations and %lld bytes more than before\n",
+				end_memory.allocations - start_memory.allocations, (long long)end_memory.used - (long long)start_memory.used);
+		}
+	}
+
+	// Read the last frame back and write it out as a binary .ppm.
+	// Only headless images are created with TRANSFER_SRC usage and end up in TRANSFER_SRC_OPTIMAL layout.
+	if(ren_config.headless && ren_config.screenshot_path && frame_num > 0) {
+		const unsigned int width  = vulkan_data.targets.extent.width;
+		const unsigned int height = vulkan_data.targets.extent.height;
+
+		VkBufferCreateInfo rb_info = {0};
+		rb_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		rb_info.size = (VkDeviceSize)width * height * 4;
+		rb_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+		// cached memory makes reading it back on the CPU much faster, if there is any
+		VkBuffer rb_buffer;
+		gpu_allocation_t rb_memory;
+		res = gpu_alloc_create_buffer(&vulkan_data.allocator, &rb_info,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+			&rb_buffer, &rb_memory);
+		ERROR_IF(res != VK_SUCCESS, "creating the readback buffer failed (%d)\n", res);
+
+		// record and submit a one-off copy
+		VkCommandBufferAllocateInfo rb_cbuf_alloc_info = {0};
+		rb_cbuf_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		rb_cbuf_alloc_info.commandPool = vulkan_data.cmd_pool;
+		rb_cbuf_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		rb_cbuf_alloc_info.commandBufferCount = 1;
+
+		VkCommandBuffer rb_cbuf;
+		res = vkAllocateCommandBuffers(vulkan_data.device, &rb_cbuf_alloc_info, &rb_cbuf);
+		ERROR_IF(res != VK_SUCCESS, "vkAllocateCommandBuffers() for readback failed (%d)\n", res);
+
+		VkCommandBufferBeginInfo rb_begin_info = {0};
+		rb_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		rb_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(rb_cbuf, &rb_begin_info);
+
+		VkBufferImageCopy region = {0};
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = (VkExtent3D){width, height, 1};
+		vkCmdCopyImageToBuffer(rb_cbuf, vulkan_data.targets.images[idx], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, rb_buffer, 1, &region);
+
+		res = vkEndCommandBuffer(rb_cbuf);
+		ERROR_IF(res != VK_SUCCESS, "vkEndCommandBuffer() for readback failed (%d)\n", res);
+
+		VkSubmitInfo rb_submit = {0};
+		rb_submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		rb_submit.commandBufferCount = 1;
+		rb_submit.pCommandBuffers = &rb_cbuf;
+		res = vkQueueSubmit(queue, 1, &rb_submit, VK_NULL_HANDLE);
+		ERROR_IF(res != VK_SUCCESS, "vkQueueSubmit() for readback failed (%d)\n", res);
+		vkQueueWaitIdle(queue);
+
+		const unsigned char* pixels = rb_memory.mapped;
+
+		FILE* ppm = fopen(ren_config.screenshot_path, "wb");
+		ERROR_IF(!ppm, "couldn't open `%s` for writing\n", ren_config.screenshot_path);
+		fprintf(ppm, "P6\n%u %u\n255\n", width, height);
+		for(unsigned int i = 0; i < width * height; i++) {
+			// BGRA -> RGB
+			const unsigned char rgb[3] = {pixels[i * 4 + 2], pixels[i * 4 + 1], pixels[i * 4 + 0]};
+			fwrite(rgb, 1, 3, ppm);
+		}
+		fclose(ppm);
+		printf("wrote `%s`\n", ren_config.screenshot_path);
+
+		vkFreeCommandBuffers(vulkan_data.device, vulkan_data.cmd_pool, 1, &rb_cbuf);
+		gpu_destroy_buffer(&vulkan_data.allocator, rb_buffer, &rb_memory);
+	}
+
+
+	// clean-up vulkan
+	{
+		for(int i = 0; i < data_count; i++) {
+			gpu_destroy_buffer(&vulkan_data.allocator, data[i].buffer, &data[i].memory);
+		}
+		gpu_destroy_buffer(&vulkan_data.allocator, uniforms.buffer, &uniforms.memory);
+		if(instance_ring.buffer) gpu_destroy_buffer(&vulkan_data.allocator, instance_ring.buffer, &instance_ring.memory);
+		gpu_cull_deinit(&gpu_cull);
+		if(node_ring.buffer) gpu_destroy_buffer(&vulkan_data.allocator, node_ring.buffer, &node_ring.memory);
+		free(node_ring.versions);
+		scene_deinit(&scene);
+		free(push_models);
+		free(draw_list);
+		free(object_lods);
+		cull_bounds_deinit(&cull_bounds);
+	
+		for(int i = 0; i < vulkan_data.frames_in_flight; i++) {
+			vkDestroySemaphore(vulkan_data.device, vulkan_data.frames[i].sema_acquire, NULL);
+			vkDestroySemaphore(vulkan_data.device, vulkan_data.frames[i].sema_render, NULL);
+			if(vulkan_data.frames[i].fence) vkDestroyFence(vulkan_data.device, vulkan_data.frames[i].fence, NULL);
+			vkDestroyCommandPool(vulkan_data.device, vulkan_data.frames[i].cmd_pool, NULL);
+			for(int t = 0; t < ren_config.threads; t++) {
+				vkDestroyCommandPool(vulkan_data.device, vulkan_data.frames[i].thread_pools[t], NULL);
+			}
 		}
-		free(fbuffers);
+		free(vulkan_data.image_frames);
+		timeline_deinit(&vulkan_data.frame_timeline);
 	
-		//vkFreeCommandBuffers(vulkan_data.device, vulkan_data.cmd_pool, vulkan_data.images_count, cmd_buffers);
+		//vkFreeCommandBuffers(vulkan_data.device, vulkan_data.cmd_pool, vulkan_data.targets.images_count, cmd_buffers);
 		vkDestroyCommandPool(vulkan_data.device, vulkan_data.cmd_pool, NULL);
 		free(cmd_buffers);
 	
@@ -1042,27 +2408,35 @@ main(int argc, char **argv) {
 	
 		vkDestroyPipelineLayout(vulkan_data.device, pl_layout, NULL);
 		vkDestroyPipeline(vulkan_data.device, pipeline, NULL);
-		vkDestroyRenderPass(vulkan_data.device, renderpass, NULL);
-	
-		for(int i = 0; i < vulkan_data.images_count; i++) {
-			vkDestroyImageView(vulkan_data.device, img_views[i], NULL);
+
+		if(ren_config.pipeline_cache_path) {
+			const size_t saved = pipeline_cache_save(vulkan_data.device, pipeline_cache, ren_config.pipeline_cache_path);
+			if(saved) printf("saved pipeline cache `%s` (%zu bytes)\n", ren_config.pipeline_cache_path, saved);
+			else fprintf(stderr, "couldn't save the pipeline cache to `%s`\n", ren_config.pipeline_cache_path);
 		}
-		free(img_views);
-	
-		free(vulkan_data.images);
+		vkDestroyPipelineCache(vulkan_data.device, pipeline_cache, NULL);
+		gpu_profiler_deinit(profiler);
+		vkDestroyRenderPass(vulkan_data.device, renderpass, NULL);
 	
-		DestroySwapchainKHR(vulkan_data.device, vulkan_data.swapchain, NULL);
+		render_targets_destroy(&vulkan_data.targets);
+		if(ren_config.threads > 0) worker_pool_deinit(&workers);
+		cpu_profiler_deinit();
+		upload_deinit(&vulkan_data.uploader);
+		deletion_queue_deinit(&vulkan_data.deletions);
+		gpu_alloc_deinit(&vulkan_data.allocator);
 		vkDestroyDevice(vulkan_data.device, NULL);
 	
-		vkDestroySurfaceKHR(vulkan_data.instance, vulkan_data.surface, NULL);
+		if(!ren_config.headless) vkDestroySurfaceKHR(vulkan_data.instance, vulkan_data.surface, NULL);
 		vkDestroyInstance(vulkan_data.instance, NULL);
 	
-		free((void*)dev_exts);
-		free(dev_ext_props);
+		if(ren_config.all_device_extensions) {
+			free((void*)dev_exts);
+			free(dev_ext_props);
+		}
 	}
 
 	// deinit GLFW
-	{
+	if(!ren_config.headless) {
 		glfwDestroyWindow(ren_glfw_window);
 		glfwTerminate();
 	}
@@ -1087,6 +2461,602 @@ _ren_vulkan_deinit() {
 
 
 
+static inline const char*
+present_mode_name(VkPresentModeKHR mode) {
+	switch(mode) {
+		case VK_PRESENT_MODE_IMMEDIATE_KHR:	return "IMMEDIATE";
+		case VK_PRESENT_MODE_MAILBOX_KHR:	return "MAILBOX";
+		case VK_PRESENT_MODE_FIFO_KHR:		return "FIFO";
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR:	return "FIFO_RELAXED";
+		default:				return "unknown";
+	}
+} // present_mode_name
+
+// The first mode of `policy` that the surface supports, FIFO when none of the others is.
+static inline VkPresentModeKHR
+present_policy_mode(VkPhysicalDevice physical_device, VkSurfaceKHR surface, present_policy_t policy) {
+	unsigned int n_present_modes = 0;
+	VkResult res = GetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &n_present_modes, NULL);
+	ERROR_IF(n_present_modes <= 0 || res != VK_SUCCESS, "Could not find any present modes for the window surface\n");
+
+	VkPresentModeKHR* present_modes = heap_alloc(n_present_modes, sizeof(VkPresentModeKHR));
+	res = GetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &n_present_modes, present_modes);
+	ERROR_IF(res != VK_SUCCESS, "vkGetPhysicalDeviceSurfacePresentModesKHR() failed (%d)\n", res);
+
+	VkPresentModeKHR mode = VK_PRESENT_MODE_FIFO_KHR;
+	const VkPresentModeKHR* wanted = present_policy_modes[policy];
+	int found = 0;
+	for(int i = 0; i < 3 && !found; i++) {
+		for(int j = 0; j < n_present_modes; j++) {
+			if(present_modes[j] == wanted[i]) {
+				mode = wanted[i];
+				found = 1;
+				break;
+			}
+		}
+	}
+	heap_free(present_modes);
+	return mode;
+} // present_policy_mode
+
+// dynamic offset of the frame constants in a region of the uniform ring
+static inline unsigned int
+uniform_frame_offset(const uniform_ring_t* ring, int region) {
+	return (unsigned int)(region * ring->region_size);
+} // uniform_frame_offset
+
+// dynamic offset of an object's constants in a region of the uniform ring
+static inline unsigned int
+uniform_object_offset(const uniform_ring_t* ring, int region, int object) {
+	return (unsigned int)(region * ring->region_size + ring->frame_stride + object * ring->object_stride);
+} // uniform_object_offset
+
+// Turns and moves the camera with the keyboard, `dt` seconds since the last call.
+static inline void
+camera_update(camera_t* camera, GLFWwindow* window, float dt) {
+	const float turn = 1.5f * dt; // radians per second
+	if(glfwGetKey(window, GLFW_KEY_LEFT)  == GLFW_PRESS) camera->yaw -= turn;
+	if(glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) camera->yaw += turn;
+	if(glfwGetKey(window, GLFW_KEY_UP)    == GLFW_PRESS) camera->pitch += turn;
+	if(glfwGetKey(window, GLFW_KEY_DOWN)  == GLFW_PRESS) camera->pitch -= turn;
+	// stop short of straight up or down, where look-at has no sideways direction
+	const float max_pitch = VMATH_PI * 0.49f;
+	if(camera->pitch >  max_pitch) camera->pitch =  max_pitch;
+	if(camera->pitch < -max_pitch) camera->pitch = -max_pitch;
+
+	const float zoom = 1.0f + 2.0f * dt;
+	if(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) camera->distance /= zoom;
+	if(glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) camera->distance *= zoom;
+	if(camera->distance < camera->near * 2.0f) camera->distance = camera->near * 2.0f;
+	if(camera->distance > 1000.0f) camera->distance = 1000.0f;
+} // camera_update
+
+// Lays the objects out on a square grid covering [-1, 1] in the XY plane, each one spinning around Z.
+static inline mat4_t
+object_transform(int object, int objects_count, float time) {
+	const int side = (int)ceilf(sqrtf((float)objects_count));
+	const float cell = 2.0f / (float)side;
+	const float scale = cell * 0.45f;
+	const float angle = time + (float)object * 0.37f;
+	const vec3_t position = vec3_make(-1.0f + cell * ((float)(object % side) + 0.5f), -1.0f + cell * ((float)(object / side) + 0.5f), 0.0f);
+	return mat4_trs(position, quat_from_axis_angle(vec3_make(0.0f, 0.0f, 1.0f), angle), vec3_make(scale, scale, scale));
+} // object_transform
+
+// mesh_lod_select() for an object: its bounding sphere (center and radius of the fitted mesh) moved by the model matrix,
+// and the distance from the eye to the sphere's nearest point, at least the near plane's.
+static inline int
+object_lod(const mesh_lods_t* lods, const mat4_t* transform, vec3_t center, float radius, vec3_t eye, float near, float factor) {
+	const vec4_t c = mat4_mul_vec4_scalar(transform, (vec4_t){center.x, center.y, center.z, 1.0f});
+	float scale2 = 0.0f;
+	for(int col = 0; col < 3; col++) {
+		const float* m = transform->m + col * 4;
+		scale2 = fmaxf(scale2, m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+	}
+	const float scale = sqrtf(scale2);
+	const float distance = fmaxf(vec3_length(vec3_sub(vec3_make(c.x, c.y, c.z), eye)) - radius * scale, near);
+	return mesh_lod_select(lods, scale, distance, factor);
+} // object_lod
+
+// object_transform() of instances [first, first + count), as 3x4 rows.
+// Each instance is put together on the stack and copied out whole, since `instances` is usually uncached (write-combined) memory.
+static inline void
+object_instances(instance_data_t* instances, int first, int count, int objects_count, float time) {
+	for(int object = first; object < first + count; object++) {
+		const mat4_t m = object_transform(object, objects_count, time);
+
+		// a fixed color per instance, from a hash of its index
+		const unsigned int hash = (unsigned int)object * 2654435761u;
+
+		instance_data_t inst;
+		for(int row = 0; row < 3; row++) {
+			inst.model[row * 4 + 0] = m.m[0 + row];
+			inst.model[row * 4 + 1] = m.m[4 + row];
+			inst.model[row * 4 + 2] = m.m[8 + row];
+			inst.model[row * 4 + 3] = m.m[12 + row];
+		}
+		inst.color = hash | 0x80808080u; // keep every channel at least half bright
+		instances[object] = inst;
+	}
+} // object_instances
+
+// Groups of SCENE_GROUP_NODES nodes: the roots on a square grid covering [-1, 1] like object_transform(), each with children
+// circling it, and a grandchild circling each child. The last group may be cut short.
+static inline void
+build_scene(scene_t* scene, int nodes_count) {
+	const int groups = (nodes_count + SCENE_GROUP_NODES - 1) / SCENE_GROUP_NODES;
+	const int side = (int)ceilf(sqrtf((float)groups));
+	const float cell = 2.0f / (float)side;
+	const vec3_t one = vec3_make(1.0f, 1.0f, 1.0f);
+
+	for(int g = 0; g < groups && scene->count < nodes_count; g++) {
+		const vec3_t position = vec3_make(-1.0f + cell * ((float)(g % side) + 0.5f), -1.0f + cell * ((float)(g / side) + 0.5f), 0.0f);
+		const float scale = cell * 0.2f;
+		const int root = scene_add_node(scene, -1, position, quat_identity(), vec3_make(scale, scale, scale));
+		for(int c = 0; c < (SCENE_GROUP_NODES - 1) / 2 && scene->count < nodes_count; c++) {
+			const float angle = (float)c * VMATH_PI * 0.5f;
+			const int child = scene_add_node(scene, root, vec3_make(1.4f * cosf(angle), 1.4f * sinf(angle), 0.0f), quat_identity(), vec3_make(0.4f, 0.4f, 0.4f));
+			if(scene->count < nodes_count) scene_add_node(scene, child, vec3_make(1.5f, 0.0f, 0.0f), quat_identity(), one);
+		}
+	}
+} // build_scene
+
+// Spins the roots and children of the moving groups. The grandchildren's local transforms never change, they only move with their parents.
+// Group g stays still when (g * 37) % 100 < static_percent, which spreads the static ones over the grid.
+static inline void
+animate_scene(scene_t* scene, float time, int static_percent) {
+	const vec3_t z = vec3_make(0.0f, 0.0f, 1.0f);
+	for(int root = 0; root < scene->count; root += SCENE_GROUP_NODES) {
+		const int g = root / SCENE_GROUP_NODES;
+		if((g * 37) % 100 < static_percent) continue;
+		scene_set_rotation(scene, root, quat_from_axis_angle(z, time * 0.5f + (float)g * 0.37f));
+		const quat_t spin = quat_from_axis_angle(z, time * 2.0f);
+		for(int child = root + 1; child < root + SCENE_GROUP_NODES && child < scene->count; child += 2) {
+			scene_set_rotation(scene, child, spin);
+		}
+	}
+} // animate_scene
+
+// worker_fn_t: writes this worker's slice of the instances.
+static void
+instance_job(void* user, int worker) {
+	instance_job_t* job = user;
+	const int first = (int)((long long)job->count * worker / job->threads);
+	const int last  = (int)((long long)job->count * (worker + 1) / job->threads);
+	cpu_zone_t zone = cpu_zone_begin("write instances");
+	object_instances(job->instances, first, last - first, job->count, job->time);
+	cpu_zone_end(&zone);
+} // instance_job
+
+// worker_fn_t: culls this worker's slice of the objects into its part of the draw list.
+static void
+cull_job(void* user, int worker) {
+	cull_job_t* job = user;
+	const int first = (int)((long long)job->bounds->count * worker / job->threads);
+	const int last  = (int)((long long)job->bounds->count * (worker + 1) / job->threads);
+	cpu_zone_t zone = cpu_zone_begin("cull objects");
+	job->visible_counts[worker] = cull_range(job->bounds, &job->frustum, job->shape, first, last - first, job->visible + first);
+	cpu_zone_end(&zone);
+} // cull_job
+
+// Begins the render pass that draws the scene.
+static inline void
+cmd_begin_scene_pass(VkCommandBuffer cmd, const draw_context_t* ctx, VkFramebuffer framebuffer, VkSubpassContents contents) {
+	VkClearValue clear_values[] = {
+		{.color = {CLEAR_COLOR}},
+		{.depthStencil = {0.0f, 0}}, // reversed Z: 0 is the far plane
+	};
+
+	VkRenderPassBeginInfo renderpass_info = {0};
+	renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderpass_info.renderPass = ctx->renderpass;
+	renderpass_info.framebuffer = framebuffer;
+	renderpass_info.renderArea.offset.x = 0;
+	renderpass_info.renderArea.offset.y = 0;
+	renderpass_info.renderArea.extent = ctx->extent;
+	renderpass_info.clearValueCount = 2;
+	renderpass_info.pClearValues = clear_values;
+	vkCmdBeginRenderPass(cmd, &renderpass_info, contents);
+} // cmd_begin_scene_pass
+
+// Draws objects [first, first + count) inside the scene render pass, using the uniform ring region `region`.
+// Sets all of its state itself, since secondary command buffers inherit none.
+static inline void
+cmd_draw_objects(VkCommandBuffer cmd, const draw_context_t* ctx, int region, int first, int count) {
+	VkViewport viewport = {0};
+	viewport.height = (float)ctx->extent.height;
+	viewport.width = (float)ctx->extent.width;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+	VkRect2D scissor = {0};
+	scissor.extent = ctx->extent;
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx->pipeline);
+	if(ctx->cull && ctx->cull->mode == GPU_CULL_MESH_TASKS) {
+		// no vertex or index buffers, the task shaders launch the visible meshlets of every object
+		gpu_cull_draw(ctx->cull, cmd, region, uniform_frame_offset(ctx->uniforms, region));
+		return;
+	}
+
+	const VkDeviceSize offsets[MESH_MAX_BINDINGS] = {0};
+	vkCmdBindVertexBuffers(cmd, 0, ctx->vertex_buffers_count, ctx->vertex_buffers, offsets);
+	vkCmdBindIndexBuffer(cmd, ctx->index_buffer, 0, ctx->index_type);
+
+	unsigned int dyn_offsets[3] = {
+		uniform_frame_offset(ctx->uniforms, region),
+		uniform_object_offset(ctx->uniforms, region, 0),
+		0,
+	};
+
+	if(ctx->nodes) {
+		// one bind and one draw, each instance reads its world matrix from this region of the node ring
+		dyn_offsets[2] = (unsigned int)(region * ctx->nodes->region_size);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx->layout, 0, 1, &ctx->desc_set, 3, dyn_offsets);
+		vkCmdDrawIndexed(cmd, ctx->n_indices, count, 0, 0, first);
+	} else if(ctx->instances) {
+		// one bind and one draw, the instance attributes come from this region of the instance ring
+		const VkDeviceSize instance_offset = region * ctx->instances->region_size;
+		vkCmdBindVertexBuffers(cmd, ctx->vertex_buffers_count, 1, &ctx->instances->buffer, &instance_offset);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx->layout, 0, 1, &ctx->desc_set, 2, dyn_offsets);
+		// or the draws the cull pass wrote, for every object
+		if(ctx->cull) gpu_cull_draw(ctx->cull, cmd, region, dyn_offsets[0]);
+		else vkCmdDrawIndexed(cmd, ctx->n_indices, count, 0, 0, first);
+	} else if(ctx->push_models) {
+		// one bind, the model matrix changes between draws
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx->layout, 0, 1, &ctx->desc_set, 2, dyn_offsets);
+		for(int i = first; i < first + count; i++) {
+			const int object = ctx->draw_list ? ctx->draw_list[i] : i;
+			vkCmdPushConstants(cmd, ctx->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(object_constants_t), &ctx->push_models[object]);
+			if(ctx->object_lods) {
+				const mesh_lod_t* lod = &ctx->lods[ctx->object_lods[object]];
+				vkCmdDrawIndexed(cmd, lod->index_count, 1, lod->first_index, 0, 0);
+			} else {
+				vkCmdDrawIndexed(cmd, ctx->n_indices, 1, 0, 0, 0);
+			}
+		}
+	} else {
+		// same descriptor set, only the object's dynamic offset changes
+		for(int i = first; i < first + count; i++) {
+			const int object = ctx->draw_list ? ctx->draw_list[i] : i;
+			dyn_offsets[1] = uniform_object_offset(ctx->uniforms, region, object);
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx->layout, 0, 1, &ctx->desc_set, 2, dyn_offsets);
+			if(ctx->object_lods) {
+				const mesh_lod_t* lod = &ctx->lods[ctx->object_lods[object]];
+				vkCmdDrawIndexed(cmd, lod->index_count, 1, lod->first_index, 0, 0);
+			} else {
+				vkCmdDrawIndexed(cmd, ctx->n_indices, 1, 0, 0, 0);
+			}
+		}
+	}
+} // cmd_draw_objects
+
+// Records the whole scene into cmd, using the uniform ring region `region`.
+static inline VkResult
+record_draw_commands(VkCommandBuffer cmd, VkCommandBufferUsageFlags usage, const draw_context_t* ctx, VkFramebuffer framebuffer, int region) {
+	VkCommandBufferBeginInfo cbuf_info = {0};
+	cbuf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cbuf_info.flags = usage;
+
+	VkResult res = vkBeginCommandBuffer(cmd, &cbuf_info);
+	if(res != VK_SUCCESS) return res;
+
+	// GPU timings go into the region's query pool, which is read back once the GPU is done with the region.
+	gpu_profiler_begin(ctx->profiler, cmd, region);
+	const int frame_zone = gpu_zone_begin(ctx->profiler, cmd, "frame", -1);
+	if(ctx->cull) {
+		const int cull_zone = gpu_zone_begin(ctx->profiler, cmd, "cull", -1);
+		gpu_cull_dispatch(ctx->cull, cmd, region, uniform_frame_offset(ctx->uniforms, region));
+		gpu_zone_end(ctx->profiler, cmd, cull_zone);
+	}
+	const int pass_zone = gpu_zone_begin(ctx->profiler, cmd, "scene pass", -1);
+	cmd_begin_scene_pass(cmd, ctx, framebuffer, VK_SUBPASS_CONTENTS_INLINE);
+
+	const int draws_zone = gpu_zone_begin(ctx->profiler, cmd, "draws", -1);
+	cmd_draw_objects(cmd, ctx, region, 0, ctx->objects_count);
+	gpu_zone_end(ctx->profiler, cmd, draws_zone);
+
+	vkCmdEndRenderPass(cmd);
+	gpu_cull_end(ctx->cull, cmd);
+	gpu_zone_end(ctx->profiler, cmd, pass_zone);
+	gpu_zone_end(ctx->profiler, cmd, frame_zone);
+
+	return vkEndCommandBuffer(cmd);
+} // record_draw_commands
+
+// worker_fn_t: records this worker's slice of the objects into its secondary command buffer.
+static void
+record_secondary_job(void* user, int worker) {
+	record_job_t* job = user;
+	const draw_context_t* ctx = job->ctx;
+	VkCommandBuffer cmd = job->frame->thread_cmds[worker];
+
+	VkResult res = vkResetCommandPool(job->device, job->frame->thread_pools[worker], 0);
+	if(res != VK_SUCCESS) {
+		job->results[worker] = res;
+		return;
+	}
+
+	VkCommandBufferInheritanceInfo inherit_info = {0};
+	inherit_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inherit_info.renderPass = ctx->renderpass;
+	inherit_info.subpass = 0;
+	inherit_info.framebuffer = job->framebuffer;
+
+	VkCommandBufferBeginInfo cbuf_info = {0};
+	cbuf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cbuf_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	cbuf_info.pInheritanceInfo = &inherit_info;
+
+	res = vkBeginCommandBuffer(cmd, &cbuf_info);
+	if(res != VK_SUCCESS) {
+		job->results[worker] = res;
+		return;
+	}
+
+	const int first = (int)((long long)ctx->objects_count * worker / job->threads);
+	const int last  = (int)((long long)ctx->objects_count * (worker + 1) / job->threads);
+	cpu_zone_t zone = cpu_zone_begin("record draws");
+	gpu_zone_mark(ctx->profiler, cmd, job->zones[worker], 0);
+	cmd_draw_objects(cmd, ctx, job->region, first, last - first);
+	gpu_zone_mark(ctx->profiler, cmd, job->zones[worker], 1);
+	cpu_zone_end(&zone);
+
+	job->results[worker] = vkEndCommandBuffer(cmd);
+} // record_secondary_job
+
+
+
+// Creates the swapchain at the window's current size (offscreen images in headless mode),
+// and the image views, depth buffer and framebuffers that go with it.
+// old_swapchain is handed to the driver to reuse its resources, and is retired by this: it can't be acquired from anymore,
+// but it still has to be destroyed. Returns VK_NOT_READY when the window has no area (minimized).
+static VkResult
+render_targets_create(render_targets_t* rt, const render_targets_info_t* info, VkSwapchainKHR old_swapchain) {
+	VkResult res;
+	memset(rt, 0, sizeof(*rt));
+
+	if(ren_config.headless) {
+		// at least one image per frame in flight, otherwise frames would wait on each other for images
+		rt->extent.width  = WINDOW_SIZE_X;
+		rt->extent.height = WINDOW_SIZE_Y;
+		rt->images_count = HEADLESS_IMAGES_COUNT;
+		if(rt->images_count < vulkan_data.frames_in_flight) rt->images_count = vulkan_data.frames_in_flight;
+		rt->images = heap_alloc_zeroed(rt->images_count, sizeof(VkImage));
+		rt->images_memory = heap_alloc_zeroed(rt->images_count, sizeof(gpu_allocation_t));
+
+		VkImageCreateInfo img_info = {0};
+		img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		img_info.imageType = VK_IMAGE_TYPE_2D;
+		img_info.format = info->color_fmt.format;
+		img_info.extent = (VkExtent3D){
+			.width	= rt->extent.width,
+			.height = rt->extent.height,
+			.depth	= 1
+		};
+		img_info.mipLevels = 1;
+		img_info.arrayLayers = 1;
+		img_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		img_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		// transfer source so that frames can be read back (--screenshot)
+		img_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		img_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		img_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		for(int i = 0; i < rt->images_count; i++) {
+			res = gpu_alloc_create_image(&vulkan_data.allocator, &img_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+				&rt->images[i], &rt->images_memory[i]);
+			if(res != VK_SUCCESS) return res;
+		}
+	} else {
+		VkSurfaceCapabilitiesKHR surf_caps = {0};
+		res = GetPhysicalDeviceSurfaceCapabilitiesKHR(info->physical_device, vulkan_data.surface, &surf_caps);
+		if(res != VK_SUCCESS) return res;
+
+		// Some platforms leave the size up to the swapchain, then it follows the window.
+		rt->extent = surf_caps.currentExtent;
+		if(rt->extent.width == 0xffffffff) {
+			int width = 0, height = 0;
+			glfwGetFramebufferSize(ren_glfw_window, &width, &height);
+			rt->extent.width  = width  < surf_caps.minImageExtent.width  ? surf_caps.minImageExtent.width  :
+				width  > surf_caps.maxImageExtent.width  ? surf_caps.maxImageExtent.width  : width;
+			rt->extent.height = height < surf_caps.minImageExtent.height ? surf_caps.minImageExtent.height :
+				height > surf_caps.maxImageExtent.height ? surf_caps.maxImageExtent.height : height;
+		}
+		if(rt->extent.width == 0 || rt->extent.height == 0) return VK_NOT_READY;
+
+		int n_swap_images = surf_caps.minImageCount + 1;
+		if(surf_caps.maxImageCount > 0 && n_swap_images > surf_caps.maxImageCount)
+			n_swap_images = surf_caps.maxImageCount;
+
+		VkImageUsageFlags img_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+			(surf_caps.supportedUsageFlags & (VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT));
+
+		VkSwapchainCreateInfoKHR swap_info = {0};
+		swap_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+		swap_info.pNext = NULL;
+		swap_info.surface = vulkan_data.surface;
+		swap_info.minImageCount = n_swap_images;
+		swap_info.imageFormat = info->color_fmt.format;
+		swap_info.imageColorSpace = info->color_fmt.colorSpace;
+		swap_info.imageExtent = rt->extent;
+		swap_info.imageUsage = img_usage;
+		swap_info.preTransform = (VkSurfaceTransformFlagBitsKHR)surf_caps.currentTransform;
+		swap_info.imageArrayLayers = 1;
+		swap_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		swap_info.queueFamilyIndexCount = 0;
+		swap_info.pQueueFamilyIndices = NULL;
+		swap_info.presentMode = vulkan_data.present_mode;
+		swap_info.oldSwapchain = old_swapchain;
+		swap_info.clipped = VK_TRUE;
+		swap_info.compositeAlpha = info->alpha_fmt;
+
+		res = CreateSwapchainKHR(vulkan_data.device, &swap_info, NULL, &rt->swapchain);
+		if(res != VK_SUCCESS) return res;
+
+		// Get swapchain images
+		// These are the endpoints for our framebuffers
+		res = GetSwapchainImagesKHR(vulkan_data.device, rt->swapchain, &rt->images_count, NULL);
+		if(res != VK_SUCCESS) return res;
+
+		rt->images = heap_alloc_zeroed(rt->images_count, sizeof(VkImage));
+		res = GetSwapchainImagesKHR(vulkan_data.device, rt->swapchain, &rt->images_count, rt->images);
+		if(res != VK_SUCCESS) return res;
+	}
+
+	// Create image views for the swapchain.
+	VkImageViewCreateInfo iv_info = {0};
+	iv_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	iv_info.pNext = NULL;
+	iv_info.format = info->color_fmt.format;
+	iv_info.components = (VkComponentMapping){
+		.r = VK_COMPONENT_SWIZZLE_R,
+		.g = VK_COMPONENT_SWIZZLE_G,
+		.b = VK_COMPONENT_SWIZZLE_B,
+		.a = VK_COMPONENT_SWIZZLE_A
+	};
+	iv_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	iv_info.subresourceRange.baseMipLevel = 0;
+	iv_info.subresourceRange.levelCount = 1;
+	iv_info.subresourceRange.baseArrayLayer = 0;
+	iv_info.subresourceRange.layerCount = 1;
+	iv_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	iv_info.flags = 0;
+
+	rt->views = heap_alloc_zeroed(rt->images_count, sizeof(VkImageView));
+	for(int i = 0; i < rt->images_count; i++) {
+		iv_info.image = rt->images[i];
+		res = vkCreateImageView(vulkan_data.device, &iv_info, NULL, &rt->views[i]);
+		if(res != VK_SUCCESS) return res;
+	}
+
+	// Create depth stencil image.
+	VkImageCreateInfo dimg_info = {0};
+	dimg_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	dimg_info.imageType = VK_IMAGE_TYPE_2D;
+	dimg_info.format = info->depth_fmt;
+	dimg_info.extent = (VkExtent3D){
+		.width	= rt->extent.width,
+		.height = rt->extent.height,
+		.depth	= 1
+	};
+	dimg_info.mipLevels = 1;
+	dimg_info.arrayLayers = 1;
+	dimg_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	dimg_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	dimg_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+
+	res = gpu_alloc_create_image(&vulkan_data.allocator, &dimg_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &rt->depth_img, &rt->depth_mem);
+	if(res != VK_SUCCESS) return res;
+
+	// Create depth stencil view.
+	// This is passed to each framebuffer.
+	VkImageAspectFlagBits aspect =
+		info->depth_fmt >= VK_FORMAT_D16_UNORM_S8_UINT ?
+		VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT :
+		VK_IMAGE_ASPECT_DEPTH_BIT;
+
+	VkImageViewCreateInfo dview_info = {0};
+	dview_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	dview_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	dview_info.image = rt->depth_img;
+	dview_info.format = info->depth_fmt;
+	dview_info.subresourceRange.baseMipLevel = 0;
+	dview_info.subresourceRange.levelCount = 1;
+	dview_info.subresourceRange.baseArrayLayer = 0;
+	dview_info.subresourceRange.layerCount = 1;
+	dview_info.subresourceRange.aspectMask = aspect;
+
+	res = vkCreateImageView(vulkan_data.device, &dview_info, NULL, &rt->depth_view);
+	if(res != VK_SUCCESS) return res;
+
+	// Create the frame buffers.
+	VkImageView fb_views[2];
+	fb_views[1] = rt->depth_view;
+
+	VkFramebufferCreateInfo fb_info = {0};
+	fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	fb_info.renderPass = info->renderpass;
+	fb_info.attachmentCount = 2;
+	fb_info.pAttachments = fb_views;
+	fb_info.width = rt->extent.width;
+	fb_info.height = rt->extent.height;
+	fb_info.layers = 1;
+
+	rt->framebuffers = heap_alloc_zeroed(rt->images_count, sizeof(VkFramebuffer));
+	for(int i = 0; i < rt->images_count; i++) {
+		fb_views[0] = rt->views[i];
+		res = vkCreateFramebuffer(vulkan_data.device, &fb_info, NULL, &rt->framebuffers[i]);
+		if(res != VK_SUCCESS) return res;
+	}
+
+	return VK_SUCCESS;
+} // render_targets_create
+
+// Only once nothing in flight uses them.
+static void
+render_targets_destroy(render_targets_t* rt) {
+	for(int i = 0; i < rt->images_count; i++) {
+		vkDestroyFramebuffer(vulkan_data.device, rt->framebuffers[i], NULL);
+		vkDestroyImageView(vulkan_data.device, rt->views[i], NULL);
+	}
+	free(rt->framebuffers);
+	free(rt->views);
+
+	vkDestroyImageView(vulkan_data.device, rt->depth_view, NULL);
+	gpu_destroy_image(&vulkan_data.allocator, rt->depth_img, &rt->depth_mem);
+
+	if(rt->images_memory) {
+		for(int i = 0; i < rt->images_count; i++) {
+			gpu_destroy_image(&vulkan_data.allocator, rt->images[i], &rt->images_memory[i]);
+		}
+		free(rt->images_memory);
+	}
+	free(rt->images);
+
+	if(rt->swapchain != VK_NULL_HANDLE) DestroySwapchainKHR(vulkan_data.device, rt->swapchain, NULL);
+	memset(rt, 0, sizeof(*rt));
+} // render_targets_destroy
+
+// deletion_fn_t for render targets
+static void
+render_targets_deleter(void* context, void* data) {
+	render_targets_destroy(data);
+} // render_targets_deleter
+
+// GPU memory held by the render targets (swapchain images aren't ours)
+static VkDeviceSize
+render_targets_bytes(const render_targets_t* rt) {
+	VkDeviceSize bytes = rt->depth_mem.size;
+	for(int i = 0; rt->images_memory && i < rt->images_count; i++) {
+		bytes += rt->images_memory[i].size;
+	}
+	return bytes;
+} // render_targets_bytes
+
+// GLFW framebuffer size callback
+static void
+window_resized(GLFWwindow* window, int width, int height) {
+	ren_window_resized = 1;
+} // window_resized
+
+// GLFW key callback. Keys held down (the camera's) are polled, this only counts presses that have to be seen once.
+static void
+key_pressed(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if(key == GLFW_KEY_P && action == GLFW_PRESS) ren_present_presses++;
+} // key_pressed
+
+// mesh_convert_unsupported() callback: whether the device reads `format` as a vertex attribute.
+static int
+vertex_format_supported(VkFormat format, void* physical_device) {
+	VkFormatProperties props = {0};
+	vkGetPhysicalDeviceFormatProperties(*(VkPhysicalDevice*)physical_device, format, &props);
+	return (props.bufferFeatures & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT) != 0;
+} // vertex_format_supported
+
+
+
 //! uses `heap_alloc`
 // for binary files
 static inline char*
@@ -0,0 +1,967 @@
+#pragma once
+
+// Mesh import: glTF 2.0 (.gltf with its .bin files or data URIs, or .glb) and Wavefront OBJ.
+//
+// A mesh is a set of vertex bindings (a byte range and a stride each) and the attributes that live in them,
+// the same shape Vulkan's vertex input takes, so the pipeline gets a VkVertexInputAttributeDescription per attribute
+// straight from the file's layout (mesh_vertex_input()), interleaved or not, floats or normalized integers.
+// - Files are memory mapped. glTF buffer views point into the mapping, and are uploaded from there as they are:
+//   nothing is read into the heap, repacked or converted on the way to the GPU, unless Vulkan can't read the format.
+// - OBJ is text, its vertices are built into one interleaved binding the mesh owns, with (position, texcoord, normal)
+//   triples shared between faces and polygons split into fans.
+// - Only the first triangle list primitive of a glTF file is loaded, the others are counted.
+// mesh_free() releases the mappings and everything the mesh owns, the data pointers stop being valid.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+
+#include "platform.h"
+#include "json.h"
+
+
+
+#define MESH_MAX_BINDINGS	8
+#define MESH_MAX_FILES		8	// mapped: the file itself, and a .gltf's buffers
+#define MESH_MAX_OWNED		16	// allocations: OBJ vertices, converted attributes, decoded data URIs
+
+typedef enum mesh_attribute_kind_t {
+	MESH_POSITION,
+	MESH_NORMAL,
+	MESH_COLOR,
+	MESH_TEXCOORD,
+	MESH_ATTRIBUTE_KINDS
+} mesh_attribute_kind_t;
+
+static const char* mesh_attribute_names[MESH_ATTRIBUTE_KINDS] = {"POSITION", "NORMAL", "COLOR_0", "TEXCOORD_0"};
+
+// glTF componentType values
+typedef enum mesh_component_t {
+	MESH_BYTE		= 5120,
+	MESH_UNSIGNED_BYTE	= 5121,
+	MESH_SHORT		= 5122,
+	MESH_UNSIGNED_SHORT	= 5123,
+	MESH_UNSIGNED_INT	= 5125,
+	MESH_FLOAT		= 5126,
+	MESH_HALF_FLOAT		= 5131,	// not in glTF, written by mesh_pack()
+} mesh_component_t;
+
+typedef struct mesh_attribute_t {
+	int			binding;	// -1 = the mesh doesn't have it
+	unsigned int		offset;		// from the start of a vertex in the binding
+	mesh_component_t	component;
+	int			components;	// 1 to 4
+	int			normalized;
+	int			octahedral;	// 2 components encoding a unit vector, see mesh_octahedral_decode()
+	VkFormat		format;		// VK_FORMAT_UNDEFINED when Vulkan has no vertex format for it
+} mesh_attribute_t;
+
+typedef struct mesh_binding_t {
+	const unsigned char*	data;	// in a mapped file, or in memory the mesh owns
+	size_t			size;	// bytes to upload
+	unsigned int		stride;
+} mesh_binding_t;
+
+typedef struct mesh_stats_t {
+	size_t			mapped_bytes;	// of the files mapped
+	size_t			copied_bytes;	// vertex and index data built or converted in memory, instead of used in place
+} mesh_stats_t;
+
+typedef struct mesh_t {
+	int			vertex_count;
+	mesh_binding_t		bindings[MESH_MAX_BINDINGS];
+	int			bindings_count;
+	mesh_attribute_t	attributes[MESH_ATTRIBUTE_KINDS];
+	const void*		indices;
+	size_t			indices_size;
+	unsigned int		index_count;
+	VkIndexType		index_type;	// UINT16 or UINT32
+	float			lo[3];		// bounding box of the positions
+	float			hi[3];
+	int			positions_quantized; // the stored positions are (position - offset) / scale, see mesh_pack()
+	float			position_offset[3];
+	float			position_scale[3];
+	int			primitives_skipped; // glTF primitives other than the one loaded
+
+	file_map_t		files[MESH_MAX_FILES];
+	int			files_count;
+	void*			owned[MESH_MAX_OWNED];
+	int			owned_count;
+	mesh_stats_t		stats;
+	char			error[256];	// why loading failed
+} mesh_t;
+
+// Which attribute feeds which shader input location, for mesh_vertex_input().
+typedef struct mesh_input_t {
+	unsigned int		location;
+	mesh_attribute_kind_t	kind;
+} mesh_input_t;
+
+
+
+static inline int
+mesh__fail(mesh_t* mesh, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(mesh->error, sizeof(mesh->error), fmt, args);
+	va_end(args);
+	return -1;
+} // mesh__fail
+
+static inline void*
+mesh__own(mesh_t* mesh, size_t size) {
+	if(mesh->owned_count == MESH_MAX_OWNED) return NULL;
+	void* p = malloc(size ? size : 1);
+	if(p) mesh->owned[mesh->owned_count++] = p;
+	return p;
+} // mesh__own
+
+static inline const file_map_t*
+mesh__map(mesh_t* mesh, const char* path) {
+	if(mesh->files_count == MESH_MAX_FILES) return NULL;
+	file_map_t* map = &mesh->files[mesh->files_count];
+	if(file_map(map, path) != 0) return NULL;
+	mesh->files_count++;
+	mesh->stats.mapped_bytes += map->size;
+	return map;
+} // mesh__map
+
+static inline void
+mesh_free(mesh_t* mesh) {
+	for(int i = 0; i < mesh->files_count; i++) {
+		file_unmap(&mesh->files[i]);
+	}
+	for(int i = 0; i < mesh->owned_count; i++) {
+		free(mesh->owned[i]);
+	}
+	mesh->files_count = 0;
+	mesh->owned_count = 0;
+	for(int i = 0; i < mesh->bindings_count; i++) {
+		mesh->bindings[i].data = NULL;
+	}
+	mesh->indices = NULL;
+} // mesh_free
+
+static inline int
+mesh_component_size(mesh_component_t component) {
+	switch(component) {
+		case MESH_BYTE: case MESH_UNSIGNED_BYTE:	return 1;
+		case MESH_SHORT: case MESH_UNSIGNED_SHORT:	return 2;
+		case MESH_HALF_FLOAT:				return 2;
+		case MESH_UNSIGNED_INT: case MESH_FLOAT:	return 4;
+		default:					return 0;
+	}
+} // mesh_component_size
+
+// The vertex format that reads `components` values of `component` as floats, VK_FORMAT_UNDEFINED if there is none.
+// Integers that aren't normalized are read as their value (the SCALED formats).
+static inline VkFormat
+mesh_vertex_format(mesh_component_t component, int components, int normalized) {
+	if(components < 1 || components > 4) return VK_FORMAT_UNDEFINED;
+	static const VkFormat formats[][4] = {
+		{VK_FORMAT_R32_SFLOAT,	VK_FORMAT_R32G32_SFLOAT,	VK_FORMAT_R32G32B32_SFLOAT,	VK_FORMAT_R32G32B32A32_SFLOAT},
+		{VK_FORMAT_R8_UNORM,	VK_FORMAT_R8G8_UNORM,		VK_FORMAT_R8G8B8_UNORM,		VK_FORMAT_R8G8B8A8_UNORM},
+		{VK_FORMAT_R8_USCALED,	VK_FORMAT_R8G8_USCALED,		VK_FORMAT_R8G8B8_USCALED,	VK_FORMAT_R8G8B8A8_USCALED},
+		{VK_FORMAT_R8_SNORM,	VK_FORMAT_R8G8_SNORM,		VK_FORMAT_R8G8B8_SNORM,		VK_FORMAT_R8G8B8A8_SNORM},
+		{VK_FORMAT_R8_SSCALED,	VK_FORMAT_R8G8_SSCALED,		VK_FORMAT_R8G8B8_SSCALED,	VK_FORMAT_R8G8B8A8_SSCALED},
+		{VK_FORMAT_R16_UNORM,	VK_FORMAT_R16G16_UNORM,		VK_FORMAT_R16G16B16_UNORM,	VK_FORMAT_R16G16B16A16_UNORM},
+		{VK_FORMAT_R16_USCALED,	VK_FORMAT_R16G16_USCALED,	VK_FORMAT_R16G16B16_USCALED,	VK_FORMAT_R16G16B16A16_USCALED},
+		{VK_FORMAT_R16_SNORM,	VK_FORMAT_R16G16_SNORM,		VK_FORMAT_R16G16B16_SNORM,	VK_FORMAT_R16G16B16A16_SNORM},
+		{VK_FORMAT_R16_SSCALED,	VK_FORMAT_R16G16_SSCALED,	VK_FORMAT_R16G16B16_SSCALED,	VK_FORMAT_R16G16B16A16_SSCALED},
+		{VK_FORMAT_R16_SFLOAT,	VK_FORMAT_R16G16_SFLOAT,	VK_FORMAT_R16G16B16_SFLOAT,	VK_FORMAT_R16G16B16A16_SFLOAT},
+	};
+	int row;
+	switch(component) {
+		case MESH_FLOAT:		row = 0; break;
+		case MESH_UNSIGNED_BYTE:	row = normalized ? 1 : 2; break;
+		case MESH_BYTE:			row = normalized ? 3 : 4; break;
+		case MESH_UNSIGNED_SHORT:	row = normalized ? 5 : 6; break;
+		case MESH_SHORT:		row = normalized ? 7 : 8; break;
+		case MESH_HALF_FLOAT:		row = 9; break;
+		default:			return VK_FORMAT_UNDEFINED; // 32 bit integers would have to be read as integers
+	}
+	return formats[row][components - 1];
+} // mesh_vertex_format
+
+static inline float
+mesh_half_to_float(unsigned short h) {
+	const unsigned int sign = (h & 0x8000u) << 16, exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ffu;
+	if(exponent == 0) {
+		const float f = (float)mantissa * (1.0f / 16777216.0f); // zero or subnormal: mantissa * 2^-24
+		return sign ? -f : f;
+	}
+	const unsigned int bits = sign | (exponent == 31 ? 0x7f800000u : (exponent + 112) << 23) | mantissa << 13;
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+} // mesh_half_to_float
+
+// The unit vector that the octahedral encoding e (each in -1 to 1) stands for: the octahedron |x| + |y| + |z| = 1
+// with its lower half folded over the upper one, flattened onto the XY plane.
+static inline void
+mesh_octahedral_decode(const float e[2], float out[3]) {
+	float n[3] = {e[0], e[1], 1.0f - fabsf(e[0]) - fabsf(e[1])};
+	const float t = fmaxf(-n[2], 0.0f);
+	n[0] += n[0] >= 0.0f ? -t : t;
+	n[1] += n[1] >= 0.0f ? -t : t;
+	const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	for(int j = 0; j < 3; j++) out[j] = n[j] / length;
+} // mesh_octahedral_decode
+
+// Attribute `kind` of vertex `vertex` as floats, the way the vertex format reads it. Missing components are 0, 0, 0, 1.
+// Packed attributes are decoded: quantized positions come back in the mesh's units, octahedral vectors as 3 components.
+static inline void
+mesh_read_attribute(const mesh_t* mesh, mesh_attribute_kind_t kind, int vertex, float out[4]) {
+	out[0] = out[1] = out[2] = 0.0f;
+	out[3] = 1.0f;
+	const mesh_attribute_t* a = &mesh->attributes[kind];
+	if(a->binding < 0) return;
+	const mesh_binding_t* b = &mesh->bindings[a->binding];
+	const unsigned char* p = b->data + (size_t)vertex * b->stride + a->offset;
+	for(int c = 0; c < a->components; c++) {
+		float v;
+		switch(a->component) {
+			case MESH_FLOAT:		{ float x; memcpy(&x, p + c * 4, 4); v = x; } break;
+			case MESH_UNSIGNED_BYTE:	v = a->normalized ? p[c] / 255.0f : p[c]; break;
+			case MESH_BYTE:			{ const float x = (signed char)p[c]; v = a->normalized ? fmaxf(x / 127.0f, -1.0f) : x; } break;
+			case MESH_UNSIGNED_SHORT:	{ unsigned short x; memcpy(&x, p + c * 2, 2); v = a->normalized ? x / 65535.0f : x; } break;
+			case MESH_SHORT:		{ short x; memcpy(&x, p + c * 2, 2); v = a->normalized ? fmaxf(x / 32767.0f, -1.0f) : x; } break;
+			case MESH_UNSIGNED_INT:		{ unsigned int x; memcpy(&x, p + c * 4, 4); v = (float)x; } break;
+			case MESH_HALF_FLOAT:		{ unsigned short x; memcpy(&x, p + c * 2, 2); v = mesh_half_to_float(x); } break;
+			default:			v = 0.0f; break;
+		}
+		out[c] = v;
+	}
+	if(a->octahedral) mesh_octahedral_decode(out, out);
+	if(kind == MESH_POSITION && mesh->positions_quantized) {
+		for(int j = 0; j < 3; j++) out[j] = mesh->position_offset[j] + out[j] * mesh->position_scale[j];
+	}
+} // mesh_read_attribute
+
+static inline void
+mesh_compute_bounds(mesh_t* mesh) {
+	for(int j = 0; j < 3; j++) {
+		mesh->lo[j] = INFINITY;
+		mesh->hi[j] = -INFINITY;
+	}
+	for(int i = 0; i < mesh->vertex_count; i++) {
+		float p[4];
+		mesh_read_attribute(mesh, MESH_POSITION, i, p);
+		for(int j = 0; j < 3; j++) {
+			mesh->lo[j] = fminf(mesh->lo[j], p[j]);
+			mesh->hi[j] = fmaxf(mesh->hi[j], p[j]);
+		}
+	}
+	if(mesh->vertex_count == 0) {
+		for(int j = 0; j < 3; j++) mesh->lo[j] = mesh->hi[j] = 0.0f;
+	}
+} // mesh_compute_bounds
+
+// A mesh over float vertices that stay where they are: `floats` per vertex, each attribute at an offset
+// in floats (-1 = none, a texcoord has 2 floats, the rest 3). Nothing is copied. Returns 0 on success.
+static inline int
+mesh_init_interleaved(mesh_t* mesh, const float* vertices, int vertex_count, int floats, const int offsets[MESH_ATTRIBUTE_KINDS],
+	const unsigned int* indices, unsigned int index_count) {
+	mesh->vertex_count = vertex_count;
+	mesh->bindings_count = 1;
+	mesh->bindings[0].data = (const unsigned char*)vertices;
+	mesh->bindings[0].stride = floats * sizeof(float);
+	mesh->bindings[0].size = (size_t)vertex_count * floats * sizeof(float);
+	for(int k = 0; k < MESH_ATTRIBUTE_KINDS; k++) {
+		mesh_attribute_t* a = &mesh->attributes[k];
+		memset(a, 0, sizeof(*a));
+		a->binding = offsets[k] >= 0 ? 0 : -1;
+		a->offset = offsets[k] >= 0 ? offsets[k] * sizeof(float) : 0;
+		a->component = MESH_FLOAT;
+		a->components = k == MESH_TEXCOORD ? 2 : 3;
+		a->format = mesh_vertex_format(MESH_FLOAT, a->components, 0);
+	}
+	mesh->indices = indices;
+	mesh->index_count = index_count;
+	mesh->indices_size = (size_t)index_count * sizeof(unsigned int);
+	mesh->index_type = VK_INDEX_TYPE_UINT32;
+	mesh_compute_bounds(mesh);
+	return mesh->attributes[MESH_POSITION].binding < 0 ? -1 : 0;
+} // mesh_init_interleaved
+
+
+
+// glTF
+
+typedef struct mesh__gltf_t {
+	json_t			json;
+	const char*		path;
+	const unsigned char*	glb_bin;	// the .glb's binary chunk, buffer 0 when it has no uri
+	size_t			glb_bin_size;
+	const unsigned char*	buffers[64];	// resolved on first use
+	size_t			buffers_size[64];
+} mesh__gltf_t;
+
+static inline int
+mesh__base64(char c) {
+	if(c >= 'A' && c <= 'Z') return c - 'A';
+	if(c >= 'a' && c <= 'z') return c - 'a' + 26;
+	if(c >= '0' && c <= '9') return c - '0' + 52;
+	if(c == '+' || c == '-') return 62;
+	if(c == '/' || c == '_') return 63;
+	return -1;
+} // mesh__base64
+
+// Buffer `index`: the .glb's chunk, a decoded data URI, or a file next to the .gltf, mapped.
+static inline int
+mesh__gltf_buffer(mesh_t* mesh, mesh__gltf_t* g, int index, const unsigned char** data, size_t* size) {
+	if(index < 0 || index >= (int)(sizeof(g->buffers) / sizeof(g->buffers[0]))) return mesh__fail(mesh, "buffer %d: too many buffers", index);
+	if(g->buffers[index]) {
+		*data = g->buffers[index];
+		*size = g->buffers_size[index];
+		return 0;
+	}
+	const int buffer = json_element(&g->json, json_member(&g->json, 0, "buffers"), index);
+	if(buffer < 0) return mesh__fail(mesh, "buffer %d doesn't exist", index);
+	const size_t length = (size_t)json_int(&g->json, json_member(&g->json, buffer, "byteLength"), 0);
+	const int uri = json_member(&g->json, buffer, "uri");
+
+	if(uri < 0) {
+		if(index != 0 || !g->glb_bin) return mesh__fail(mesh, "buffer %d has no uri", index);
+		*data = g->glb_bin;
+		*size = g->glb_bin_size;
+	} else {
+		const json_token_t* t = &g->json.tokens[uri];
+		const char* s = g->json.text + t->start;
+		const int n = t->end - t->start;
+		if(n > 5 && memcmp(s, "data:", 5) == 0) {
+			const char* comma = memchr(s, ',', n);
+			if(!comma || comma - s < 7 || memcmp(comma - 7, ";base64", 7) != 0) return mesh__fail(mesh, "buffer %d: only base64 data URIs are supported", index);
+			const char* b64 = comma + 1;
+			const int b64_n = (int)(s + n - b64);
+			unsigned char* out = mesh__own(mesh, (size_t)b64_n / 4 * 3 + 3);
+			if(!out) return mesh__fail(mesh, "out of memory");
+			size_t bytes = 0;
+			unsigned int bits = 0;
+			int bits_count = 0;
+			for(int i = 0; i < b64_n; i++) {
+				const int v = mesh__base64(b64[i]);
+				if(v < 0) continue; // padding
+				bits = bits << 6 | (unsigned int)v;
+				bits_count += 6;
+				if(bits_count >= 8) {
+					bits_count -= 8;
+					out[bytes++] = (unsigned char)(bits >> bits_count);
+				}
+			}
+			*data = out;
+			*size = bytes;
+		} else {
+			// relative to the .gltf, with %XX escapes decoded
+			char file[1024];
+			char name[512];
+			if(json_string(&g->json, uri, name, sizeof(name)) < 0) return mesh__fail(mesh, "buffer %d: uri too long", index);
+			int j = 0;
+			for(int i = 0; name[i]; i++) {
+				if(name[i] == '%' && name[i + 1] && name[i + 2]) {
+					const char hex[3] = {name[i + 1], name[i + 2], 0};
+					name[j++] = (char)strtol(hex, NULL, 16);
+					i += 2;
+				} else {
+					name[j++] = name[i];
+				}
+			}
+			name[j] = 0;
+			const char* slash = strrchr(g->path, '/');
+			const char* backslash = strrchr(g->path, '\\');
+			if(backslash > slash) slash = backslash;
+			const int dir = slash ? (int)(slash - g->path + 1) : 0;
+			if(snprintf(file, sizeof(file), "%.*s%s", dir, g->path, name) >= (int)sizeof(file)) return mesh__fail(mesh, "buffer %d: path too long", index);
+			const file_map_t* map = mesh__map(mesh, file);
+			if(!map) return mesh__fail(mesh, "buffer %d: couldn't map `%s`", index, file);
+			*data = map->data;
+			*size = map->size;
+		}
+	}
+	if(*size < length) return mesh__fail(mesh, "buffer %d is shorter than its byteLength", index);
+	g->buffers[index] = *data;
+	g->buffers_size[index] = *size;
+	return 0;
+} // mesh__gltf_buffer
+
+// Where accessor `index`'s data is: its buffer view's start plus the accessor's offset, the view's stride (0 = packed),
+// and how many bytes the view has from there.
+typedef struct mesh__accessor_t {
+	const unsigned char*	data;
+	size_t			available;
+	unsigned int		view_stride;
+	int			view;
+	unsigned int		offset;	// into the view
+	int			count;
+	mesh_component_t	component;
+	int			components;
+	int			normalized;
+	int			token;
+} mesh__accessor_t;
+
+static inline int
+mesh__gltf_accessor(mesh_t* mesh, mesh__gltf_t* g, int index, mesh__accessor_t* out) {
+	const json_t* json = &g->json;
+	memset(out, 0, sizeof(*out));
+	const int accessor = json_element(json, json_member(json, 0, "accessors"), index);
+	if(accessor < 0) return mesh__fail(mesh, "accessor %d doesn't exist", index);
+	out->token = accessor;
+	if(json_member(json, accessor, "sparse") >= 0) return mesh__fail(mesh, "accessor %d: sparse accessors aren't supported", index);
+	out->view = (int)json_int(json, json_member(json, accessor, "bufferView"), -1);
+	if(out->view < 0) return mesh__fail(mesh, "accessor %d has no buffer view", index);
+	const long long offset = json_int(json, json_member(json, accessor, "byteOffset"), 0);
+	const long long count = json_int(json, json_member(json, accessor, "count"), 0);
+	if(offset < 0 || offset > 0xffffffffll) return mesh__fail(mesh, "accessor %d: bad byteOffset", index);
+	if(count <= 0 || count > 0x7fffffffll) return mesh__fail(mesh, "accessor %d: bad count %lld", index, count);
+	out->offset = (unsigned int)offset;
+	out->count = (int)count;
+	out->component = (mesh_component_t)json_int(json, json_member(json, accessor, "componentType"), 0);
+	const int normalized = json_member(json, accessor, "normalized");
+	out->normalized = normalized >= 0 && json->tokens[normalized].type == JSON_TRUE;
+	const int type = json_member(json, accessor, "type");
+	out->components = json_string_equals(json, type, "SCALAR") ? 1 : json_string_equals(json, type, "VEC2") ? 2 :
+		json_string_equals(json, type, "VEC3") ? 3 : json_string_equals(json, type, "VEC4") ? 4 : 0;
+	if(out->components == 0 || mesh_component_size(out->component) == 0) return mesh__fail(mesh, "accessor %d: unsupported type", index);
+
+	const int view = json_element(json, json_member(json, 0, "bufferViews"), out->view);
+	if(view < 0) return mesh__fail(mesh, "buffer view %d doesn't exist", out->view);
+	const long long view_offset = json_int(json, json_member(json, view, "byteOffset"), 0);
+	const long long view_length = json_int(json, json_member(json, view, "byteLength"), 0);
+	const long long view_stride = json_int(json, json_member(json, view, "byteStride"), 0);
+	if(view_offset < 0 || view_length < 0 || view_stride < 0 || view_stride > 252) return mesh__fail(mesh, "buffer view %d: bad byteOffset, byteLength or byteStride", out->view);
+	out->view_stride = (unsigned int)view_stride;
+
+	const unsigned char* buffer;
+	size_t buffer_size;
+	if(mesh__gltf_buffer(mesh, g, (int)json_int(json, json_member(json, view, "buffer"), -1), &buffer, &buffer_size) != 0) return -1;
+	// compared by subtracting from what's known to fit, so nothing a file claims can wrap around
+	if((unsigned long long)view_offset > buffer_size || (unsigned long long)view_length > buffer_size - (size_t)view_offset || out->offset > (unsigned long long)view_length) {
+		return mesh__fail(mesh, "buffer view %d is out of its buffer", out->view);
+	}
+	out->data = buffer + (size_t)view_offset + out->offset;
+	out->available = (size_t)view_length - out->offset;
+
+	// the last element starts at stride * (count - 1) and has to end inside the view
+	const size_t element = (size_t)mesh_component_size(out->component) * out->components;
+	const size_t stride = out->view_stride ? out->view_stride : element;
+	if(element > out->available || (size_t)(out->count - 1) > (out->available - element) / stride) return mesh__fail(mesh, "accessor %d is out of its buffer view", index);
+	return 0;
+} // mesh__gltf_accessor
+
+static inline int
+mesh_load_gltf(mesh_t* mesh, const char* path) {
+	mesh__gltf_t* g = calloc(1, sizeof(mesh__gltf_t));
+	if(!g) return mesh__fail(mesh, "out of memory");
+	g->path = path;
+	int result = -1;
+
+	const file_map_t* map = mesh__map(mesh, path);
+	if(!map) {
+		mesh__fail(mesh, "couldn't map `%s`", path);
+		goto done;
+	}
+	const char* text = map->data;
+	size_t text_size = map->size;
+
+	// .glb: a 12 byte header, then chunks of (length, type, data): the JSON, then optionally the binary buffer
+	const unsigned char* bytes = map->data;
+	if(map->size >= 12 && memcmp(bytes, "glTF", 4) == 0) {
+		unsigned int header[3];
+		memcpy(header, bytes, sizeof(header));
+		if(header[1] != 2) {
+			mesh__fail(mesh, "glTF version %u isn't supported", header[1]);
+			goto done;
+		}
+		size_t pos = 12;
+		const size_t end = header[2] < map->size ? header[2] : map->size;
+		text = NULL;
+		while(pos + 8 <= end) {
+			unsigned int chunk[2];
+			memcpy(chunk, bytes + pos, sizeof(chunk));
+			if(pos + 8 + chunk[0] > end) break;
+			if(chunk[1] == 0x4e4f534a && !text) { // JSON
+				text = (const char*)bytes + pos + 8;
+				text_size = chunk[0];
+			} else if(chunk[1] == 0x004e4942 && !g->glb_bin) { // BIN
+				g->glb_bin = bytes + pos + 8;
+				g->glb_bin_size = chunk[0];
+			}
+			pos += 8 + ((chunk[0] + 3) & ~3u);
+		}
+		if(!text) {
+			mesh__fail(mesh, "no JSON chunk");
+			goto done;
+		}
+		// the JSON chunk is padded with spaces, which the parser skips
+	}
+
+	if(json_parse(&g->json, text, text_size) != 0) {
+		mesh__fail(mesh, "JSON syntax error");
+		goto done;
+	}
+	const json_t* json = &g->json;
+
+	// the first triangle list (mode 4, the default) of any mesh
+	const int meshes = json_member(json, 0, "meshes");
+	int primitive = -1;
+	int primitives_count = 0;
+	for(int m = 0; m < json_size(json, meshes); m++) {
+		const int primitives = json_member(json, json_element(json, meshes, m), "primitives");
+		for(int p = 0; p < json_size(json, primitives); p++) {
+			const int prim = json_element(json, primitives, p);
+			primitives_count++;
+			if(primitive < 0 && json_int(json, json_member(json, prim, "mode"), 4) == 4) primitive = prim;
+		}
+	}
+	if(primitive < 0) {
+		mesh__fail(mesh, "no triangle list primitive");
+		goto done;
+	}
+	mesh->primitives_skipped = primitives_count - 1;
+
+	// Attributes from the same buffer view with a stride share a binding when they're interleaved in it.
+	// Anything else gets a binding of its own, starting at its first element.
+	const int attributes = json_member(json, primitive, "attributes");
+	int binding_views[MESH_MAX_BINDINGS];
+	mesh->vertex_count = -1;
+	for(int k = 0; k < MESH_ATTRIBUTE_KINDS; k++) {
+		mesh_attribute_t* a = &mesh->attributes[k];
+		memset(a, 0, sizeof(*a));
+		a->binding = -1;
+		const int index = (int)json_int(json, json_member(json, attributes, mesh_attribute_names[k]), -1);
+		if(index < 0) continue;
+
+		mesh__accessor_t acc;
+		if(mesh__gltf_accessor(mesh, g, index, &acc) != 0) goto done;
+		if(mesh->vertex_count >= 0 && acc.count != mesh->vertex_count) {
+			mesh__fail(mesh, "%s has %d vertices, not %d", mesh_attribute_names[k], acc.count, mesh->vertex_count);
+			goto done;
+		}
+		mesh->vertex_count = acc.count;
+		a->component = acc.component;
+		a->components = acc.components;
+		a->normalized = acc.normalized;
+		a->format = mesh_vertex_format(acc.component, acc.components, acc.normalized);
+
+		const unsigned int element = mesh_component_size(acc.component) * acc.components;
+		const int interleaved = acc.view_stride > 0 && acc.offset + element <= acc.view_stride;
+		for(int b = 0; interleaved && b < mesh->bindings_count; b++) {
+			if(binding_views[b] == acc.view) a->binding = b;
+		}
+		if(a->binding < 0) {
+			if(mesh->bindings_count == MESH_MAX_BINDINGS) {
+				mesh__fail(mesh, "too many vertex bindings");
+				goto done;
+			}
+			a->binding = mesh->bindings_count++;
+			mesh_binding_t* b = &mesh->bindings[a->binding];
+			b->stride = acc.view_stride ? acc.view_stride : element;
+			if(interleaved) {
+				b->data = acc.data - acc.offset;
+				binding_views[a->binding] = acc.view;
+			} else {
+				b->data = acc.data;
+				binding_views[a->binding] = -1;
+			}
+		}
+		a->offset = (unsigned int)(acc.data - mesh->bindings[a->binding].data);
+
+		// everything up to the last vertex's last attribute
+		mesh_binding_t* b = &mesh->bindings[a->binding];
+		const size_t size = (size_t)b->stride * (acc.count - 1) + a->offset + element;
+		if(size > b->size) b->size = size;
+	}
+	if(mesh->attributes[MESH_POSITION].binding < 0) {
+		mesh__fail(mesh, "the primitive has no positions");
+		goto done;
+	}
+
+	// Indices are used in place when they're 16 or 32 bit. 8 bit ones need an extension, they're widened,
+	// and a primitive without any is drawn in order.
+	const int indices = (int)json_int(json, json_member(json, primitive, "indices"), -1);
+	if(indices >= 0) {
+		mesh__accessor_t acc;
+		if(mesh__gltf_accessor(mesh, g, indices, &acc) != 0) goto done;
+		mesh->index_count = acc.count;
+		if(acc.component == MESH_UNSIGNED_SHORT || acc.component == MESH_UNSIGNED_INT) {
+			mesh->indices = acc.data;
+			mesh->index_type = acc.component == MESH_UNSIGNED_SHORT ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+			mesh->indices_size = (size_t)acc.count * mesh_component_size(acc.component);
+		} else if(acc.component == MESH_UNSIGNED_BYTE) {
+			unsigned short* wide = mesh__own(mesh, (size_t)acc.count * sizeof(unsigned short));
+			if(!wide) {
+				mesh__fail(mesh, "out of memory");
+				goto done;
+			}
+			for(int i = 0; i < acc.count; i++) wide[i] = acc.data[i];
+			mesh->indices = wide;
+			mesh->index_type = VK_INDEX_TYPE_UINT16;
+			mesh->indices_size = (size_t)acc.count * sizeof(unsigned short);
+			mesh->stats.copied_bytes += mesh->indices_size;
+		} else {
+			mesh__fail(mesh, "unsupported index type %d", acc.component);
+			goto done;
+		}
+	} else {
+		unsigned int* order = mesh__own(mesh, (size_t)mesh->vertex_count * sizeof(unsigned int));
+		if(!order) {
+			mesh__fail(mesh, "out of memory");
+			goto done;
+		}
+		for(int i = 0; i < mesh->vertex_count; i++) order[i] = i;
+		mesh->indices = order;
+		mesh->index_count = mesh->vertex_count;
+		mesh->index_type = VK_INDEX_TYPE_UINT32;
+		mesh->indices_size = (size_t)mesh->vertex_count * sizeof(unsigned int);
+		mesh->stats.copied_bytes += mesh->indices_size;
+	}
+
+	// POSITION has to have min and max, only compute them when a file doesn't follow that
+	mesh__accessor_t pos;
+	if(mesh__gltf_accessor(mesh, g, (int)json_int(json, json_member(json, attributes, "POSITION"), -1), &pos) != 0) goto done;
+	const int min = json_member(json, pos.token, "min");
+	const int max = json_member(json, pos.token, "max");
+	if(json_size(json, min) >= 3 && json_size(json, max) >= 3 && !mesh->attributes[MESH_POSITION].normalized) {
+		for(int j = 0; j < 3; j++) {
+			mesh->lo[j] = (float)json_number(json, json_element(json, min, j), 0.0);
+			mesh->hi[j] = (float)json_number(json, json_element(json, max, j), 0.0);
+		}
+	} else {
+		mesh_compute_bounds(mesh);
+	}
+	result = 0;
+
+done:
+	json_free(&g->json);
+	free(g);
+	return result;
+} // mesh_load_gltf
+
+
+
+// OBJ
+
+typedef struct mesh__obj_corner_t {
+	int	v, t, n; // 0-based, -1 = none
+} mesh__obj_corner_t;
+
+// Growable array of `size` byte items.
+typedef struct mesh__array_t {
+	void*	data;
+	size_t	count;
+	size_t	capacity;
+} mesh__array_t;
+
+static inline void*
+mesh__push(mesh__array_t* a, size_t size) {
+	if(a->count == a->capacity) {
+		const size_t capacity = a->capacity ? a->capacity * 2 : 1024;
+		void* data = realloc(a->data, capacity * size);
+		if(!data) return NULL;
+		a->data = data;
+		a->capacity = capacity;
+	}
+	return (char*)a->data + a->count++ * size;
+} // mesh__push
+
+// The characters of the number at s (up to end) into buf, zero terminated: strtof() and strtol() read until something isn't
+// part of a number, and the mapping has no zero after its last line.
+static inline const char*
+mesh__obj_number(const char* s, const char* end, char* buf, size_t size) {
+	size_t n = 0;
+	while(s + n < end && n < size - 1 && ((s[n] >= '0' && s[n] <= '9') || s[n] == '+' || s[n] == '-' || s[n] == '.' || s[n] == 'e' || s[n] == 'E')) n++;
+	memcpy(buf, s, n);
+	buf[n] = 0;
+	return buf;
+} // mesh__obj_number
+
+static inline const char*
+mesh__obj_floats(const char* s, const char* end, float* out, int max, int* count) {
+	*count = 0;
+	while(*count < max) {
+		while(s < end && (*s == ' ' || *s == '\t')) s++;
+		if(s >= end || *s == '\n' || *s == '\r') break;
+		char buf[64];
+		char* after;
+		out[*count] = strtof(mesh__obj_number(s, end, buf, sizeof(buf)), &after);
+		if(after == buf) break;
+		s += after - buf;
+		(*count)++;
+	}
+	return s;
+} // mesh__obj_floats
+
+static inline unsigned int
+mesh__obj_hash(mesh__obj_corner_t c) {
+	unsigned int h = (unsigned int)c.v * 73856093u ^ (unsigned int)c.t * 19349663u ^ (unsigned int)c.n * 83492791u;
+	return h ^ (h >> 15);
+} // mesh__obj_hash
+
+static inline int
+mesh_load_obj(mesh_t* mesh, const char* path) {
+	const file_map_t* map = mesh__map(mesh, path);
+	if(!map) return mesh__fail(mesh, "couldn't map `%s`", path);
+
+	mesh__array_t positions = {0}, normals = {0}, texcoords = {0}; // 6 floats (position, color), 3, 2
+	mesh__array_t corners = {0}; // unique corners, the vertices
+	mesh__array_t indices = {0};
+	unsigned int* table = NULL; // open addressing, corner index + 1, 0 = empty
+	size_t table_size = 0;
+	int has_colors = 0;
+	int result = -1;
+	int line_number = 0;
+
+	const char* s = map->data;
+	const char* end = s + map->size;
+	while(s < end) {
+		line_number++;
+		while(s < end && (*s == ' ' || *s == '\t')) s++;
+		const char* line_end = memchr(s, '\n', end - s);
+		if(!line_end) line_end = end;
+
+		if(line_end - s > 2 && s[0] == 'v' && (s[1] == ' ' || s[1] == '\t')) {
+			float* p = mesh__push(&positions, 6 * sizeof(float));
+			if(!p) goto oom;
+			int n;
+			mesh__obj_floats(s + 2, line_end, p, 6, &n);
+			if(n < 3) { mesh__fail(mesh, "line %d: a vertex needs 3 coordinates", line_number); goto fail; }
+			if(n == 6) has_colors = 1; // a common extension
+			else p[3] = p[4] = p[5] = 1.0f;
+		} else if(line_end - s > 3 && s[0] == 'v' && s[1] == 'n') {
+			float* p = mesh__push(&normals, 3 * sizeof(float));
+			if(!p) goto oom;
+			int n;
+			mesh__obj_floats(s + 3, line_end, p, 3, &n);
+			if(n < 3) { mesh__fail(mesh, "line %d: a normal needs 3 coordinates", line_number); goto fail; }
+		} else if(line_end - s > 3 && s[0] == 'v' && s[1] == 't') {
+			float* p = mesh__push(&texcoords, 2 * sizeof(float));
+			if(!p) goto oom;
+			int n;
+			mesh__obj_floats(s + 3, line_end, p, 2, &n);
+			if(n < 2) p[1] = 0.0f;
+		} else if(line_end - s > 2 && s[0] == 'f' && (s[1] == ' ' || s[1] == '\t')) {
+			// v, v/t, v//n or v/t/n per corner, 1-based or negative from the end. Polygons become fans.
+			unsigned int first = 0, prev = 0;
+			int corner_count = 0;
+			const char* c = s + 2;
+			for(;;) {
+				while(c < line_end && (*c == ' ' || *c == '\t' || *c == '\r')) c++;
+				if(c >= line_end) break;
+				int idx[3] = {0, 0, 0};
+				for(int part = 0; part < 3 && c < line_end; part++) {
+					char buf[16];
+					char* after;
+					if(*c != '/') {
+						idx[part] = (int)strtol(mesh__obj_number(c, line_end, buf, sizeof(buf)), &after, 10);
+						if(after == buf) break;
+						c += after - buf;
+					}
+					if(c >= line_end || *c != '/') break;
+					c++;
+				}
+				while(c < line_end && *c != ' ' && *c != '\t' && *c != '\r') c++;
+
+				const int counts[3] = {(int)positions.count, (int)texcoords.count, (int)normals.count};
+				mesh__obj_corner_t corner;
+				int* fields[3] = {&corner.v, &corner.t, &corner.n};
+				for(int part = 0; part < 3; part++) {
+					const int i = idx[part] < 0 ? counts[part] + idx[part] : idx[part] - 1;
+					*fields[part] = idx[part] == 0 ? -1 : i;
+					if(idx[part] != 0 && (i < 0 || i >= counts[part])) { mesh__fail(mesh, "line %d: index out of range", line_number); goto fail; }
+				}
+				if(corner.v < 0) { mesh__fail(mesh, "line %d: a face corner needs a vertex", line_number); goto fail; }
+
+				// the same corner in another face is the same vertex
+				if((corners.count + 1) * 2 > table_size) {
+					const size_t size = table_size ? table_size * 2 : 4096;
+					unsigned int* grown = calloc(size, sizeof(unsigned int));
+					if(!grown) goto oom;
+					for(size_t i = 0; i < corners.count; i++) {
+						size_t h = mesh__obj_hash(((mesh__obj_corner_t*)corners.data)[i]) & (size - 1);
+						while(grown[h]) h = (h + 1) & (size - 1);
+						grown[h] = (unsigned int)i + 1;
+					}
+					free(table);
+					table = grown;
+					table_size = size;
+				}
+				size_t h = mesh__obj_hash(corner) & (table_size - 1);
+				unsigned int vertex = 0;
+				while(table[h]) {
+					const mesh__obj_corner_t* other = &((mesh__obj_corner_t*)corners.data)[table[h] - 1];
+					if(other->v == corner.v && other->t == corner.t && other->n == corner.n) {
+						vertex = table[h];
+						break;
+					}
+					h = (h + 1) & (table_size - 1);
+				}
+				if(!vertex) {
+					mesh__obj_corner_t* added = mesh__push(&corners, sizeof(mesh__obj_corner_t));
+					if(!added) goto oom;
+					*added = corner;
+					vertex = table[h] = (unsigned int)corners.count;
+				}
+				vertex--;
+
+				if(corner_count == 0) first = vertex;
+				if(corner_count >= 2) {
+					unsigned int* tri = mesh__push(&indices, 3 * sizeof(unsigned int));
+					if(!tri) goto oom;
+					tri[0] = first;
+					tri[1] = prev;
+					tri[2] = vertex;
+				}
+				prev = vertex;
+				corner_count++;
+			}
+		}
+		s = line_end + 1;
+	}
+
+	// One interleaved binding: position, then whatever the file has of normal, color and texcoord.
+	{
+		int offsets[MESH_ATTRIBUTE_KINDS] = {0, -1, -1, -1};
+		int floats = 3;
+		int has_normals = 0, has_texcoords = 0;
+		for(size_t i = 0; i < corners.count; i++) {
+			const mesh__obj_corner_t* c = &((mesh__obj_corner_t*)corners.data)[i];
+			has_normals |= c->n >= 0;
+			has_texcoords |= c->t >= 0;
+		}
+		if(has_normals) { offsets[MESH_NORMAL] = floats; floats += 3; }
+		if(has_colors) { offsets[MESH_COLOR] = floats; floats += 3; }
+		if(has_texcoords) { offsets[MESH_TEXCOORD] = floats; floats += 2; }
+
+		float* vertices = mesh__own(mesh, corners.count * floats * sizeof(float));
+		unsigned int* index_data = mesh__own(mesh, indices.count * 3 * sizeof(unsigned int));
+		if(!vertices || !index_data) goto oom;
+		for(size_t i = 0; i < corners.count; i++) {
+			const mesh__obj_corner_t* c = &((mesh__obj_corner_t*)corners.data)[i];
+			float* v = vertices + i * floats;
+			const float* p = (const float*)positions.data + (size_t)c->v * 6;
+			memcpy(v, p, 3 * sizeof(float));
+			if(has_normals) {
+				if(c->n >= 0) memcpy(v + offsets[MESH_NORMAL], (const float*)normals.data + (size_t)c->n * 3, 3 * sizeof(float));
+				else memset(v + offsets[MESH_NORMAL], 0, 3 * sizeof(float));
+			}
+			if(has_colors) memcpy(v + offsets[MESH_COLOR], p + 3, 3 * sizeof(float));
+			if(has_texcoords) {
+				if(c->t >= 0) memcpy(v + offsets[MESH_TEXCOORD], (const float*)texcoords.data + (size_t)c->t * 2, 2 * sizeof(float));
+				else memset(v + offsets[MESH_TEXCOORD], 0, 2 * sizeof(float));
+			}
+		}
+		memcpy(index_data, indices.data, indices.count * 3 * sizeof(unsigned int));
+		if(mesh_init_interleaved(mesh, vertices, (int)corners.count, floats, offsets, index_data, (unsigned int)indices.count * 3) != 0 || corners.count == 0) {
+			mesh__fail(mesh, "no faces");
+			goto fail;
+		}
+		mesh->stats.copied_bytes += mesh->bindings[0].size + mesh->indices_size;
+	}
+	result = 0;
+	goto fail; // just the clean-up
+
+oom:
+	mesh__fail(mesh, "out of memory");
+fail:
+	free(positions.data);
+	free(normals.data);
+	free(texcoords.data);
+	free(corners.data);
+	free(indices.data);
+	free(table);
+	return result;
+} // mesh_load_obj
+
+// Every index has to name a vertex: everything after loading (the optimizer, the packer, meshlets, the GPU)
+// reads vertices through them without checking again.
+static inline int
+mesh__check_indices(mesh_t* mesh) {
+	const unsigned int vertex_count = (unsigned int)mesh->vertex_count;
+	for(unsigned int i = 0; i < mesh->index_count; i++) {
+		const unsigned int index = mesh->index_type == VK_INDEX_TYPE_UINT16 ? ((const unsigned short*)mesh->indices)[i] : ((const unsigned int*)mesh->indices)[i];
+		if(index >= vertex_count) return mesh__fail(mesh, "index %u is %u, there are %u vertices", i, index, vertex_count);
+	}
+	return 0;
+} // mesh__check_indices
+
+// Loads a .gltf, .glb or .obj file, by extension. Returns 0 on success, otherwise mesh->error says why.
+// Call mesh_free() either way.
+static inline int
+mesh_load(mesh_t* mesh, const char* path) {
+	memset(mesh, 0, sizeof(*mesh));
+	const char* dot = strrchr(path, '.');
+	int result;
+	if(dot && (strcmp(dot, ".obj") == 0 || strcmp(dot, ".OBJ") == 0)) result = mesh_load_obj(mesh, path);
+	else if(dot && (strcmp(dot, ".gltf") == 0 || strcmp(dot, ".glb") == 0)) result = mesh_load_gltf(mesh, path);
+	else return mesh__fail(mesh, "unknown file type, .gltf, .glb or .obj");
+	return result != 0 ? result : mesh__check_indices(mesh);
+} // mesh_load
+
+// Rewrites every attribute whose format Vulkan can't read (supported() returns 0 for it) as floats, in a binding of its own.
+// Bindings nothing reads anymore are dropped. Returns 0 on success.
+static inline int
+mesh_convert_unsupported(mesh_t* mesh, int (*supported)(VkFormat format, void* user), void* user) {
+	for(int k = 0; k < MESH_ATTRIBUTE_KINDS; k++) {
+		mesh_attribute_t* a = &mesh->attributes[k];
+		if(a->binding < 0 || (a->format != VK_FORMAT_UNDEFINED && supported(a->format, user))) continue;
+		if(mesh->bindings_count == MESH_MAX_BINDINGS) return mesh__fail(mesh, "too many vertex bindings");
+
+		float* floats = mesh__own(mesh, (size_t)mesh->vertex_count * a->components * sizeof(float));
+		if(!floats) return mesh__fail(mesh, "out of memory");
+		for(int i = 0; i < mesh->vertex_count; i++) {
+			float v[4];
+			mesh_read_attribute(mesh, (mesh_attribute_kind_t)k, i, v);
+			memcpy(floats + (size_t)i * a->components, v, a->components * sizeof(float));
+		}
+		mesh_binding_t* b = &mesh->bindings[mesh->bindings_count];
+		b->data = (const unsigned char*)floats;
+		b->stride = a->components * sizeof(float);
+		b->size = (size_t)mesh->vertex_count * b->stride;
+		mesh->stats.copied_bytes += b->size;
+		a->binding = mesh->bindings_count++;
+		a->offset = 0;
+		a->component = MESH_FLOAT;
+		a->normalized = 0;
+		a->format = mesh_vertex_format(MESH_FLOAT, a->components, 0);
+	}
+
+	int remap[MESH_MAX_BINDINGS];
+	int used = 0;
+	for(int b = 0; b < mesh->bindings_count; b++) {
+		remap[b] = -1;
+		for(int k = 0; k < MESH_ATTRIBUTE_KINDS; k++) {
+			if(mesh->attributes[k].binding == b) remap[b] = used;
+		}
+		if(remap[b] >= 0) mesh->bindings[used++] = mesh->bindings[b];
+	}
+	mesh->bindings_count = used;
+	for(int k = 0; k < MESH_ATTRIBUTE_KINDS; k++) {
+		if(mesh->attributes[k].binding >= 0) mesh->attributes[k].binding = remap[mesh->attributes[k].binding];
+	}
+	return 0;
+} // mesh_convert_unsupported
+
+// The mesh's bindings (as bindings 0 to bindings_count - 1) and one attribute per input, for VkPipelineVertexInputStateCreateInfo.
+// Every input's attribute has to exist. Returns the number of attributes written.
+static inline int
+mesh_vertex_input(const mesh_t* mesh, const mesh_input_t* inputs, int inputs_count,
+	VkVertexInputBindingDescription* bindings, VkVertexInputAttributeDescription* attributes) {
+	for(int b = 0; b < mesh->bindings_count; b++) {
+		bindings[b].binding = b;
+		bindings[b].stride = mesh->bindings[b].stride;
+		bindings[b].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	}
+	int n = 0;
+	for(int i = 0; i < inputs_count; i++) {
+		const mesh_attribute_t* a = &mesh->attributes[inputs[i].kind];
+		if(a->binding < 0) continue;
+		attributes[n].location = inputs[i].location;
+		attributes[n].binding = a->binding;
+		attributes[n].format = a->format;
+		attributes[n].offset = a->offset;
+		n++;
+	}
+	return n;
+} // mesh_vertex_input
@@ -0,0 +1,349 @@
+#pragma once
+
+// Level of detail chain, generated at import by edge collapse (--lod).
+//
+// Every level is a range of the same index buffer over the same vertices, so drawing a coarser level is a different
+// firstIndex and indexCount and nothing else: no extra vertex data, no rebinding.
+// - Simplification is half-edge collapse: a vertex is moved onto a neighbour, which keeps its position and attributes,
+//   and the triangles that had both disappear. Each collapse is priced with quadric error metrics (Garland, Heckbert 1997):
+//   every vertex carries the area weighted sum of the planes of its triangles, and the cost of moving it is the mean squared
+//   distance of the new position from those planes, so flat areas go first and creases and silhouettes last.
+// - Vertices are welded by position for the topology, so a seam in the normals, colors or texcoords doesn't look like a hole.
+//   Vertices on a seam, on an open border or on a non-manifold edge are locked: moving them would tear the surface or drag an
+//   attribute across the seam. Collapses that would flip a triangle are skipped.
+// - A level aims for MESH_LOD_RATIO of the triangles of the one before it, in passes: the candidate collapses are sorted by cost
+//   and taken cheapest first, each one locking its neighbourhood for the rest of the pass. The chain stops at MESH_LOD_MAX
+//   levels, at MESH_LOD_MIN_TRIANGLES, or when a level doesn't get smaller (everything left is locked).
+// - A level's error is the largest collapse cost so far as a distance, in the mesh's units: how far its surface may be from the
+//   full mesh's. mesh_lod_select() projects it to pixels at an object's distance and picks the coarsest level that stays
+//   under the threshold.
+// Triangles keep their order from level to level, so a mesh ordered by --optimize-mesh keeps most of its cache locality.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mesh.h"
+
+
+
+#define MESH_LOD_MAX		6	// levels, the full mesh included. gpu_cull_push_t has room for GPU_CULL_MAX_LODS
+#define MESH_LOD_RATIO		0.5f	// of the triangles of the level before
+#define MESH_LOD_MIN_TRIANGLES	32	// no level below this
+#define MESH_LOD_PASSES		16	// per level at most
+
+typedef struct mesh_lod_t {
+	unsigned int	first_index;	// in the mesh's index buffer
+	unsigned int	index_count;
+	float		error;		// distance from the full mesh's surface, an estimate from the quadrics. 0 for the full mesh
+} mesh_lod_t;
+
+typedef struct mesh_lods_t {
+	mesh_lod_t	levels[MESH_LOD_MAX];
+	int		count;
+	int		locked;		// vertex positions that are never moved
+	unsigned long long ns;
+} mesh_lods_t;
+
+// Symmetric 4x4 plane quadric: a 3x3, b, c, and the total area weight.
+typedef struct mesh_lod__quadric_t {
+	double	a00, a01, a02, a11, a12, a22;
+	double	b0, b1, b2;
+	double	c;
+	double	w;
+} mesh_lod__quadric_t;
+
+typedef struct mesh_lod__collapse_t {
+	float		cost;	// squared distance
+	unsigned int	from;	// vertex
+	unsigned int	to;	// vertex, the corner of a shared triangle, so the wedge with the right attributes
+} mesh_lod__collapse_t;
+
+
+
+static inline void
+mesh_lod__add(mesh_lod__quadric_t* q, const mesh_lod__quadric_t* r) {
+	q->a00 += r->a00; q->a01 += r->a01; q->a02 += r->a02;
+	q->a11 += r->a11; q->a12 += r->a12; q->a22 += r->a22;
+	q->b0 += r->b0; q->b1 += r->b1; q->b2 += r->b2;
+	q->c += r->c;
+	q->w += r->w;
+} // mesh_lod__add
+
+// Mean squared distance of p from the planes in q and r together.
+static inline float
+mesh_lod__cost(const mesh_lod__quadric_t* q, const mesh_lod__quadric_t* r, const float p[3]) {
+	mesh_lod__quadric_t s = *q;
+	mesh_lod__add(&s, r);
+	const double x = p[0], y = p[1], z = p[2];
+	const double e = s.a00 * x * x + s.a11 * y * y + s.a22 * z * z + 2.0 * (s.a01 * x * y + s.a02 * x * z + s.a12 * y * z) +
+		2.0 * (s.b0 * x + s.b1 * y + s.b2 * z) + s.c;
+	return s.w > 0.0 ? (float)fmax(e / s.w, 0.0) : 0.0f;
+} // mesh_lod__cost
+
+static inline void
+mesh_lod__normal(const float* p0, const float* p1, const float* p2, float n[3]) {
+	const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+	const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+} // mesh_lod__normal
+
+static int
+mesh_lod__compare_keys(const void* a, const void* b) {
+	const unsigned long long x = *(const unsigned long long*)a, y = *(const unsigned long long*)b;
+	return x < y ? -1 : x > y;
+} // mesh_lod__compare_keys
+
+static int
+mesh_lod__compare_collapses(const void* a, const void* b) {
+	const float x = ((const mesh_lod__collapse_t*)a)->cost, y = ((const mesh_lod__collapse_t*)b)->cost;
+	return x < y ? -1 : x > y;
+} // mesh_lod__compare_collapses
+
+// One pass of collapses over the triangles in `indices`, until `target` triangles are left. Dead triangles are removed.
+// canon: the welded vertex of every vertex. Returns the number of collapses, *error grows to the largest cost.
+static inline size_t
+mesh_lod__pass(unsigned int* indices, size_t* index_count, size_t target, const float (*positions)[3], const unsigned int* canon,
+	const unsigned char* locked, mesh_lod__quadric_t* quadrics, int vertex_count, float* error) {
+	const size_t triangle_count = *index_count / 3;
+	unsigned int* offsets = calloc((size_t)vertex_count + 1, sizeof(unsigned int));
+	unsigned int* adjacency = malloc((*index_count + 1) * sizeof(unsigned int));
+	mesh_lod__collapse_t* collapses = malloc((*index_count + 1) * sizeof(mesh_lod__collapse_t));
+	unsigned char* marked = calloc(vertex_count ? vertex_count : 1, 1);
+	unsigned char* dead = calloc(triangle_count ? triangle_count : 1, 1);
+	size_t collapsed = 0;
+	if(!offsets || !adjacency || !collapses || !marked || !dead) goto done;
+
+	// triangles around every welded vertex
+	for(size_t i = 0; i < *index_count; i++) offsets[canon[indices[i]] + 1]++;
+	for(int v = 0; v < vertex_count; v++) offsets[v + 1] += offsets[v];
+	for(size_t i = 0; i < *index_count; i++) adjacency[offsets[canon[indices[i]]]++] = (unsigned int)(i / 3);
+	for(int v = vertex_count; v > 0; v--) offsets[v] = offsets[v - 1];
+	offsets[0] = 0;
+
+	// every corner onto the next one of its triangle, unless it's locked: an inner edge is in two triangles, once each way
+	size_t candidates = 0;
+	for(size_t i = 0; i < *index_count; i++) {
+		const unsigned int from = indices[i], to = indices[i - i % 3 + (i + 1) % 3];
+		if(locked[canon[from]]) continue;
+		collapses[candidates].from = from;
+		collapses[candidates].to = to;
+		collapses[candidates].cost = mesh_lod__cost(&quadrics[canon[from]], &quadrics[canon[to]], positions[to]);
+		candidates++;
+	}
+	qsort(collapses, candidates, sizeof(mesh_lod__collapse_t), mesh_lod__compare_collapses);
+
+	size_t left = triangle_count;
+	for(size_t k = 0; k < candidates && left > target; k++) {
+		const unsigned int from = collapses[k].from, to = collapses[k].to;
+		const unsigned int cf = canon[from], ct = canon[to];
+		if(marked[cf] || marked[ct] || cf == ct) continue;
+
+		// no triangle that stays may turn over
+		int flips = 0;
+		for(unsigned int j = offsets[cf]; j < offsets[cf + 1] && !flips; j++) {
+			const unsigned int* tri = indices + (size_t)adjacency[j] * 3;
+			if(canon[tri[0]] == ct || canon[tri[1]] == ct || canon[tri[2]] == ct) continue;
+			const float* p[3] = {positions[tri[0]], positions[tri[1]], positions[tri[2]]};
+			float before[3], after[3];
+			mesh_lod__normal(p[0], p[1], p[2], before);
+			for(int c = 0; c < 3; c++) {
+				if(canon[tri[c]] == cf) p[c] = positions[to];
+			}
+			mesh_lod__normal(p[0], p[1], p[2], after);
+			flips = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0f;
+		}
+		if(flips) continue;
+
+		// the triangles around `from` are only changed by this collapse, until the next pass
+		for(unsigned int j = offsets[cf]; j < offsets[cf + 1]; j++) {
+			const unsigned int t = adjacency[j];
+			unsigned int* tri = indices + (size_t)t * 3;
+			for(int c = 0; c < 3; c++) marked[canon[tri[c]]] = 1;
+			if(canon[tri[0]] == ct || canon[tri[1]] == ct || canon[tri[2]] == ct) {
+				dead[t] = 1;
+				left--;
+			}
+			for(int c = 0; c < 3; c++) {
+				if(tri[c] == from) tri[c] = to;
+			}
+		}
+		mesh_lod__add(&quadrics[ct], &quadrics[cf]);
+		*error = fmaxf(*error, collapses[k].cost);
+		collapsed++;
+	}
+
+	size_t kept = 0;
+	for(size_t t = 0; t < triangle_count; t++) {
+		if(dead[t]) continue;
+		memmove(indices + kept * 3, indices + t * 3, 3 * sizeof(unsigned int));
+		kept++;
+	}
+	*index_count = kept * 3;
+
+done:
+	free(offsets);
+	free(adjacency);
+	free(collapses);
+	free(marked);
+	free(dead);
+	return collapsed;
+} // mesh_lod__pass
+
+// Builds the chain and appends its levels to the mesh's index buffer, which the mesh then owns.
+// index_count stays the full mesh's, indices_size covers all levels. Returns 0 on success, otherwise mesh->error says why.
+static inline int
+mesh_lod_build(mesh_t* mesh, mesh_lods_t* lods) {
+	const unsigned long long start_ns = time_now_ns();
+	memset(lods, 0, sizeof(*lods));
+	const size_t index_count = mesh->index_count - mesh->index_count % 3;
+	const int vertex_count = mesh->vertex_count;
+	size_t hash_size = 1;
+	while(hash_size < 2 * (size_t)vertex_count) hash_size *= 2;
+
+	// every level one after the other, at most twice the full mesh with a ratio of a half
+	const size_t capacity = index_count * MESH_LOD_MAX;
+	unsigned int* chain = malloc((capacity + 1) * sizeof(unsigned int));
+	unsigned int* level = malloc((index_count + 1) * sizeof(unsigned int));
+	float (*positions)[3] = malloc(((size_t)vertex_count + 1) * sizeof(*positions));
+	unsigned int* canon = malloc(((size_t)vertex_count + 1) * sizeof(unsigned int));
+	unsigned int* hash = malloc(hash_size * sizeof(unsigned int));
+	unsigned char* locked = calloc((size_t)vertex_count + 1, 1);
+	unsigned long long* edges = malloc((index_count + 1) * sizeof(unsigned long long));
+	mesh_lod__quadric_t* quadrics = calloc((size_t)vertex_count + 1, sizeof(mesh_lod__quadric_t));
+	int result = 0;
+	if(!chain || !level || !positions || !canon || !hash || !locked || !edges || !quadrics) {
+		result = mesh__fail(mesh, "out of memory");
+		goto done;
+	}
+	for(size_t i = 0; i < index_count; i++) {
+		chain[i] = mesh->index_type == VK_INDEX_TYPE_UINT16 ? ((const unsigned short*)mesh->indices)[i] : ((const unsigned int*)mesh->indices)[i];
+		if(chain[i] >= (unsigned int)vertex_count) {
+			result = mesh__fail(mesh, "index %u is past the last vertex", chain[i]);
+			goto done;
+		}
+	}
+
+	// weld by position: the first vertex at a position stands for all of them, a second one there means a seam
+	for(int v = 0; v < vertex_count; v++) {
+		float p[4];
+		mesh_read_attribute(mesh, MESH_POSITION, v, p);
+		memcpy(positions[v], p, sizeof(positions[v]));
+	}
+	memset(hash, 0xff, hash_size * sizeof(unsigned int));
+	for(int v = 0; v < vertex_count; v++) {
+		unsigned int bits[3];
+		memcpy(bits, positions[v], sizeof(bits));
+		size_t h = ((bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u)) & (hash_size - 1);
+		while(hash[h] != ~0u && memcmp(positions[hash[h]], positions[v], sizeof(positions[v])) != 0) h = (h + 1) & (hash_size - 1);
+		if(hash[h] == ~0u) {
+			hash[h] = (unsigned int)v;
+			canon[v] = (unsigned int)v;
+		} else {
+			canon[v] = hash[h];
+			locked[hash[h]] = 1;
+		}
+	}
+
+	// edges used by one triangle (open borders) or more than two (non-manifold)
+	for(size_t i = 0; i < index_count; i++) {
+		const unsigned long long a = canon[chain[i]], b = canon[chain[i - i % 3 + (i + 1) % 3]];
+		edges[i] = a < b ? a << 32 | b : b << 32 | a;
+	}
+	qsort(edges, index_count, sizeof(unsigned long long), mesh_lod__compare_keys);
+	for(size_t i = 0; i < index_count;) {
+		size_t run = 1;
+		while(i + run < index_count && edges[i + run] == edges[i]) run++;
+		if(run != 2) locked[edges[i] >> 32] = locked[edges[i] & 0xffffffffu] = 1;
+		i += run;
+	}
+	for(int v = 0; v < vertex_count; v++) lods->locked += canon[v] == (unsigned int)v && locked[v];
+
+	// the planes around every welded vertex, weighted by area
+	for(size_t t = 0; t < index_count / 3; t++) {
+		const unsigned int* tri = chain + t * 3;
+		float n[3];
+		mesh_lod__normal(positions[tri[0]], positions[tri[1]], positions[tri[2]], n);
+		const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if(length == 0.0f) continue;
+		const double x = n[0] / length, y = n[1] / length, z = n[2] / length;
+		const double d = -(x * positions[tri[0]][0] + y * positions[tri[0]][1] + z * positions[tri[0]][2]);
+		const double w = length * 0.5;
+		const mesh_lod__quadric_t q = {x * x * w, x * y * w, x * z * w, y * y * w, y * z * w, z * z * w, x * d * w, y * d * w, z * d * w, d * d * w, w};
+		for(int c = 0; c < 3; c++) mesh_lod__add(&quadrics[canon[tri[c]]], &q);
+	}
+
+	lods->levels[0].index_count = (unsigned int)index_count;
+	lods->count = 1;
+	size_t chain_count = index_count, level_count = index_count;
+	memcpy(level, chain, index_count * sizeof(unsigned int));
+	float error = 0.0f; // squared
+	while(lods->count < MESH_LOD_MAX && level_count / 3 > MESH_LOD_MIN_TRIANGLES) {
+		const size_t before = level_count / 3;
+		size_t target = (size_t)(before * MESH_LOD_RATIO);
+		if(target < MESH_LOD_MIN_TRIANGLES) target = MESH_LOD_MIN_TRIANGLES;
+		for(int pass = 0; pass < MESH_LOD_PASSES && level_count / 3 > target; pass++) {
+			if(mesh_lod__pass(level, &level_count, target, (const float (*)[3])positions, canon, locked, quadrics, vertex_count, &error) == 0) break;
+		}
+		// what's left is mostly locked
+		if(level_count / 3 > before - before / 8) break;
+		mesh_lod_t* l = &lods->levels[lods->count++];
+		l->first_index = (unsigned int)chain_count;
+		l->index_count = (unsigned int)level_count;
+		l->error = sqrtf(error);
+		memcpy(chain + chain_count, level, level_count * sizeof(unsigned int));
+		chain_count += level_count;
+	}
+
+	if(lods->count > 1) {
+		const size_t index_size = mesh->index_type == VK_INDEX_TYPE_UINT16 ? sizeof(unsigned short) : sizeof(unsigned int);
+		void* indices = mesh__own(mesh, chain_count * index_size);
+		if(!indices) {
+			result = mesh__fail(mesh, "out of memory");
+			goto done;
+		}
+		for(size_t i = 0; i < chain_count; i++) {
+			if(index_size == sizeof(unsigned short)) ((unsigned short*)indices)[i] = (unsigned short)chain[i];
+			else ((unsigned int*)indices)[i] = chain[i];
+		}
+		mesh->indices = indices;
+		mesh->indices_size = chain_count * index_size;
+		mesh->stats.copied_bytes += mesh->indices_size;
+	}
+	lods->ns = time_now_ns() - start_ns;
+
+done:
+	free(chain);
+	free(level);
+	free(positions);
+	free(canon);
+	free(hash);
+	free(locked);
+	free(edges);
+	free(quadrics);
+	return result;
+} // mesh_lod_build
+
+// Errors in another space: the mesh scaled uniformly, like the fit into -1 to 1.
+static inline void
+mesh_lod_scale(mesh_lods_t* lods, float scale) {
+	for(int i = 0; i < lods->count; i++) lods->levels[i].error *= scale;
+} // mesh_lod_scale
+
+// Pixels per unit of error at distance 1, divided by the pixel threshold, from the frame's projection matrix (column major)
+// and the height of the render target: a distance d error e covers e * projection[1][1] * height / 2 / d pixels.
+static inline float
+mesh_lod_factor(const float projection[16], float height, float threshold_pixels) {
+	return fabsf(projection[5]) * height * 0.5f / threshold_pixels;
+} // mesh_lod_factor
+
+// The coarsest level whose error, scaled by `scale` (the object's) and seen from `distance`, stays under the threshold of `factor`.
+// The same test as cull.comp's.
+static inline int
+mesh_lod_select(const mesh_lods_t* lods, float scale, float distance, float factor) {
+	int i = lods->count - 1;
+	while(i > 0 && lods->levels[i].error * scale * factor > distance) i--;
+	return i;
+} // mesh_lod_select
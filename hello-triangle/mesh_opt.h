@@ -0,0 +1,364 @@
+#pragma once
+
+// Import-time mesh optimization, for meshes that would otherwise be drawn in file order (--optimize-mesh).
+//
+// Three passes over the index buffer, in this order, each keeping what the one before it won:
+// - Post-transform vertex cache: Tipsify (Sander, Nehab, Barczak 2007). Fans triangles around a vertex, then moves on to
+//   the neighbour that is still in a simulated FIFO cache of MESH_OPT_CACHE_SIZE entries, or the most recent dead end.
+//   Linear time, and it never looks at positions.
+// - Overdraw: the Tipsify order is cut into clusters where the cache restarts anyway (and where a cluster's own miss rate allows),
+//   then the clusters are sorted to draw the ones facing away from the mesh center first: those are the outside surfaces
+//   that occlude the rest, so later fragments fail the depth test instead of being shaded.
+// - Vertex fetch: vertices are renumbered in the order the indices first use them and every binding is rewritten in that order,
+//   so the vertex fetches walk memory forwards. Vertices no index uses are dropped.
+// ACMR (average cache miss ratio: transformed vertices per triangle, 0.5 at best on a regular grid, 3 at worst) and ATVR
+// (transformed vertices per vertex, 1 at best) are measured with the same FIFO cache before and after.
+// The optimized index and vertex data are owned by the mesh, so this is also where a mapped file stops being used in place.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mesh.h"
+
+
+
+#define MESH_OPT_CACHE_SIZE	16	// FIFO entries, what Tipsify targets and what ACMR is measured with
+#define MESH_OPT_OVERDRAW	1.05f	// clusters may have up to this much of their ACMR in extra misses
+
+typedef struct mesh_opt_cache_stats_t {
+	float	acmr;
+	float	atvr;
+	float	overfetch; // bytes read through a 16 KB direct mapped cache of 64 byte lines, per byte of vertex data used. 1 at best
+} mesh_opt_cache_stats_t;
+
+typedef struct mesh_opt_report_t {
+	mesh_opt_cache_stats_t	before;
+	mesh_opt_cache_stats_t	after;
+	int			clusters;
+	int			vertices_dropped;
+	unsigned long long	ns;
+} mesh_opt_report_t;
+
+
+
+// Simulates the FIFO post-transform cache over the triangles. misses: per triangle, how many of its vertices missed (may be NULL).
+// Returns the total misses.
+static inline size_t
+mesh_opt__simulate(const unsigned int* indices, size_t index_count, unsigned int* stamps, int vertex_count, unsigned char* misses) {
+	unsigned int time = MESH_OPT_CACHE_SIZE + 1;
+	for(int v = 0; v < vertex_count; v++) stamps[v] = 0;
+	size_t total = 0;
+	for(size_t t = 0; t < index_count / 3; t++) {
+		unsigned char m = 0;
+		for(int c = 0; c < 3; c++) {
+			const unsigned int v = indices[t * 3 + c];
+			if(time - stamps[v] > MESH_OPT_CACHE_SIZE) {
+				stamps[v] = time++;
+				m++;
+			}
+		}
+		if(misses) misses[t] = m;
+		total += m;
+	}
+	return total;
+} // mesh_opt__simulate
+
+// 64 byte lines read through a 16 KB direct mapped cache, for a binding of `stride` byte vertices.
+static inline size_t
+mesh_opt__fetched_lines(const unsigned int* indices, size_t index_count, unsigned int stride) {
+	enum { LINE = 64, LINES = 16384 / 64 };
+	size_t tags[LINES];
+	for(int l = 0; l < LINES; l++) tags[l] = (size_t)-1;
+	size_t fetched = 0;
+	for(size_t i = 0; i < index_count; i++) {
+		const size_t first = (size_t)indices[i] * stride / LINE;
+		const size_t last = ((size_t)indices[i] * stride + stride - 1) / LINE;
+		for(size_t line = first; line <= last; line++) {
+			if(tags[line % LINES] != line) {
+				tags[line % LINES] = line;
+				fetched++;
+			}
+		}
+	}
+	return fetched;
+} // mesh_opt__fetched_lines
+
+static inline void
+mesh_opt__measure(const mesh_t* mesh, const unsigned int* indices, size_t index_count, unsigned int* scratch, mesh_opt_cache_stats_t* out) {
+	const size_t misses = mesh_opt__simulate(indices, index_count, scratch, mesh->vertex_count, NULL);
+	// vertices used, scratch is free again
+	memset(scratch, 0, (size_t)mesh->vertex_count * sizeof(unsigned int));
+	size_t used = 0;
+	for(size_t i = 0; i < index_count; i++) {
+		if(!scratch[indices[i]]) {
+			scratch[indices[i]] = 1;
+			used++;
+		}
+	}
+	size_t fetched = 0, bytes = 0;
+	for(int b = 0; b < mesh->bindings_count; b++) {
+		fetched += mesh_opt__fetched_lines(indices, index_count, mesh->bindings[b].stride) * 64;
+		bytes += used * mesh->bindings[b].stride;
+	}
+	out->acmr = index_count ? (float)misses / (float)(index_count / 3) : 0.0f;
+	out->atvr = used ? (float)misses / (float)used : 0.0f;
+	out->overfetch = bytes ? (float)fetched / (float)bytes : 0.0f;
+} // mesh_opt__measure
+
+// Tipsify. Writes the reordered triangles to out (not in place).
+// Needs 3 * vertex_count + 1 + 2 * index_count + triangle_count unsigned ints of scratch.
+static inline void
+mesh_opt_tipsify(unsigned int* out, const unsigned int* indices, size_t index_count, int vertex_count, unsigned int* scratch) {
+	const size_t triangle_count = index_count / 3;
+	unsigned int* live = scratch;				// per vertex: triangles not emitted yet
+	unsigned int* offsets = live + vertex_count;		// per vertex: its triangles in `adjacency`
+	unsigned int* stamps = offsets + vertex_count + 1;	// per vertex: FIFO time it went into the cache
+	unsigned int* adjacency = stamps + vertex_count;	// triangles of every vertex, grouped by vertex
+	unsigned int* emitted = adjacency + index_count;	// per triangle
+	unsigned int* dead_ends = emitted + triangle_count;	// stack of vertices used lately, where to go when a fan runs out
+	// candidates for the next fanning vertex reuse the dead end stack's free space: it only grows by what is pushed here
+
+	memset(live, 0, (size_t)vertex_count * sizeof(unsigned int));
+	for(size_t i = 0; i < index_count; i++) live[indices[i]]++;
+	offsets[0] = 0;
+	for(int v = 0; v < vertex_count; v++) offsets[v + 1] = offsets[v] + live[v];
+	memcpy(stamps, offsets, (size_t)vertex_count * sizeof(unsigned int)); // as fill cursors
+	for(size_t t = 0; t < triangle_count; t++) {
+		for(int c = 0; c < 3; c++) adjacency[stamps[indices[t * 3 + c]]++] = (unsigned int)t;
+	}
+	memset(stamps, 0, (size_t)vertex_count * sizeof(unsigned int));
+	memset(emitted, 0, triangle_count * sizeof(unsigned int));
+
+	unsigned int time = MESH_OPT_CACHE_SIZE + 1;
+	size_t dead_count = 0;
+	size_t written = 0;
+	int cursor = 0; // vertices before it have nothing left
+	int fan = vertex_count > 0 ? 0 : -1;
+	while(fan >= 0) {
+		const size_t candidates_start = dead_count;
+		for(unsigned int a = offsets[fan]; a < offsets[fan + 1]; a++) {
+			const unsigned int t = adjacency[a];
+			if(emitted[t]) continue;
+			emitted[t] = 1;
+			for(int c = 0; c < 3; c++) {
+				const unsigned int v = indices[t * 3 + c];
+				out[written++] = v;
+				dead_ends[dead_count++] = v;
+				live[v]--;
+				if(time - stamps[v] > MESH_OPT_CACHE_SIZE) stamps[v] = time++;
+			}
+		}
+
+		// The candidate that will still be in the cache after its remaining triangles, the one that went in first.
+		// One that won't (priority 0) is no better than a dead end, so it isn't taken.
+		int next = -1;
+		unsigned int best = 0;
+		for(size_t i = candidates_start; i < dead_count; i++) {
+			const unsigned int v = dead_ends[i];
+			if(live[v] == 0) continue;
+			unsigned int priority = 0;
+			if(time - stamps[v] + 2 * live[v] <= MESH_OPT_CACHE_SIZE) priority = time - stamps[v];
+			if(priority > best) {
+				best = priority;
+				next = (int)v;
+			}
+		}
+		// a dead end: the latest vertex with triangles left, or the next one in input order
+		while(next < 0 && dead_count > 0) {
+			const unsigned int v = dead_ends[--dead_count];
+			if(live[v] > 0) next = (int)v;
+		}
+		while(next < 0 && cursor < vertex_count) {
+			if(live[cursor] > 0) next = cursor;
+			cursor++;
+		}
+		fan = next;
+	}
+} // mesh_opt_tipsify
+
+// Sorts the clusters of the cache ordered triangles in `indices` (in place) so the outward facing ones go first.
+// Returns the number of clusters. Needs 2 * triangle_count + vertex_count unsigned ints of scratch.
+static inline int
+mesh_opt_overdraw(const mesh_t* mesh, unsigned int* indices, size_t index_count, unsigned int* scratch) {
+	const size_t triangle_count = index_count / 3;
+	if(triangle_count == 0) return 0;
+	unsigned char* misses = (unsigned char*)scratch; // triangle_count bytes
+	unsigned int* clusters = scratch + (triangle_count + 3) / 4; // first triangle of each cluster
+	unsigned int* stamps = clusters + triangle_count + 1;
+
+	// Hard boundaries: the cache started over, all three vertices missed.
+	mesh_opt__simulate(indices, index_count, stamps, mesh->vertex_count, misses);
+	int hard_count = 0;
+	for(size_t t = 0; t < triangle_count; t++) {
+		if(t == 0 || misses[t] == 3) clusters[hard_count++] = (unsigned int)t;
+	}
+	clusters[hard_count] = (unsigned int)triangle_count;
+
+	// Soft boundaries inside them: wherever the misses so far are within MESH_OPT_OVERDRAW of the cluster's own ACMR,
+	// the cut doesn't cost more than that. Done on the same simulation, the cluster's first triangles are cold anyway.
+	typedef struct cluster_t {
+		unsigned int	first, count;
+		float		key;
+	} cluster_t;
+	cluster_t* sorted = malloc(triangle_count * sizeof(cluster_t));
+	if(!sorted) return 1;
+	int count = 0;
+	for(int h = 0; h < hard_count; h++) {
+		const unsigned int start = clusters[h], end = clusters[h + 1];
+		unsigned int cluster_misses = 0;
+		for(unsigned int t = start; t < end; t++) cluster_misses += misses[t];
+		const float threshold = MESH_OPT_OVERDRAW * (float)cluster_misses / (float)(end - start);
+		unsigned int first = start, running = 0;
+		for(unsigned int t = start; t < end; t++) {
+			running += misses[t];
+			const unsigned int n = t + 1 - first;
+			if(t + 1 < end && n >= 32 && (float)running / (float)n <= threshold && misses[t + 1] > 0) {
+				sorted[count++] = (cluster_t){first, n, 0.0f};
+				first = t + 1;
+				running = 0;
+			}
+		}
+		sorted[count++] = (cluster_t){first, end - first, 0.0f};
+	}
+
+	// Sort key: how much the cluster faces away from the mesh center, its area weighted normal dotted with its centroid's offset.
+	float center[3] = {0, 0, 0};
+	for(int j = 0; j < 3; j++) center[j] = 0.5f * (mesh->lo[j] + mesh->hi[j]);
+	for(int c = 0; c < count; c++) {
+		float centroid[3] = {0, 0, 0}, normal[3] = {0, 0, 0}, area = 0.0f;
+		for(unsigned int t = sorted[c].first; t < sorted[c].first + sorted[c].count; t++) {
+			float p[3][4];
+			for(int k = 0; k < 3; k++) mesh_read_attribute(mesh, MESH_POSITION, (int)indices[t * 3 + k], p[k]);
+			const float e1[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]};
+			const float e2[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]};
+			const float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+			const float a = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for(int j = 0; j < 3; j++) {
+				centroid[j] += (p[0][j] + p[1][j] + p[2][j]) * a / 3.0f;
+				normal[j] += n[j];
+			}
+			area += a;
+		}
+		const float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		float key = 0.0f;
+		for(int j = 0; j < 3 && area > 0.0f && length > 0.0f; j++) key += (centroid[j] / area - center[j]) * normal[j] / length;
+		sorted[c].key = key;
+	}
+
+	// insertion sort on the keys, descending, stable. Clusters come mostly in spatial order already
+	for(int c = 1; c < count; c++) {
+		const cluster_t x = sorted[c];
+		int j = c - 1;
+		while(j >= 0 && sorted[j].key < x.key) {
+			sorted[j + 1] = sorted[j];
+			j--;
+		}
+		sorted[j + 1] = x;
+	}
+
+	unsigned int* copy = malloc(index_count * sizeof(unsigned int));
+	if(!copy) {
+		free(sorted);
+		return 1;
+	}
+	memcpy(copy, indices, index_count * sizeof(unsigned int));
+	size_t written = 0;
+	for(int c = 0; c < count; c++) {
+		memcpy(indices + written, copy + (size_t)sorted[c].first * 3, (size_t)sorted[c].count * 3 * sizeof(unsigned int));
+		written += (size_t)sorted[c].count * 3;
+	}
+	free(copy);
+	free(sorted);
+	return count;
+} // mesh_opt_overdraw
+
+// Optimizes the mesh's triangle order and vertex order as described at the top. Needs the mesh's data (before mesh_free()).
+// Returns 0 on success, otherwise mesh->error says why and the mesh is unchanged.
+static inline int
+mesh_optimize(mesh_t* mesh, mesh_opt_report_t* report) {
+	const unsigned long long start_ns = time_now_ns();
+	memset(report, 0, sizeof(*report));
+	const size_t index_count = mesh->index_count - mesh->index_count % 3;
+	const int vertex_count = mesh->vertex_count;
+	const size_t triangle_count = index_count / 3;
+
+	unsigned int* indices = calloc(index_count, sizeof(unsigned int));
+	unsigned int* reordered = malloc(index_count * sizeof(unsigned int));
+	unsigned int* scratch = malloc((3 * (size_t)vertex_count + 1 + 2 * index_count + triangle_count) * sizeof(unsigned int));
+	if(!indices || !reordered || !scratch) {
+		free(indices);
+		free(reordered);
+		free(scratch);
+		return mesh__fail(mesh, "out of memory");
+	}
+	for(size_t i = 0; i < index_count; i++) {
+		const unsigned int index = mesh->index_type == VK_INDEX_TYPE_UINT16 ? ((const unsigned short*)mesh->indices)[i] : ((const unsigned int*)mesh->indices)[i];
+		indices[i] = index;
+		if(index >= (unsigned int)vertex_count) {
+			free(indices);
+			free(reordered);
+			free(scratch);
+			return mesh__fail(mesh, "index %u is past the last vertex", index);
+		}
+	}
+	mesh_opt__measure(mesh, indices, index_count, scratch, &report->before);
+
+	mesh_opt_tipsify(reordered, indices, index_count, vertex_count, scratch);
+	report->clusters = mesh_opt_overdraw(mesh, reordered, index_count, scratch);
+
+	// vertex fetch: new numbers in order of first use
+	unsigned int* remap = scratch;
+	for(int v = 0; v < vertex_count; v++) remap[v] = ~0u;
+	unsigned int used = 0;
+	for(size_t i = 0; i < index_count; i++) {
+		if(remap[reordered[i]] == ~0u) remap[reordered[i]] = used++;
+		indices[i] = remap[reordered[i]];
+	}
+	free(reordered);
+
+	int failed = 0;
+	unsigned char* bindings[MESH_MAX_BINDINGS] = {0};
+	for(int b = 0; b < mesh->bindings_count && !failed; b++) {
+		bindings[b] = mesh__own(mesh, (size_t)used * mesh->bindings[b].stride);
+		failed = bindings[b] == NULL;
+	}
+	void* new_indices = failed ? NULL : mesh__own(mesh, index_count * (mesh->index_type == VK_INDEX_TYPE_UINT16 ? 2 : 4));
+	if(!new_indices) {
+		free(indices);
+		free(scratch);
+		return mesh__fail(mesh, "out of memory");
+	}
+	for(int b = 0; b < mesh->bindings_count; b++) {
+		// the binding may end right after the last vertex's attributes, short of a whole stride
+		const mesh_binding_t* src = &mesh->bindings[b];
+		memset(bindings[b], 0, (size_t)used * src->stride);
+		for(int v = 0; v < vertex_count; v++) {
+			if(remap[v] == ~0u) continue;
+			const size_t from = (size_t)v * src->stride;
+			const size_t bytes = src->size - from < src->stride ? src->size - from : src->stride;
+			memcpy(bindings[b] + (size_t)remap[v] * src->stride, src->data + from, bytes);
+		}
+	}
+	for(int b = 0; b < mesh->bindings_count; b++) {
+		mesh->bindings[b].data = bindings[b];
+		mesh->bindings[b].size = (size_t)used * mesh->bindings[b].stride;
+		mesh->stats.copied_bytes += mesh->bindings[b].size;
+	}
+	for(size_t i = 0; i < index_count; i++) {
+		if(mesh->index_type == VK_INDEX_TYPE_UINT16) ((unsigned short*)new_indices)[i] = (unsigned short)indices[i];
+		else ((unsigned int*)new_indices)[i] = indices[i];
+	}
+	mesh->indices = new_indices;
+	mesh->index_count = (unsigned int)index_count;
+	mesh->indices_size = index_count * (mesh->index_type == VK_INDEX_TYPE_UINT16 ? 2 : 4);
+	mesh->stats.copied_bytes += mesh->indices_size;
+	report->vertices_dropped = vertex_count - (int)used;
+	mesh->vertex_count = (int)used;
+
+	mesh_opt__measure(mesh, indices, index_count, scratch, &report->after);
+	free(indices);
+	free(scratch);
+	report->ns = time_now_ns() - start_ns;
+	return 0;
+} // mesh_optimize
@@ -0,0 +1,236 @@
+#pragma once
+
+// Vertex and index packing, the last step before a mesh is uploaded (--pack-mesh, 16 bit indices always).
+//
+// Every attribute goes into one interleaved binding in the smallest format that keeps it close enough:
+// - positions: unorm16 over the bounding box, RGBA16 (the 3 component 16 bit formats are rarely vertex formats).
+//   The shader gets 0 to 1, and the dequantization (offset + stored * scale) is folded into the mesh matrix it already applies.
+// - normals: octahedral, 2 snorm16. The octahedron |x| + |y| + |z| = 1 is unfolded onto a square, so a unit vector is 2 numbers
+//   with about the same precision everywhere. Decoded by the shader (mesh_octahedral_decode() is the same code).
+// - colors: unorm8 when they are in 0 to 1, half floats otherwise.
+// - texcoords: half floats.
+// A float position, normal, color and texcoord vertex goes from 44 to 20 bytes. Formats the device can't read as vertex
+// attributes are kept as floats. Everything is read back after packing and compared with the original, the largest errors are reported
+// and mesh_pack_check() holds positions and normals to the bounds below.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mesh.h"
+
+
+
+// Rounding to unorm16 moves each axis at most half a step of the box, so a position at most half a step of the diagonal.
+// The bound is a whole step, for the float math of the dequantization.
+#define MESH_PACK_MAX_POSITION_ERROR	(1.0f / 65535.0f)
+// Degrees. Two snorm16 octahedral components measure under 0.004 over random unit vectors.
+#define MESH_PACK_MAX_NORMAL_ERROR	0.01f
+
+typedef struct mesh_pack_report_t {
+	unsigned int	vertex_bytes_before;	// per vertex, over all bindings
+	unsigned int	vertex_bytes_after;
+	float		position_error;		// largest distance from the original, in the mesh's units
+	float		position_error_relative; // ... over the bounding box diagonal
+	float		normal_error;		// largest angle from the original, in degrees
+	float		color_error;		// largest difference of a component
+	float		texcoord_error;
+	VkFormat	formats[MESH_ATTRIBUTE_KINDS];
+} mesh_pack_report_t;
+
+
+
+// Round to nearest, overflows become infinity.
+static inline unsigned short
+mesh_pack__half(float f) {
+	unsigned int bits;
+	memcpy(&bits, &f, sizeof(bits));
+	const unsigned int sign = (bits >> 16) & 0x8000u;
+	const unsigned int biased = (bits >> 23) & 0xff;
+	unsigned int mantissa = bits & 0x7fffffu;
+	if(biased == 0xff) return (unsigned short)(sign | 0x7c00u | (mantissa ? 0x200u : 0)); // infinity, NaN
+	const int exponent = (int)biased - 127 + 15;
+	if(exponent >= 31) return (unsigned short)(sign | 0x7c00u);
+	if(exponent <= 0) {
+		// subnormal
+		if(exponent < -10) return (unsigned short)sign;
+		mantissa |= 0x800000u;
+		const int shift = 14 - exponent;
+		unsigned int h = mantissa >> shift;
+		if((mantissa >> (shift - 1)) & 1) h++;
+		return (unsigned short)(sign | h);
+	}
+	unsigned int h = sign | (unsigned int)exponent << 10 | mantissa >> 13;
+	if(mantissa & 0x1000u) h++; // a carry into the exponent is still the right rounding
+	return (unsigned short)h;
+} // mesh_pack__half
+
+static inline short
+mesh_pack__snorm16(float f) {
+	return (short)lrintf(fminf(fmaxf(f, -1.0f), 1.0f) * 32767.0f);
+} // mesh_pack__snorm16
+
+// Octahedral encoding of unit vector n as 2 snorm16.
+static inline void
+mesh_pack__octahedral(const float n[3], short out[2]) {
+	const float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+	if(l1 == 0.0f) {
+		out[0] = out[1] = 0;
+		return;
+	}
+	float x = n[0] / l1, y = n[1] / l1;
+	if(n[2] < 0.0f) {
+		const float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		const float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = fx;
+		y = fy;
+	}
+	out[0] = mesh_pack__snorm16(x);
+	out[1] = mesh_pack__snorm16(y);
+} // mesh_pack__octahedral
+
+// 16 bit indices when every vertex fits, used in place when they already are. Returns 0 on success.
+static inline int
+mesh_pack_indices(mesh_t* mesh) {
+	if(mesh->index_type == VK_INDEX_TYPE_UINT16 || mesh->vertex_count > 65536) return 0;
+	unsigned short* indices = mesh__own(mesh, (size_t)mesh->index_count * sizeof(unsigned short));
+	if(!indices) return mesh__fail(mesh, "out of memory");
+	const unsigned int* wide = mesh->indices;
+	for(unsigned int i = 0; i < mesh->index_count; i++) indices[i] = (unsigned short)wide[i];
+	mesh->indices = indices;
+	mesh->index_type = VK_INDEX_TYPE_UINT16;
+	mesh->indices_size = (size_t)mesh->index_count * sizeof(unsigned short);
+	mesh->stats.copied_bytes += mesh->indices_size;
+	return 0;
+} // mesh_pack_indices
+
+// Packs the vertices as described at the top. Needs the mesh's data (before mesh_free()).
+// Returns 0 on success, otherwise mesh->error says why and the mesh is unchanged.
+static inline int
+mesh_pack(mesh_t* mesh, int (*supported)(VkFormat format, void* user), void* user, mesh_pack_report_t* report) {
+	memset(report, 0, sizeof(*report));
+	const mesh_t original = *mesh; // its data stays where it is until mesh_free()
+	for(int b = 0; b < original.bindings_count; b++) report->vertex_bytes_before += original.bindings[b].stride;
+
+	// the layout: each attribute in its packed format if the device has it, as floats otherwise
+	mesh_attribute_t packed[MESH_ATTRIBUTE_KINDS];
+	unsigned int stride = 0;
+	int colors_unit = 1;
+	for(int i = 0; i < original.vertex_count && original.attributes[MESH_COLOR].binding >= 0 && colors_unit; i++) {
+		float c[4];
+		mesh_read_attribute(&original, MESH_COLOR, i, c);
+		for(int j = 0; j < 4; j++) colors_unit &= c[j] >= 0.0f && c[j] <= 1.0f;
+	}
+	for(int k = 0; k < MESH_ATTRIBUTE_KINDS; k++) {
+		const mesh_attribute_t* a = &original.attributes[k];
+		mesh_attribute_t* p = &packed[k];
+		memset(p, 0, sizeof(*p));
+		p->binding = -1;
+		if(a->binding < 0) continue;
+		switch(k) {
+			case MESH_POSITION:	*p = (mesh_attribute_t){.component = MESH_UNSIGNED_SHORT, .components = 4, .normalized = 1}; break;
+			case MESH_NORMAL:	*p = (mesh_attribute_t){.component = MESH_SHORT, .components = 2, .normalized = 1, .octahedral = 1}; break;
+			case MESH_COLOR:	*p = (mesh_attribute_t){.component = colors_unit ? MESH_UNSIGNED_BYTE : MESH_HALF_FLOAT, .components = 4, .normalized = colors_unit}; break;
+			case MESH_TEXCOORD:	*p = (mesh_attribute_t){.component = MESH_HALF_FLOAT, .components = 2}; break;
+		}
+		p->format = mesh_vertex_format(p->component, p->components, p->normalized);
+		if(!supported(p->format, user)) {
+			const int components = k == MESH_TEXCOORD ? 2 : k == MESH_COLOR ? a->components : 3;
+			*p = (mesh_attribute_t){.component = MESH_FLOAT, .components = components, .format = mesh_vertex_format(MESH_FLOAT, components, 0)};
+		}
+		p->offset = stride;
+		stride += (mesh_component_size(p->component) * p->components + 3) & ~3u;
+	}
+
+	unsigned char* vertices = mesh__own(mesh, (size_t)original.vertex_count * stride);
+	if(!vertices) return mesh__fail(mesh, "out of memory");
+	memset(vertices, 0, (size_t)original.vertex_count * stride);
+
+	// positions over the bounding box, a flat side stays 0
+	float offset[3], scale[3];
+	for(int j = 0; j < 3; j++) {
+		offset[j] = original.lo[j];
+		scale[j] = original.hi[j] > original.lo[j] ? original.hi[j] - original.lo[j] : 1.0f;
+	}
+	const int quantized = packed[MESH_POSITION].component == MESH_UNSIGNED_SHORT;
+
+	for(int i = 0; i < original.vertex_count; i++) {
+		unsigned char* v = vertices + (size_t)i * stride;
+		for(int k = 0; k < MESH_ATTRIBUTE_KINDS; k++) {
+			const mesh_attribute_t* p = &packed[k];
+			if(p->binding < 0) continue;
+			float x[4];
+			mesh_read_attribute(&original, (mesh_attribute_kind_t)k, i, x);
+			unsigned char* out = v + p->offset;
+			if(p->component == MESH_FLOAT) {
+				memcpy(out, x, p->components * sizeof(float));
+			} else if(k == MESH_POSITION) {
+				unsigned short q[4] = {0, 0, 0, 65535};
+				for(int j = 0; j < 3; j++) q[j] = (unsigned short)lrintf(fminf(fmaxf((x[j] - offset[j]) / scale[j], 0.0f), 1.0f) * 65535.0f);
+				memcpy(out, q, sizeof(q));
+			} else if(k == MESH_NORMAL) {
+				short e[2];
+				mesh_pack__octahedral(x, e);
+				memcpy(out, e, sizeof(e));
+			} else if(p->component == MESH_UNSIGNED_BYTE) {
+				for(int j = 0; j < 4; j++) out[j] = (unsigned char)lrintf(x[j] * 255.0f);
+			} else {
+				unsigned short h[4];
+				for(int j = 0; j < p->components; j++) h[j] = mesh_pack__half(x[j]);
+				memcpy(out, h, p->components * sizeof(unsigned short));
+			}
+		}
+	}
+
+	mesh->bindings_count = 1;
+	mesh->bindings[0].data = vertices;
+	mesh->bindings[0].stride = stride;
+	mesh->bindings[0].size = (size_t)original.vertex_count * stride;
+	memcpy(mesh->attributes, packed, sizeof(packed));
+	mesh->positions_quantized = quantized;
+	memcpy(mesh->position_offset, offset, sizeof(offset));
+	memcpy(mesh->position_scale, scale, sizeof(scale));
+	mesh->stats.copied_bytes += mesh->bindings[0].size;
+	report->vertex_bytes_after = stride;
+	for(int k = 0; k < MESH_ATTRIBUTE_KINDS; k++) report->formats[k] = packed[k].format;
+
+	// reconstruction error: decoded the way the shaders read it, against the original
+	for(int i = 0; i < original.vertex_count; i++) {
+		for(int k = 0; k < MESH_ATTRIBUTE_KINDS; k++) {
+			if(packed[k].binding < 0) continue;
+			float was[4], is[4];
+			mesh_read_attribute(&original, (mesh_attribute_kind_t)k, i, was);
+			mesh_read_attribute(mesh, (mesh_attribute_kind_t)k, i, is);
+			if(k == MESH_POSITION) {
+				const float d = sqrtf((was[0] - is[0]) * (was[0] - is[0]) + (was[1] - is[1]) * (was[1] - is[1]) + (was[2] - is[2]) * (was[2] - is[2]));
+				report->position_error = fmaxf(report->position_error, d);
+			} else if(k == MESH_NORMAL) {
+				// atan2 of the sine and cosine, acosf alone can't resolve angles under about 0.02 degrees
+				if(was[0] == 0.0f && was[1] == 0.0f && was[2] == 0.0f) continue;
+				const float cross[3] = {was[1] * is[2] - was[2] * is[1], was[2] * is[0] - was[0] * is[2], was[0] * is[1] - was[1] * is[0]};
+				const float sine = sqrtf(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+				const float cosine = was[0] * is[0] + was[1] * is[1] + was[2] * is[2];
+				report->normal_error = fmaxf(report->normal_error, atan2f(sine, cosine) * (180.0f / 3.14159265f));
+			} else {
+				float* error = k == MESH_COLOR ? &report->color_error : &report->texcoord_error;
+				for(int j = 0; j < original.attributes[k].components; j++) *error = fmaxf(*error, fabsf(was[j] - is[j]));
+			}
+		}
+	}
+	const float diagonal = sqrtf(scale[0] * scale[0] + scale[1] * scale[1] + scale[2] * scale[2]);
+	report->position_error_relative = report->position_error / diagonal;
+	return 0;
+} // mesh_pack
+
+// Returns 0 when the packed positions and normals are within MESH_PACK_MAX_POSITION_ERROR and MESH_PACK_MAX_NORMAL_ERROR
+// of the original, otherwise mesh->error says which isn't.
+static inline int
+mesh_pack_check(mesh_t* mesh, const mesh_pack_report_t* report) {
+	if(!(report->position_error_relative <= MESH_PACK_MAX_POSITION_ERROR)) {
+		return mesh__fail(mesh, "position error %g of the box diagonal is over %g", report->position_error_relative, MESH_PACK_MAX_POSITION_ERROR);
+	}
+	if(!(report->normal_error <= MESH_PACK_MAX_NORMAL_ERROR)) {
+		return mesh__fail(mesh, "normal error %g degrees is over %g", report->normal_error, MESH_PACK_MAX_NORMAL_ERROR);
+	}
+	return 0;
+} // mesh_pack_check
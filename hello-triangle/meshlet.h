@@ -0,0 +1,239 @@
+#pragma once
+
+// Meshlets: the mesh cut into small clusters that are culled one by one on the GPU (--cull meshlets).
+//
+// The index buffer is walked in order and triangles are added to the current meshlet until one more would take it past
+// MESHLET_MAX_VERTICES unique vertices or MESHLET_MAX_TRIANGLES triangles. Each meshlet is a contiguous range of the
+// mesh's triangles, so the indirect draw of a meshlet is a range of the index buffer as it is. Run --optimize-mesh first:
+// the cache order keeps neighbouring triangles together, which is what makes the clusters small.
+// Every meshlet has what a culling pass needs:
+// - a bounding sphere (Ritter's: the farthest pair along an axis, grown over the rest), for the frustum test.
+// - a normal cone: the average of the triangle normals and how far the others spread from it. The whole meshlet faces away
+//   from the camera when dot(center - eye, axis) >= cutoff * |center - eye| + radius. Cones wider than about 84 degrees
+//   (dot of a normal with the axis below 0.1) are useless and get cutoff 1, which never culls. Cones only leave the image as it is
+//   when the rasterizer culls back faces too: meshlets_disable_cones() turns them all off for geometry drawn from both sides.
+// The mesh shader path also gets each meshlet's vertex list (mesh vertex numbers) and its triangles as 3 bytes of meshlet vertex numbers,
+// the layout of the limits in VK_EXT_mesh_shader's terms: 64 vertices and 124 triangles fit one workgroup's outputs on every vendor.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mesh.h"
+
+
+
+#define MESHLET_MAX_VERTICES	64
+#define MESHLET_MAX_TRIANGLES	124	// meshlet.mesh max_primitives
+
+// std430 in meshlet_cull.comp and meshlet.task, 48 bytes.
+typedef struct meshlet_t {
+	unsigned int	vertex_offset;	// first entry in meshlets_t.vertices
+	unsigned int	triangle_offset; // first triangle, the same in meshlets_t.triangles and the mesh's indices
+	unsigned int	vertex_count;
+	unsigned int	triangle_count;
+	float		center[3];	// bounding sphere
+	float		radius;
+	float		cone_axis[3];	// unit length, or 0 when cone_cutoff is 1
+	float		cone_cutoff;
+} meshlet_t;
+
+typedef struct meshlets_t {
+	meshlet_t*	meshlets;
+	int		count;
+	unsigned int*	vertices;	// the mesh vertex of every meshlet vertex
+	unsigned int	vertices_count;
+	unsigned char*	triangles;	// 3 meshlet vertex numbers per triangle, padded to 4 bytes
+	size_t		triangles_size;
+	int		cones;		// meshlets with a cone that can cull
+} meshlets_t;
+
+// A vertex as the mesh shader reads it, std430 in meshlet.mesh.
+typedef struct meshlet_vertex_t {
+	float		position[3];	// what the vertex shaders get: 0 to 1 over the box when packed, the mesh matrix applies to both
+	unsigned int	color;		// location 1 of the vertex shaders, as unorm8 RGBA
+} meshlet_vertex_t;
+
+
+
+static inline void
+meshlets_free(meshlets_t* meshlets) {
+	free(meshlets->meshlets);
+	free(meshlets->vertices);
+	free(meshlets->triangles);
+	memset(meshlets, 0, sizeof(*meshlets));
+} // meshlets_free
+
+// Ritter's bounding sphere of the meshlet's vertices, and its normal cone.
+static inline void
+meshlets__bounds(const mesh_t* mesh, const meshlets_t* meshlets, meshlet_t* m) {
+	float p[MESHLET_MAX_VERTICES][4];
+	for(unsigned int i = 0; i < m->vertex_count; i++) mesh_read_attribute(mesh, MESH_POSITION, (int)meshlets->vertices[m->vertex_offset + i], p[i]);
+
+	// the farthest apart of the lowest and highest vertex along each axis
+	float best = -1.0f;
+	int a = 0, b = 0;
+	for(int axis = 0; axis < 3; axis++) {
+		int lo = 0, hi = 0;
+		for(unsigned int i = 1; i < m->vertex_count; i++) {
+			if(p[i][axis] < p[lo][axis]) lo = (int)i;
+			if(p[i][axis] > p[hi][axis]) hi = (int)i;
+		}
+		const float dx = p[hi][0] - p[lo][0], dy = p[hi][1] - p[lo][1], dz = p[hi][2] - p[lo][2];
+		const float d2 = dx * dx + dy * dy + dz * dz;
+		if(d2 > best) {
+			best = d2;
+			a = lo;
+			b = hi;
+		}
+	}
+	float c[3] = {(p[a][0] + p[b][0]) * 0.5f, (p[a][1] + p[b][1]) * 0.5f, (p[a][2] + p[b][2]) * 0.5f};
+	float r = sqrtf(best) * 0.5f;
+	for(unsigned int i = 0; i < m->vertex_count; i++) {
+		const float d[3] = {p[i][0] - c[0], p[i][1] - c[1], p[i][2] - c[2]};
+		const float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+		if(distance <= r) continue;
+		// move the center towards the vertex so the sphere just reaches it
+		const float grown = (r + distance) * 0.5f;
+		for(int j = 0; j < 3; j++) c[j] += d[j] * (grown - r) / distance;
+		r = grown;
+	}
+	memcpy(m->center, c, sizeof(c));
+	m->radius = r;
+
+	// triangle normals, the same winding as the rasterizer's front faces
+	float normals[MESHLET_MAX_TRIANGLES][3];
+	float sum[3] = {0};
+	unsigned int normals_count = 0;
+	for(unsigned int t = 0; t < m->triangle_count; t++) {
+		const unsigned char* tri = meshlets->triangles + (size_t)(m->triangle_offset + t) * 3;
+		const float* v0 = p[tri[0]], * v1 = p[tri[1]], * v2 = p[tri[2]];
+		const float e1[3] = {v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2]};
+		const float e2[3] = {v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2]};
+		float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+		const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if(length == 0.0f) continue; // degenerate, faces nowhere
+		for(int j = 0; j < 3; j++) {
+			normals[normals_count][j] = n[j] / length;
+			sum[j] += n[j] / length;
+		}
+		normals_count++;
+	}
+	memset(m->cone_axis, 0, sizeof(m->cone_axis));
+	m->cone_cutoff = 1.0f;
+	const float length = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+	if(normals_count == 0 || length == 0.0f) return;
+	float axis[3] = {sum[0] / length, sum[1] / length, sum[2] / length};
+	float min_dot = 1.0f;
+	for(unsigned int t = 0; t < normals_count; t++) {
+		min_dot = fminf(min_dot, normals[t][0] * axis[0] + normals[t][1] * axis[1] + normals[t][2] * axis[2]);
+	}
+	if(min_dot <= 0.1f) return;
+	memcpy(m->cone_axis, axis, sizeof(axis));
+	// the view direction must be within 90 degrees minus the cone's half angle of the axis: cos(90 - a) = sin(a)
+	m->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+} // meshlets__bounds
+
+// Cuts the mesh's triangles into meshlets, in index buffer order. Bounds are in the mesh's own units.
+// Returns 0 on success, otherwise mesh->error says why.
+static inline int
+meshlets_build(meshlets_t* meshlets, mesh_t* mesh) {
+	memset(meshlets, 0, sizeof(*meshlets));
+	const size_t triangle_count = mesh->index_count / 3;
+	// at worst a meshlet per triangle, and 3 vertices each
+	meshlets->meshlets = malloc((triangle_count ? triangle_count : 1) * sizeof(meshlet_t));
+	meshlets->vertices = malloc((triangle_count * 3 + 1) * sizeof(unsigned int));
+	meshlets->triangles = malloc(triangle_count * 3 + 4);
+	unsigned int* indices = malloc((triangle_count * 3 + 1) * sizeof(unsigned int));
+	unsigned char* local = malloc(mesh->vertex_count ? mesh->vertex_count : 1); // meshlet vertex number of each mesh vertex, 0xff = not in it
+	if(!meshlets->meshlets || !meshlets->vertices || !meshlets->triangles || !indices || !local) {
+		free(indices);
+		free(local);
+		meshlets_free(meshlets);
+		return mesh__fail(mesh, "out of memory");
+	}
+	for(size_t i = 0; i < triangle_count * 3; i++) {
+		const unsigned int index = mesh->index_type == VK_INDEX_TYPE_UINT16 ? ((const unsigned short*)mesh->indices)[i] : ((const unsigned int*)mesh->indices)[i];
+		indices[i] = index;
+		if(index >= (unsigned int)mesh->vertex_count) {
+			free(indices);
+			free(local);
+			meshlets_free(meshlets);
+			return mesh__fail(mesh, "index %u is past the last vertex", index);
+		}
+	}
+	memset(local, 0xff, mesh->vertex_count);
+
+	meshlet_t* m = NULL;
+	for(size_t t = 0; t < triangle_count; t++) {
+		const unsigned int* tri = indices + t * 3;
+		const unsigned int added = (local[tri[0]] == 0xff) + (local[tri[1]] == 0xff && tri[1] != tri[0]) +
+			(local[tri[2]] == 0xff && tri[2] != tri[0] && tri[2] != tri[1]);
+		if(!m || m->vertex_count + added > MESHLET_MAX_VERTICES || m->triangle_count == MESHLET_MAX_TRIANGLES) {
+			if(m) {
+				for(unsigned int i = 0; i < m->vertex_count; i++) local[meshlets->vertices[m->vertex_offset + i]] = 0xff;
+			}
+			m = &meshlets->meshlets[meshlets->count++];
+			memset(m, 0, sizeof(*m));
+			m->vertex_offset = meshlets->vertices_count;
+			m->triangle_offset = (unsigned int)t;
+		}
+		unsigned char* out = meshlets->triangles + t * 3;
+		for(int c = 0; c < 3; c++) {
+			if(local[tri[c]] == 0xff) {
+				local[tri[c]] = (unsigned char)m->vertex_count++;
+				meshlets->vertices[meshlets->vertices_count++] = tri[c];
+			}
+			out[c] = local[tri[c]];
+		}
+		m->triangle_count++;
+	}
+	meshlets->triangles_size = (triangle_count * 3 + 3) & ~(size_t)3;
+	memset(meshlets->triangles + triangle_count * 3, 0, meshlets->triangles_size - triangle_count * 3);
+
+	for(int i = 0; i < meshlets->count; i++) {
+		meshlets__bounds(mesh, meshlets, &meshlets->meshlets[i]);
+		meshlets->cones += meshlets->meshlets[i].cone_cutoff < 1.0f;
+	}
+	free(indices);
+	free(local);
+	return 0;
+} // meshlets_build
+
+// Moves the bounds by a uniform scale, then an offset: into the space the culling passes test, the fitted mesh's.
+// Cones don't change.
+static inline void
+meshlets_transform(meshlets_t* meshlets, float scale, const float offset[3]) {
+	for(int i = 0; i < meshlets->count; i++) {
+		meshlet_t* m = &meshlets->meshlets[i];
+		for(int j = 0; j < 3; j++) m->center[j] = m->center[j] * scale + offset[j];
+		m->radius *= scale;
+	}
+} // meshlets_transform
+
+// Gives every meshlet cutoff 1, which never culls, for a rasterizer that draws back faces: a meshlet facing away is still seen.
+static inline void
+meshlets_disable_cones(meshlets_t* meshlets) {
+	for(int i = 0; i < meshlets->count; i++) {
+		meshlet_t* m = &meshlets->meshlets[i];
+		memset(m->cone_axis, 0, sizeof(m->cone_axis));
+		m->cone_cutoff = 1.0f;
+	}
+	meshlets->cones = 0;
+} // meshlets_disable_cones
+
+// The vertices for the mesh shader, vertex_count of them: the position, and attribute `color` as the vertex shaders get it at location 1.
+static inline void
+meshlets_vertex_data(const mesh_t* mesh, mesh_attribute_kind_t color, meshlet_vertex_t* out) {
+	for(int i = 0; i < mesh->vertex_count; i++) {
+		float p[4], c[4];
+		mesh_read_attribute(mesh, MESH_POSITION, i, p);
+		mesh_read_attribute(mesh, color, i, c);
+		for(int j = 0; j < 3; j++) {
+			out[i].position[j] = mesh->positions_quantized ? (p[j] - mesh->position_offset[j]) / mesh->position_scale[j] : p[j];
+		}
+		unsigned int rgba = 0;
+		for(int j = 0; j < 4; j++) rgba |= (unsigned int)lrintf(fminf(fmaxf(c[j], 0.0f), 1.0f) * 255.0f) << (8 * j);
+		out[i].color = rgba;
+	}
+} // meshlets_vertex_data
@@ -0,0 +1,114 @@
+#pragma once
+
+// Pipeline cache persisted to disk.
+//
+// The cache file is the raw vkGetPipelineCacheData() blob. Before handing it to the driver its header is checked
+// against the device (header version, vendorID, deviceID, pipelineCacheUUID). A cache from another GPU
+// or driver version is dropped, and the run starts with an empty (cold) cache.
+// At shutdown the cache is written back atomically, so a crash can't leave a truncated file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+
+
+
+// VkPipelineCacheHeaderVersionOne, as laid out at the start of the cache data
+#define PIPELINE_CACHE_HEADER_SIZE (16 + VK_UUID_SIZE)
+
+typedef enum pipeline_cache_status_t {
+	PIPELINE_CACHE_COLD,		// no cache file
+	PIPELINE_CACHE_MISMATCH,	// there was a file, but it's for a different device/driver (or corrupt)
+	PIPELINE_CACHE_WARM,		// loaded
+} pipeline_cache_status_t;
+
+static inline const char*
+pipeline_cache_status_name(pipeline_cache_status_t status) {
+	switch(status) {
+		case PIPELINE_CACHE_COLD:	return "cold";
+		case PIPELINE_CACHE_MISMATCH:	return "cold, stale file ignored";
+		case PIPELINE_CACHE_WARM:	return "warm";
+		default:			return "unknown";
+	}
+} // pipeline_cache_status_name
+
+// Checks that the cache data was made by this device and driver.
+static inline int
+pipeline_cache_header_valid(const void* data, size_t size, const VkPhysicalDeviceProperties* props) {
+	if(size < PIPELINE_CACHE_HEADER_SIZE) return 0;
+
+	unsigned int header[4]; // headerSize, headerVersion, vendorID, deviceID
+	memcpy(header, data, sizeof(header));
+
+	if(header[0] < PIPELINE_CACHE_HEADER_SIZE || header[0] > size) return 0;
+	if(header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) return 0;
+	if(header[2] != props->vendorID) return 0;
+	if(header[3] != props->deviceID) return 0;
+	if(memcmp((const char*)data + 16, props->pipelineCacheUUID, VK_UUID_SIZE) != 0) return 0;
+	return 1;
+} // pipeline_cache_header_valid
+
+// Creates a pipeline cache, filled from `path` when it holds a valid cache for this device.
+static inline VkResult
+pipeline_cache_load(VkDevice device, const VkPhysicalDeviceProperties* props, const char* path,
+	VkPipelineCache* cache, pipeline_cache_status_t* status, size_t* loaded_size) {
+	*status = PIPELINE_CACHE_COLD;
+	*loaded_size = 0;
+
+	void* data = NULL;
+	size_t size = 0;
+
+	FILE* f = path ? fopen(path, "rb") : NULL;
+	if(f) {
+		fseek(f, 0L, SEEK_END);
+		const long file_size = ftell(f);
+		fseek(f, 0L, SEEK_SET);
+
+		if(file_size > 0) {
+			data = malloc(file_size);
+			size = fread(data, 1, file_size, f);
+		}
+		fclose(f);
+
+		if(data && pipeline_cache_header_valid(data, size, props)) {
+			*status = PIPELINE_CACHE_WARM;
+			*loaded_size = size;
+		} else {
+			*status = PIPELINE_CACHE_MISMATCH;
+			size = 0;
+		}
+	}
+
+	VkPipelineCacheCreateInfo cache_info = {0};
+	cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cache_info.initialDataSize = size;
+	cache_info.pInitialData = size ? data : NULL;
+
+	VkResult res = vkCreatePipelineCache(device, &cache_info, NULL, cache);
+	if(res != VK_SUCCESS && size) {
+		// The driver didn't like the data after all. Start over empty rather than fail.
+		*status = PIPELINE_CACHE_MISMATCH;
+		*loaded_size = 0;
+		cache_info.initialDataSize = 0;
+		cache_info.pInitialData = NULL;
+		res = vkCreatePipelineCache(device, &cache_info, NULL, cache);
+	}
+
+	free(data);
+	return res;
+} // pipeline_cache_load
+
+// Writes the cache contents to `path`, replacing the old file atomically. Returns the number of bytes written, 0 on failure.
+static inline size_t
+pipeline_cache_save(VkDevice device, VkPipelineCache cache, const char* path) {
+	size_t size = 0;
+	if(vkGetPipelineCacheData(device, cache, &size, NULL) != VK_SUCCESS || size == 0) return 0;
+
+	void* data = malloc(size);
+	VkResult res = vkGetPipelineCacheData(device, cache, &size, data);
+	const int ok = res == VK_SUCCESS && file_write_atomic(path, data, size) == 0;
+	free(data);
+	return ok ? size : 0;
+} // pipeline_cache_save
@@ -0,0 +1,329 @@
+#pragma once
+
+// Small platform layer.
+// Everything OS-specific that isn't handled by GLFW lives here.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib") // GetProcessMemoryInfo() on SDKs targeting Windows before 7
+#endif
+#else
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#endif
+
+
+
+// monotonic high resolution clock, in nanoseconds
+static inline unsigned long long
+time_now_ns() {
+#ifdef _WIN32
+	static LARGE_INTEGER freq = {0};
+	if(freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	// split to avoid overflowing 64 bits
+	const unsigned long long secs = now.QuadPart / freq.QuadPart;
+	const unsigned long long rem  = now.QuadPart % freq.QuadPart;
+	return secs * 1000000000ull + rem * 1000000000ull / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+#endif
+} // time_now_ns
+
+
+
+// Writes a whole file so that readers see either the old contents or the new ones, never a torn file:
+// the data goes to `<path>.tmp` first, which then replaces `path`. Returns 0 on success.
+static inline int
+file_write_atomic(const char* path, const void* data, size_t size) {
+	char tmp_path[1024];
+	if(snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) return -1;
+
+	FILE* f = fopen(tmp_path, "wb");
+	if(!f) return -1;
+	int ok = fwrite(data, 1, size, f) == size;
+	ok = fflush(f) == 0 && ok;
+#ifndef _WIN32
+	ok = fsync(fileno(f)) == 0 && ok; // make sure the data is on disk before the rename is
+#endif
+	ok = fclose(f) == 0 && ok;
+	if(!ok) {
+		remove(tmp_path);
+		return -1;
+	}
+
+#ifdef _WIN32
+	ok = MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	ok = rename(tmp_path, path) == 0;
+#endif
+	if(!ok) remove(tmp_path);
+	return ok ? 0 : -1;
+} // file_write_atomic
+
+
+
+// A whole file mapped read-only into memory. Pages are only read from disk when touched,
+// and they're the page cache's own, so nothing is copied into the process.
+typedef struct file_map_t {
+	const void*	data;
+	size_t		size;
+#ifdef _WIN32
+	HANDLE		file;
+	HANDLE		mapping;
+#endif
+} file_map_t;
+
+// Returns 0 on success. Empty files map to data = NULL, size = 0.
+static inline int
+file_map(file_map_t* map, const char* path) {
+	memset(map, 0, sizeof(*map));
+#ifdef _WIN32
+	map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(map->file == INVALID_HANDLE_VALUE) return -1;
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(map->file, &size)) {
+		CloseHandle(map->file);
+		return -1;
+	}
+	map->size = (size_t)size.QuadPart;
+	if(map->size == 0) return 0;
+	map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(map->mapping) map->data = MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+	if(!map->data) {
+		if(map->mapping) CloseHandle(map->mapping);
+		CloseHandle(map->file);
+		return -1;
+	}
+	return 0;
+#else
+	const int fd = open(path, O_RDONLY);
+	if(fd < 0) return -1;
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+	map->size = (size_t)st.st_size;
+	if(map->size > 0) {
+		void* data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data != MAP_FAILED) {
+			madvise(data, map->size, MADV_SEQUENTIAL);
+			map->data = data;
+		}
+	}
+	close(fd); // the mapping keeps the file open
+	return map->size == 0 || map->data ? 0 : -1;
+#endif
+} // file_map
+
+static inline void
+file_unmap(file_map_t* map) {
+#ifdef _WIN32
+	if(map->data) UnmapViewOfFile(map->data);
+	if(map->mapping) CloseHandle(map->mapping);
+	if(map->file && map->file != INVALID_HANDLE_VALUE) CloseHandle(map->file);
+#else
+	if(map->data) munmap((void*)map->data, map->size);
+#endif
+	memset(map, 0, sizeof(*map));
+} // file_unmap
+
+// Most physical memory the process has had at once, in bytes. 0 when unknown.
+static inline unsigned long long
+peak_rss_bytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return (unsigned long long)usage.ru_maxrss; // bytes
+#else
+	return (unsigned long long)usage.ru_maxrss * 1024; // KB
+#endif
+#endif
+} // peak_rss_bytes
+
+
+
+// threads
+
+typedef void (*thread_fn_t)(void* arg);
+
+typedef struct thread__start_t {
+	thread_fn_t	fn;
+	void*		arg;
+} thread__start_t;
+
+// per-thread storage for a static variable
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+#ifdef _WIN32
+typedef HANDLE			thread_t;
+typedef CRITICAL_SECTION	mutex_t;
+typedef CONDITION_VARIABLE	cond_t;
+
+static DWORD WINAPI
+thread__trampoline(LPVOID param) {
+	thread__start_t start = *(thread__start_t*)param;
+	free(param);
+	start.fn(start.arg);
+	return 0;
+} // thread__trampoline
+#else
+typedef pthread_t		thread_t;
+typedef pthread_mutex_t		mutex_t;
+typedef pthread_cond_t		cond_t;
+
+static void*
+thread__trampoline(void* param) {
+	thread__start_t start = *(thread__start_t*)param;
+	free(param);
+	start.fn(start.arg);
+	return NULL;
+} // thread__trampoline
+#endif
+
+// returns 0 on success
+static inline int
+thread_create(thread_t* thread, thread_fn_t fn, void* arg) {
+	thread__start_t* start = malloc(sizeof(thread__start_t));
+	start->fn = fn;
+	start->arg = arg;
+#ifdef _WIN32
+	*thread = CreateThread(NULL, 0, thread__trampoline, start, 0, NULL);
+	if(*thread == NULL) { free(start); return -1; }
+	return 0;
+#else
+	const int err = pthread_create(thread, NULL, thread__trampoline, start);
+	if(err) free(start);
+	return err;
+#endif
+} // thread_create
+
+static inline void
+thread_join(thread_t thread) {
+#ifdef _WIN32
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_join(thread, NULL);
+#endif
+} // thread_join
+
+static inline int
+cpu_count() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	const long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+#endif
+} // cpu_count
+
+static inline void
+mutex_init(mutex_t* m) {
+#ifdef _WIN32
+	InitializeCriticalSection(m);
+#else
+	pthread_mutex_init(m, NULL);
+#endif
+} // mutex_init
+
+static inline void
+mutex_destroy(mutex_t* m) {
+#ifdef _WIN32
+	DeleteCriticalSection(m);
+#else
+	pthread_mutex_destroy(m);
+#endif
+} // mutex_destroy
+
+static inline void
+mutex_lock(mutex_t* m) {
+#ifdef _WIN32
+	EnterCriticalSection(m);
+#else
+	pthread_mutex_lock(m);
+#endif
+} // mutex_lock
+
+static inline void
+mutex_unlock(mutex_t* m) {
+#ifdef _WIN32
+	LeaveCriticalSection(m);
+#else
+	pthread_mutex_unlock(m);
+#endif
+} // mutex_unlock
+
+static inline void
+cond_init(cond_t* c) {
+#ifdef _WIN32
+	InitializeConditionVariable(c);
+#else
+	pthread_cond_init(c, NULL);
+#endif
+} // cond_init
+
+static inline void
+cond_destroy(cond_t* c) {
+#ifdef _WIN32
+	(void)c; // nothing to free
+#else
+	pthread_cond_destroy(c);
+#endif
+} // cond_destroy
+
+// m must be locked, and is locked again when this returns
+static inline void
+cond_wait(cond_t* c, mutex_t* m) {
+#ifdef _WIN32
+	SleepConditionVariableCS(c, m, INFINITE);
+#else
+	pthread_cond_wait(c, m);
+#endif
+} // cond_wait
+
+static inline void
+cond_signal(cond_t* c) {
+#ifdef _WIN32
+	WakeConditionVariable(c);
+#else
+	pthread_cond_signal(c);
+#endif
+} // cond_signal
+
+static inline void
+cond_broadcast(cond_t* c) {
+#ifdef _WIN32
+	WakeAllConditionVariable(c);
+#else
+	pthread_cond_broadcast(c);
+#endif
+} // cond_broadcast
@@ -0,0 +1,269 @@
+#pragma once
+
+// Scene nodes: a transform hierarchy, updated in batches.
+//
+// Local transforms (position, rotation, scale) are kept as structure of arrays, so the local matrices are built
+// 4 nodes at a time with the vmath.h vector operations. Nodes are stored with parents before their children, which
+// makes the world matrices a single pass in order (mat4_mul_hierarchy_indexed()).
+// Setting a local transform marks the node dirty. scene_update() only rebuilds dirty nodes and everything below them,
+// and numbers every world matrix with the update that last changed it, so scene_write() can copy out just what a
+// destination (e.g. a region of a mapped GPU buffer) hasn't seen yet. A scene that doesn't move costs nothing.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "vmath.h"
+
+
+
+#define SCENE_HISTORY	8	// updates whose first changed node is remembered, for scene_write()
+
+typedef struct scene_stats_t {
+	unsigned long long	updates;	// scene_update() calls that changed something
+	unsigned long long	locals;		// local matrices built
+	unsigned long long	worlds;		// world matrices computed
+	unsigned long long	written;	// world matrices copied out by scene_write()
+	unsigned long long	update_ns;
+	unsigned long long	write_ns;
+} scene_stats_t;
+
+typedef struct scene_t {
+	int			count;
+	int			capacity;	// a multiple of 4, the arrays are padded to it
+
+	// local transforms, structure of arrays
+	float*			pos_x;
+	float*			pos_y;
+	float*			pos_z;
+	float*			rot_x;
+	float*			rot_y;
+	float*			rot_z;
+	float*			rot_w;
+	float*			scale_x;
+	float*			scale_y;
+	float*			scale_z;
+
+	int*			parent;		// always a lower index, -1 for roots
+	unsigned char*		dirty;		// local transform changed since the last update
+	unsigned char*		moved;		// world matrix changed in the last update
+	int*			changed;	// nodes whose world matrix changed in the last update, in order
+	unsigned long long*	versions;	// per node: the update that last changed its world matrix
+	mat4_t*			local;
+	mat4_t*			world;
+
+	int			dirty_first;	// lowest dirty node, count when none
+	unsigned long long	version;	// of the last update that changed something, starts at 1
+	int			changed_first[SCENE_HISTORY]; // lowest node changed by each of the last updates, by version
+	scene_stats_t		stats;
+} scene_t;
+
+
+
+// Room for `capacity` nodes. Returns 0 on success.
+static inline int
+scene_init(scene_t* s, int capacity) {
+	memset(s, 0, sizeof(*s));
+	s->capacity = (capacity + 3) & ~3;
+
+	float* floats = calloc((size_t)s->capacity * 10, sizeof(float));
+	s->parent   = calloc(s->capacity, sizeof(int));
+	s->dirty    = calloc(s->capacity, 1);
+	s->moved    = calloc(s->capacity, 1);
+	s->changed  = calloc(s->capacity, sizeof(int));
+	s->versions = calloc(s->capacity, sizeof(unsigned long long));
+	s->local    = calloc(s->capacity, sizeof(mat4_t));
+	s->world    = calloc(s->capacity, sizeof(mat4_t));
+	s->pos_x = floats;
+	if(!floats || !s->parent || !s->dirty || !s->moved || !s->changed || !s->versions || !s->local || !s->world) return -1;
+
+	s->pos_y   = floats + s->capacity * 1;
+	s->pos_z   = floats + s->capacity * 2;
+	s->rot_x   = floats + s->capacity * 3;
+	s->rot_y   = floats + s->capacity * 4;
+	s->rot_z   = floats + s->capacity * 5;
+	s->rot_w   = floats + s->capacity * 6;
+	s->scale_x = floats + s->capacity * 7;
+	s->scale_y = floats + s->capacity * 8;
+	s->scale_z = floats + s->capacity * 9;
+	s->version = 1;
+	return 0;
+} // scene_init
+
+static inline void
+scene_deinit(scene_t* s) {
+	free(s->pos_x);
+	free(s->parent);
+	free(s->dirty);
+	free(s->moved);
+	free(s->changed);
+	free(s->versions);
+	free(s->local);
+	free(s->world);
+	memset(s, 0, sizeof(*s));
+} // scene_deinit
+
+static inline void
+scene__mark_dirty(scene_t* s, int node) {
+	s->dirty[node] = 1;
+	if(node < s->dirty_first) s->dirty_first = node;
+} // scene__mark_dirty
+
+static inline void
+scene_set_transform(scene_t* s, int node, vec3_t position, quat_t rotation, vec3_t scale) {
+	s->pos_x[node] = position.x;
+	s->pos_y[node] = position.y;
+	s->pos_z[node] = position.z;
+	s->rot_x[node] = rotation.x;
+	s->rot_y[node] = rotation.y;
+	s->rot_z[node] = rotation.z;
+	s->rot_w[node] = rotation.w;
+	s->scale_x[node] = scale.x;
+	s->scale_y[node] = scale.y;
+	s->scale_z[node] = scale.z;
+	scene__mark_dirty(s, node);
+} // scene_set_transform
+
+static inline void
+scene_set_rotation(scene_t* s, int node, quat_t rotation) {
+	s->rot_x[node] = rotation.x;
+	s->rot_y[node] = rotation.y;
+	s->rot_z[node] = rotation.z;
+	s->rot_w[node] = rotation.w;
+	scene__mark_dirty(s, node);
+} // scene_set_rotation
+
+// Adds a node under `parent` (-1 for a root), which must already be there. Returns the node's index, -1 when full or when the parent doesn't exist yet.
+static inline int
+scene_add_node(scene_t* s, int parent, vec3_t position, quat_t rotation, vec3_t scale) {
+	if(s->count == s->capacity || parent >= s->count) return -1;
+	const int node = s->count++;
+	s->parent[node] = parent < 0 ? -1 : parent;
+	scene_set_transform(s, node, position, rotation, scale);
+	return node;
+} // scene_add_node
+
+// Local matrices of nodes [first, first + 4).
+static inline void
+scene__locals(scene_t* s, int first) {
+#if defined(VMATH_SIMD)
+	// Every vector holds one matrix element of 4 nodes, like the arrays they come from.
+	const vmath_f4 x = vmath_load(s->rot_x + first);
+	const vmath_f4 y = vmath_load(s->rot_y + first);
+	const vmath_f4 z = vmath_load(s->rot_z + first);
+	const vmath_f4 w = vmath_load(s->rot_w + first);
+	const vmath_f4 sx = vmath_load(s->scale_x + first);
+	const vmath_f4 sy = vmath_load(s->scale_y + first);
+	const vmath_f4 sz = vmath_load(s->scale_z + first);
+	const vmath_f4 one = vmath_set1(1.0f);
+	const vmath_f4 two = vmath_set1(2.0f);
+	const vmath_f4 zero = vmath_set1(0.0f);
+
+	const vmath_f4 x2 = vmath_mul(x, two), y2 = vmath_mul(y, two), z2 = vmath_mul(z, two);
+	const vmath_f4 xx = vmath_mul(x, x2), yy = vmath_mul(y, y2), zz = vmath_mul(z, z2);
+	const vmath_f4 xy = vmath_mul(x, y2), xz = vmath_mul(x, z2), yz = vmath_mul(y, z2);
+	const vmath_f4 wx = vmath_mul(w, x2), wy = vmath_mul(w, y2), wz = vmath_mul(w, z2);
+
+	// the columns of mat4_trs()
+	vmath_f4 c0r0 = vmath_mul(vmath_sub(one, vmath_add(yy, zz)), sx);
+	vmath_f4 c0r1 = vmath_mul(vmath_add(xy, wz), sx);
+	vmath_f4 c0r2 = vmath_mul(vmath_sub(xz, wy), sx);
+	vmath_f4 c0r3 = zero;
+	vmath_f4 c1r0 = vmath_mul(vmath_sub(xy, wz), sy);
+	vmath_f4 c1r1 = vmath_mul(vmath_sub(one, vmath_add(xx, zz)), sy);
+	vmath_f4 c1r2 = vmath_mul(vmath_add(yz, wx), sy);
+	vmath_f4 c1r3 = zero;
+	vmath_f4 c2r0 = vmath_mul(vmath_add(xz, wy), sz);
+	vmath_f4 c2r1 = vmath_mul(vmath_sub(yz, wx), sz);
+	vmath_f4 c2r2 = vmath_mul(vmath_sub(one, vmath_add(xx, yy)), sz);
+	vmath_f4 c2r3 = zero;
+	vmath_f4 c3r0 = vmath_load(s->pos_x + first);
+	vmath_f4 c3r1 = vmath_load(s->pos_y + first);
+	vmath_f4 c3r2 = vmath_load(s->pos_z + first);
+	vmath_f4 c3r3 = one;
+
+	// back to one column of one node per vector
+	vmath_transpose(c0r0, c0r1, c0r2, c0r3);
+	vmath_transpose(c1r0, c1r1, c1r2, c1r3);
+	vmath_transpose(c2r0, c2r1, c2r2, c2r3);
+	vmath_transpose(c3r0, c3r1, c3r2, c3r3);
+	float* m = s->local[first].m;
+	vmath_store(m + 0,  c0r0); vmath_store(m + 4,  c1r0); vmath_store(m + 8,  c2r0); vmath_store(m + 12, c3r0);
+	vmath_store(m + 16, c0r1); vmath_store(m + 20, c1r1); vmath_store(m + 24, c2r1); vmath_store(m + 28, c3r1);
+	vmath_store(m + 32, c0r2); vmath_store(m + 36, c1r2); vmath_store(m + 40, c2r2); vmath_store(m + 44, c3r2);
+	vmath_store(m + 48, c0r3); vmath_store(m + 52, c1r3); vmath_store(m + 56, c2r3); vmath_store(m + 60, c3r3);
+#else
+	for(int i = first; i < first + 4; i++) {
+		const quat_t q = {s->rot_x[i], s->rot_y[i], s->rot_z[i], s->rot_w[i]};
+		s->local[i] = mat4_trs(vec3_make(s->pos_x[i], s->pos_y[i], s->pos_z[i]), q, vec3_make(s->scale_x[i], s->scale_y[i], s->scale_z[i]));
+	}
+#endif
+} // scene__locals
+
+// Brings the world matrices up to date with the local transforms set since the last call. Returns how many changed.
+static inline int
+scene_update(scene_t* s) {
+	if(s->dirty_first >= s->count) return 0;
+	const unsigned long long start_ns = time_now_ns();
+	const int first = s->dirty_first;
+
+	// Local matrices, 4 nodes at a time when any of them is dirty. The padding is never dirty.
+	for(int i = first & ~3; i < s->count; i += 4) {
+		if(s->dirty[i] | s->dirty[i + 1] | s->dirty[i + 2] | s->dirty[i + 3]) {
+			scene__locals(s, i);
+			s->stats.locals += 4;
+		}
+	}
+
+	// A world matrix changes with its local matrix or its parent's world matrix. Parents come first, so one pass finds them all.
+	// Nothing before the first dirty node can have changed: its ancestors are all before it too.
+	s->version++;
+	int changed_count = 0;
+	for(int i = first; i < s->count; i++) {
+		const int p = s->parent[i];
+		const unsigned char moved = s->dirty[i] | (p >= first ? s->moved[p] : 0);
+		s->moved[i] = moved;
+		s->dirty[i] = 0;
+		if(moved) {
+			s->changed[changed_count++] = i;
+			s->versions[i] = s->version;
+		}
+	}
+	mat4_mul_hierarchy_indexed(s->world, s->local, s->parent, s->changed, changed_count);
+
+	s->changed_first[s->version % SCENE_HISTORY] = first;
+	s->dirty_first = s->count;
+	s->stats.updates++;
+	s->stats.worlds += changed_count;
+	s->stats.update_ns += time_now_ns() - start_ns;
+	return changed_count;
+} // scene_update
+
+// Copies the world matrices that changed since `*dst_version` into dst (count of them, in node order), then sets *dst_version
+// to the current version. Start with *dst_version = 0 to copy everything. Returns how many were copied.
+static inline int
+scene_write(scene_t* s, mat4_t* dst, unsigned long long* dst_version) {
+	if(*dst_version >= s->version) return 0;
+	const unsigned long long start_ns = time_now_ns();
+
+	// Only the last few updates remember where they started, anything older scans from the beginning.
+	int first = 0;
+	if(*dst_version > 0 && s->version - *dst_version <= SCENE_HISTORY) {
+		first = s->count;
+		for(unsigned long long v = *dst_version + 1; v <= s->version; v++) {
+			if(s->changed_first[v % SCENE_HISTORY] < first) first = s->changed_first[v % SCENE_HISTORY];
+		}
+	}
+
+	int written = 0;
+	for(int i = first; i < s->count; i++) {
+		if(s->versions[i] > *dst_version) {
+			dst[i] = s->world[i];
+			written++;
+		}
+	}
+	*dst_version = s->version;
+	s->stats.written += written;
+	s->stats.write_ns += time_now_ns() - start_ns;
+	return written;
+} // scene_write
@@ -5,11 +5,34 @@
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inColor;
 
-layout (binding = 0) uniform UBO {
+// Set by the application: take the model matrix from push constants instead of the per-object uniform block.
+layout (constant_id = 0) const bool MODEL_FROM_PUSH_CONSTANT = false;
+
+// Set by the application when location 1 is an octahedral encoded normal (--pack-mesh, a mesh without colors), shown as the color.
+layout (constant_id = 1) const bool COLOR_FROM_OCTAHEDRAL_NORMAL = false;
+
+// per-frame constants
+layout (binding = 0) uniform Frame {
 	mat4 projectionMatrix;
-	mat4 modelMatrix;
 	mat4 viewMatrix;
-} ubo;
+	mat4 meshMatrix;	// dequantizes packed positions and fits the mesh into -1 to 1
+} frame;
+
+// per-object constants, selected with a dynamic offset
+layout (binding = 1) uniform Object {
+	mat4 modelMatrix;
+} object;
+
+layout (push_constant) uniform Push {
+	mat4 modelMatrix;
+} push;
+
+#ifdef MODEL_FROM_SCENE
+// Built with -DMODEL_FROM_SCENE as shader_scene.vert.spv: every instance is a scene node, with its world matrix here.
+layout (std430, binding = 2) readonly buffer Nodes {
+	mat4 world[];
+} nodes;
+#endif
 
 layout (location = 0) out vec3 outColor;
 
@@ -19,7 +42,20 @@ out gl_PerVertex {
 
 
 
+// mesh_octahedral_decode() in mesh.h
+vec3 octahedralDecode(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
 void main() {
-	outColor = inColor;
-	gl_Position = ubo.projectionMatrix * ubo.viewMatrix * ubo.modelMatrix * vec4(inPos.xyz, 1.0);
+	outColor = COLOR_FROM_OCTAHEDRAL_NORMAL ? octahedralDecode(inColor.xy) : inColor;
+#ifdef MODEL_FROM_SCENE
+	mat4 modelMatrix = nodes.world[gl_InstanceIndex];
+#else
+	mat4 modelMatrix = MODEL_FROM_PUSH_CONSTANT ? push.modelMatrix : object.modelMatrix;
+#endif
+	gl_Position = frame.projectionMatrix * frame.viewMatrix * modelMatrix * frame.meshMatrix * vec4(inPos.xyz, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,46 @@
+#version 450
+
+
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inColor;
+
+// per-instance, from the second vertex binding: the rows of a 3x4 model matrix, and a color
+layout (location = 2) in vec4 inModelRow0;
+layout (location = 3) in vec4 inModelRow1;
+layout (location = 4) in vec4 inModelRow2;
+layout (location = 5) in vec4 inInstanceColor;
+
+// Set by the application when location 1 is an octahedral encoded normal (--pack-mesh, a mesh without colors), shown as the color.
+layout (constant_id = 1) const bool COLOR_FROM_OCTAHEDRAL_NORMAL = false;
+
+// per-frame constants
+layout (binding = 0) uniform Frame {
+	mat4 projectionMatrix;
+	mat4 viewMatrix;
+	mat4 meshMatrix;	// dequantizes packed positions and fits the mesh into -1 to 1
+} frame;
+
+layout (location = 0) out vec3 outColor;
+
+out gl_PerVertex {
+	vec4 gl_Position;	
+};
+
+
+
+// mesh_octahedral_decode() in mesh.h
+vec3 octahedralDecode(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+void main() {
+	vec3 color = COLOR_FROM_OCTAHEDRAL_NORMAL ? octahedralDecode(inColor.xy) : inColor;
+	outColor = color * inInstanceColor.rgb;
+	vec4 pos = frame.meshMatrix * vec4(inPos.xyz, 1.0);
+	vec4 worldPos = vec4(dot(inModelRow0, pos), dot(inModelRow1, pos), dot(inModelRow2, pos), 1.0);
+	gl_Position = frame.projectionMatrix * frame.viewMatrix * worldPos;
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+// Timeline semaphore (VK_KHR_timeline_semaphore, core in Vulkan 1.2).
+//
+// A semaphore with a 64-bit counter that only goes up. Submits signal it to a value, the CPU (or other submits)
+// wait until it has reached one. A single timeline can stand in for a whole set of fences: work numbered N
+// signals N, "is N done" is one counter read, and nothing ever has to be reset.
+// The completed value is cached, so asking about work that's known to be done costs nothing.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+
+
+
+typedef struct timeline_stats_t {
+	unsigned long long	waits;		// timeline_wait() calls for values not known to be done
+	unsigned long long	wait_ns;	// CPU time spent in them
+	unsigned long long	queries;	// counter reads
+} timeline_stats_t;
+
+typedef struct timeline_t {
+	VkDevice		device;
+	VkSemaphore		semaphore;
+	unsigned long long	completed;	// the counter, last time it was looked at
+	PFN_vkWaitSemaphores	wait_semaphores;
+	PFN_vkGetSemaphoreCounterValue get_counter_value;
+	timeline_stats_t	stats;
+} timeline_t;
+
+
+
+// Needs the timelineSemaphore feature enabled on the device. The functions come from VK_KHR_timeline_semaphore
+// when it's enabled, and from the core otherwise. Returns VK_ERROR_FEATURE_NOT_PRESENT when neither has them.
+static inline VkResult
+timeline_init(timeline_t* t, VkDevice device, unsigned long long initial_value) {
+	memset(t, 0, sizeof(*t));
+	t->device = device;
+	t->completed = initial_value;
+
+	t->wait_semaphores = (PFN_vkWaitSemaphores)vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+	t->get_counter_value = (PFN_vkGetSemaphoreCounterValue)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+	if(!t->wait_semaphores || !t->get_counter_value) {
+		t->wait_semaphores = (PFN_vkWaitSemaphores)vkGetDeviceProcAddr(device, "vkWaitSemaphores");
+		t->get_counter_value = (PFN_vkGetSemaphoreCounterValue)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValue");
+	}
+	if(!t->wait_semaphores || !t->get_counter_value) return VK_ERROR_FEATURE_NOT_PRESENT;
+
+	VkSemaphoreTypeCreateInfo type_info = {0};
+	type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	type_info.initialValue = initial_value;
+
+	VkSemaphoreCreateInfo sema_info = {0};
+	sema_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	sema_info.pNext = &type_info;
+	return vkCreateSemaphore(device, &sema_info, NULL, &t->semaphore);
+} // timeline_init
+
+static inline void
+timeline_deinit(timeline_t* t) {
+	if(t->semaphore) vkDestroySemaphore(t->device, t->semaphore, NULL);
+	t->semaphore = VK_NULL_HANDLE;
+} // timeline_deinit
+
+// Reads the counter. Everything that signals a value up to the result is done.
+static inline unsigned long long
+timeline_completed(timeline_t* t) {
+	uint64_t value = 0;
+	t->stats.queries++;
+	if(t->get_counter_value(t->device, t->semaphore, &value) == VK_SUCCESS && value > t->completed) t->completed = value;
+	return t->completed;
+} // timeline_completed
+
+// Waits until the counter has reached `value`.
+static inline VkResult
+timeline_wait(timeline_t* t, unsigned long long value, unsigned long long timeout_ns) {
+	if(value <= t->completed) return VK_SUCCESS;
+	const uint64_t wait_value = value;
+
+	VkSemaphoreWaitInfo wait_info = {0};
+	wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores = &t->semaphore;
+	wait_info.pValues = &wait_value;
+
+	const unsigned long long start_ns = time_now_ns();
+	const VkResult res = t->wait_semaphores(t->device, &wait_info, timeout_ns);
+	t->stats.waits++;
+	t->stats.wait_ns += time_now_ns() - start_ns;
+	if(res == VK_SUCCESS && value > t->completed) t->completed = value;
+	return res;
+} // timeline_wait
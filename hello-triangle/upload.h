@@ -0,0 +1,463 @@
+#pragma once
+
+// Upload engine.
+//
+// Copies data into DEVICE_LOCAL buffers through a host visible staging ring buffer.
+// - Uploads are only queued by upload_buffer(). All queued copies are recorded and submitted together
+//   by upload_flush(), with one vkCmdCopyBuffer() per destination buffer, so loading many meshes
+//   costs one submit instead of one per buffer.
+// - Uses a dedicated transfer queue family when the device has one. Destination buffers are then
+//   released by the transfer queue and acquired by the graphics queue (queue family ownership transfer),
+//   with a semaphore in between.
+// - Each submitted batch has a fence. Once it has signalled, the batch's part of the staging ring is reclaimed.
+//   When the ring is full, the oldest batch is waited on.
+// - With a timeline semaphore, batches are numbered instead. The transfer submit signals the batch's value minus one,
+//   the graphics acquire waits for it and signals the value itself. One counter read tells which batches are done,
+//   and there are no per-batch fences or semaphores to reset.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu_alloc.h"
+#include "timeline.h"
+
+
+
+#define UPLOAD_RING_SIZE	(8ull << 20)	// staging memory
+#define UPLOAD_MAX_BATCHES	8		// submitted batches that can be in flight at once
+#define UPLOAD_ALIGNMENT	16		// staging offsets are aligned to this
+
+typedef struct upload_copy_t {
+	VkBuffer	dst;
+	VkBufferCopy	region;
+} upload_copy_t;
+
+typedef struct upload_batch_t {
+	VkCommandBuffer		cmd;		// transfer queue: copies (and ownership release)
+	VkCommandBuffer		acquire_cmd;	// graphics queue: ownership acquire, only with a dedicated transfer queue
+	VkSemaphore		sema;		// transfer -> graphics handoff, only with a dedicated transfer queue (and no timeline)
+	VkFence			fence;		// signalled when the whole batch is done (no timeline)
+	uint64_t		value;		// timeline value signalled when the whole batch is done
+	unsigned long long	ring_end;	// staging ring head when the batch was submitted
+} upload_batch_t;
+
+typedef struct upload_stats_t {
+	unsigned long long	bytes;		// total bytes copied
+	unsigned long long	copies;		// upload_buffer() calls (after splitting to fit the ring)
+	unsigned long long	copy_commands;	// vkCmdCopyBuffer() calls
+	unsigned long long	submits;	// batches
+	unsigned long long	ring_waits;	// times the CPU had to wait for staging space
+} upload_stats_t;
+
+typedef struct upload_engine_t {
+	VkDevice		device;
+	gpu_allocator_t*	allocator;
+
+	VkQueue			queue;		// queue the copies run on
+	unsigned int		queue_family;
+	VkQueue			graphics_queue;	// queue the buffers are used on
+	unsigned int		graphics_family;
+	int			dedicated;	// queue_family != graphics_family
+
+	VkCommandPool		pool;
+	VkCommandPool		graphics_pool;	// for ownership acquires, only with a dedicated transfer queue
+
+	int			use_timeline;	// batches are tracked with `timeline` instead of fences
+	timeline_t		timeline;
+	unsigned long long	timeline_value;	// last value a submit signals
+
+	// staging ring. head and tail only ever grow, the ring offset is `% ring_size`.
+	VkBuffer		staging;
+	gpu_allocation_t	staging_mem;
+	VkDeviceSize		ring_size;
+	unsigned long long	head;		// where the next upload goes
+	unsigned long long	tail;		// start of the oldest data still in use by the GPU
+
+	upload_batch_t		batches[UPLOAD_MAX_BATCHES];
+	int			batch_first;	// oldest batch in flight
+	int			batches_in_flight;
+
+	// copies queued since the last flush
+	upload_copy_t*		pending;
+	int			pending_count;
+	int			pending_capacity;
+
+	upload_stats_t		stats;
+} upload_engine_t;
+
+
+
+// `timeline` = 1 tracks batches with a timeline semaphore, the device needs the timelineSemaphore feature for it.
+static inline VkResult
+upload_init(upload_engine_t* e, VkDevice device, gpu_allocator_t* allocator,
+	VkQueue queue, unsigned int queue_family, VkQueue graphics_queue, unsigned int graphics_family, int timeline) {
+	memset(e, 0, sizeof(*e));
+	e->device = device;
+	e->allocator = allocator;
+	e->queue = queue;
+	e->queue_family = queue_family;
+	e->graphics_queue = graphics_queue;
+	e->graphics_family = graphics_family;
+	e->dedicated = queue_family != graphics_family;
+	e->ring_size = UPLOAD_RING_SIZE;
+
+	VkResult res;
+
+	if(timeline) {
+		res = timeline_init(&e->timeline, device, 0);
+		if(res != VK_SUCCESS) return res;
+		e->use_timeline = 1;
+	}
+
+	VkBufferCreateInfo buf_info = {0};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.size = e->ring_size;
+	buf_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	res = gpu_alloc_create_buffer(allocator, &buf_info,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, &e->staging, &e->staging_mem);
+	if(res != VK_SUCCESS) return res;
+
+	VkCommandPoolCreateInfo cpool_info = {0};
+	cpool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cpool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	cpool_info.queueFamilyIndex = queue_family;
+	res = vkCreateCommandPool(device, &cpool_info, NULL, &e->pool);
+	if(res != VK_SUCCESS) return res;
+
+	if(e->dedicated) {
+		cpool_info.queueFamilyIndex = graphics_family;
+		res = vkCreateCommandPool(device, &cpool_info, NULL, &e->graphics_pool);
+		if(res != VK_SUCCESS) return res;
+	}
+
+	VkCommandBufferAllocateInfo cbuf_alloc_info = {0};
+	cbuf_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cbuf_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cbuf_alloc_info.commandBufferCount = 1;
+
+	VkFenceCreateInfo fence_info = {0};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	VkSemaphoreCreateInfo sema_info = {0};
+	sema_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for(int i = 0; i < UPLOAD_MAX_BATCHES; i++) {
+		upload_batch_t* batch = &e->batches[i];
+
+		cbuf_alloc_info.commandPool = e->pool;
+		res = vkAllocateCommandBuffers(device, &cbuf_alloc_info, &batch->cmd);
+		if(res != VK_SUCCESS) return res;
+
+		if(!e->use_timeline) {
+			res = vkCreateFence(device, &fence_info, NULL, &batch->fence);
+			if(res != VK_SUCCESS) return res;
+		}
+
+		if(e->dedicated) {
+			cbuf_alloc_info.commandPool = e->graphics_pool;
+			res = vkAllocateCommandBuffers(device, &cbuf_alloc_info, &batch->acquire_cmd);
+			if(res != VK_SUCCESS) return res;
+
+			if(!e->use_timeline) {
+				res = vkCreateSemaphore(device, &sema_info, NULL, &batch->sema);
+				if(res != VK_SUCCESS) return res;
+			}
+		}
+	}
+
+	return VK_SUCCESS;
+} // upload_init
+
+// Retires finished batches (oldest first) and gives their staging memory back to the ring.
+static inline void
+upload_reclaim(upload_engine_t* e) {
+	const unsigned long long completed = e->use_timeline && e->batches_in_flight > 0 ? timeline_completed(&e->timeline) : 0;
+	while(e->batches_in_flight > 0) {
+		upload_batch_t* batch = &e->batches[e->batch_first];
+		if(e->use_timeline) {
+			if(batch->value > completed) break;
+		} else {
+			if(vkGetFenceStatus(e->device, batch->fence) != VK_SUCCESS) break;
+			vkResetFences(e->device, 1, &batch->fence);
+		}
+
+		e->tail = batch->ring_end;
+		e->batch_first = (e->batch_first + 1) % UPLOAD_MAX_BATCHES;
+		e->batches_in_flight--;
+	}
+	// nothing in use, so the next upload can start at the beginning without wrapping
+	if(e->batches_in_flight == 0 && e->pending_count == 0) e->head = e->tail = 0;
+} // upload_reclaim
+
+static inline VkResult
+upload__wait_batch(upload_engine_t* e, const upload_batch_t* batch) {
+	if(e->use_timeline) return timeline_wait(&e->timeline, batch->value, ~0ull);
+	return vkWaitForFences(e->device, 1, &batch->fence, VK_TRUE, ~0ull);
+} // upload__wait_batch
+
+static inline VkResult
+upload__wait_oldest(upload_engine_t* e) {
+	if(e->batches_in_flight == 0) return VK_SUCCESS;
+	e->stats.ring_waits++;
+	VkResult res = upload__wait_batch(e, &e->batches[e->batch_first]);
+	upload_reclaim(e);
+	return res;
+} // upload__wait_oldest
+
+static int
+upload__cmp_copy(const void* a, const void* b) {
+	const upload_copy_t* ca = a;
+	const upload_copy_t* cb = b;
+	if(ca->dst != cb->dst) return (size_t)ca->dst < (size_t)cb->dst ? -1 : 1;
+	return ca->region.dstOffset < cb->region.dstOffset ? -1 : ca->region.dstOffset > cb->region.dstOffset;
+} // upload__cmp_copy
+
+// Records and submits all queued copies as one batch.
+static inline VkResult
+upload_flush(upload_engine_t* e) {
+	if(e->pending_count == 0) return VK_SUCCESS;
+
+	VkResult res;
+	if(e->batches_in_flight == UPLOAD_MAX_BATCHES) {
+		res = upload__wait_oldest(e);
+		if(res != VK_SUCCESS) return res;
+	}
+
+	upload_batch_t* batch = &e->batches[(e->batch_first + e->batches_in_flight) % UPLOAD_MAX_BATCHES];
+
+	// group copies by destination
+	qsort(e->pending, e->pending_count, sizeof(upload_copy_t), upload__cmp_copy);
+
+	VkBufferCopy* regions = malloc(e->pending_count * sizeof(VkBufferCopy));
+	VkBufferMemoryBarrier* barriers = calloc(e->pending_count, sizeof(VkBufferMemoryBarrier));
+	int n_barriers = 0;
+
+	// The stages/accesses the buffers may be used with afterwards.
+	const VkPipelineStageFlags use_stages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+		| VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+	const VkAccessFlags use_access = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT
+		| VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+	VkCommandBufferBeginInfo begin_info = {0};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkResetCommandBuffer(batch->cmd, 0);
+	vkBeginCommandBuffer(batch->cmd, &begin_info);
+
+	for(int i = 0; i < e->pending_count; ) {
+		const VkBuffer dst = e->pending[i].dst;
+		int n = 0;
+		while(i + n < e->pending_count && e->pending[i + n].dst == dst) {
+			regions[n] = e->pending[i + n].region;
+			n++;
+		}
+		vkCmdCopyBuffer(batch->cmd, e->staging, dst, n, regions);
+		e->stats.copy_commands++;
+
+		VkBufferMemoryBarrier* barrier = &barriers[n_barriers++];
+		barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier->srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier->dstAccessMask = e->dedicated ? 0 : use_access; // a release has no destination access
+		barrier->srcQueueFamilyIndex = e->dedicated ? e->queue_family : VK_QUEUE_FAMILY_IGNORED;
+		barrier->dstQueueFamilyIndex = e->dedicated ? e->graphics_family : VK_QUEUE_FAMILY_IGNORED;
+		barrier->buffer = dst;
+		barrier->offset = 0;
+		barrier->size = VK_WHOLE_SIZE;
+
+		i += n;
+	}
+
+	vkCmdPipelineBarrier(batch->cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		e->dedicated ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : use_stages,
+		0, 0, NULL, n_barriers, barriers, 0, NULL);
+
+	res = vkEndCommandBuffer(batch->cmd);
+	if(res != VK_SUCCESS) goto done;
+
+	// With a timeline the handoff and the batch's completion are values of the same semaphore:
+	// the copies signal `handoff`, the acquire (or the copies, without a dedicated queue) signals `batch->value`.
+	const VkSemaphore handoff_sema = e->use_timeline ? e->timeline.semaphore : batch->sema;
+	const uint64_t handoff = e->timeline_value + 1;
+	batch->value = e->dedicated ? handoff + 1 : handoff;
+
+	VkTimelineSemaphoreSubmitInfo timeline_info = {0};
+	timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_info.signalSemaphoreValueCount = 1;
+	timeline_info.pSignalSemaphoreValues = e->dedicated ? &handoff : &batch->value;
+
+	VkSubmitInfo submit_info = {0};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = e->use_timeline ? &timeline_info : NULL;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &batch->cmd;
+	if(e->use_timeline || e->dedicated) {
+		submit_info.signalSemaphoreCount = 1;
+		submit_info.pSignalSemaphores = &handoff_sema;
+	}
+
+	if(!e->dedicated) {
+		res = vkQueueSubmit(e->queue, 1, &submit_info, batch->fence);
+		if(res != VK_SUCCESS) goto done;
+	} else {
+		res = vkQueueSubmit(e->queue, 1, &submit_info, VK_NULL_HANDLE);
+		if(res != VK_SUCCESS) goto done;
+
+		// The matching acquire on the graphics queue.
+		for(int i = 0; i < n_barriers; i++) {
+			barriers[i].srcAccessMask = 0;
+			barriers[i].dstAccessMask = use_access;
+		}
+
+		vkResetCommandBuffer(batch->acquire_cmd, 0);
+		vkBeginCommandBuffer(batch->acquire_cmd, &begin_info);
+		vkCmdPipelineBarrier(batch->acquire_cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, use_stages,
+			0, 0, NULL, n_barriers, barriers, 0, NULL);
+		res = vkEndCommandBuffer(batch->acquire_cmd);
+		if(res != VK_SUCCESS) goto done;
+
+		VkTimelineSemaphoreSubmitInfo acquire_timeline_info = {0};
+		acquire_timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		acquire_timeline_info.waitSemaphoreValueCount = 1;
+		acquire_timeline_info.pWaitSemaphoreValues = &handoff;
+		acquire_timeline_info.signalSemaphoreValueCount = 1;
+		acquire_timeline_info.pSignalSemaphoreValues = &batch->value;
+
+		const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		VkSubmitInfo acquire_info = {0};
+		acquire_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquire_info.pNext = e->use_timeline ? &acquire_timeline_info : NULL;
+		acquire_info.waitSemaphoreCount = 1;
+		acquire_info.pWaitSemaphores = &handoff_sema;
+		acquire_info.pWaitDstStageMask = &wait_stage;
+		acquire_info.commandBufferCount = 1;
+		acquire_info.pCommandBuffers = &batch->acquire_cmd;
+		if(e->use_timeline) {
+			acquire_info.signalSemaphoreCount = 1;
+			acquire_info.pSignalSemaphores = &handoff_sema;
+		}
+		res = vkQueueSubmit(e->graphics_queue, 1, &acquire_info, batch->fence);
+		if(res != VK_SUCCESS) goto done;
+	}
+
+	e->timeline_value = batch->value;
+	batch->ring_end = e->head;
+	e->batches_in_flight++;
+	e->pending_count = 0;
+	e->stats.submits++;
+
+done:
+	free(regions);
+	free(barriers);
+	return res;
+} // upload_flush
+
+// Reserves `size` contiguous bytes of staging memory, waiting for older batches if needed.
+static inline VkResult
+upload__reserve(upload_engine_t* e, VkDeviceSize size, VkDeviceSize* offset) {
+	size = (size + UPLOAD_ALIGNMENT - 1) & ~(VkDeviceSize)(UPLOAD_ALIGNMENT - 1);
+
+	for(;;) {
+		upload_reclaim(e);
+
+		// don't let an allocation wrap around the end of the ring
+		const VkDeviceSize pos = e->head % e->ring_size;
+		const VkDeviceSize pad = pos + size > e->ring_size ? e->ring_size - pos : 0;
+		if(e->head + pad + size - e->tail <= e->ring_size) {
+			e->head += pad;
+			*offset = e->head % e->ring_size;
+			e->head += size;
+			return VK_SUCCESS;
+		}
+
+		// Out of space. Submit what we have, then wait for the oldest batch to free its part of the ring.
+		VkResult res;
+		if(e->pending_count) {
+			res = upload_flush(e);
+		} else if(e->batches_in_flight) {
+			res = upload__wait_oldest(e);
+		} else {
+			return VK_ERROR_OUT_OF_DEVICE_MEMORY; // bigger than the whole ring, callers split before this
+		}
+		if(res != VK_SUCCESS) return res;
+	}
+} // upload__reserve
+
+// Queues a copy of `size` bytes from `data` to `dst` at `dst_offset`.
+// The data is copied into staging memory right away, the GPU copy happens at the next upload_flush().
+static inline VkResult
+upload_buffer(upload_engine_t* e, VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size) {
+	// anything bigger than half the ring goes in pieces, so a single upload can't stall on itself
+	const VkDeviceSize max_chunk = e->ring_size / 2;
+
+	while(size > 0) {
+		const VkDeviceSize chunk = size < max_chunk ? size : max_chunk;
+
+		VkDeviceSize src_offset;
+		VkResult res = upload__reserve(e, chunk, &src_offset);
+		if(res != VK_SUCCESS) return res;
+
+		memcpy((char*)e->staging_mem.mapped + src_offset, data, chunk);
+
+		if(e->pending_count == e->pending_capacity) {
+			e->pending_capacity = e->pending_capacity ? e->pending_capacity * 2 : 64;
+			e->pending = realloc(e->pending, e->pending_capacity * sizeof(upload_copy_t));
+		}
+		upload_copy_t* copy = &e->pending[e->pending_count++];
+		copy->dst = dst;
+		copy->region.srcOffset = src_offset;
+		copy->region.dstOffset = dst_offset;
+		copy->region.size = chunk;
+
+		e->stats.bytes += chunk;
+		e->stats.copies++;
+
+		data = (const char*)data + chunk;
+		dst_offset += chunk;
+		size -= chunk;
+	}
+	return VK_SUCCESS;
+} // upload_buffer
+
+// Creates a DEVICE_LOCAL buffer and queues `data` to be uploaded into it.
+// The buffer can be used on the graphics queue once the upload has been flushed (submission order covers the rest).
+static inline VkResult
+upload_create_buffer(upload_engine_t* e, const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer* buffer, gpu_allocation_t* memory) {
+	VkBufferCreateInfo buf_info = {0};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.size = size;
+	buf_info.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult res = gpu_alloc_create_buffer(e->allocator, &buf_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, buffer, memory);
+	if(res != VK_SUCCESS) return res;
+
+	return upload_buffer(e, *buffer, 0, data, size);
+} // upload_create_buffer
+
+// Flushes and waits until every upload has finished.
+static inline VkResult
+upload_wait_idle(upload_engine_t* e) {
+	VkResult res = upload_flush(e);
+	while(res == VK_SUCCESS && e->batches_in_flight) {
+		// with a timeline the newest batch covers all of them
+		const int last = e->use_timeline ? (e->batch_first + e->batches_in_flight - 1) % UPLOAD_MAX_BATCHES : e->batch_first;
+		res = upload__wait_batch(e, &e->batches[last]);
+		upload_reclaim(e);
+	}
+	return res;
+} // upload_wait_idle
+
+static inline void
+upload_deinit(upload_engine_t* e) {
+	for(int i = 0; i < UPLOAD_MAX_BATCHES; i++) {
+		if(e->batches[i].fence) vkDestroyFence(e->device, e->batches[i].fence, NULL);
+		if(e->batches[i].sema) vkDestroySemaphore(e->device, e->batches[i].sema, NULL);
+	}
+	vkDestroyCommandPool(e->device, e->pool, NULL);
+	if(e->graphics_pool) vkDestroyCommandPool(e->device, e->graphics_pool, NULL);
+	gpu_destroy_buffer(e->allocator, e->staging, &e->staging_mem);
+	timeline_deinit(&e->timeline);
+	free(e->pending);
+	memset(e, 0, sizeof(*e));
+} // upload_deinit
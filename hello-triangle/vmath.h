@@ -0,0 +1,669 @@
+#pragma once
+
+// Vector, matrix and quaternion math.
+//
+// Matrices are column major (m[column * 4 + row]), like GLSL, and map to Vulkan clip space:
+// y points down and depth goes from 0 to 1. Projections use reversed Z, the near plane is at depth 1 and the far plane
+// (or infinity) at 0, which spreads float depth precision evenly over the distance. Depth tests use GREATER_OR_EQUAL and clear to 0.
+//
+// The 4-wide kernels (matrix products, inverse, quaternions) are written once against a small set of vector
+// operations, which map to SSE2 on x86 and NEON on ARM64. With AVX2 the batched matrix products do two columns at a time.
+// Everything also exists as plain C with a `_scalar` suffix, which is used when there is no SIMD (or VMATH_SCALAR is defined),
+// and by the benchmarks to compare against.
+// 3-component vectors are always scalar, they don't fill a register.
+
+#include <math.h>
+#include <string.h>
+
+#if !defined(VMATH_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define VMATH_SSE2 1
+	#include <emmintrin.h>
+	#if defined(__FMA__) // also without AVX2, e.g. -march=bdver2
+		#define VMATH_FMA 1
+	#endif
+	#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+		#define VMATH_AVX2 1
+	#endif
+	#if defined(VMATH_FMA) || defined(VMATH_AVX2)
+		#include <immintrin.h>
+	#endif
+#elif !defined(VMATH_SCALAR) && defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+	#define VMATH_NEON 1
+	#include <arm_neon.h>
+#endif
+
+#if defined(VMATH_SSE2) || defined(VMATH_NEON)
+	#define VMATH_SIMD 1
+#endif
+
+#ifdef _MSC_VER
+	#define VMATH_ALIGN(n) __declspec(align(n))
+#else
+	#define VMATH_ALIGN(n) __attribute__((aligned(n)))
+#endif
+
+#define VMATH_PI 3.14159265358979323846f
+
+
+
+typedef struct vec3_t {
+	float	x, y, z;
+} vec3_t;
+
+typedef struct VMATH_ALIGN(16) vec4_t {
+	float	x, y, z, w;
+} vec4_t;
+
+// Rotation, x y z is the vector part.
+typedef struct VMATH_ALIGN(16) quat_t {
+	float	x, y, z, w;
+} quat_t;
+
+typedef struct VMATH_ALIGN(16) mat4_t {
+	float	m[16]; // column major
+} mat4_t;
+
+
+
+// The vector operations the SIMD kernels are written with.
+#if defined(VMATH_SSE2)
+	typedef __m128 vmath_f4;
+	#define vmath_load(p)			_mm_loadu_ps(p)
+	#define vmath_store(p, v)		_mm_storeu_ps(p, v)
+	#define vmath_set1(x)			_mm_set1_ps(x)
+	#define vmath_set(x, y, z, w)		_mm_setr_ps(x, y, z, w)
+	#define vmath_add(a, b)			_mm_add_ps(a, b)
+	#define vmath_sub(a, b)			_mm_sub_ps(a, b)
+	#define vmath_mul(a, b)			_mm_mul_ps(a, b)
+	#define vmath_div(a, b)			_mm_div_ps(a, b)
+	#define vmath_min(a, b)			_mm_min_ps(a, b)
+	#if defined(VMATH_FMA)
+		#define vmath_madd(a, b, c)	_mm_fmadd_ps(a, b, c) // a * b + c
+	#else
+		#define vmath_madd(a, b, c)	_mm_add_ps(_mm_mul_ps(a, b), c)
+	#endif
+	// (a[x], a[y], b[z], b[w]), indices must be constants
+	#define vmath_shuffle(a, b, x, y, z, w)	_mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+	#define vmath_splat(v, i)		_mm_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i))
+#elif defined(VMATH_NEON)
+	typedef float32x4_t vmath_f4;
+	#define vmath_load(p)			vld1q_f32(p)
+	#define vmath_store(p, v)		vst1q_f32(p, v)
+	#define vmath_set1(x)			vdupq_n_f32(x)
+	#define vmath_add(a, b)			vaddq_f32(a, b)
+	#define vmath_sub(a, b)			vsubq_f32(a, b)
+	#define vmath_mul(a, b)			vmulq_f32(a, b)
+	#define vmath_div(a, b)			vdivq_f32(a, b)
+	#define vmath_min(a, b)			vminq_f32(a, b)
+	#define vmath_madd(a, b, c)		vfmaq_f32(c, a, b)
+	#define vmath_splat(v, i)		vdupq_laneq_f32(v, i)
+	#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 12)
+		#define vmath_shuffle(a, b, x, y, z, w)	__builtin_shufflevector(a, b, x, y, 4 + (z), 4 + (w))
+	#else
+		#define vmath_shuffle(a, b, x, y, z, w)	vmath__shuffle(a, b, x, y, z, w)
+		static inline vmath_f4
+		vmath__shuffle(vmath_f4 a, vmath_f4 b, int x, int y, int z, int w) {
+			float fa[4], fb[4];
+			vst1q_f32(fa, a);
+			vst1q_f32(fb, b);
+			const float r[4] = {fa[x], fa[y], fb[z], fb[w]};
+			return vld1q_f32(r);
+		} // vmath__shuffle
+	#endif
+
+	static inline vmath_f4
+	vmath_set(float x, float y, float z, float w) {
+		const float v[4] = {x, y, z, w};
+		return vld1q_f32(v);
+	} // vmath_set
+#endif
+
+#if defined(VMATH_SIMD)
+	// Transposes the 4x4 matrix with rows (or columns) a b c d in place. Turns 4 values of 4 things into 4 vectors, and back.
+	#define vmath_transpose(a, b, c, d) do { \
+		const vmath_f4 vmath__t0 = vmath_shuffle(a, b, 0, 1, 0, 1); \
+		const vmath_f4 vmath__t1 = vmath_shuffle(a, b, 2, 3, 2, 3); \
+		const vmath_f4 vmath__t2 = vmath_shuffle(c, d, 0, 1, 0, 1); \
+		const vmath_f4 vmath__t3 = vmath_shuffle(c, d, 2, 3, 2, 3); \
+		(a) = vmath_shuffle(vmath__t0, vmath__t2, 0, 2, 0, 2); \
+		(b) = vmath_shuffle(vmath__t0, vmath__t2, 1, 3, 1, 3); \
+		(c) = vmath_shuffle(vmath__t1, vmath__t3, 0, 2, 0, 2); \
+		(d) = vmath_shuffle(vmath__t1, vmath__t3, 1, 3, 1, 3); \
+	} while(0)
+#endif
+
+static inline const char*
+vmath_backend() {
+#if defined(VMATH_AVX2)
+	return "AVX2";
+#elif defined(VMATH_SSE2)
+	return "SSE2";
+#elif defined(VMATH_NEON)
+	return "NEON";
+#else
+	return "scalar";
+#endif
+} // vmath_backend
+
+
+
+// 3-component vectors
+
+static inline vec3_t
+vec3_make(float x, float y, float z) {
+	vec3_t r = {x, y, z};
+	return r;
+} // vec3_make
+
+static inline vec3_t
+vec3_add(vec3_t a, vec3_t b) {
+	return vec3_make(a.x + b.x, a.y + b.y, a.z + b.z);
+} // vec3_add
+
+static inline vec3_t
+vec3_sub(vec3_t a, vec3_t b) {
+	return vec3_make(a.x - b.x, a.y - b.y, a.z - b.z);
+} // vec3_sub
+
+static inline vec3_t
+vec3_scale(vec3_t a, float s) {
+	return vec3_make(a.x * s, a.y * s, a.z * s);
+} // vec3_scale
+
+static inline float
+vec3_dot(vec3_t a, vec3_t b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+} // vec3_dot
+
+static inline vec3_t
+vec3_cross(vec3_t a, vec3_t b) {
+	return vec3_make(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+} // vec3_cross
+
+static inline float
+vec3_length(vec3_t a) {
+	return sqrtf(vec3_dot(a, a));
+} // vec3_length
+
+// Zero stays zero.
+static inline vec3_t
+vec3_normalize(vec3_t a) {
+	const float len = vec3_length(a);
+	return len > 0.0f ? vec3_scale(a, 1.0f / len) : a;
+} // vec3_normalize
+
+
+
+// Scalar kernels. Always there, the plain versions below use them when there is no SIMD.
+
+static inline mat4_t
+mat4_mul_scalar(const mat4_t* a, const mat4_t* b) {
+	mat4_t r;
+	for(int c = 0; c < 4; c++) {
+		for(int row = 0; row < 4; row++) {
+			r.m[c * 4 + row] = a->m[0 * 4 + row] * b->m[c * 4 + 0] + a->m[1 * 4 + row] * b->m[c * 4 + 1]
+				+ a->m[2 * 4 + row] * b->m[c * 4 + 2] + a->m[3 * 4 + row] * b->m[c * 4 + 3];
+		}
+	}
+	return r;
+} // mat4_mul_scalar
+
+static inline vec4_t
+mat4_mul_vec4_scalar(const mat4_t* a, vec4_t v) {
+	vec4_t r;
+	r.x = a->m[0] * v.x + a->m[4] * v.y + a->m[8]  * v.z + a->m[12] * v.w;
+	r.y = a->m[1] * v.x + a->m[5] * v.y + a->m[9]  * v.z + a->m[13] * v.w;
+	r.z = a->m[2] * v.x + a->m[6] * v.y + a->m[10] * v.z + a->m[14] * v.w;
+	r.w = a->m[3] * v.x + a->m[7] * v.y + a->m[11] * v.z + a->m[15] * v.w;
+	return r;
+} // mat4_mul_vec4_scalar
+
+// General inverse by cofactors. A singular matrix gives non-finite values.
+static inline mat4_t
+mat4_inverse_scalar(const mat4_t* a) {
+	const float* m = a->m;
+	mat4_t r;
+	float* o = r.m;
+
+	o[0]  =  m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+	o[4]  = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+	o[8]  =  m[4] * m[9]  * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+	o[12] = -m[4] * m[9]  * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+	o[1]  = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+	o[5]  =  m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+	o[9]  = -m[0] * m[9]  * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+	o[13] =  m[0] * m[9]  * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+	o[2]  =  m[1] * m[6]  * m[15] - m[1] * m[7]  * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7]  - m[13] * m[3] * m[6];
+	o[6]  = -m[0] * m[6]  * m[15] + m[0] * m[7]  * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7]  + m[12] * m[3] * m[6];
+	o[10] =  m[0] * m[5]  * m[15] - m[0] * m[7]  * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7]  - m[12] * m[3] * m[5];
+	o[14] = -m[0] * m[5]  * m[14] + m[0] * m[6]  * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6]  + m[12] * m[2] * m[5];
+	o[3]  = -m[1] * m[6]  * m[11] + m[1] * m[7]  * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9]  * m[2] * m[7]  + m[9]  * m[3] * m[6];
+	o[7]  =  m[0] * m[6]  * m[11] - m[0] * m[7]  * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8]  * m[2] * m[7]  - m[8]  * m[3] * m[6];
+	o[11] = -m[0] * m[5]  * m[11] + m[0] * m[7]  * m[9]  + m[4] * m[1] * m[11] - m[4] * m[3] * m[9]  - m[8]  * m[1] * m[7]  + m[8]  * m[3] * m[5];
+	o[15] =  m[0] * m[5]  * m[10] - m[0] * m[6]  * m[9]  - m[4] * m[1] * m[10] + m[4] * m[2] * m[9]  + m[8]  * m[1] * m[6]  - m[8]  * m[2] * m[5];
+
+	const float inv_det = 1.0f / (m[0] * o[0] + m[1] * o[4] + m[2] * o[8] + m[3] * o[12]);
+	for(int i = 0; i < 16; i++) {
+		o[i] *= inv_det;
+	}
+	return r;
+} // mat4_inverse_scalar
+
+static inline quat_t
+quat_mul_scalar(quat_t a, quat_t b) {
+	quat_t r;
+	r.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+	r.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+	r.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+	r.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+	return r;
+} // quat_mul_scalar
+
+// out[i] = a[i] * b[i]. out may be a or b.
+static inline void
+mat4_mul_batch_scalar(mat4_t* out, const mat4_t* a, const mat4_t* b, int count) {
+	for(int i = 0; i < count; i++) {
+		out[i] = mat4_mul_scalar(&a[i], &b[i]);
+	}
+} // mat4_mul_batch_scalar
+
+// world[i] = world[parent[i]] * local[i], or local[i] for roots (parent < 0). Parents must come before their children.
+static inline void
+mat4_mul_hierarchy_scalar(mat4_t* world, const mat4_t* local, const int* parent, int count) {
+	for(int i = 0; i < count; i++) {
+		world[i] = parent[i] < 0 ? local[i] : mat4_mul_scalar(&world[parent[i]], &local[i]);
+	}
+} // mat4_mul_hierarchy_scalar
+
+// mat4_mul_hierarchy_scalar() for the listed nodes only, the others keep their world matrix. `nodes` must be in increasing order.
+static inline void
+mat4_mul_hierarchy_indexed_scalar(mat4_t* world, const mat4_t* local, const int* parent, const int* nodes, int count) {
+	for(int n = 0; n < count; n++) {
+		const int i = nodes[n];
+		world[i] = parent[i] < 0 ? local[i] : mat4_mul_scalar(&world[parent[i]], &local[i]);
+	}
+} // mat4_mul_hierarchy_indexed_scalar
+
+
+
+// SIMD kernels
+
+#if defined(VMATH_SIMD)
+// One column of a * b: a's columns weighted by the column of b.
+static inline vmath_f4
+vmath__column(vmath_f4 a0, vmath_f4 a1, vmath_f4 a2, vmath_f4 a3, vmath_f4 b) {
+	vmath_f4 r = vmath_mul(a0, vmath_splat(b, 0));
+	r = vmath_madd(a1, vmath_splat(b, 1), r);
+	r = vmath_madd(a2, vmath_splat(b, 2), r);
+	r = vmath_madd(a3, vmath_splat(b, 3), r);
+	return r;
+} // vmath__column
+
+static inline void
+vmath__mul(float* out, const float* a, const float* b) {
+	const vmath_f4 a0 = vmath_load(a + 0);
+	const vmath_f4 a1 = vmath_load(a + 4);
+	const vmath_f4 a2 = vmath_load(a + 8);
+	const vmath_f4 a3 = vmath_load(a + 12);
+	const vmath_f4 r0 = vmath__column(a0, a1, a2, a3, vmath_load(b + 0));
+	const vmath_f4 r1 = vmath__column(a0, a1, a2, a3, vmath_load(b + 4));
+	const vmath_f4 r2 = vmath__column(a0, a1, a2, a3, vmath_load(b + 8));
+	const vmath_f4 r3 = vmath__column(a0, a1, a2, a3, vmath_load(b + 12));
+	vmath_store(out + 0, r0);
+	vmath_store(out + 4, r1);
+	vmath_store(out + 8, r2);
+	vmath_store(out + 12, r3);
+} // vmath__mul
+
+// 2x2 blocks for the inverse, stored (m00, m01, m10, m11).
+static inline vmath_f4
+vmath__mat2_mul(vmath_f4 a, vmath_f4 b) { // a * b
+	return vmath_add(vmath_mul(a, vmath_shuffle(b, b, 0, 3, 0, 3)),
+		vmath_mul(vmath_shuffle(a, a, 1, 0, 3, 2), vmath_shuffle(b, b, 2, 1, 2, 1)));
+} // vmath__mat2_mul
+
+static inline vmath_f4
+vmath__mat2_adj_mul(vmath_f4 a, vmath_f4 b) { // adj(a) * b
+	return vmath_sub(vmath_mul(vmath_shuffle(a, a, 3, 3, 0, 0), b),
+		vmath_mul(vmath_shuffle(a, a, 1, 1, 2, 2), vmath_shuffle(b, b, 2, 3, 0, 1)));
+} // vmath__mat2_adj_mul
+
+static inline vmath_f4
+vmath__mat2_mul_adj(vmath_f4 a, vmath_f4 b) { // a * adj(b)
+	return vmath_sub(vmath_mul(a, vmath_shuffle(b, b, 3, 0, 3, 0)),
+		vmath_mul(vmath_shuffle(a, a, 1, 0, 3, 2), vmath_shuffle(b, b, 2, 1, 2, 1)));
+} // vmath__mat2_mul_adj
+
+// Block-wise inverse: the matrix is split into four 2x2 blocks, and the inverse is built from their adjugates and determinants.
+// Works on the storage as it is, since inverse(transpose(M)) = transpose(inverse(M)).
+static inline void
+vmath__inverse(float* out, const float* in) {
+	const vmath_f4 c0 = vmath_load(in + 0);
+	const vmath_f4 c1 = vmath_load(in + 4);
+	const vmath_f4 c2 = vmath_load(in + 8);
+	const vmath_f4 c3 = vmath_load(in + 12);
+
+	const vmath_f4 a = vmath_shuffle(c0, c1, 0, 1, 0, 1);
+	const vmath_f4 b = vmath_shuffle(c0, c1, 2, 3, 2, 3);
+	const vmath_f4 c = vmath_shuffle(c2, c3, 0, 1, 0, 1);
+	const vmath_f4 d = vmath_shuffle(c2, c3, 2, 3, 2, 3);
+
+	// (|a|, |b|, |c|, |d|)
+	const vmath_f4 det_sub = vmath_sub(
+		vmath_mul(vmath_shuffle(c0, c2, 0, 2, 0, 2), vmath_shuffle(c1, c3, 1, 3, 1, 3)),
+		vmath_mul(vmath_shuffle(c0, c2, 1, 3, 1, 3), vmath_shuffle(c1, c3, 0, 2, 0, 2)));
+	const vmath_f4 det_a = vmath_splat(det_sub, 0);
+	const vmath_f4 det_b = vmath_splat(det_sub, 1);
+	const vmath_f4 det_c = vmath_splat(det_sub, 2);
+	const vmath_f4 det_d = vmath_splat(det_sub, 3);
+
+	const vmath_f4 d_c = vmath__mat2_adj_mul(d, c);
+	const vmath_f4 a_b = vmath__mat2_adj_mul(a, b);
+	vmath_f4 x = vmath_sub(vmath_mul(det_d, a), vmath__mat2_mul(b, d_c));
+	vmath_f4 w = vmath_sub(vmath_mul(det_a, d), vmath__mat2_mul(c, a_b));
+	vmath_f4 y = vmath_sub(vmath_mul(det_b, c), vmath__mat2_mul_adj(d, a_b));
+	vmath_f4 z = vmath_sub(vmath_mul(det_c, b), vmath__mat2_mul_adj(a, d_c));
+
+	// |M| = |a||d| + |b||c| - tr(adj(a) b adj(d) c)
+	vmath_f4 tr = vmath_mul(a_b, vmath_shuffle(d_c, d_c, 0, 2, 1, 3));
+	tr = vmath_add(tr, vmath_shuffle(tr, tr, 2, 3, 0, 1));
+	tr = vmath_add(tr, vmath_shuffle(tr, tr, 1, 0, 3, 2));
+	const vmath_f4 det = vmath_sub(vmath_add(vmath_mul(det_a, det_d), vmath_mul(det_b, det_c)), tr);
+
+	const vmath_f4 inv_det = vmath_div(vmath_set(1.0f, -1.0f, -1.0f, 1.0f), det);
+	x = vmath_mul(x, inv_det);
+	y = vmath_mul(y, inv_det);
+	z = vmath_mul(z, inv_det);
+	w = vmath_mul(w, inv_det);
+
+	// the adjugates of the blocks, put back in place
+	vmath_store(out + 0,  vmath_shuffle(x, y, 3, 1, 3, 1));
+	vmath_store(out + 4,  vmath_shuffle(x, y, 2, 0, 2, 0));
+	vmath_store(out + 8,  vmath_shuffle(z, w, 3, 1, 3, 1));
+	vmath_store(out + 12, vmath_shuffle(z, w, 2, 0, 2, 0));
+} // vmath__inverse
+#endif
+
+#if defined(VMATH_AVX2)
+// Two columns of a * b at once: a's columns are in both halves, b's elements are broadcast within each half.
+static inline void
+vmath__mul_avx2(float* out, const float* a, const float* b) {
+	const __m256 a0 = _mm256_broadcast_ps((const __m128*)(a + 0));
+	const __m256 a1 = _mm256_broadcast_ps((const __m128*)(a + 4));
+	const __m256 a2 = _mm256_broadcast_ps((const __m128*)(a + 8));
+	const __m256 a3 = _mm256_broadcast_ps((const __m128*)(a + 12));
+	for(int c = 0; c < 16; c += 8) {
+		const __m256 bc = _mm256_loadu_ps(b + c);
+		__m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bc, 0x00));
+		r = _mm256_fmadd_ps(a1, _mm256_permute_ps(bc, 0x55), r);
+		r = _mm256_fmadd_ps(a2, _mm256_permute_ps(bc, 0xaa), r);
+		r = _mm256_fmadd_ps(a3, _mm256_permute_ps(bc, 0xff), r);
+		_mm256_storeu_ps(out + c, r);
+	}
+} // vmath__mul_avx2
+#endif
+
+
+
+// Matrices
+
+static inline mat4_t
+mat4_identity() {
+	mat4_t r = {{
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f,
+	}};
+	return r;
+} // mat4_identity
+
+static inline mat4_t
+mat4_mul(const mat4_t* a, const mat4_t* b) {
+#if defined(VMATH_SIMD)
+	mat4_t r;
+	vmath__mul(r.m, a->m, b->m);
+	return r;
+#else
+	return mat4_mul_scalar(a, b);
+#endif
+} // mat4_mul
+
+static inline vec4_t
+mat4_mul_vec4(const mat4_t* a, vec4_t v) {
+#if defined(VMATH_SIMD)
+	vec4_t r;
+	vmath_store(&r.x, vmath__column(vmath_load(a->m), vmath_load(a->m + 4), vmath_load(a->m + 8), vmath_load(a->m + 12), vmath_load(&v.x)));
+	return r;
+#else
+	return mat4_mul_vec4_scalar(a, v);
+#endif
+} // mat4_mul_vec4
+
+static inline mat4_t
+mat4_inverse(const mat4_t* a) {
+#if defined(VMATH_SIMD)
+	mat4_t r;
+	vmath__inverse(r.m, a->m);
+	return r;
+#else
+	return mat4_inverse_scalar(a);
+#endif
+} // mat4_inverse
+
+static inline mat4_t
+mat4_transpose(const mat4_t* a) {
+	mat4_t r;
+	for(int c = 0; c < 4; c++) {
+		for(int row = 0; row < 4; row++) {
+			r.m[row * 4 + c] = a->m[c * 4 + row];
+		}
+	}
+	return r;
+} // mat4_transpose
+
+static inline void
+mat4_mul_batch(mat4_t* out, const mat4_t* a, const mat4_t* b, int count) {
+#if defined(VMATH_AVX2)
+	for(int i = 0; i < count; i++) {
+		vmath__mul_avx2(out[i].m, a[i].m, b[i].m);
+	}
+#elif defined(VMATH_SIMD)
+	for(int i = 0; i < count; i++) {
+		vmath__mul(out[i].m, a[i].m, b[i].m);
+	}
+#else
+	mat4_mul_batch_scalar(out, a, b, count);
+#endif
+} // mat4_mul_batch
+
+#if defined(VMATH_SIMD)
+static inline void
+vmath__hierarchy_node(mat4_t* world, const mat4_t* local, const int* parent, int i) {
+	if(parent[i] < 0) {
+		world[i] = local[i];
+		return;
+	}
+	#if defined(VMATH_AVX2)
+	vmath__mul_avx2(world[i].m, world[parent[i]].m, local[i].m);
+	#else
+	vmath__mul(world[i].m, world[parent[i]].m, local[i].m);
+	#endif
+} // vmath__hierarchy_node
+#endif
+
+// World matrices of a transform hierarchy, see mat4_mul_hierarchy_scalar().
+static inline void
+mat4_mul_hierarchy(mat4_t* world, const mat4_t* local, const int* parent, int count) {
+#if defined(VMATH_SIMD)
+	for(int i = 0; i < count; i++) {
+		vmath__hierarchy_node(world, local, parent, i);
+	}
+#else
+	mat4_mul_hierarchy_scalar(world, local, parent, count);
+#endif
+} // mat4_mul_hierarchy
+
+// See mat4_mul_hierarchy_indexed_scalar().
+static inline void
+mat4_mul_hierarchy_indexed(mat4_t* world, const mat4_t* local, const int* parent, const int* nodes, int count) {
+#if defined(VMATH_SIMD)
+	for(int n = 0; n < count; n++) {
+		vmath__hierarchy_node(world, local, parent, nodes[n]);
+	}
+#else
+	mat4_mul_hierarchy_indexed_scalar(world, local, parent, nodes, count);
+#endif
+} // mat4_mul_hierarchy_indexed
+
+static inline mat4_t
+mat4_translation(vec3_t t) {
+	mat4_t r = mat4_identity();
+	r.m[12] = t.x;
+	r.m[13] = t.y;
+	r.m[14] = t.z;
+	return r;
+} // mat4_translation
+
+static inline mat4_t
+mat4_scaling(vec3_t s) {
+	mat4_t r = mat4_identity();
+	r.m[0] = s.x;
+	r.m[5] = s.y;
+	r.m[10] = s.z;
+	return r;
+} // mat4_scaling
+
+// Rotation matrix of a unit quaternion.
+static inline mat4_t
+mat4_from_quat(quat_t q) {
+	const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+	mat4_t r = {{
+		1.0f - 2.0f * (yy + zz),	2.0f * (xy + wz),		2.0f * (xz - wy),		0.0f,
+		2.0f * (xy - wz),		1.0f - 2.0f * (xx + zz),	2.0f * (yz + wx),		0.0f,
+		2.0f * (xz + wy),		2.0f * (yz - wx),		1.0f - 2.0f * (xx + yy),	0.0f,
+		0.0f,				0.0f,				0.0f,				1.0f,
+	}};
+	return r;
+} // mat4_from_quat
+
+// translation * rotation * scale, without multiplying them out.
+static inline mat4_t
+mat4_trs(vec3_t t, quat_t q, vec3_t s) {
+	mat4_t r = mat4_from_quat(q);
+	for(int i = 0; i < 3; i++) {
+		r.m[0 + i] *= s.x;
+		r.m[4 + i] *= s.y;
+		r.m[8 + i] *= s.z;
+	}
+	r.m[12] = t.x;
+	r.m[13] = t.y;
+	r.m[14] = t.z;
+	return r;
+} // mat4_trs
+
+// Reversed Z perspective projection for a right handed view space looking down -Z, into Vulkan clip space (y down, depth 0 to 1).
+// `fov_y` in radians, `aspect` is width / height. far = INFINITY puts the far plane at infinity.
+static inline mat4_t
+mat4_perspective(float fov_y, float aspect, float near, float far) {
+	const float f = 1.0f / tanf(fov_y * 0.5f);
+	mat4_t r = {{0}};
+	r.m[0] = f / aspect;
+	r.m[5] = -f;
+	r.m[11] = -1.0f;
+	if(isinf(far)) {
+		// depth = near / -z
+		r.m[10] = 0.0f;
+		r.m[14] = near;
+	} else {
+		// depth = (near * far / -z - near) / (far - near): 1 at the near plane, 0 at the far one
+		r.m[10] = near / (far - near);
+		r.m[14] = near * far / (far - near);
+	}
+	return r;
+} // mat4_perspective
+
+// View matrix of a camera at `eye` looking at `target`, right handed (the camera looks down its -Z).
+static inline mat4_t
+mat4_look_at(vec3_t eye, vec3_t target, vec3_t up) {
+	const vec3_t f = vec3_normalize(vec3_sub(target, eye));
+	const vec3_t s = vec3_normalize(vec3_cross(f, up));
+	const vec3_t u = vec3_cross(s, f);
+	mat4_t r = {{
+		s.x,			u.x,			-f.x,			0.0f,
+		s.y,			u.y,			-f.y,			0.0f,
+		s.z,			u.z,			-f.z,			0.0f,
+		-vec3_dot(s, eye),	-vec3_dot(u, eye),	vec3_dot(f, eye),	1.0f,
+	}};
+	return r;
+} // mat4_look_at
+
+
+
+// Quaternions
+
+static inline quat_t
+quat_identity() {
+	quat_t r = {0.0f, 0.0f, 0.0f, 1.0f};
+	return r;
+} // quat_identity
+
+// `axis` must be unit length.
+static inline quat_t
+quat_from_axis_angle(vec3_t axis, float angle) {
+	const float s = sinf(angle * 0.5f);
+	quat_t r = {axis.x * s, axis.y * s, axis.z * s, cosf(angle * 0.5f)};
+	return r;
+} // quat_from_axis_angle
+
+// Rotation by b, then by a.
+static inline quat_t
+quat_mul(quat_t a, quat_t b) {
+#if defined(VMATH_SIMD)
+	// a.w * b + a.x * (b.w, -b.z, b.y, -b.x) + a.y * (b.z, b.w, -b.x, -b.y) + a.z * (-b.y, b.x, b.w, -b.z)
+	const vmath_f4 va = vmath_load(&a.x);
+	const vmath_f4 vb = vmath_load(&b.x);
+	const vmath_f4 nb = vmath_sub(vmath_set1(0.0f), vb);
+	const vmath_f4 bx = vmath_shuffle(vmath_shuffle(vb, nb, 3, 3, 2, 2), vmath_shuffle(vb, nb, 1, 1, 0, 0), 0, 2, 0, 2);
+	const vmath_f4 by = vmath_shuffle(vmath_shuffle(vb, vb, 2, 3, 2, 3), nb, 0, 1, 0, 1);
+	const vmath_f4 bz = vmath_shuffle(vmath_shuffle(nb, vb, 1, 1, 0, 0), vmath_shuffle(vb, nb, 3, 3, 2, 2), 0, 2, 0, 2);
+	vmath_f4 r = vmath_mul(vmath_splat(va, 3), vb);
+	r = vmath_madd(vmath_splat(va, 0), bx, r);
+	r = vmath_madd(vmath_splat(va, 1), by, r);
+	r = vmath_madd(vmath_splat(va, 2), bz, r);
+	quat_t q;
+	vmath_store(&q.x, r);
+	return q;
+#else
+	return quat_mul_scalar(a, b);
+#endif
+} // quat_mul
+
+static inline quat_t
+quat_normalize(quat_t q) {
+	const float len = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+	const float inv = len > 0.0f ? 1.0f / len : 0.0f;
+	quat_t r = {q.x * inv, q.y * inv, q.z * inv, q.w * inv};
+	return r;
+} // quat_normalize
+
+// Rotates v by the unit quaternion q.
+static inline vec3_t
+quat_rotate(quat_t q, vec3_t v) {
+	// v + 2w (q x v) + 2 q x (q x v)
+	const vec3_t qv = vec3_make(q.x, q.y, q.z);
+	const vec3_t t = vec3_scale(vec3_cross(qv, v), 2.0f);
+	return vec3_add(vec3_add(v, vec3_scale(t, q.w)), vec3_cross(qv, t));
+} // quat_rotate
+
+// Normalized linear interpolation along the shorter arc. Close to slerp for small angles, and much cheaper.
+static inline quat_t
+quat_nlerp(quat_t a, quat_t b, float t) {
+	const float dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	const float tb = dot < 0.0f ? -t : t;
+	const float ta = 1.0f - t;
+	quat_t r = {a.x * ta + b.x * tb, a.y * ta + b.y * tb, a.z * ta + b.z * tb, a.w * ta + b.w * tb};
+	return quat_normalize(r);
+} // quat_nlerp
@@ -0,0 +1,204 @@
+#pragma once
+
+// Micro-benchmarks of the vmath.h kernels (`main --bench-math`).
+//
+// Every kernel runs over the same random inputs in its scalar and in its SIMD version. Each gets the best of a few runs,
+// so one-off hiccups (page faults, frequency changes) don't count. Printed per kernel: ns per operation for both, the speedup,
+// and the largest difference between their results.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "platform.h"
+#include "vmath.h"
+
+
+
+#define VMATH_BENCH_COUNT	4096	// operations per run, the inputs stay in the cache
+#define VMATH_BENCH_RUNS	200
+
+typedef struct vmath_bench_data_t {
+	mat4_t*	a;
+	mat4_t*	b;
+	mat4_t*	out_scalar;
+	mat4_t*	out_simd;
+	quat_t*	qa;
+	quat_t*	qb;
+	vec4_t*	v;
+	int*	parent;
+} vmath_bench_data_t;
+
+typedef void (*vmath_bench_fn_t)(const vmath_bench_data_t* d, mat4_t* out);
+
+static inline float
+vmath_bench__random() {
+	return (float)rand() / (float)RAND_MAX * 2.0f - 1.0f;
+} // vmath_bench__random
+
+static void
+vmath_bench__mul_scalar(const vmath_bench_data_t* d, mat4_t* out) {
+	for(int i = 0; i < VMATH_BENCH_COUNT; i++) {
+		out[i] = mat4_mul_scalar(&d->a[i], &d->b[i]);
+	}
+} // vmath_bench__mul_scalar
+
+static void
+vmath_bench__mul(const vmath_bench_data_t* d, mat4_t* out) {
+	for(int i = 0; i < VMATH_BENCH_COUNT; i++) {
+		out[i] = mat4_mul(&d->a[i], &d->b[i]);
+	}
+} // vmath_bench__mul
+
+static void
+vmath_bench__batch_scalar(const vmath_bench_data_t* d, mat4_t* out) {
+	mat4_mul_batch_scalar(out, d->a, d->b, VMATH_BENCH_COUNT);
+} // vmath_bench__batch_scalar
+
+static void
+vmath_bench__batch(const vmath_bench_data_t* d, mat4_t* out) {
+	mat4_mul_batch(out, d->a, d->b, VMATH_BENCH_COUNT);
+} // vmath_bench__batch
+
+static void
+vmath_bench__tree_scalar(const vmath_bench_data_t* d, mat4_t* out) {
+	mat4_mul_hierarchy_scalar(out, d->b, d->parent, VMATH_BENCH_COUNT);
+} // vmath_bench__tree_scalar
+
+static void
+vmath_bench__tree(const vmath_bench_data_t* d, mat4_t* out) {
+	mat4_mul_hierarchy(out, d->b, d->parent, VMATH_BENCH_COUNT);
+} // vmath_bench__tree
+
+static void
+vmath_bench__inverse_scalar(const vmath_bench_data_t* d, mat4_t* out) {
+	for(int i = 0; i < VMATH_BENCH_COUNT; i++) {
+		out[i] = mat4_inverse_scalar(&d->b[i]);
+	}
+} // vmath_bench__inverse_scalar
+
+static void
+vmath_bench__inverse(const vmath_bench_data_t* d, mat4_t* out) {
+	for(int i = 0; i < VMATH_BENCH_COUNT; i++) {
+		out[i] = mat4_inverse(&d->b[i]);
+	}
+} // vmath_bench__inverse
+
+// The results of the vector and quaternion kernels go in the first 4 floats of each output matrix.
+static void
+vmath_bench__vec4_scalar(const vmath_bench_data_t* d, mat4_t* out) {
+	for(int i = 0; i < VMATH_BENCH_COUNT; i++) {
+		const vec4_t r = mat4_mul_vec4_scalar(&d->a[i], d->v[i]);
+		memcpy(out[i].m, &r, sizeof(r));
+	}
+} // vmath_bench__vec4_scalar
+
+static void
+vmath_bench__vec4(const vmath_bench_data_t* d, mat4_t* out) {
+	for(int i = 0; i < VMATH_BENCH_COUNT; i++) {
+		const vec4_t r = mat4_mul_vec4(&d->a[i], d->v[i]);
+		memcpy(out[i].m, &r, sizeof(r));
+	}
+} // vmath_bench__vec4
+
+static void
+vmath_bench__quat_scalar(const vmath_bench_data_t* d, mat4_t* out) {
+	for(int i = 0; i < VMATH_BENCH_COUNT; i++) {
+		const quat_t r = quat_mul_scalar(d->qa[i], d->qb[i]);
+		memcpy(out[i].m, &r, sizeof(r));
+	}
+} // vmath_bench__quat_scalar
+
+static void
+vmath_bench__quat(const vmath_bench_data_t* d, mat4_t* out) {
+	for(int i = 0; i < VMATH_BENCH_COUNT; i++) {
+		const quat_t r = quat_mul(d->qa[i], d->qb[i]);
+		memcpy(out[i].m, &r, sizeof(r));
+	}
+} // vmath_bench__quat
+
+// Best time of VMATH_BENCH_RUNS runs, in ns per operation.
+static inline double
+vmath_bench__time(vmath_bench_fn_t fn, const vmath_bench_data_t* d, mat4_t* out) {
+	unsigned long long best_ns = ~0ull;
+	for(int run = 0; run < VMATH_BENCH_RUNS; run++) {
+		const unsigned long long start_ns = time_now_ns();
+		fn(d, out);
+		const unsigned long long ns = time_now_ns() - start_ns;
+		if(ns < best_ns) best_ns = ns;
+	}
+	return (double)best_ns / (double)VMATH_BENCH_COUNT;
+} // vmath_bench__time
+
+// Returns 0 on success, -1 when out of memory.
+static inline int
+vmath_bench_run() {
+	vmath_bench_data_t d = {0};
+	d.a          = malloc(VMATH_BENCH_COUNT * sizeof(mat4_t));
+	d.b          = malloc(VMATH_BENCH_COUNT * sizeof(mat4_t));
+	d.out_scalar = malloc(VMATH_BENCH_COUNT * sizeof(mat4_t));
+	d.out_simd   = malloc(VMATH_BENCH_COUNT * sizeof(mat4_t));
+	d.qa         = malloc(VMATH_BENCH_COUNT * sizeof(quat_t));
+	d.qb         = malloc(VMATH_BENCH_COUNT * sizeof(quat_t));
+	d.v          = malloc(VMATH_BENCH_COUNT * sizeof(vec4_t));
+	d.parent     = malloc(VMATH_BENCH_COUNT * sizeof(int));
+	int result = -1;
+	if(!d.a || !d.b || !d.out_scalar || !d.out_simd || !d.qa || !d.qb || !d.v || !d.parent) goto done;
+
+	// `a` is anything, `b` are rigid transforms with some scale, which keeps the inverse and long parent chains well conditioned.
+	srand(1);
+	for(int i = 0; i < VMATH_BENCH_COUNT; i++) {
+		for(int j = 0; j < 16; j++) {
+			d.a[i].m[j] = vmath_bench__random();
+		}
+		const quat_t q = quat_normalize((quat_t){vmath_bench__random(), vmath_bench__random(), vmath_bench__random(), vmath_bench__random()});
+		const float s = 1.0f + 0.01f * vmath_bench__random();
+		d.b[i] = mat4_trs(vec3_make(vmath_bench__random(), vmath_bench__random(), vmath_bench__random()), q, vec3_make(s, s, s));
+		d.qa[i] = q;
+		d.qb[i] = quat_normalize((quat_t){vmath_bench__random(), vmath_bench__random(), vmath_bench__random(), vmath_bench__random()});
+		d.v[i] = (vec4_t){vmath_bench__random(), vmath_bench__random(), vmath_bench__random(), 1.0f};
+		// a few roots, then every node hangs off one of the nodes before it
+		d.parent[i] = i < 16 ? -1 : i - 1 - rand() % 16;
+	}
+
+	const struct {
+		const char*		name;
+		vmath_bench_fn_t	scalar;
+		vmath_bench_fn_t	simd;
+		int			floats; // of each output to compare
+	} kernels[] = {
+		{"mat4_mul",		vmath_bench__mul_scalar,	vmath_bench__mul,	16},
+		{"mat4_mul_batch",	vmath_bench__batch_scalar,	vmath_bench__batch,	16},
+		{"mat4_mul_hierarchy",	vmath_bench__tree_scalar,	vmath_bench__tree,	16},
+		{"mat4_inverse",	vmath_bench__inverse_scalar,	vmath_bench__inverse,	16},
+		{"mat4_mul_vec4",	vmath_bench__vec4_scalar,	vmath_bench__vec4,	4},
+		{"quat_mul",		vmath_bench__quat_scalar,	vmath_bench__quat,	4},
+	};
+
+	printf("math kernels, %s, %d operations per run, best of %d runs\n", vmath_backend(), VMATH_BENCH_COUNT, VMATH_BENCH_RUNS);
+	printf("%-20s %12s %12s %8s %12s\n", "kernel", "scalar ns/op", "simd ns/op", "speedup", "max error");
+	for(int k = 0; k < (int)(sizeof(kernels) / sizeof(kernels[0])); k++) {
+		const double scalar_ns = vmath_bench__time(kernels[k].scalar, &d, d.out_scalar);
+		const double simd_ns = vmath_bench__time(kernels[k].simd, &d, d.out_simd);
+		float max_error = 0.0f;
+		for(int i = 0; i < VMATH_BENCH_COUNT; i++) {
+			for(int j = 0; j < kernels[k].floats; j++) {
+				const float error = fabsf(d.out_scalar[i].m[j] - d.out_simd[i].m[j]);
+				if(error > max_error) max_error = error;
+			}
+		}
+		printf("%-20s %12.2f %12.2f %7.2fx %12.3g\n", kernels[k].name, scalar_ns, simd_ns, simd_ns > 0.0 ? scalar_ns / simd_ns : 0.0, max_error);
+	}
+	result = 0;
+
+done:
+	free(d.a);
+	free(d.b);
+	free(d.out_scalar);
+	free(d.out_simd);
+	free(d.qa);
+	free(d.qb);
+	free(d.v);
+	free(d.parent);
+	return result;
+} // vmath_bench_run
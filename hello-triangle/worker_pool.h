@@ -0,0 +1,129 @@
+#pragma once
+
+// Fixed pool of worker threads for fork/join style work.
+//
+// worker_pool_run() calls the same function once on every worker, with the worker's index,
+// and returns when all of them are done. The calling thread is worker 0, so a pool of 1 has no extra threads.
+// Meant for splitting a known amount of per-frame work (e.g. command recording) evenly,
+// each worker owns whatever per-thread state is indexed by its worker index.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+
+
+
+#define WORKER_POOL_MAX_THREADS 16
+
+typedef void (*worker_fn_t)(void* user, int worker);
+
+typedef struct worker_pool_t worker_pool_t;
+
+typedef struct worker__arg_t {
+	worker_pool_t*	pool;
+	int		index;
+} worker__arg_t;
+
+struct worker_pool_t {
+	int			workers_count;	// including the calling thread
+	thread_t		threads[WORKER_POOL_MAX_THREADS];
+	worker__arg_t		args[WORKER_POOL_MAX_THREADS];
+
+	mutex_t			mutex;
+	cond_t			wake;		// new work, or quit
+	cond_t			done;		// last worker finished
+	unsigned long long	generation;	// bumped for every run
+	int			pending;	// workers still running the current job
+	int			quit;
+
+	worker_fn_t		fn;
+	void*			user;
+};
+
+
+
+static void
+worker__main(void* param) {
+	worker__arg_t* arg = param;
+	worker_pool_t* pool = arg->pool;
+	unsigned long long seen = 0;
+
+	for(;;) {
+		mutex_lock(&pool->mutex);
+		while(!pool->quit && pool->generation == seen) cond_wait(&pool->wake, &pool->mutex);
+		if(pool->quit) {
+			mutex_unlock(&pool->mutex);
+			return;
+		}
+		seen = pool->generation;
+		worker_fn_t fn = pool->fn;
+		void* user = pool->user;
+		mutex_unlock(&pool->mutex);
+
+		fn(user, arg->index);
+
+		mutex_lock(&pool->mutex);
+		if(--pool->pending == 0) cond_signal(&pool->done);
+		mutex_unlock(&pool->mutex);
+	}
+} // worker__main
+
+// returns 0 on success
+static inline int
+worker_pool_init(worker_pool_t* pool, int workers_count) {
+	memset(pool, 0, sizeof(*pool));
+	if(workers_count < 1) workers_count = 1;
+	if(workers_count > WORKER_POOL_MAX_THREADS) workers_count = WORKER_POOL_MAX_THREADS;
+
+	mutex_init(&pool->mutex);
+	cond_init(&pool->wake);
+	cond_init(&pool->done);
+
+	pool->workers_count = 1;
+	for(int i = 1; i < workers_count; i++) {
+		pool->args[i].pool = pool;
+		pool->args[i].index = i;
+		if(thread_create(&pool->threads[i], worker__main, &pool->args[i]) != 0) return -1;
+		pool->workers_count++;
+	}
+	return 0;
+} // worker_pool_init
+
+// Runs fn(user, worker) on every worker and waits for all of them.
+static inline void
+worker_pool_run(worker_pool_t* pool, worker_fn_t fn, void* user) {
+	if(pool->workers_count > 1) {
+		mutex_lock(&pool->mutex);
+		pool->fn = fn;
+		pool->user = user;
+		pool->pending = pool->workers_count - 1;
+		pool->generation++;
+		cond_broadcast(&pool->wake);
+		mutex_unlock(&pool->mutex);
+	}
+
+	fn(user, 0);
+
+	if(pool->workers_count > 1) {
+		mutex_lock(&pool->mutex);
+		while(pool->pending > 0) cond_wait(&pool->done, &pool->mutex);
+		mutex_unlock(&pool->mutex);
+	}
+} // worker_pool_run
+
+static inline void
+worker_pool_deinit(worker_pool_t* pool) {
+	mutex_lock(&pool->mutex);
+	pool->quit = 1;
+	cond_broadcast(&pool->wake);
+	mutex_unlock(&pool->mutex);
+
+	for(int i = 1; i < pool->workers_count; i++) {
+		thread_join(pool->threads[i]);
+	}
+
+	cond_destroy(&pool->done);
+	cond_destroy(&pool->wake);
+	mutex_destroy(&pool->mutex);
+} // worker_pool_deinit